@@ -1,5 +1,6 @@
 #pragma once
 #include "Utils.h"
+#include "../Shader/CpuCompute.h"
 
 namespace FrameDX
 {
@@ -59,6 +60,8 @@ namespace FrameDX
 		auto GetSRV() const  { return SRV; }
 		auto GetUAV() const  { return UAV; }
 		const vector<T>& GetRawData() const  { return Data; }
+		// View of the CPU copy of the data to bind it to a CpuDispatch. Writes to it are not uploaded to the GPU buffer
+		CpuBufferView<T> GetCpuView() { return Data; }
 
 		StatusCode Build(size_t Size, Device& Dev, vector<T> InData = {}, D3D11_USAGE Usage = D3D11_USAGE_IMMUTABLE, bool NeedsUAV = false)
 		{
@@ -87,7 +90,7 @@ namespace FrameDX
 			desc.Format = DXGI_FORMAT_UNKNOWN;
 			desc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
 			
-			status = LogCheckAndContinue(Dev.GetDevice()->CreateShaderResourceView(Buffer, &desc, &SRV), LogCategory::Error);
+			status = LogCheckAndContinue(Dev.GetDeviceBackend()->CreateShaderResourceView(Buffer, &desc, &SRV), LogCategory::Error);
 			if (status != StatusCode::Ok)
 				return status;
 
@@ -98,7 +101,7 @@ namespace FrameDX
 				uav_desc.Format = DXGI_FORMAT_UNKNOWN;
 				uav_desc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
 
-				status = LogCheckAndContinue(Dev.GetDevice()->CreateUnorderedAccessView(Buffer, &uav_desc, &UAV), LogCategory::Error);
+				status = LogCheckAndContinue(Dev.GetDeviceBackend()->CreateUnorderedAccessView(Buffer, &uav_desc, &UAV), LogCategory::Error);
 				if (status != StatusCode::Ok)
 					return status;
 			}
@@ -107,17 +110,60 @@ namespace FrameDX
 		}
 	};
 
-	template<typename T>
-	struct ConstantBuffer
+	// Base of ConstantBuffer, so the device can keep the buffers that were edited without knowing their type
+	// Edited buffers are uploaded together before the next draw or dispatch on the device, and only if their contents
+	// changed since the last upload, which is kept as a copy to compare against
+	// Not thread safe, they are tracked for the immediate context
+	class TrackedConstantBuffer
 	{
-		static_assert(sizeof(T) % 16 == 0, "T needs to be 16-bytes aligned");
-
+	public:
 		ID3D11Buffer * Buffer;
-		
-		ConstantBuffer() 
+
+		bool IsDirty() const { return Dirty; }
+	protected:
+		TrackedConstantBuffer(const void* Data, size_t Size) : Buffer(nullptr), Owner(nullptr), TrackedData(Data), TrackedSize(Size) {}
+		~TrackedConstantBuffer() { forget_(); }
+
+		// Registers the buffer on the device, once until it's uploaded. Needs to be built
+		void mark_dirty_()
 		{
-			Buffer = nullptr;
+			if(Dirty || !Owner)
+				return;
+			Dirty = true;
+			Owner->track_constant_buffer_(this);
+		}
+		void forget_()
+		{
+			if(Dirty)
+				Owner->forget_constant_buffer_(this);
+			Dirty = false;
 		}
+		StatusCode upload_(Device& Dev) { return Dev.upload_constant_buffer_(*this); }
+		bool uploaded_() const { return !UploadedData.empty(); }
+		// Takes the copy of the last upload of a buffer that is being moved here, as the GPU buffer comes with it
+		void take_uploaded_(TrackedConstantBuffer& Source)
+		{
+			UploadedData = move(Source.UploadedData);
+			Source.UploadedData.clear();
+		}
+
+		Device* Owner;
+	private:
+		friend class Device;
+
+		const void* TrackedData;
+		size_t TrackedSize;
+		bool Dirty = false;
+		// Contents of the GPU buffer, empty until the first upload
+		vector<uint8_t> UploadedData;
+	};
+
+	template<typename T>
+	struct ConstantBuffer : public TrackedConstantBuffer
+	{
+		static_assert(sizeof(T) % 16 == 0, "T needs to be 16-bytes aligned");
+
+		ConstantBuffer() : TrackedConstantBuffer(&Data, sizeof(T)) {}
 		~ConstantBuffer()
 		{
 			if(Buffer)
@@ -125,18 +171,45 @@ namespace FrameDX
 		}
 		ConstantBuffer(const ConstantBuffer&) = delete;
 		ConstantBuffer(ConstantBuffer&& rhs) :
-			Buffer(rhs.Buffer)
+			TrackedConstantBuffer(&Data, sizeof(T)),
+			Data(move(rhs.Data))
 		{
+			Buffer = rhs.Buffer;
+			Owner = rhs.Owner;
 			rhs.Buffer = nullptr;
+			take_uploaded_(rhs);
+
+			// The device tracks the address, so the edit moves to this one
+			if(rhs.IsDirty())
+			{
+				rhs.forget_();
+				mark_dirty_();
+			}
 		}
 			
 
 		ConstantBuffer& operator=(const ConstantBuffer&) = delete;
 		ConstantBuffer& operator=(ConstantBuffer&& rhs)
 		{
-			Buffer = rhs.Buffer;
+			if(this == &rhs)
+				return *this;
 
+			forget_();
+			if(Buffer)
+				Buffer->Release();
+
+			Data = move(rhs.Data);
+			Buffer = rhs.Buffer;
+			Owner = rhs.Owner;
 			rhs.Buffer = nullptr;
+			take_uploaded_(rhs);
+
+			if(rhs.IsDirty())
+			{
+				rhs.forget_();
+				mark_dirty_();
+			}
+			return *this;
 		}
 
 		StatusCode Build(Device& Dev)
@@ -150,16 +223,34 @@ namespace FrameDX
 			cb_desc.MiscFlags = 0;
 			cb_desc.StructureByteStride = 0;
 
-			return LogCheckAndContinue(Dev.GetDevice()->
+			Owner = &Dev;
+			return LogCheckAndContinue(Dev.GetDeviceBackend()->
 				CreateBuffer(&cb_desc, nullptr, &Buffer), FrameDX::LogCategory::CriticalError);
 		}
 
-		// Updates the buffer with Data
-		// Warning : Costly operation
+		// Changes done directly to Data are not tracked, those need Update
 		T Data;
+
+		// Returns the data to change it, and marks the buffer to be uploaded before the next draw or dispatch
+		T& Edit()
+		{
+			mark_dirty_();
+			return Data;
+		}
+		// Same as above, but the buffer is only marked if the value is different, or it was never uploaded
+		void Set(const T& Value)
+		{
+			if(uploaded_() && memcmp(&Data, &Value, sizeof(T)) == 0)
+				return;
+			Data = Value;
+			mark_dirty_();
+		}
+
+		// Updates the buffer with Data now, if it changed since the last upload
+		// Warning : Costly operation
 		StatusCode Update(Device& Dev)
 		{
-			return Dev.UpdateBuffer(Buffer, Data);
+			return upload_(Dev);
 		}
 	};
-}
\ No newline at end of file
+}
@@ -23,7 +23,8 @@ namespace FrameDX
 		StillDrawing              = DXGI_ERROR_WAS_STILL_DRAWING
 	};
 	
-	inline std::wstring StatusCodeToString(StatusCode code)
+	// Returns a string literal, so it can be stored without copying
+	inline const wchar_t* StatusCodeToString(StatusCode code)
 	{
 		switch(code)
 		{
@@ -0,0 +1,129 @@
+#include "stdafx.h"
+#include "FrameStats.h"
+
+using namespace FrameDX;
+
+namespace
+{
+	// Scope names shared by all the FrameStats instances
+	struct scope_registry_
+	{
+		mutex Mutex;
+		const wchar_t* Names[FrameStats::MaxScopes] = {};
+		atomic<uint32_t> Count = 0;
+	};
+
+	scope_registry_& scope_registry()
+	{
+		static scope_registry_ registry;
+		return registry;
+	}
+}
+
+FrameStats::FrameStats() : Scopes(make_unique<ring_<ScopeWindowSize>[]>(MaxScopes))
+{
+	SetHitchBudget(chrono::duration_cast<chrono::nanoseconds>(chrono::duration<double>(1.0 / 60.0)));
+}
+
+void FrameStats::RecordFrame(chrono::nanoseconds FrameTime)
+{
+	Frames.push(FrameTime.count());
+
+	if(FrameTime.count() > HitchBudget.load(memory_order_relaxed))
+		Hitches.fetch_add(1, memory_order_relaxed);
+}
+
+FrameStats::Summary FrameStats::GetFrameSummary() const
+{
+	auto summary = summarize_(Frames);
+	summary.Hitches = Hitches.load(memory_order_relaxed);
+	return summary;
+}
+
+uint32_t FrameStats::RegisterScope(const wchar_t* Name)
+{
+	auto& registry = scope_registry();
+	lock_guard<mutex> lock(registry.Mutex);
+
+	uint32_t count = registry.Count.load(memory_order_relaxed);
+	for(uint32_t i = 0; i < count; i++)
+		if(wcscmp(registry.Names[i], Name) == 0)
+			return i;
+
+	if(count == MaxScopes)
+		return InvalidScope;
+
+	registry.Names[count] = Name;
+	registry.Count.store(count + 1, memory_order_release);
+	return count;
+}
+
+const wchar_t* FrameStats::GetScopeName(uint32_t Scope)
+{
+	auto& registry = scope_registry();
+	return Scope < registry.Count.load(memory_order_acquire) ? registry.Names[Scope] : nullptr;
+}
+
+void FrameStats::RecordScope(uint32_t Scope, chrono::nanoseconds Time)
+{
+	if(Scope < MaxScopes)
+		Scopes[Scope].push(Time.count());
+}
+
+FrameStats::Summary FrameStats::GetScopeSummary(uint32_t Scope) const
+{
+	return Scope < MaxScopes ? summarize_(Scopes[Scope]) : Summary();
+}
+
+vector<pair<const wchar_t*, FrameStats::Summary>> FrameStats::GetScopeSummaries() const
+{
+	vector<pair<const wchar_t*, Summary>> summaries;
+
+	uint32_t count = scope_registry().Count.load(memory_order_acquire);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		auto summary = summarize_(Scopes[i]);
+		if(summary.TotalSamples > 0)
+			summaries.emplace_back(GetScopeName(i), summary);
+	}
+
+	return summaries;
+}
+
+template<size_t N>
+FrameStats::Summary FrameStats::summarize_(const ring_<N>& Ring)
+{
+	Summary summary;
+	summary.TotalSamples = Ring.Count.load(memory_order_acquire);
+	summary.WindowSamples = (size_t)min<uint64_t>(summary.TotalSamples, N);
+	if(summary.WindowSamples == 0)
+		return summary;
+
+	// Work on a copy, the writer keeps going
+	uint64_t samples[N];
+	uint64_t total = 0;
+	for(size_t i = 0; i < summary.WindowSamples; i++)
+	{
+		samples[i] = Ring.Samples[i].load(memory_order_acquire);
+		total += samples[i];
+	}
+
+	auto to_ms = [](double Nanoseconds) { return milliseconds(Nanoseconds / 1e6); };
+	// Called in increasing order, so each one only has to partition what's above the previous one
+	size_t partitioned = 0;
+	auto percentile = [&](double P)
+	{
+		size_t k = min(summary.WindowSamples - 1, (size_t)(P * summary.WindowSamples));
+		nth_element(samples + partitioned, samples + k, samples + summary.WindowSamples);
+		partitioned = k;
+		return to_ms((double)samples[k]);
+	};
+
+	summary.Mean = to_ms(double(total) / summary.WindowSamples);
+	summary.P50 = percentile(0.50);
+	summary.P95 = percentile(0.95);
+	summary.P99 = percentile(0.99);
+	summary.Max = to_ms((double)*max_element(samples + partitioned, samples + summary.WindowSamples));
+
+	return summary;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "stdafx.h"
+
+namespace FrameDX
+{
+	// Keeps a rolling window of frame times and of named timing scopes
+	// Writing a sample is a couple of atomic stores, so it never blocks the render loop
+	// The summaries can be read from any thread. They are computed from a copy of the window, which can mix
+	// samples of the frame that is being written, but each sample is always complete
+	class FrameStats
+	{
+	public:
+		typedef chrono::duration<double, milli> milliseconds;
+
+		static constexpr size_t FrameWindowSize = 1024;
+		static constexpr size_t ScopeWindowSize = 256;
+		static constexpr size_t MaxScopes = 64;
+		static constexpr uint32_t InvalidScope = ~0u;
+
+		struct Summary
+		{
+			// Samples on the window, and since the start
+			size_t WindowSamples = 0;
+			uint64_t TotalSamples = 0;
+			// Only for frames, samples over the budget since the start
+			uint64_t Hitches = 0;
+
+			milliseconds Mean = milliseconds(0);
+			milliseconds P50 = milliseconds(0);
+			milliseconds P95 = milliseconds(0);
+			milliseconds P99 = milliseconds(0);
+			milliseconds Max = milliseconds(0);
+		};
+
+		FrameStats();
+		FrameStats(const FrameStats&) = delete;
+		FrameStats& operator=(const FrameStats&) = delete;
+
+		// Called by Device::EnterMainLoop
+		void RecordFrame(chrono::nanoseconds FrameTime);
+
+		// Frames longer than the budget are counted as hitches. The default is 60 Hz
+		void SetHitchBudget(chrono::nanoseconds Budget) { HitchBudget.store(Budget.count(), memory_order_relaxed); }
+		uint64_t GetHitchCount() const { return Hitches.load(memory_order_relaxed); }
+
+		Summary GetFrameSummary() const;
+
+		// Scopes are global, so the same id is valid for all the instances
+		// Registering a name twice returns the same id. Returns InvalidScope if there are already MaxScopes
+		// The name is stored without copying, so it should be a string literal
+		static uint32_t RegisterScope(const wchar_t* Name);
+		static const wchar_t* GetScopeName(uint32_t Scope);
+
+		void RecordScope(uint32_t Scope, chrono::nanoseconds Time);
+		Summary GetScopeSummary(uint32_t Scope) const;
+		// Summaries of all the scopes with at least one sample
+		vector<pair<const wchar_t*, Summary>> GetScopeSummaries() const;
+
+		// Records the time between construction and destruction on a scope
+		class ScopeTimer
+		{
+		public:
+			ScopeTimer(FrameStats& Stats, uint32_t Scope) : Stats(Stats), Scope(Scope), Start(chrono::high_resolution_clock::now()) {}
+			~ScopeTimer() { Stats.RecordScope(Scope, chrono::high_resolution_clock::now() - Start); }
+		private:
+			FrameStats& Stats;
+			uint32_t Scope;
+			chrono::high_resolution_clock::time_point Start;
+		};
+	private:
+		// Slots are reserved with an atomic add, so more than one thread can write to the same ring
+		template<size_t N>
+		struct ring_
+		{
+			atomic<uint64_t> Samples[N] = {};
+			atomic<uint64_t> Count = 0;
+
+			void push(uint64_t Value)
+			{
+				uint64_t index = Count.fetch_add(1, memory_order_relaxed);
+				Samples[index % N].store(Value, memory_order_release);
+			}
+		};
+
+		template<size_t N>
+		static Summary summarize_(const ring_<N>& Ring);
+
+		ring_<FrameWindowSize> Frames;
+		unique_ptr<ring_<ScopeWindowSize>[]> Scopes;
+		atomic<int64_t> HitchBudget;
+		atomic<uint64_t> Hitches = 0;
+	};
+}
+
+#define __TIMING_SCOPE_INNER(stats, name, n) static const uint32_t __timing_scope_id_##n = FrameDX::FrameStats::RegisterScope(name); \
+	FrameDX::FrameStats::ScopeTimer __timing_scope_##n(stats, __timing_scope_id_##n);
+#define __TIMING_SCOPE_EXPAND(stats, name, n) __TIMING_SCOPE_INNER(stats, name, n)
+// Times the rest of the enclosing block, and records it on the scope with the provided name
+// The name is registered only once per call site
+#define TimingScope(stats, name) __TIMING_SCOPE_EXPAND(stats, name, __COUNTER__)
@@ -0,0 +1,347 @@
+// Doesn't use the precompiled header, so it only depends on the standard library
+#include "JobSystem.h"
+
+using namespace FrameDX;
+using namespace std;
+
+namespace FrameDX
+{
+	struct job_
+	{
+		function<void()> Work;
+		// Decremented when the job finishes, used by task groups
+		atomic<uint32_t>* Counter = nullptr;
+		// The scheduler and each handle own a reference
+		atomic<int32_t> References = 1;
+		// Unfinished dependencies, plus one that's held while the job is being submitted
+		atomic<int32_t> PendingDependencies = 1;
+
+		// Jobs waiting for this one. Protected by the lock flag, as it's only held for a few instructions
+		atomic<bool> Locked = false;
+		bool Finished = false;
+		vector<job_*> Dependents;
+		atomic<bool> Done = false;
+
+		void lock() { while(Locked.exchange(true, memory_order_acquire)) this_thread::yield(); }
+		void unlock() { Locked.store(false, memory_order_release); }
+		void release() { if(References.fetch_sub(1, memory_order_acq_rel) == 1) delete this; }
+	};
+}
+
+namespace
+{
+	// Worker that runs on the current thread, if any
+	thread_local void* current_worker = nullptr;
+}
+
+JobHandle::JobHandle(const JobHandle& Other) : Job(Other.Job)
+{
+	if(Job)
+		Job->References.fetch_add(1, memory_order_relaxed);
+}
+
+JobHandle::~JobHandle()
+{
+	if(Job)
+		Job->release();
+}
+
+bool JobHandle::IsFinished() const
+{
+	return !Job || Job->Done.load(memory_order_acquire);
+}
+
+bool JobSystem::work_deque_::push(job_* Job)
+{
+	int64_t bottom = Bottom.load(memory_order_relaxed);
+	int64_t top = Top.load(memory_order_acquire);
+	if(bottom - top >= (int64_t)DequeCapacity)
+		return false;
+
+	Buffer[bottom % DequeCapacity].store(Job, memory_order_relaxed);
+	Bottom.store(bottom + 1, memory_order_release);
+	return true;
+}
+
+job_* JobSystem::work_deque_::pop()
+{
+	int64_t bottom = Bottom.load(memory_order_relaxed) - 1;
+	Bottom.store(bottom, memory_order_seq_cst);
+	int64_t top = Top.load(memory_order_seq_cst);
+
+	if(top > bottom)
+	{
+		// Empty
+		Bottom.store(bottom + 1, memory_order_relaxed);
+		return nullptr;
+	}
+
+	job_* job = Buffer[bottom % DequeCapacity].load(memory_order_relaxed);
+	if(top == bottom)
+	{
+		// Last job, race against the thieves for it
+		if(!Top.compare_exchange_strong(top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+			job = nullptr;
+		Bottom.store(bottom + 1, memory_order_relaxed);
+	}
+
+	return job;
+}
+
+job_* JobSystem::work_deque_::steal()
+{
+	int64_t top = Top.load(memory_order_seq_cst);
+	int64_t bottom = Bottom.load(memory_order_seq_cst);
+	if(top >= bottom)
+		return nullptr;
+
+	job_* job = Buffer[top % DequeCapacity].load(memory_order_relaxed);
+	if(!Top.compare_exchange_strong(top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+		return nullptr;
+
+	return job;
+}
+
+JobSystem::JobSystem(unsigned WorkerCount)
+{
+	if(WorkerCount == 0)
+	{
+		// hardware_concurrency can return 0 when it's not known
+		unsigned hardware_threads = thread::hardware_concurrency();
+		WorkerCount = max(1u, hardware_threads > 1 ? hardware_threads - 1 : 1u);
+	}
+
+	for(unsigned i = 0; i < WorkerCount; i++)
+	{
+		Workers.emplace_back();
+		Workers.back().Owner = this;
+		Workers.back().RandomState = 0x9E3779B9u * (i + 1);
+	}
+
+	// Start them after all are created, as they steal from each other
+	for(auto& worker : Workers)
+		worker.Thread = thread([this, &worker]() { worker_loop_(&worker); });
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		lock_guard<mutex> lock(SleepMutex);
+		Stopping = true;
+	}
+	SleepCondition.notify_all();
+
+	for(auto& worker : Workers)
+		worker.Thread.join();
+}
+
+JobHandle JobSystem::submit_(function<void()>&& Work, const JobHandle* Dependencies, size_t DependencyCount, atomic<uint32_t>* Counter)
+{
+	job_* job = new job_;
+	job->Work = move(Work);
+	job->Counter = Counter;
+
+	for(size_t i = 0; i < DependencyCount; i++)
+	{
+		job_* dependency = Dependencies[i].Job;
+		if(!dependency)
+			continue;
+
+		dependency->lock();
+		if(!dependency->Finished)
+		{
+			job->PendingDependencies.fetch_add(1, memory_order_relaxed);
+			dependency->Dependents.push_back(job);
+		}
+		dependency->unlock();
+	}
+
+	JobHandle handle;
+	handle.Job = job;
+	job->References.fetch_add(1, memory_order_relaxed);
+
+	// Drop the submission hold. If all the dependencies are done, it can run already
+	if(job->PendingDependencies.fetch_sub(1, memory_order_acq_rel) == 1)
+		push_(job);
+
+	return handle;
+}
+
+void JobSystem::push_(job_* Job)
+{
+	auto worker = (worker_*)current_worker;
+	if(!worker || worker->Owner != this || !worker->Deque.push(Job))
+	{
+		lock_guard<mutex> lock(SharedMutex);
+		SharedQueue.push_back(Job);
+		SharedCount.fetch_add(1, memory_order_relaxed);
+	}
+
+	// Pairs with the Sleeping increment of the workers, one of the two sides sees the other
+	WorkEpoch.fetch_add(1, memory_order_seq_cst);
+	if(Sleeping.load(memory_order_seq_cst) > 0)
+	{
+		lock_guard<mutex> lock(SleepMutex);
+		SleepCondition.notify_one();
+	}
+}
+
+job_* JobSystem::find_job_(worker_* Worker)
+{
+	if(Worker)
+		if(job_* job = Worker->Deque.pop())
+			return job;
+
+	if(SharedCount.load(memory_order_relaxed) > 0)
+	{
+		lock_guard<mutex> lock(SharedMutex);
+		if(!SharedQueue.empty())
+		{
+			job_* job = SharedQueue.front();
+			SharedQueue.pop_front();
+			SharedCount.fetch_sub(1, memory_order_relaxed);
+			return job;
+		}
+	}
+
+	// Steal, starting from a random worker so the thieves spread out
+	uint32_t start = 0;
+	if(Worker)
+	{
+		Worker->RandomState ^= Worker->RandomState << 13;
+		Worker->RandomState ^= Worker->RandomState >> 17;
+		Worker->RandomState ^= Worker->RandomState << 5;
+		start = Worker->RandomState;
+	}
+
+	size_t count = Workers.size();
+	for(size_t i = 0; i < count; i++)
+	{
+		worker_& victim = Workers[(start + i) % count];
+		if(&victim != Worker)
+			if(job_* job = victim.Deque.steal())
+				return job;
+	}
+
+	return nullptr;
+}
+
+void JobSystem::run_(job_* Job)
+{
+	Job->Work();
+
+	Job->lock();
+	Job->Finished = true;
+	auto dependents = move(Job->Dependents);
+	Job->unlock();
+
+	for(job_* dependent : dependents)
+		if(dependent->PendingDependencies.fetch_sub(1, memory_order_acq_rel) == 1)
+			push_(dependent);
+
+	Job->Done.store(true, memory_order_release);
+	if(Job->Counter)
+		Job->Counter->fetch_sub(1, memory_order_release);
+
+	// Pairs with the Helping increment of the threads blocked on a wait, one of the two sides sees the other
+	FinishEpoch.fetch_add(1, memory_order_seq_cst);
+	if(Helping.load(memory_order_seq_cst) > 0)
+	{
+		lock_guard<mutex> lock(FinishMutex);
+		FinishCondition.notify_all();
+	}
+
+	Job->release();
+}
+
+bool JobSystem::local_queue_empty_() const
+{
+	auto worker = (worker_*)current_worker;
+	if(worker && worker->Owner == this)
+		return worker->Deque.empty();
+
+	return SharedCount.load(memory_order_relaxed) == 0;
+}
+
+void JobSystem::help_until_(const function<bool()>& Done)
+{
+	auto worker = (worker_*)current_worker;
+	if(worker && worker->Owner != this)
+		worker = nullptr;
+
+	int idle = 0;
+	while(!Done())
+	{
+		uint64_t epoch = FinishEpoch.load(memory_order_seq_cst);
+
+		if(job_* job = find_job_(worker))
+		{
+			run_(job);
+			idle = 0;
+			continue;
+		}
+
+		// Workers keep looking, as the job they wait for can be on their own deque behind the others
+		// Any other thread spins a bit and then sleeps until some job finishes, as that's the only thing that can change Done
+		if(worker || ++idle < 64)
+		{
+			this_thread::yield();
+			continue;
+		}
+
+		unique_lock<mutex> lock(FinishMutex);
+		Helping.fetch_add(1, memory_order_seq_cst);
+		FinishCondition.wait(lock, [&]() { return FinishEpoch.load(memory_order_seq_cst) != epoch; });
+		Helping.fetch_sub(1, memory_order_relaxed);
+		idle = 0;
+	}
+}
+
+void JobSystem::Wait(const JobHandle& Handle)
+{
+	help_until_([&Handle]() { return Handle.IsFinished(); });
+}
+
+void JobSystem::worker_loop_(worker_* Worker)
+{
+	current_worker = Worker;
+
+	while(true)
+	{
+		uint64_t epoch = WorkEpoch.load(memory_order_seq_cst);
+
+		if(job_* job = find_job_(Worker))
+		{
+			run_(job);
+			continue;
+		}
+
+		// Spin a bit before sleeping, new jobs usually come in bursts
+		bool found = false;
+		for(int i = 0; i < 64 && !found; i++)
+		{
+			this_thread::yield();
+			if(job_* job = find_job_(Worker))
+			{
+				run_(job);
+				found = true;
+			}
+		}
+		if(found)
+			continue;
+
+		unique_lock<mutex> lock(SleepMutex);
+		Sleeping.fetch_add(1, memory_order_seq_cst);
+		SleepCondition.wait(lock, [&]() { return Stopping || WorkEpoch.load(memory_order_seq_cst) != epoch; });
+		Sleeping.fetch_sub(1, memory_order_relaxed);
+
+		if(Stopping)
+			return;
+	}
+}
+
+JobSystem& FrameDX::GetJobSystem()
+{
+	static JobSystem system;
+	return system;
+}
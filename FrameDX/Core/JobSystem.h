@@ -0,0 +1,197 @@
+#pragma once
+// Only uses the standard library, so it can be built and used outside of Windows
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace FrameDX
+{
+	class JobSystem;
+	struct job_;
+
+	// Reference to a submitted job, used to wait for it or to make other jobs depend on it
+	class JobHandle
+	{
+	public:
+		JobHandle() = default;
+		JobHandle(const JobHandle& Other);
+		JobHandle(JobHandle&& Other) noexcept : Job(Other.Job) { Other.Job = nullptr; }
+		JobHandle& operator=(JobHandle Other) { std::swap(Job, Other.Job); return *this; }
+		~JobHandle();
+
+		bool IsValid() const { return Job != nullptr; }
+		bool IsFinished() const;
+	private:
+		friend class JobSystem;
+		job_* Job = nullptr;
+	};
+
+	// Work stealing scheduler
+	// Each worker has its own Chase-Lev deque. It pushes and pops from the bottom, and the idle workers steal from the top
+	// Jobs submitted from threads that are not workers go to a shared queue
+	// All the waits run other jobs while the waited ones are not done, so waiting inside a job doesn't block a worker
+	class JobSystem
+	{
+	public:
+		// By default, one worker less than the number of cores, as the thread that waits also runs jobs
+		explicit JobSystem(unsigned WorkerCount = 0);
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		unsigned GetWorkerCount() const { return (unsigned)Workers.size(); }
+
+		// Runs f on some worker. If there are dependencies, it's only started after all of them are finished
+		template<typename F>
+		JobHandle Submit(F&& f, std::initializer_list<JobHandle> Dependencies = {})
+		{
+			return submit_(std::function<void()>(std::forward<F>(f)), Dependencies.begin(), Dependencies.size(), nullptr);
+		}
+		JobHandle Submit(std::function<void()> f, const std::vector<JobHandle>& Dependencies)
+		{
+			return submit_(std::move(f), Dependencies.data(), Dependencies.size(), nullptr);
+		}
+
+		// Runs other jobs until the job is finished
+		// Threads that aren't workers of this system sleep once there's nothing they can run, until a job finishes
+		void Wait(const JobHandle& Handle);
+
+		// Fork/join set of jobs. The destructor waits for all of them
+		class TaskGroup
+		{
+		public:
+			explicit TaskGroup(JobSystem& System) : System(System) {}
+			~TaskGroup() { Wait(); }
+
+			TaskGroup(const TaskGroup&) = delete;
+			TaskGroup& operator=(const TaskGroup&) = delete;
+
+			template<typename F>
+			void Run(F&& f)
+			{
+				Pending.fetch_add(1, std::memory_order_relaxed);
+				System.submit_(std::function<void()>(std::forward<F>(f)), nullptr, 0, &Pending);
+			}
+
+			// Runs other jobs until all the jobs of the group are finished
+			void Wait() { System.help_until_([this]() { return Pending.load(std::memory_order_acquire) == 0; }); }
+		private:
+			JobSystem& System;
+			std::atomic<uint32_t> Pending = 0;
+		};
+
+		// Calls f(RangeBegin, RangeEnd) over subranges that cover [Begin, End), and waits for all of them
+		// The grain is adaptive: a range is only split in half while the local queue is empty, that is, while other workers
+		// could take the other half. Otherwise it's processed in chunks of Grain elements
+		// If Grain is 0 it's chosen from the size of the range and the number of workers
+		template<typename F>
+		void ParallelForRange(size_t Begin, size_t End, F&& f, size_t Grain = 0)
+		{
+			if(End <= Begin)
+				return;
+
+			if(Grain == 0)
+				Grain = std::max<size_t>(1, (End - Begin) / (64 * (GetWorkerCount() + 1)));
+
+			TaskGroup group(*this);
+			for_range_(group, Begin, End, f, Grain);
+			group.Wait();
+		}
+
+		// Calls f(i) for each i in [Begin, End)
+		template<typename F>
+		void ParallelFor(size_t Begin, size_t End, F&& f, size_t Grain = 0)
+		{
+			ParallelForRange(Begin, End, [&f](size_t RangeBegin, size_t RangeEnd)
+			{
+				for(size_t i = RangeBegin; i < RangeEnd; i++)
+					f(i);
+			}, Grain);
+		}
+	private:
+		static constexpr size_t DequeCapacity = 4096;
+
+		// Chase-Lev deque with a fixed capacity, push fails when it's full
+		class work_deque_
+		{
+		public:
+			bool push(job_* Job);
+			job_* pop();
+			job_* steal();
+			bool empty() const { return Bottom.load(std::memory_order_relaxed) <= Top.load(std::memory_order_relaxed); }
+		private:
+			alignas(64) std::atomic<int64_t> Top = 0;
+			alignas(64) std::atomic<int64_t> Bottom = 0;
+			std::atomic<job_*> Buffer[DequeCapacity] = {};
+		};
+
+		struct worker_
+		{
+			JobSystem* Owner;
+			work_deque_ Deque;
+			uint32_t RandomState;
+			std::thread Thread;
+		};
+
+		template<typename F>
+		void for_range_(TaskGroup& Group, size_t Begin, size_t End, F& f, size_t Grain)
+		{
+			while(End - Begin > Grain)
+			{
+				if(local_queue_empty_())
+				{
+					// Give the upper half to whoever is idle
+					size_t middle = Begin + (End - Begin) / 2;
+					Group.Run([this, &Group, &f, middle, End, Grain]() { for_range_(Group, middle, End, f, Grain); });
+					End = middle;
+				}
+				else
+				{
+					f(Begin, Begin + Grain);
+					Begin += Grain;
+				}
+			}
+
+			f(Begin, End);
+		}
+
+		JobHandle submit_(std::function<void()>&& Work, const JobHandle* Dependencies, size_t DependencyCount, std::atomic<uint32_t>* Counter);
+		void push_(job_* Job);
+		job_* find_job_(worker_* Worker);
+		void run_(job_* Job);
+		bool local_queue_empty_() const;
+		void help_until_(const std::function<bool()>& Done);
+		void worker_loop_(worker_* Worker);
+
+		std::deque<worker_> Workers;
+
+		// Jobs submitted from outside the workers
+		std::mutex SharedMutex;
+		std::deque<job_*> SharedQueue;
+		std::atomic<size_t> SharedCount = 0;
+
+		// Idle workers sleep here. The epoch changes every time a job is pushed, so a worker that didn't see it doesn't sleep
+		std::mutex SleepMutex;
+		std::condition_variable SleepCondition;
+		std::atomic<uint64_t> WorkEpoch = 0;
+		std::atomic<uint32_t> Sleeping = 0;
+		bool Stopping = false;
+
+		// Threads that aren't workers sleep here while they wait. The epoch changes every time a job finishes
+		std::mutex FinishMutex;
+		std::condition_variable FinishCondition;
+		std::atomic<uint64_t> FinishEpoch = 0;
+		std::atomic<uint32_t> Helping = 0;
+	};
+
+	// Shared job system, created on first use
+	JobSystem& GetJobSystem();
+}
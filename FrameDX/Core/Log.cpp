@@ -1,53 +1,905 @@
 #include "stdafx.h"
 #include "Log.h"
+#include "Core.h"
+#include "TimerWheel.h"
 
 using namespace FrameDX;
 
 log_ FrameDX::Log;
 
-void log_::record_(const wstring & Message, LogCategory Category, int Line, const wstring & Function, const wstring & File)
+log_::ThreadBuffer* log_::get_thread_buffer_()
 {
-	Entry e;
+	// Flags the buffer when the thread exits, so the consumer can free it once it's empty
+	struct handle_
+	{
+		ThreadBuffer* Buffer = nullptr;
+		~handle_() { if(Buffer) Buffer->Retired.store(true, memory_order_release); }
+	};
+	thread_local handle_ handle;
+
+	// Only the first record of each thread gets here
+	if(!handle.Buffer)
+	{
+		auto buffer = make_unique<ThreadBuffer>();
+		handle.Buffer = buffer.get();
+
+		lock_guard<mutex> lock(DrainMutex);
+		ThreadBuffers.push_back(move(buffer));
+		DrainPending.reserve(ThreadBuffers.size());
+	}
+
+	return handle.Buffer;
+}
+
+bool log_::suppress_(const LogCallsite& Site, LogCategory Category)
+{
+	auto& state = Site.Repeats[(int)Category];
+
+	// Fast path, the window is already open
+	if(state.Suppressed.load(memory_order_relaxed))
+	{
+		state.Count.fetch_add(1, memory_order_relaxed);
+		close_expired_repeat_windows_();
+		return true;
+	}
+
+	if(!SuppressRepeats.load(memory_order_relaxed))
+		return false;
+
+	// Another thread could have opened it in the meantime
+	if(state.Suppressed.exchange(true, memory_order_acquire))
+	{
+		state.Count.fetch_add(1, memory_order_relaxed);
+		return true;
+	}
+
+	// This record opens the window, hand it to the log so it can close it later
+	state.WindowStart = chrono::steady_clock::now();
+	state.Site = &Site;
+	state.Category = Category;
+	state.Next = PendingRepeatWindows.load(memory_order_relaxed);
+	while(!PendingRepeatWindows.compare_exchange_weak(state.Next, &state, memory_order_seq_cst, memory_order_relaxed));
+	// Makes the next record drain, which picks it up and computes when it ends
+	RepeatWindowCloseTicks.store(0, memory_order_seq_cst);
+
+	return false;
+}
+
+log_::Entry* log_::begin_record_(const LogCallsite& Site, LogCategory Category, ThreadBuffer*& Buffer)
+{
+	if(suppress_(Site, Category))
+		return nullptr;
+
+	Buffer = get_thread_buffer_();
+
+	uint64_t tail = Buffer->Tail.load(memory_order_relaxed);
+	if(tail - Buffer->Head.load(memory_order_acquire) >= ThreadBufferSize && !try_drain_(Buffer, tail))
+	{
+		// Never block the caller, just lose the record
+		DroppedCount.fetch_add(1, memory_order_relaxed);
+		return nullptr;
+	}
+
+	Entry& e = Buffer->Slots[tail % ThreadBufferSize];
 	e.Category = Category;
-	e.Message = Message;
+	e.Site = &Site;
 	e.Timestamp = chrono::system_clock::now();
-	e.Line = Line;
-	e.Function = Function;
-	e.File = File;
+	e.Sequence = NextSequence.fetch_add(1, memory_order_relaxed);
+
+	return &e;
+}
+
+void log_::end_record_(ThreadBuffer* Buffer)
+{
+	// Publish the slot
+	uint64_t tail = Buffer->Tail.load(memory_order_relaxed) + 1;
+	Buffer->Tail.store(tail, memory_order_release);
 
-	Records.push_back(e);
+	// Without a reader nothing would move the records out of the buffer, so once it's half full do it here
+	if(tail - Buffer->Head.load(memory_order_relaxed) >= ThreadBufferSize / 2)
+		try_drain_(Buffer, tail);
 
+	published_();
+
+	if(SuppressRepeats.load(memory_order_relaxed))
+		close_expired_repeat_windows_();
 }
 
-size_t log_::PrintAll(wostream & OutputStream)
+void log_::close_expired_repeat_windows_()
+{
+	if(chrono::steady_clock::now().time_since_epoch().count() < RepeatWindowCloseTicks.load(memory_order_relaxed))
+		return;
+
+	// The summary has to go after the records of its callsite that are still on the thread buffers, so drain all of them
+	unique_lock<mutex> lock(DrainMutex, try_to_lock);
+	if(lock.owns_lock())
+		drain_();
+}
+
+bool log_::try_drain_(ThreadBuffer* Buffer, uint64_t Tail)
+{
+	// Only if the lock is free, the caller never waits for a reader or another producer that is already draining
+	unique_lock<mutex> lock(DrainMutex, try_to_lock);
+	if(lock.owns_lock())
+		drain_();
+	return Tail - Buffer->Head.load(memory_order_acquire) < ThreadBufferSize;
+}
+
+void log_::published_()
+{
+	// Both sides are sequentially consistent, a waiter lowers the threshold and then reads Published,
+	// so either it sees this record or this thread sees the new threshold
+	uint64_t published = Published.fetch_add(1, memory_order_seq_cst) + 1;
+	uint64_t threshold = WakeThreshold.load(memory_order_seq_cst);
+	while(published >= threshold)
+	{
+		// Only the thread that resets it wakes the waiters. If a waiter lowered it in the meantime, check again
+		if(WakeThreshold.compare_exchange_weak(threshold, NoWaiters, memory_order_seq_cst))
+		{
+			// The lock only covers the generation, so a waiter can't miss it between checking and blocking
+			{
+				lock_guard<mutex> lock(WaitMutex);
+				RecordGeneration++;
+			}
+			WaitCondition.notify_all();
+			break;
+		}
+	}
+}
+
+// Built-in formats
+static void format_text(wostream& OutputStream, const uint8_t* Arguments, size_t Size)
+{
+	OutputStream.write((const wchar_t*)Arguments, Size / sizeof(wchar_t));
+}
+
+static void format_literal(wostream& OutputStream, const uint8_t* Arguments, size_t Size)
+{
+	const wchar_t* message;
+	memcpy(&message, Arguments, sizeof(message));
+	OutputStream << message;
+}
+
+struct status_check_args
+{
+	const wchar_t* Condition;
+	int32_t Code;
+};
+
+static void format_status_check(wostream& OutputStream, const uint8_t* Arguments, size_t Size)
+{
+	status_check_args args;
+	memcpy(&args, Arguments, sizeof(args));
+	OutputStream << args.Condition << L" failed with code " << StatusCodeToString((StatusCode)args.Code);
+}
+
+static void format_repeated(wostream& OutputStream, const uint8_t* Arguments, size_t Size)
+{
+	uint32_t count;
+	memcpy(&count, Arguments, sizeof(count));
+	OutputStream << L"repeated " << count << L" times";
+}
+
+log_::log_()
+{
+	Formats[(size_t)LogFormat::Text].store(format_text, memory_order_relaxed);
+	Formats[(size_t)LogFormat::Literal].store(format_literal, memory_order_relaxed);
+	Formats[(size_t)LogFormat::StatusCheck].store(format_status_check, memory_order_relaxed);
+	Formats[(size_t)LogFormat::Repeated].store(format_repeated, memory_order_relaxed);
+	FormatCount = (uint16_t)LogFormat::UserFormats_;
+
+	WindowCapacity = DefaultRetention;
+	Window = make_unique<Entry[]>(WindowCapacity);
+	WindowTimeKeys = make_unique<chrono::system_clock::time_point[]>(WindowCapacity);
+	WindowLinks = make_unique<window_links_[]>(WindowCapacity);
+}
+
+// Append only file, written through a mapped view that moves forward one chunk at a time
+struct log_::spill_file_
+{
+	// Needs to be a multiple of the allocation granularity (64 KB)
+	static constexpr uint64_t ChunkSize = 1 << 20;
+
+	HANDLE File = INVALID_HANDLE_VALUE;
+	HANDLE Mapping = nullptr;
+	uint8_t* View = nullptr;
+	uint64_t ViewOffset = 0; // File offset of the view
+	uint64_t Written = 0;    // Bytes written to the file
+
+	~spill_file_() { Close(); }
+
+	StatusCode Open(const wstring& Path)
+	{
+		File = CreateFileW(Path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(File == INVALID_HANDLE_VALUE)
+			return LAST_ERROR;
+
+		// Append to what's already there
+		LARGE_INTEGER size;
+		if(!GetFileSizeEx(File, &size))
+		{
+			// Not through Close, that would cut the existing file to Written
+			auto status = LAST_ERROR;
+			CloseHandle(File);
+			File = INVALID_HANDLE_VALUE;
+			return status;
+		}
+		Written = size.QuadPart;
+
+		return StatusCode::Ok;
+	}
+
+	StatusCode Append(const char* Data, size_t Size)
+	{
+		while(Size > 0)
+		{
+			if(!View || Written >= ViewOffset + ChunkSize)
+			{
+				auto status = map_(Written - Written % ChunkSize);
+				if(status != StatusCode::Ok)
+					return status;
+			}
+
+			size_t count = (size_t)min<uint64_t>(Size, ViewOffset + ChunkSize - Written);
+			memcpy(View + (Written - ViewOffset), Data, count);
+			Written += count;
+			Data += count;
+			Size -= count;
+		}
+
+		return StatusCode::Ok;
+	}
+
+	void Close()
+	{
+		unmap_();
+		if(File != INVALID_HANDLE_VALUE)
+		{
+			// The mapping grows the file a chunk at a time, so cut the unused tail
+			LARGE_INTEGER size;
+			size.QuadPart = Written;
+			SetFilePointerEx(File, size, nullptr, FILE_BEGIN);
+			SetEndOfFile(File);
+
+			CloseHandle(File);
+			File = INVALID_HANDLE_VALUE;
+		}
+	}
+private:
+	StatusCode map_(uint64_t Offset)
+	{
+		unmap_();
+
+		uint64_t mapping_size = Offset + ChunkSize;
+		Mapping = CreateFileMappingW(File, nullptr, PAGE_READWRITE, (DWORD)(mapping_size >> 32), (DWORD)mapping_size, nullptr);
+		if(!Mapping)
+			return LAST_ERROR;
+
+		View = (uint8_t*)MapViewOfFile(Mapping, FILE_MAP_WRITE, (DWORD)(Offset >> 32), (DWORD)Offset, ChunkSize);
+		if(!View)
+			return LAST_ERROR;
+		ViewOffset = Offset;
+
+		return StatusCode::Ok;
+	}
+
+	void unmap_()
+	{
+		if(View)
+			UnmapViewOfFile(View);
+		if(Mapping)
+			CloseHandle(Mapping);
+		View = nullptr;
+		Mapping = nullptr;
+	}
+};
+
+log_::~log_()
+{
+	// Stop the flusher before the state it uses goes away, then write what's left
+	Flusher = nullptr;
+
+	lock_guard<mutex> lock(DrainMutex);
+	flush_spill_();
+}
+
+StatusCode log_::SetRetention(size_t Capacity, const wstring& SpillPath)
+{
+	if(Capacity == 0)
+		return StatusCode::InvalidArgument;
+
+	// The flusher callback takes DrainMutex, so it's created outside of it
+	if(!SpillPath.empty())
+		call_once(FlusherOnce, [this]()
+		{
+			Flusher = make_unique<TimerWheel>();
+			Flusher->Schedule([this]()
+			{
+				lock_guard<mutex> lock(DrainMutex);
+				flush_spill_();
+			}, SpillFlushPeriod, SpillFlushPeriod, SpillFlushPeriod / 2);
+		});
+
+	lock_guard<mutex> lock(DrainMutex);
+	// Also finishes the current spill file, before the window can discard anything
+	flush_spill_();
+
+	// Keep the newest records that fit on the new window
+	if(Capacity != WindowCapacity)
+	{
+		uint64_t start = WindowEnd - min<uint64_t>({ WindowEnd, WindowCapacity, Capacity });
+		trim_indexes_(start);
+
+		auto window = make_unique<Entry[]>(Capacity);
+		auto time_keys = make_unique<chrono::system_clock::time_point[]>(Capacity);
+		auto links = make_unique<window_links_[]>(Capacity);
+		for(uint64_t i = start; i < WindowEnd; i++)
+		{
+			window[i % Capacity] = Window[i % WindowCapacity];
+			time_keys[i % Capacity] = WindowTimeKeys[i % WindowCapacity];
+			links[i % Capacity] = WindowLinks[i % WindowCapacity];
+		}
+
+		Window = move(window);
+		WindowTimeKeys = move(time_keys);
+		WindowLinks = move(links);
+		WindowCapacity = Capacity;
+		WindowBegin = start;
+	}
+
+	Spill = nullptr;
+	SpilledEnd = WindowEnd;
+	if(!SpillPath.empty())
+	{
+		auto spill = make_unique<spill_file_>();
+		auto status = spill->Open(SpillPath);
+		if(status != StatusCode::Ok)
+			return status;
+		Spill = move(spill);
+	}
+
+	return StatusCode::Ok;
+}
+
+uint16_t log_::RegisterFormat(FormatFunction Function)
+{
+	uint16_t id = FormatCount.load(memory_order_relaxed);
+	do
+	{
+		if(id >= MaxFormats)
+			return (uint16_t)-1;
+	} while(!FormatCount.compare_exchange_weak(id, id + 1, memory_order_relaxed));
+
+	// The id only reserves the slot, the function is published by the slot itself
+	// A thread that got the id from here and logs with it is ordered after this store, and so is whoever reads that record
+	Formats[id].store(Function, memory_order_release);
+	return id;
+}
+
+void log_::record_(const LogCallsite& Site, LogCategory Category, uint16_t Format, const void* Arguments, size_t Size)
+{
+	ThreadBuffer* buffer;
+	Entry* e = begin_record_(Site, Category, buffer);
+	if(!e) return;
+
+	e->Format = Format;
+	e->ArgumentsSize = (uint16_t)min(Size, MaxArgumentsSize);
+	memcpy(e->Arguments, Arguments, e->ArgumentsSize);
+	end_record_(buffer);
+}
+
+void log_::record_(const LogCallsite& Site, LogCategory Category, const wchar_t* Message)
+{
+	record_(Site, Category, (uint16_t)LogFormat::Text, Message, wcslen(Message) * sizeof(wchar_t));
+}
+
+void log_::record_(const LogCallsite& Site, LogCategory Category, const wstring& Message)
+{
+	record_(Site, Category, (uint16_t)LogFormat::Text, Message.data(), Message.size() * sizeof(wchar_t));
+}
+
+void log_::record_literal_(const LogCallsite& Site, LogCategory Category, const wchar_t* Message)
+{
+	record_(Site, Category, (uint16_t)LogFormat::Literal, Message);
+}
+
+void log_::record_status_(const LogCallsite& Site, LogCategory Category, const wchar_t* Condition, int32_t Code)
+{
+	record_(Site, Category, (uint16_t)LogFormat::StatusCheck, status_check_args{ Condition, Code });
+}
+
+void log_::PrintMessage(wostream& OutputStream, const Entry& e)
+{
+	FormatFunction function = e.Format < MaxFormats ? Formats[e.Format].load(memory_order_acquire) : nullptr;
+	if(function)
+		function(OutputStream, e.Arguments, e.ArgumentsSize);
+	else
+		OutputStream << L"Unknown log format " << e.Format;
+}
+
+void log_::drain_()
+{
+	// Snapshot what each thread published so far
+	// Retired is read before Tail, so if it's set no more records can show up on that buffer
+	DrainPending.clear();
+	for(auto& buffer : ThreadBuffers)
+	{
+		bool retired = buffer->Retired.load(memory_order_acquire);
+		DrainPending.push_back({ buffer.get(), buffer->Head.load(memory_order_relaxed), buffer->Tail.load(memory_order_acquire), retired });
+	}
+
+	// Each buffer is already sorted, so merge them by sequence
+	// If the spill file is behind the rest stays on the buffers, the flusher drains again after writing
+	while(!spill_full_())
+	{
+		pending_* next = nullptr;
+		for(auto& p : DrainPending)
+			if(p.Head != p.Tail && (!next || p.Buffer->Slots[p.Head % ThreadBufferSize].Sequence < next->Buffer->Slots[next->Head % ThreadBufferSize].Sequence))
+				next = &p;
+
+		if(!next)
+			break;
+
+		store_(next->Buffer->Slots[next->Head % ThreadBufferSize]);
+		next->Head++;
+	}
+
+	// Give the slots back to the producers
+	for(auto& p : DrainPending)
+		p.Buffer->Head.store(p.Head, memory_order_release);
+
+	// Free the buffers of threads that are gone
+	for(size_t i = ThreadBuffers.size(); i-- > 0;)
+		if(DrainPending[i].Retired && DrainPending[i].Head == DrainPending[i].Tail)
+			ThreadBuffers.erase(ThreadBuffers.begin() + i);
+
+	close_repeat_windows_();
+}
+
+void log_::close_repeat_windows_()
 {
+	// Pick up the windows opened since the last time
+	for(auto state = PendingRepeatWindows.exchange(nullptr, memory_order_seq_cst); state; state = state->Next)
+		OpenRepeatWindows.push_back(state);
+
+	auto now = chrono::steady_clock::now();
+	NextRepeatWindowClose = chrono::steady_clock::time_point::max();
+	for(size_t i = 0; i < OpenRepeatWindows.size();)
+	{
+		// The summary would discard a record that wasn't written to the spill file, so try again once it's written
+		if(spill_full_())
+		{
+			NextRepeatWindowClose = now;
+			break;
+		}
+
+		auto state = OpenRepeatWindows[i];
+		if(now - state->WindowStart < RepeatWindow)
+		{
+			NextRepeatWindowClose = min(NextRepeatWindowClose, state->WindowStart + RepeatWindow);
+			i++;
+			continue;
+		}
+
+		// Read everything before reopening it, after that another thread can write the state
+		const LogCallsite* site = state->Site;
+		LogCategory category = state->Category;
+		OpenRepeatWindows[i] = OpenRepeatWindows.back();
+		OpenRepeatWindows.pop_back();
+
+		// Repeats that race with this end up on the next window
+		state->Suppressed.store(false, memory_order_release);
+		uint32_t count = state->Count.exchange(0, memory_order_relaxed);
+		if(count > 0)
+		{
+			Entry e;
+			e.Category = category;
+			e.Site = site;
+			e.Timestamp = chrono::system_clock::now();
+			e.Sequence = NextSequence.fetch_add(1, memory_order_relaxed);
+			e.Format = (uint16_t)LogFormat::Repeated;
+			e.ArgumentsSize = sizeof(count);
+			memcpy(e.Arguments, &count, sizeof(count));
+			store_(e);
+			published_();
+		}
+	}
+
+	// A window opened after the exchange above could have set it to 0 before this store, so check it again after
+	RepeatWindowCloseTicks.store(NextRepeatWindowClose.time_since_epoch().count(), memory_order_seq_cst);
+	if(PendingRepeatWindows.load(memory_order_seq_cst))
+		RepeatWindowCloseTicks.store(0, memory_order_seq_cst);
+}
+
+void log_::SetRepeatWindow(chrono::milliseconds Window)
+{
+	lock_guard<mutex> lock(DrainMutex);
+	RepeatWindow = Window;
+	SuppressRepeats.store(Window.count() > 0, memory_order_relaxed);
+
+	// Closes the windows that ended with the new length, all of them when disabling it
+	drain_();
+}
+
+void log_::print_entry_(wostream & OutputStream, const Entry & e, time_cache_& Cache)
+{
+	auto time = chrono::system_clock::to_time_t(e.Timestamp);
+	if(time != Cache.Time)
+	{
+		localtime_s(&Cache.TimeInfo, &time);
+		Cache.Time = time;
+	}
+	OutputStream << L"[" << put_time(&Cache.TimeInfo, L"%T") << L"] " << cat_name[(int)e.Category] << L" : ";
+	PrintMessage(OutputStream, e);
+	OutputStream << endl;
+	OutputStream << L"    on line " << e.Line() << L" of file " << e.File() << L", function " << e.Function() << endl;
+}
+
+void log_::store_(const Entry& e)
+{
+	size_t slot = WindowEnd % WindowCapacity;
+
+	// The oldest record is about to be overwritten, and it's the first one on its indexes
+	// After growing the window the slots before WindowBegin were never filled, so they aren't indexed
+	if(WindowEnd >= WindowCapacity && WindowEnd - WindowCapacity >= WindowBegin)
+	{
+		uint64_t evicted = WindowEnd - WindowCapacity;
+		const Entry& old = Window[slot];
+
+		index_pop_(CategoryIndex[(int)old.Category], &window_links_::NextInCategory, evicted);
+		if(index_pop_(old.Site->Positions, &window_links_::NextInSite, evicted) && old.Site->Positions.Count == 0)
+			unlink_site_(old.Site);
+	}
+
+	auto time_key = WindowEnd > 0 ? max(e.Timestamp, WindowTimeKeys[(WindowEnd - 1) % WindowCapacity]) : e.Timestamp;
+
+	Window[slot] = e;
+	WindowTimeKeys[slot] = time_key;
+	index_push_(CategoryIndex[(int)e.Category], &window_links_::NextInCategory, WindowEnd);
+	if(e.Site->Positions.Count == 0)
+	{
+		e.Site->PrevIndexed = nullptr;
+		e.Site->NextIndexed = IndexedSites;
+		if(IndexedSites)
+			IndexedSites->PrevIndexed = e.Site;
+		IndexedSites = e.Site;
+	}
+	index_push_(e.Site->Positions, &window_links_::NextInSite, WindowEnd);
+	WindowEnd++;
+}
+
+void log_::index_push_(LogCallsite::PositionList& List, uint64_t window_links_::* Next, uint64_t Position)
+{
+	WindowLinks[Position % WindowCapacity].*Next = NoPosition;
+	if(List.Count == 0)
+		List.First = Position;
+	else
+		WindowLinks[List.Last % WindowCapacity].*Next = Position;
+	List.Last = Position;
+	List.Count++;
+}
+
+bool log_::index_pop_(LogCallsite::PositionList& List, uint64_t window_links_::* Next, uint64_t Position)
+{
+	if(List.Count == 0 || List.First != Position)
+		return false;
+
+	List.First = WindowLinks[Position % WindowCapacity].*Next;
+	List.Count--;
+	return true;
+}
+
+void log_::unlink_site_(const LogCallsite* Site)
+{
+	(Site->PrevIndexed ? Site->PrevIndexed->NextIndexed : IndexedSites) = Site->NextIndexed;
+	if(Site->NextIndexed)
+		Site->NextIndexed->PrevIndexed = Site->PrevIndexed;
+	Site->PrevIndexed = nullptr;
+	Site->NextIndexed = nullptr;
+}
+
+void log_::trim_indexes_(uint64_t Start)
+{
+	for(auto& index : CategoryIndex)
+		while(index.Count > 0 && index.First < Start)
+			index_pop_(index, &window_links_::NextInCategory, index.First);
+
+	for(const LogCallsite* site = IndexedSites; site;)
+	{
+		const LogCallsite* next = site->NextIndexed;
+		while(site->Positions.Count > 0 && site->Positions.First < Start)
+			index_pop_(site->Positions, &window_links_::NextInSite, site->Positions.First);
+
+		if(site->Positions.Count == 0)
+			unlink_site_(site);
+		site = next;
+	}
+}
+
+void log_::flush_spill_()
+{
+	while(true)
+	{
+		drain_();
+		bool full = spill_full_();
+
+		if(Spill)
+		{
+			// Reuse the same buffers, this runs once per record
+			time_cache_ cache;
+			for(; SpilledEnd < WindowEnd && Spill; SpilledEnd++)
+			{
+				SpillFormatter.str(L"");
+				print_entry_(SpillFormatter, Window[SpilledEnd % WindowCapacity], cache);
+
+				const wstring& text = SpillFormatter.str();
+				int size = WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), nullptr, 0, nullptr, nullptr);
+				SpillBuffer.resize(size);
+				WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), SpillBuffer.data(), size, nullptr, nullptr);
+
+				// If the disk fails stop spilling instead of failing every record
+				if(Spill->Append(SpillBuffer.data(), SpillBuffer.size()) != StatusCode::Ok)
+					Spill = nullptr;
+			}
+		}
+		SpilledEnd = WindowEnd;
+
+		// The drain stopped because the window was full, there can be more records waiting
+		if(!full)
+			break;
+	}
+}
+
+size_t log_::QueryCategories(uint32_t CategoryMask, vector<Entry>& Out, size_t MaxCount)
+{
+	lock_guard<mutex> lock(DrainMutex);
+	drain_();
+
+	// Merge the indexes of the selected categories, each one is already sorted
+	uint64_t heads[(int)LogCategory::LogCategoryCount_];
+	for(int c = 0; c < (int)LogCategory::LogCategoryCount_; c++)
+		heads[c] = (CategoryMask & (1u << c)) && CategoryIndex[c].Count > 0 ? CategoryIndex[c].First : NoPosition;
+
 	size_t count = 0;
-	for(const auto& e : Records)
+	while(count < MaxCount)
 	{
-		auto time = chrono::system_clock::to_time_t(e.Timestamp);
-		tm timeinfo;
-		localtime_s(&timeinfo, &time);
-		OutputStream << L"[" << put_time(&timeinfo, L"%T") << L"] " << cat_name[(int)e.Category] << L" : " << e.Message << endl;
-		OutputStream << L"    on line " << e.Line << L" of file " << e.File << L", function " << e.Function << endl;
+		int next = 0;
+		for(int c = 1; c < (int)LogCategory::LogCategoryCount_; c++)
+			if(heads[c] < heads[next])
+				next = c;
+
+		if(heads[next] == NoPosition)
+			break;
+
+		Out.push_back(Window[heads[next] % WindowCapacity]);
+		heads[next] = WindowLinks[heads[next] % WindowCapacity].NextInCategory;
 		count++;
 	}
 
 	return count;
 }
 
-size_t log_::PrintRange(wostream & OutputStream,size_t Start, size_t End)
+size_t log_::QueryCallsite(const LogCallsite& Site, vector<Entry>& Out, size_t MaxCount)
+{
+	lock_guard<mutex> lock(DrainMutex);
+	drain_();
+
+	size_t count = min(MaxCount, Site.Positions.Count);
+	uint64_t position = Site.Positions.First;
+	for(size_t i = 0; i < count; i++)
+	{
+		Out.push_back(Window[position % WindowCapacity]);
+		position = WindowLinks[position % WindowCapacity].NextInSite;
+	}
+
+	return count;
+}
+
+size_t log_::QueryFile(const wchar_t* File, vector<Entry>& Out, size_t MaxCount)
 {
+	lock_guard<mutex> lock(DrainMutex);
+	drain_();
+
+	// The same file can have many callsites, and the string can be duplicated on different translation units
+	vector<uint64_t> positions;
+	for(const LogCallsite* site = IndexedSites; site; site = site->NextIndexed)
+		if(site->File == File || wcscmp(site->File, File) == 0)
+		{
+			uint64_t position = site->Positions.First;
+			for(size_t i = 0; i < site->Positions.Count; i++)
+			{
+				positions.push_back(position);
+				position = WindowLinks[position % WindowCapacity].NextInSite;
+			}
+		}
+	sort(positions.begin(), positions.end());
+
+	size_t count = min(MaxCount, positions.size());
+	for(size_t i = 0; i < count; i++)
+		Out.push_back(Window[positions[i] % WindowCapacity]);
+
+	return count;
+}
+
+size_t log_::QueryTimeRange(chrono::system_clock::time_point From, chrono::system_clock::time_point To, vector<Entry>& Out, size_t MaxCount)
+{
+	lock_guard<mutex> lock(DrainMutex);
+	drain_();
+
+	// Find the first position with a key >= From
+	uint64_t first = window_start_();
+	uint64_t last = WindowEnd;
+	while(first < last)
+	{
+		uint64_t middle = first + (last - first) / 2;
+		if(WindowTimeKeys[middle % WindowCapacity] < From)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	size_t count = 0;
+	for(uint64_t i = first; i < WindowEnd && count < MaxCount && WindowTimeKeys[i % WindowCapacity] <= To; i++)
+	{
+		const Entry& e = Window[i % WindowCapacity];
+		if(e.Timestamp >= From && e.Timestamp <= To)
+		{
+			Out.push_back(e);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+size_t log_::print_range_(wostream & OutputStream, uint64_t Start, uint64_t End)
+{
+	End = min(End, WindowEnd);
+	uint64_t window_start = window_start_();
+	if(Start < window_start && Start < End)
+	{
+		OutputStream << L"... " << min(End, window_start) - Start << L" records dropped ..." << endl;
+		Start = window_start;
+	}
+
+	time_cache_ cache;
 	size_t count = 0;
-	for(size_t i = Start; i < End && i < Records.size(); i++)
-	{
-		const auto& e = Records[i];
-		auto time = chrono::system_clock::to_time_t(e.Timestamp);
-		tm timeinfo;
-		localtime_s(&timeinfo, &time);
-		OutputStream << L"[" << put_time(&timeinfo, L"%T") << L"] " << cat_name[(int)e.Category] << L" : " << e.Message << endl;
-		OutputStream << L"    on line " << e.Line << L" of file " << e.File << L", function " << e.Function << endl;
+	for(uint64_t i = Start; i < End; i++)
+	{
+		print_entry_(OutputStream, Window[i % WindowCapacity], cache);
 		count++;
 	}
 
 	return count;
 }
+
+size_t log_::Print(wostream & OutputStream, Cursor& From, size_t MaxCount)
+{
+	lock_guard<mutex> lock(DrainMutex);
+	drain_();
+
+	uint64_t end = From.Position + min<uint64_t>(MaxCount, WindowEnd - min(From.Position, WindowEnd));
+	size_t count = print_range_(OutputStream, From.Position, end);
+	From.Position = max(From.Position, end);
+
+	return count;
+}
+
+size_t log_::available_(const Cursor& From)
+{
+	drain_();
+	return (size_t)(WindowEnd - min(From.Position, WindowEnd));
+}
+
+size_t log_::WaitForRecords(const Cursor& From, size_t MaxCount, chrono::microseconds MaxLatency, chrono::milliseconds Timeout)
+{
+	uint64_t stop_generation;
+	{
+		lock_guard<mutex> lock(WaitMutex);
+		stop_generation = WakeGeneration;
+	}
+
+	// Also returns when the next repeat window closes, as that stores a new record
+	// Only DrainMutex is taken here, so producers that have to wake someone never wait for a drain
+	chrono::steady_clock::time_point next_window_close;
+	auto check = [&]()
+	{
+		lock_guard<mutex> drain_lock(DrainMutex);
+		size_t available = available_(From);
+		next_window_close = NextRepeatWindowClose;
+		return available;
+	};
+
+	// Wait for the first record, then batch the ones that arrive soon after
+	MaxCount = max<size_t>(MaxCount, 1);
+	auto start = chrono::steady_clock::now();
+	auto timeout_end = Timeout == chrono::milliseconds::max() ? chrono::steady_clock::time_point::max() : start + Timeout;
+	auto batch_end = chrono::steady_clock::time_point::max();
+	size_t count = 0;
+	while(true)
+	{
+		uint64_t generation;
+		{
+			lock_guard<mutex> lock(WaitMutex);
+			if(WakeGeneration != stop_generation)
+				break;
+			generation = RecordGeneration;
+		}
+
+		// Everything counted here was published before the drain, so it's included on count
+		uint64_t published = Published.load(memory_order_seq_cst);
+		count = check();
+		if(count >= MaxCount)
+			break;
+
+		auto now = chrono::steady_clock::now();
+		if(count > 0 && batch_end == chrono::steady_clock::time_point::max())
+			batch_end = now + MaxLatency;
+		if(now >= (count > 0 ? batch_end : timeout_end))
+			break;
+
+		// Ask to be woken by the record that completes the count
+		uint64_t needed = count > 0 ? MaxCount - count : 1;
+		uint64_t target = needed < NoWaiters - published ? published + needed : NoWaiters;
+		uint64_t threshold = WakeThreshold.load(memory_order_seq_cst);
+		while(target < threshold && !WakeThreshold.compare_exchange_weak(threshold, target, memory_order_seq_cst));
+		if(Published.load(memory_order_seq_cst) >= target)
+			continue;
+
+		auto wake_time = count > 0 ? batch_end : min(timeout_end, next_window_close);
+		auto woken = [&]() { return RecordGeneration != generation || WakeGeneration != stop_generation; };
+		unique_lock<mutex> lock(WaitMutex);
+		if(wake_time == chrono::steady_clock::time_point::max())
+			WaitCondition.wait(lock, woken);
+		else
+			WaitCondition.wait_until(lock, wake_time, woken);
+	}
+
+	return count;
+}
+
+void log_::WakeWaiters()
+{
+	{
+		lock_guard<mutex> lock(WaitMutex);
+		WakeGeneration++;
+	}
+	WaitCondition.notify_all();
+}
+
+size_t log_::Read(Cursor& From, vector<Entry>& Out, size_t MaxCount)
+{
+	lock_guard<mutex> lock(DrainMutex);
+	drain_();
+
+	From.Position = max(From.Position, window_start_());
+
+	size_t count = (size_t)min<uint64_t>(MaxCount, WindowEnd - min(From.Position, WindowEnd));
+	for(size_t i = 0; i < count; i++)
+		Out.push_back(Window[(From.Position + i) % WindowCapacity]);
+	From.Position += count;
+
+	return count;
+}
+
+void log_::PrintEntry(wostream & OutputStream, const Entry & e)
+{
+	time_cache_ cache;
+	print_entry_(OutputStream, e, cache);
+}
+
+size_t log_::PrintAll(wostream & OutputStream)
+{
+	lock_guard<mutex> lock(DrainMutex);
+	drain_();
+
+	return print_range_(OutputStream, window_start_(), WindowEnd);
+}
+
+size_t log_::PrintRange(wostream & OutputStream,size_t Start, size_t End)
+{
+	lock_guard<mutex> lock(DrainMutex);
+	drain_();
+
+	return print_range_(OutputStream, Start, End == (size_t)-1 ? WindowEnd : End);
+}
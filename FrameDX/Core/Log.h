@@ -1,5 +1,6 @@
 #pragma once
 #include "stdafx.h"
+#include "Core.h"
 
 namespace FrameDX
 {
@@ -12,57 +13,382 @@ namespace FrameDX
 		LogCategoryCount_
 	};
 
+#ifndef FRAMEDX_LOG_MIN_CATEGORY
+	// Records with a category below this one are removed at compile time (the conditions of asserts and checks are still evaluated)
+	// Define it on the project, for example to 2 to only keep Error and CriticalError
+	#define FRAMEDX_LOG_MIN_CATEGORY 0
+#endif
+
+	constexpr bool IsLogCategoryCompiled(LogCategory Category) { return (int)Category >= FRAMEDX_LOG_MIN_CATEGORY; }
+
+	// Static information about the place a log record comes from
+	// Every macro expansion owns one, so records only need to keep a pointer to it
+	// The constructor is constexpr so the static is initialized at compile time, without a guard
+	struct LogCallsite
+	{
+		constexpr LogCallsite(const wchar_t* InFunction,const wchar_t* InFile,int InLine) :
+			Function(InFunction),
+			File(InFile),
+			Line(InLine)
+		{}
+
+		const wchar_t* Function;
+		const wchar_t* File;
+		int Line;
+
+		// Used to collapse repeated records, one per category
+		// The first record of a window is stored as usual. Until the log closes the window the following ones only increment Count,
+		// then a single "repeated N times" record is stored
+		struct RepeatState
+		{
+			atomic<bool> Suppressed { false };
+			atomic<uint32_t> Count { 0 };
+
+			// Written by the thread that opened the window, before publishing it
+			chrono::steady_clock::time_point WindowStart;
+			const LogCallsite* Site = nullptr;
+			LogCategory Category = LogCategory::Info;
+			RepeatState* Next = nullptr; // Intrusive list of windows pending to be picked up by the log
+		};
+		mutable RepeatState Repeats[(int)LogCategory::LogCategoryCount_];
+
+		// Positions of the records of this callsite that are still in memory
+		// They are linked through the window of the log, so indexing a record never allocates. Written by the log while it holds its drain lock
+		struct PositionList
+		{
+			uint64_t First = ~0ull;
+			uint64_t Last = ~0ull;
+			size_t Count = 0;
+		};
+		mutable PositionList Positions;
+		// Callsites with records in memory, so queries by file don't walk all of them
+		mutable const LogCallsite* PrevIndexed = nullptr;
+		mutable const LogCallsite* NextIndexed = nullptr;
+	};
+
+	class TimerWheel;
+
 	#define __MAKE_WIDE(x) L##x
 	#define MAKE_WIDE(x) __MAKE_WIDE(x) // Double macro to make it expand x if x is a macro
 
+	// Guards the recording code of the macros. Categories below FRAMEDX_LOG_MIN_CATEGORY are discarded at compile time,
+	// and the rest pay one branch on the runtime mask before doing anything else
+	// Category needs to be a constant expression
+#define __LOG_ENABLED(cat) if constexpr(FrameDX::IsLogCategoryCompiled(cat)) if(FrameDX::Log.IsEnabled(cat))
+	// Declares the static callsite used by the rest of the macros
+#define __LOG_CALLSITE static FrameDX::LogCallsite __log_callsite(MAKE_WIDE(__FUNCTION__), MAKE_WIDE(__FILE__), __LINE__);
+
 	// Stores a new entry to the log (thread safe)
-#define LogMsg(msg,cat) FrameDX::Log.record_(msg,cat,__LINE__,MAKE_WIDE(__FUNCTION__),MAKE_WIDE(__FILE__))
+#define LogMsg(msg,cat) do { __LOG_ENABLED(cat) { __LOG_CALLSITE FrameDX::Log.record_(__log_callsite,cat,msg); } } while(0)
+	// Stores a structured entry to the log (thread safe)
+	// Only the format id and a raw copy of args are stored, the text is built by the format function when the log is read
+	// args must be trivially copyable and the format must be one of LogFormat or an id returned by Log.RegisterFormat
+#define LogStructured(format,args,cat) do { __LOG_ENABLED(cat) { __LOG_CALLSITE FrameDX::Log.record_(__log_callsite,cat,(uint16_t)(format),args); } } while(0)
 	// Checks an assert and stores to the log if false (thread safe)
-#define LogAssert(cond,cat) if(!(cond)) FrameDX::Log.record_(#cond L" != true",cat,__LINE__,MAKE_WIDE(__FUNCTION__),MAKE_WIDE(__FILE__))
+#define LogAssert(cond,cat) if(!(cond)) { __LOG_ENABLED(cat) { __LOG_CALLSITE FrameDX::Log.record_literal_(__log_callsite,cat,#cond L" != true"); } }
 	// Checks an HRESULT/StatusCode and if it's not S_OK it stores to the log (thread safe)
-#define LogCheck(cond,cat) {auto scode = (FrameDX::StatusCode)(cond); if(scode != FrameDX::StatusCode::Ok) FrameDX::Log.record_(std::wstring(#cond L" failed with code ") + FrameDX::StatusCodeToString(scode),cat,__LINE__,MAKE_WIDE(__FUNCTION__),MAKE_WIDE(__FILE__)); }
+#define LogCheck(cond,cat) {auto scode = (FrameDX::StatusCode)(cond); if(scode != FrameDX::StatusCode::Ok) { __LOG_ENABLED(cat) { __LOG_CALLSITE FrameDX::Log.record_status_(__log_callsite,cat,#cond L"",(int32_t)scode); } }}
 	// Checks an assert and if false stores to the log and returns the "ret" value. (thread safe)
 	// This is a macro, so it can be used to return out of a function on failure
-#define LogAssertWithReturn(cond,cat,ret) if(!(cond)) { FrameDX::Log.record_(#cond L" != true",cat,__LINE__,MAKE_WIDE(__FUNCTION__),MAKE_WIDE(__FILE__)); return ret; }
+#define LogAssertWithReturn(cond,cat,ret) if(!(cond)) { __LOG_ENABLED(cat) { __LOG_CALLSITE FrameDX::Log.record_literal_(__log_callsite,cat,#cond L" != true"); } return ret; }
 	// Checks an HRESULT/StatusCode and if it's not S_OK it stores to the log and returns the HRESULT converted to StatusCode. (thread safe)
 	// This is a macro, so it can be used to return out of a function on failure
-#define LogCheckWithReturn(cond,cat) {auto scode = ( FrameDX::StatusCode)(cond); if(scode != FrameDX::StatusCode::Ok) {FrameDX::Log.record_(std::wstring(#cond L" failed with code ") + FrameDX::StatusCodeToString(scode) ,cat,__LINE__,MAKE_WIDE(__FUNCTION__),MAKE_WIDE(__FILE__)); return scode; }}
+#define LogCheckWithReturn(cond,cat) {auto scode = ( FrameDX::StatusCode)(cond); if(scode != FrameDX::StatusCode::Ok) { __LOG_ENABLED(cat) { __LOG_CALLSITE FrameDX::Log.record_status_(__log_callsite,cat,#cond L"",(int32_t)scode); } return scode; }}
 	// Checks an assert and if false stores to the log and triggers a debug break (thread safe)
-#define LogAssertWithBreak(cond,cat) if(!(cond)) { FrameDX::Log.record_(#cond L" != true",cat,__LINE__,MAKE_WIDE(__FUNCTION__) ,MAKE_WIDE(__FILE__)); DebugBreak();  }
+#define LogAssertWithBreak(cond,cat) if(!(cond)) { __LOG_ENABLED(cat) { __LOG_CALLSITE FrameDX::Log.record_literal_(__log_callsite,cat,#cond L" != true"); } DebugBreak();  }
 	// Checks an assert, stores to the log if false and returns the !cond. Can be used inside an if (thread safe)
-#define LogAssertAndContinue(cond,cat) [&](){ bool b = cond; if(!b) FrameDX::Log.record_(#cond L" != true",cat,__LINE__,MAKE_WIDE(__FUNCTION__),MAKE_WIDE(__FILE__)); return !b; }() 
+#define LogAssertAndContinue(cond,cat) [&](){ bool b = cond; if(!b) { __LOG_ENABLED(cat) { __LOG_CALLSITE FrameDX::Log.record_literal_(__log_callsite,cat,#cond L" != true"); } } return !b; }() 
 	// Checks an HRESULT/StatusCode and if it's not S_OK it stores to the log. It returns the HRESULT converted to StatusCode. (thread safe)
 	// Can be used inside an if
-#define LogCheckAndContinue(cond,cat) [&](){auto scode = ( FrameDX::StatusCode)(cond); if(scode !=  FrameDX::StatusCode::Ok) { FrameDX::Log.record_(std::wstring(#cond L" failed with code ") + FrameDX::StatusCodeToString(scode) ,cat,__LINE__,MAKE_WIDE(__FUNCTION__),MAKE_WIDE(__FILE__));} return scode; }()
+#define LogCheckAndContinue(cond,cat) [&](){auto scode = ( FrameDX::StatusCode)(cond); if(scode !=  FrameDX::StatusCode::Ok) { __LOG_ENABLED(cat) { __LOG_CALLSITE FrameDX::Log.record_status_(__log_callsite,cat,#cond L"",(int32_t)scode); } } return scode; }()
+
+	// Ids of the built-in formats
+	// The arguments of an entry are interpreted by the format function of its id
+	enum class LogFormat : uint16_t
+	{
+		Text,		 // Inline copy of the message
+		Literal,	 // Pointer to a string with static storage
+		StatusCheck, // Pointer to the condition string + the StatusCode it returned
+		Repeated,	 // Number of records collapsed by the repeat window
+		UserFormats_ // First id handed out by RegisterFormat
+	};
 	
 	extern class log_
 	{
 	public:
+		log_();
+		~log_();
+
+		// Size of the raw arguments of an entry. Text messages longer than this are truncated
+		static constexpr size_t MaxArgumentsSize = 512;
+		static constexpr size_t MaxMessageLength = MaxArgumentsSize / sizeof(wchar_t);
+		// Number of records a thread can have pending before they are moved to the log
+		// Once a buffer is half full the producer moves the records itself, if no other thread is doing it at that moment,
+		// so they don't depend on someone reading the log. If a thread still fills its buffer, and can't drain it right then,
+		// the new records are dropped (see GetDroppedCount)
+		// Moving a record only copies it to the window and links it on the indexes, nothing is allocated. The spill file is written by a background thread
+		static constexpr size_t ThreadBufferSize = 512;
+		// Number of records kept in memory unless SetRetention is called
+		static constexpr size_t DefaultRetention = 4096;
+		// How often the background thread writes the new records to the spill file
+		static constexpr chrono::milliseconds SpillFlushPeriod = chrono::milliseconds(10);
+		// Maximum number of formats, counting the built-in ones
+		static constexpr size_t MaxFormats = 64;
+
+		// Writes the text of an entry from its raw arguments
+		typedef void (*FormatFunction)(wostream& OutputStream, const uint8_t* Arguments, size_t Size);
+
+		// Fixed size so it can be copied around without touching the heap
+		// It stores the format and its arguments, not the text, that's only built when printing
 		struct Entry
 		{
 			LogCategory Category;
-			wstring Message;
-
+			const LogCallsite* Site;
 			chrono::system_clock::time_point Timestamp;
-			int Line;
-			wstring Function;
-			wstring File;
+			uint64_t Sequence; // Global order of the record
+			uint16_t Format;
+			uint16_t ArgumentsSize;
+			alignas(8) uint8_t Arguments[MaxArgumentsSize];
+
+			int Line() const { return Site->Line; }
+			const wchar_t* Function() const { return Site->Function; }
+			const wchar_t* File() const { return Site->File; }
 		};
 
-		// Need to define the functions outside of the header otherwise you get a duplicated definition on the concurrent_vector for some reason
-		void record_(const wstring& Message,LogCategory Category,int Line,const wstring& Function,const wstring& File);
+		// Stores the record on a lock-free buffer owned by the calling thread. No heap allocations are done here
+		// The callsite is not copied, so it must have static storage (the macros take care of that)
+		// If the callsite already logged a record with the same category during the current repeat window, only a counter is incremented
+		// The text overloads copy the message
+		void record_(const LogCallsite& Site,LogCategory Category,const wchar_t* Message);
+		void record_(const LogCallsite& Site,LogCategory Category,const wstring& Message);
+		// Stores a raw copy of the arguments, to be formatted on read
+		void record_(const LogCallsite& Site,LogCategory Category,uint16_t Format,const void* Arguments,size_t Size);
+		template<typename T>
+		void record_(const LogCallsite& Site,LogCategory Category,uint16_t Format,const T& Arguments)
+		{
+			static_assert(is_trivially_copyable_v<T>, "Log arguments are copied as raw bytes");
+			static_assert(sizeof(T) <= MaxArgumentsSize, "Log arguments are too big");
+			record_(Site, Category, Format, &Arguments, sizeof(T));
+		}
+		// Only stores the pointer, so Message MUST have static storage
+		void record_literal_(const LogCallsite& Site,LogCategory Category,const wchar_t* Message);
+		// Stores the condition pointer and the code, the message is built on read. Condition MUST have static storage
+		void record_status_(const LogCallsite& Site,LogCategory Category,const wchar_t* Condition,int32_t Code);
+
+		// Adds a new format and returns its id, to be used with LogStructured
+		// Returns (uint16_t)-1 if there's no more room
+		uint16_t RegisterFormat(FormatFunction Function);
+
+		// Writes the message of the entry, running its format function
+		void PrintMessage(wostream& OutputStream,const Entry& e);
+
+		// Stable position on the log
+		// Records are numbered in the order they were moved to the log, so a cursor stays valid even after the records it points to are discarded
+		struct Cursor
+		{
+			uint64_t Position = 0;
+		};
+
+		// Keeps only the last Capacity records in memory, the older ones are discarded
+		// If SpillPath is not empty every record is also appended, as UTF-8 text, to that file. It's written through a memory mapped view, so memory use stays bounded
+		// The file is written every SpillFlushPeriod from a background thread. Records are not moved to the log while that would discard
+		// one that wasn't written yet, they wait on the thread buffers instead
+		// Passing an empty path closes the current spill file, if any
+		StatusCode SetRetention(size_t Capacity,const wstring& SpillPath = L"");
+
+		// Prints up to MaxCount records, starting at the cursor, and moves it past them
+		// If the reader fell behind and some of those records were already discarded, a marker with the dropped count is printed first
+		// Returns the number of printed items
+		size_t Print(wostream& OutputStream,Cursor& From,size_t MaxCount = -1);
 
-		// Prints the entire log to the supplied stream
+		// Prints all the records still in memory to the supplied stream
 		// The stream can be a file, wcout, or any other wostream
 		// Returns the number of printed items
 		size_t PrintAll(wostream& OutputStream);
 
 		// Equal to PrintAll, but only prints a range of logs instead of all of them
-		// If End = -1 it prints all the logs from Start
+		// Start and End are cursor positions. If End = -1 it prints all the logs from Start
 		// Returns the number of printed items
 		size_t PrintRange(wostream& OutputStream,size_t Start, size_t End = -1);
+
+		// Blocks until there are records past the cursor
+		// Once the first record is there it keeps waiting, to batch them, until MaxCount records are available or MaxLatency has passed
+		// Returns the number of records available to the cursor, or 0 if Timeout expired or WakeWaiters was called before anything showed up
+		// Waiters publish how many records they still need, and only the record that completes that count wakes them,
+		// the rest of the producers just compare against it
+		size_t WaitForRecords(const Cursor& From,
+							  size_t MaxCount = 1,
+							  chrono::microseconds MaxLatency = chrono::microseconds(0),
+							  chrono::milliseconds Timeout = chrono::milliseconds::max());
+
+		// Makes all the threads blocked on WaitForRecords return. Useful to stop them
+		void WakeWaiters();
+
+		// Records from the same callsite and category that arrive less than Window apart from the first one are collapsed
+		// Once the window ends a single "repeated N times" record is stored. That's checked by the following records,
+		// from any callsite, and when the log is read
+		// The message is not part of the key, so only enable it if the callsites that repeat always log the same text
+		// A zero window disables it, and it's disabled by default
+		void SetRepeatWindow(chrono::milliseconds Window);
+
+		// Copies up to MaxCount records, starting at the cursor, to the end of Out and moves the cursor past them
+		// Records that were already discarded are skipped
+		// Returns the number of copied records
+		size_t Read(Cursor& From,vector<Entry>& Out,size_t MaxCount = -1);
+
+		// Queries over the records still in memory, backed by indexes updated as records are moved to the log
+		// They cost O(results) instead of walking the whole log (time ranges add a binary search)
+		// Matches are appended to Out in log order, up to MaxCount of them. They return the number of matches
+		// Records matching any of the categories on the mask (bit i = LogCategory i)
+		size_t QueryCategories(uint32_t CategoryMask,vector<Entry>& Out,size_t MaxCount = -1);
+		size_t QueryCategory(LogCategory Category,vector<Entry>& Out,size_t MaxCount = -1) { return QueryCategories(1u << (int)Category, Out, MaxCount); }
+		// Records from one callsite
+		size_t QueryCallsite(const LogCallsite& Site,vector<Entry>& Out,size_t MaxCount = -1);
+		// Records from all the callsites on a file. This one also walks the list of callsites
+		size_t QueryFile(const wchar_t* File,vector<Entry>& Out,size_t MaxCount = -1);
+		// Records with a timestamp on [From,To]
+		// Records from different threads can be slightly out of order. The search uses the running maximum of the timestamps,
+		// so a record that's older than one logged before it is only found if that one is also inside the range
+		size_t QueryTimeRange(chrono::system_clock::time_point From,chrono::system_clock::time_point To,vector<Entry>& Out,size_t MaxCount = -1);
+
+		// Prints a single entry, with the same format as PrintAll
+		void PrintEntry(wostream& OutputStream,const Entry& e);
+
+		// Enables or disables a category at runtime. Disabled records are discarded before any work is done with them
+		void SetCategoryEnabled(LogCategory Category,bool Enabled)
+		{
+			if(Enabled)
+				EnabledCategories.fetch_or(1u << (int)Category, memory_order_relaxed);
+			else
+				EnabledCategories.fetch_and(~(1u << (int)Category), memory_order_relaxed);
+		}
+		bool IsEnabled(LogCategory Category) const { return EnabledCategories.load(memory_order_relaxed) & (1u << (int)Category); }
+
+		// Number of records lost because the thread buffer was full when they were recorded
+		uint64_t GetDroppedCount() const { return DroppedCount.load(memory_order_relaxed); }
 	private:
-		concurrency::concurrent_vector<Entry> Records;
+		// Single producer (the owner thread), single consumer (whoever holds DrainMutex) ring
+		struct ThreadBuffer
+		{
+			ThreadBuffer() : Head(0), Tail(0), Retired(false) {}
+
+			Entry Slots[ThreadBufferSize];
+			alignas(64) atomic<uint64_t> Head; // Next slot to read, only written by the consumer
+			alignas(64) atomic<uint64_t> Tail; // Next slot to write, only written by the producer
+			atomic<bool> Retired; // Set when the owner thread exits
+		};
+
+		// Returns true if the record must be dropped because it's a repeat
+		bool suppress_(const LogCallsite& Site,LogCategory Category);
+		Entry* begin_record_(const LogCallsite& Site,LogCategory Category,ThreadBuffer*& Buffer);
+		void end_record_(ThreadBuffer* Buffer);
+		// Drains if no other thread is doing it. Returns true if the buffer has free slots, Tail being the producer's
+		bool try_drain_(ThreadBuffer* Buffer,uint64_t Tail);
+		// Drains, which stores the summaries, if a repeat window has ended and no other thread is draining
+		void close_expired_repeat_windows_();
+		// Counts a record that is visible to drain_, and wakes the waiters if it's the one they were waiting for
+		void published_();
+		ThreadBuffer* get_thread_buffer_();
+
+		// Moves all the published records from the thread buffers to the window, keeping the global order
+		// Must be called with DrainMutex locked
+		void drain_();
+		void store_(const Entry& e);
+		// Removes from the indexes the positions before Start. Must be called with DrainMutex locked, before the window is resized
+		void trim_indexes_(uint64_t Start);
+		uint64_t window_start_() const { return max(WindowBegin, WindowEnd - min<uint64_t>(WindowEnd, WindowCapacity)); }
+
+		// Links of a window slot, to the next position of the same category and callsite
+		struct window_links_
+		{
+			uint64_t NextInCategory;
+			uint64_t NextInSite;
+		};
+		static constexpr uint64_t NoPosition = ~0ull;
+		void index_push_(LogCallsite::PositionList& List,uint64_t window_links_::* Next,uint64_t Position);
+		// Removes Position if it's the first one on the list. Returns true if it was removed
+		bool index_pop_(LogCallsite::PositionList& List,uint64_t window_links_::* Next,uint64_t Position);
+		void unlink_site_(const LogCallsite* Site);
+
+		// True if storing another record would discard one that wasn't written to the spill file
+		bool spill_full_() const { return Spill && WindowEnd - SpilledEnd >= WindowCapacity; }
+		// Drains and writes the new records to the spill file, until everything published is written. Must be called with DrainMutex locked
+		void flush_spill_();
+		// Stores the summary of the repeat windows that ended. Must be called with DrainMutex locked
+		void close_repeat_windows_();
+		// Prints the positions [Start,End) that are still on the window. Must be called with DrainMutex locked
+		size_t print_range_(wostream& OutputStream,uint64_t Start,uint64_t End);
+		// The cache avoids converting the timestamp again for entries on the same second
+		struct time_cache_
+		{
+			time_t Time = -1;
+			tm TimeInfo;
+		};
+		void print_entry_(wostream& OutputStream,const Entry& e,time_cache_& Cache);
+
+		// Returns the number of records past the cursor, draining first. Must be called with DrainMutex locked
+		size_t available_(const Cursor& From);
+
+		// Lock order is DrainMutex -> WaitMutex. Waiters never hold WaitMutex while they drain
+		mutex WaitMutex;
+		condition_variable WaitCondition;
+		uint64_t WakeGeneration = 0; // Incremented by WakeWaiters. Protected by WaitMutex
+		uint64_t RecordGeneration = 0; // Incremented when Published reaches WakeThreshold. Protected by WaitMutex
+		// Number of records published so far, and the lowest count a waiter is waiting for (NoWaiters if none)
+		static constexpr uint64_t NoWaiters = ~0ull;
+		atomic<uint64_t> Published = 0;
+		atomic<uint64_t> WakeThreshold = NoWaiters;
+
+		mutex DrainMutex;
+		vector<unique_ptr<ThreadBuffer>> ThreadBuffers; // Protected by DrainMutex
+		// Snapshot of the buffers taken by drain_. It keeps its memory, and grows with ThreadBuffers, so draining doesn't allocate
+		struct pending_
+		{
+			ThreadBuffer* Buffer;
+			uint64_t Head;
+			uint64_t Tail;
+			bool Retired;
+		};
+		vector<pending_> DrainPending;
+		atomic<uint64_t> NextSequence = 0;
+		atomic<uint64_t> DroppedCount = 0;
+
+		// An id is reserved on FormatCount before its slot is written, so readers load the slot itself (with acquire)
+		// and treat a null one as not registered yet
+		atomic<FormatFunction> Formats[MaxFormats] = {};
+		atomic<uint16_t> FormatCount = 0;
+
+		atomic<uint32_t> EnabledCategories = ~0u;
+		atomic<bool> SuppressRepeats = false;
+		atomic<LogCallsite::RepeatState*> PendingRepeatWindows = nullptr;
+		// Copy of NextRepeatWindowClose for the producers, in steady_clock ticks. 0 when there are new windows to pick up
+		atomic<chrono::steady_clock::rep> RepeatWindowCloseTicks = numeric_limits<chrono::steady_clock::rep>::max();
+		// Protected by DrainMutex
+		chrono::steady_clock::duration RepeatWindow = chrono::steady_clock::duration::zero();
+		vector<LogCallsite::RepeatState*> OpenRepeatWindows;
+		chrono::steady_clock::time_point NextRepeatWindowClose = chrono::steady_clock::time_point::max();
+
+		// Circular window with the last WindowCapacity records. Protected by DrainMutex
+		unique_ptr<Entry[]> Window;
+		size_t WindowCapacity = 0;
+		uint64_t WindowEnd = 0; // Position of the next record, equal to the number of records moved to the log
+		uint64_t WindowBegin = 0; // Oldest position that was kept the last time the window was resized
+
+		// Secondary indexes, lists of positions linked through WindowLinks. The callsites keep their own list. Protected by DrainMutex
+		LogCallsite::PositionList CategoryIndex[(int)LogCategory::LogCategoryCount_];
+		const LogCallsite* IndexedSites = nullptr;
+		unique_ptr<window_links_[]> WindowLinks;
+		// Running maximum of the timestamps, parallel to Window. It's sorted, so time ranges can be binary searched
+		unique_ptr<chrono::system_clock::time_point[]> WindowTimeKeys;
+
+		struct spill_file_;
+		unique_ptr<spill_file_> Spill; // Protected by DrainMutex
+		uint64_t SpilledEnd = 0; // Position of the next record to write to the spill file. Protected by DrainMutex
+		wostringstream SpillFormatter;
+		string SpillBuffer;
+		// Runs flush_spill_, created the first time a spill file is set
+		unique_ptr<TimerWheel> Flusher;
+		once_flag FlusherOnce;
 		const wchar_t* cat_name[(int)LogCategory::LogCategoryCount_] = { L"Info", L"Warning", L"Error", L"CriticalError" };
 	} Log;
-}
\ No newline at end of file
+}
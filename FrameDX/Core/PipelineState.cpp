@@ -7,7 +7,7 @@ using namespace FrameDX;
 
 StatusCode FrameDX::PipelineState::BuildInputLayout(Device * OwnerDev)
 {
-	return LogCheckAndContinue(OwnerDev->GetDevice()->CreateInputLayout
+	return LogCheckAndContinue(OwnerDev->GetDeviceBackend()->CreateInputLayout
 	(
 		Mesh.LayoutDesc->data(),
 		Mesh.LayoutDesc->size(),
@@ -16,3 +16,77 @@ StatusCode FrameDX::PipelineState::BuildInputLayout(Device * OwnerDev)
 		&InputLayout
 	), FrameDX::LogCategory::Error);
 }
+
+namespace
+{
+	// FNV-1a over the bytes of the values
+	class hasher_
+	{
+	public:
+		template<typename T>
+		void add(const T& Value) { add_bytes_(&Value, sizeof(T)); }
+		template<typename T>
+		void add(const vector<T>& Values)
+		{
+			add(Values.size());
+			add_bytes_(Values.data(), sizeof(T) * Values.size());
+		}
+
+		uint64_t get() const { return Hash; }
+	private:
+		void add_bytes_(const void* Data, size_t Size)
+		{
+			auto bytes = (const uint8_t*)Data;
+			for(size_t i = 0; i < Size; i++)
+				Hash = (Hash ^ bytes[i]) * 0x100000001B3ull;
+		}
+
+		uint64_t Hash = 0xCBF29CE484222325ull;
+	};
+}
+
+BakedPipelineState::BakedPipelineState(const PipelineState& Source) : State(Source)
+{
+	for(size_t stage = 0; stage < (size_t)ShaderStage::_count; stage++)
+	{
+		hasher_ h;
+		h.add(State.Shaders[stage].ShaderPtr);
+		h.add(State.Shaders[stage].ResourcesTable);
+		h.add(State.Shaders[stage].ConstantBuffersTable);
+		h.add(State.Shaders[stage].SamplersTable);
+		if(stage == (size_t)ShaderStage::Compute)
+			h.add(State.Output.ComputeShaderUAVs);
+
+		Hashes[stage] = h.get();
+	}
+
+	{
+		hasher_ h;
+		h.add(State.Mesh.IndexBuffer);
+		h.add(State.Mesh.IndexFormat);
+		h.add(State.Mesh.VertexBuffer);
+		h.add(State.Mesh.VertexStride);
+		h.add(State.Mesh.PrimitiveType);
+		h.add(State.InputLayout);
+		Hashes[(size_t)Segment::InputAssembler] = h.get();
+	}
+
+	{
+		hasher_ h;
+		h.add(State.Output.Viewports);
+		h.add(State.Output.RasterState);
+		Hashes[(size_t)Segment::Rasterizer] = h.get();
+	}
+
+	{
+		hasher_ h;
+		h.add(State.Output.RTVs);
+		h.add(State.Output.UAVs);
+		h.add(State.Output.DSV);
+		h.add(State.Output.DepthStencilState);
+		h.add(State.Output.StencilRef);
+		h.add(State.Output.BlendState);
+		h.add(State.Output.BlendFactors);
+		Hashes[(size_t)Segment::OutputMerger] = h.get();
+	}
+}
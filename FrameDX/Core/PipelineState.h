@@ -7,6 +7,34 @@ namespace FrameDX
 {
 	enum class ShaderStage { Vertex, Hull, Domain, Geometry, Pixel, Compute, _count };
 
+	// A view together with the resource it points to
+	// The resource is resolved once, when the view is stored, so binding never has to call GetResource
+	// It doesn't hold references, the view already keeps the resource alive
+	template<typename T>
+	struct View
+	{
+		View() : Ptr(nullptr), Resource(nullptr) {}
+		View(nullptr_t) : Ptr(nullptr), Resource(nullptr) {}
+		View(T* ViewPtr) : Ptr(ViewPtr), Resource(nullptr)
+		{
+			if(Ptr)
+			{
+				Ptr->GetResource(&Resource);
+				Resource->Release();
+			}
+		}
+		// For when the resource is already known, i.e. the one the view was created from
+		View(T* ViewPtr, ID3D11Resource* ViewResource) : Ptr(ViewPtr), Resource(ViewResource) {}
+
+		operator T*() const { return Ptr; }
+		T* operator->() const { return Ptr; }
+		bool operator==(const View& Other) const { return Ptr == Other.Ptr; }
+		bool operator!=(const View& Other) const { return Ptr != Other.Ptr; }
+
+		T* Ptr;
+		ID3D11Resource* Resource;
+	};
+
 	// Stores the context for one shader
 	// It consists on the shader, an srv table, a cb table, a sampler table
 	// It assumes all srvs and cb are bound with contiguous indexes, starting at 0
@@ -17,7 +45,7 @@ namespace FrameDX
 		{}
 
 		class Shader * ShaderPtr;
-		vector<ID3D11ShaderResourceView*> ResourcesTable;
+		vector<View<ID3D11ShaderResourceView>> ResourcesTable;
 		vector<ID3D11Buffer*> ConstantBuffersTable;
 		vector<ID3D11SamplerState*> SamplersTable;
 	};
@@ -36,8 +64,8 @@ namespace FrameDX
 
 		ID3D11Buffer* IndexBuffer;
 		ID3D11Buffer* VertexBuffer;
-		UINT VertexStride;
-		const vector<D3D11_INPUT_ELEMENT_DESC>* LayoutDesc; // Needs to always be valid. Usually points to a static resource
+		UINT VertexStride = 0;
+		const vector<D3D11_INPUT_ELEMENT_DESC>* LayoutDesc = nullptr; // Needs to always be valid. Usually points to a static resource
 		D3D11_PRIMITIVE_TOPOLOGY PrimitiveType;
 		DXGI_FORMAT IndexFormat;
 	};
@@ -49,22 +77,21 @@ namespace FrameDX
 	struct OutputContext
 	{
 		OutputContext() : 
-			DSV(nullptr),
 			DepthStencilState(nullptr),
 			BlendState(nullptr),
 			RasterState(nullptr),
 			BlendFactors { 1.0f, 1.0f, 1.0f, 1.0f }
 		{}
 
-		vector<ID3D11RenderTargetView*> RTVs;
-		vector<ID3D11UnorderedAccessView*> UAVs;
-		vector<ID3D11UnorderedAccessView*> ComputeShaderUAVs;
+		vector<View<ID3D11RenderTargetView>> RTVs;
+		vector<View<ID3D11UnorderedAccessView>> UAVs;
+		vector<View<ID3D11UnorderedAccessView>> ComputeShaderUAVs;
 		vector<D3D11_VIEWPORT> Viewports;
-		ID3D11DepthStencilView * DSV;
+		View<ID3D11DepthStencilView> DSV;
 		ID3D11DepthStencilState * DepthStencilState;
 		ID3D11BlendState * BlendState;
 		ID3D11RasterizerState* RasterState;
-		UINT StencilRef;
+		UINT StencilRef = 0;
 		float BlendFactors[4];
 	};
 
@@ -76,7 +103,28 @@ namespace FrameDX
 		OutputContext Output;
 		
 		// This depends on both the Mesh and the VS, so it's created by this object
-		ID3D11InputLayout * InputLayout;
+		ID3D11InputLayout * InputLayout = nullptr;
 		StatusCode BuildInputLayout(class Device * OwnerDev);
 	};
+
+	// Immutable copy of a PipelineState, with a hash for each segment of the pipeline
+	// Binding it only compares the hashes, so rebinding an identical segment costs one compare instead of walking its vectors
+	// Bake it once and reuse it, as baking walks the whole state
+	class BakedPipelineState
+	{
+	public:
+		// The shader stages go first, so the segment of a stage has the same index
+		// The compute UAVs are part of the compute segment
+		enum class Segment { Vertex, Hull, Domain, Geometry, Pixel, Compute, InputAssembler, Rasterizer, OutputMerger, _count };
+		static constexpr uint32_t AllSegments = (1u << (uint32_t)Segment::_count) - 1;
+
+		BakedPipelineState() : Hashes{} {}
+		explicit BakedPipelineState(const PipelineState& Source);
+
+		const PipelineState& GetState() const { return State; }
+		uint64_t GetHash(Segment Target) const { return Hashes[(size_t)Target]; }
+	private:
+		PipelineState State;
+		uint64_t Hashes[(size_t)Segment::_count];
+	};
 }
@@ -0,0 +1,296 @@
+#include "stdafx.h"
+#include "TimerWheel.h"
+
+using namespace FrameDX;
+
+TimerWheel::TimerWheel(chrono::nanoseconds TickDuration) : Start(clock::now()), Tick(max<clock::duration>(chrono::duration_cast<clock::duration>(TickDuration), clock::duration(1)))
+{
+	for(auto& level : Slots)
+		for(auto& slot : level)
+			slot = InvalidNode;
+
+	ServiceThread = thread([this]() { service_(); });
+}
+
+TimerWheel::~TimerWheel()
+{
+	{
+		lock_guard<mutex> lock(Mutex);
+		Stopping = true;
+	}
+	Wakeup.notify_one();
+	ServiceThread.join();
+}
+
+uint64_t TimerWheel::current_tick_() const
+{
+	return (clock::now() - Start) / Tick;
+}
+
+uint64_t TimerWheel::to_ticks_(chrono::nanoseconds Duration) const
+{
+	auto d = chrono::duration_cast<clock::duration>(Duration);
+	return d <= clock::duration::zero() ? 0 : (d + Tick - clock::duration(1)) / Tick;
+}
+
+TimerHandle TimerWheel::Schedule(function<void()> Callback, chrono::nanoseconds Delay, chrono::nanoseconds Period, chrono::nanoseconds Slack, const CancellationToken* Token)
+{
+	// Align the timer to the largest power of two of ticks that fits on the slack
+	// Timers with similar deadlines end up on the same tick
+	uint64_t slack = to_ticks_(Slack);
+	uint64_t slack_mask = 0;
+	while(slack_mask * 2 + 1 <= slack)
+		slack_mask = slack_mask * 2 + 1;
+
+	uint64_t period = to_ticks_(Period);
+
+	lock_guard<mutex> lock(Mutex);
+
+	// Round the absolute time up, so a timer never runs early
+	uint64_t deadline = to_ticks_(clock::now() - Start + Delay);
+
+	uint32_t index = alloc_node_();
+	node_& n = Nodes[index];
+	n.Callback = move(Callback);
+	n.Token = Token ? Token->State : nullptr;
+	// Ticks up to Now were already processed
+	n.Deadline = max(deadline, Now + 1);
+	n.Period = Period > 0ns ? max<uint64_t>(period, 1) : 0;
+	n.SlackMask = slack_mask;
+	n.Expiry = (n.Deadline + slack_mask) & ~slack_mask;
+	insert_(index);
+
+	// Only wake up the service thread if it's sleeping past the new timer
+	if(n.Expiry < WaitTarget)
+		Wakeup.notify_one();
+
+	return { index, n.Generation };
+}
+
+bool TimerWheel::Cancel(TimerHandle Handle)
+{
+	lock_guard<mutex> lock(Mutex);
+
+	if(Handle.Index >= Nodes.size())
+		return false;
+
+	node_& n = Nodes[Handle.Index];
+	if(n.Generation != Handle.Generation)
+		return false;
+
+	switch(n.State)
+	{
+	case node_state_::Queued:
+		unlink_(Handle.Index);
+		free_node_(Handle.Index);
+		return true;
+	case node_state_::Firing:
+		// The service thread frees it after the callback returns
+		n.State = node_state_::Cancelled;
+		return true;
+	default:
+		return false;
+	}
+}
+
+size_t TimerWheel::GetTimerCount() const
+{
+	lock_guard<mutex> lock(Mutex);
+	return ActiveTimers;
+}
+
+uint32_t TimerWheel::alloc_node_()
+{
+	ActiveTimers++;
+
+	if(FreeNodes != InvalidNode)
+	{
+		uint32_t index = FreeNodes;
+		FreeNodes = Nodes[index].Next;
+		return index;
+	}
+
+	Nodes.emplace_back();
+	return (uint32_t)Nodes.size() - 1;
+}
+
+void TimerWheel::free_node_(uint32_t Index)
+{
+	ActiveTimers--;
+
+	node_& n = Nodes[Index];
+	n.Callback = nullptr;
+	n.Token = nullptr;
+	n.State = node_state_::Free;
+	// Invalidates the handles to it
+	n.Generation++;
+	n.Next = FreeNodes;
+	FreeNodes = Index;
+}
+
+void TimerWheel::insert_(uint32_t Index)
+{
+	node_& n = Nodes[Index];
+
+	// The level is given by the highest group of bits where the expiry differs from the current tick
+	// That way all the timers on a slot are due at the same time the slot is reached
+	uint64_t diff = n.Expiry ^ Now;
+	uint32_t level = 0;
+	while(diff >> (LevelBits * (level + 1)) && level < LevelCount - 1)
+		level++;
+	uint32_t slot = (n.Expiry >> (LevelBits * level)) & (SlotsPerLevel - 1);
+
+	uint32_t& head = Slots[level][slot];
+	n.Prev = InvalidNode;
+	n.Next = head;
+	if(head != InvalidNode)
+		Nodes[head].Prev = Index;
+	head = Index;
+
+	n.Slot = (uint16_t)(level * SlotsPerLevel + slot);
+	n.State = node_state_::Queued;
+	OccupiedSlots[level] |= 1ull << slot;
+}
+
+void TimerWheel::unlink_(uint32_t Index)
+{
+	node_& n = Nodes[Index];
+	uint32_t level = n.Slot / SlotsPerLevel;
+	uint32_t slot = n.Slot % SlotsPerLevel;
+
+	if(n.Prev != InvalidNode)
+		Nodes[n.Prev].Next = n.Next;
+	else
+		Slots[level][slot] = n.Next;
+
+	if(n.Next != InvalidNode)
+		Nodes[n.Next].Prev = n.Prev;
+
+	if(Slots[level][slot] == InvalidNode)
+		OccupiedSlots[level] &= ~(1ull << slot);
+}
+
+uint64_t TimerWheel::next_event_() const
+{
+	// For each level, the next event is the first occupied slot after the current one
+	// On level 0 that's a timer that's due, on the rest it's the tick where the slot has to be spread to the lower levels
+	uint64_t next = NoEvent;
+	for(uint32_t level = 0; level < LevelCount; level++)
+	{
+		uint32_t shift = LevelBits * level;
+		uint32_t current = (Now >> shift) & (SlotsPerLevel - 1);
+		uint64_t pending = current == SlotsPerLevel - 1 ? 0 : OccupiedSlots[level] & (~0ull << (current + 1));
+		if(!pending)
+			continue;
+
+		uint64_t slot = 0;
+		while(!(pending & (1ull << slot)))
+			slot++;
+
+		uint32_t upper_shift = shift + LevelBits;
+		uint64_t base = upper_shift >= 64 ? 0 : (Now >> upper_shift) << upper_shift;
+		next = min(next, base | (slot << shift));
+	}
+
+	return next;
+}
+
+void TimerWheel::process_tick_(uint64_t TickIndex, unique_lock<mutex>& Lock)
+{
+	Now = TickIndex;
+
+	// Move the slots that start on this tick to the lower levels
+	for(uint32_t level = LevelCount - 1; level > 0; level--)
+	{
+		uint32_t shift = LevelBits * level;
+		if(Now & ((1ull << shift) - 1))
+			continue;
+
+		uint32_t slot = (Now >> shift) & (SlotsPerLevel - 1);
+		uint32_t index = Slots[level][slot];
+		Slots[level][slot] = InvalidNode;
+		OccupiedSlots[level] &= ~(1ull << slot);
+
+		while(index != InvalidNode)
+		{
+			uint32_t next = Nodes[index].Next;
+			insert_(index);
+			index = next;
+		}
+	}
+
+	// Everything left on the level 0 slot is due now
+	uint32_t slot = Now & (SlotsPerLevel - 1);
+	uint32_t index = Slots[0][slot];
+	Slots[0][slot] = InvalidNode;
+	OccupiedSlots[0] &= ~(1ull << slot);
+
+	Firing.clear();
+	for(; index != InvalidNode; index = Nodes[index].Next)
+	{
+		Nodes[index].State = node_state_::Firing;
+		Firing.emplace_back(index, &Nodes[index]);
+	}
+
+	if(Firing.empty())
+		return;
+
+	// Run the callbacks without the lock, so they can use the wheel
+	// The nodes can't be freed or moved while they are firing
+	auto firing = move(Firing);
+	Lock.unlock();
+	for(auto& entry : firing)
+	{
+		node_& n = *entry.second;
+		if(!n.Token || !n.Token->load(memory_order_acquire))
+			n.Callback();
+	}
+	Lock.lock();
+
+	for(auto& entry : firing)
+	{
+		uint32_t i = entry.first;
+		node_& n = Nodes[i];
+		bool cancelled = n.State == node_state_::Cancelled || (n.Token && n.Token->load(memory_order_acquire));
+		if(cancelled || n.Period == 0)
+		{
+			free_node_(i);
+			continue;
+		}
+
+		// Skip the periods that were missed
+		n.Deadline += n.Period;
+		if(n.Deadline <= Now)
+			n.Deadline += ((Now - n.Deadline) / n.Period + 1) * n.Period;
+		n.Expiry = (n.Deadline + n.SlackMask) & ~n.SlackMask;
+		insert_(i);
+	}
+
+	// Keep the allocation
+	Firing = move(firing);
+}
+
+void TimerWheel::service_()
+{
+	unique_lock<mutex> lock(Mutex);
+
+	while(!Stopping)
+	{
+		uint64_t next = next_event_();
+		if(next > current_tick_())
+		{
+			WaitTarget = next;
+			if(next == NoEvent)
+				Wakeup.wait(lock);
+			else
+				Wakeup.wait_until(lock, Start + next * Tick);
+			WaitTarget = NoEvent;
+
+			WakeupCount.fetch_add(1, memory_order_relaxed);
+			continue;
+		}
+
+		// If the thread woke up late, all the ticks that are due are processed on this same wakeup
+		process_tick_(next, lock);
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "stdafx.h"
+
+namespace FrameDX
+{
+	// Cancels every timer that was scheduled with it, copies share the same state
+	// The timers are removed lazily, when they are due
+	class CancellationToken
+	{
+	public:
+		CancellationToken() : State(make_shared<atomic<bool>>(false)) {}
+
+		void Cancel() { State->store(true, memory_order_release); }
+		bool IsCancelled() const { return State->load(memory_order_acquire); }
+	private:
+		friend class TimerWheel;
+		shared_ptr<atomic<bool>> State;
+	};
+
+	// Identifies a scheduled timer. Stays safe to use after the timer is gone, it's just ignored
+	struct TimerHandle
+	{
+		uint32_t Index = ~0u;
+		uint32_t Generation = 0;
+
+		bool IsValid() const { return Index != ~0u; }
+	};
+
+	// Runs many timers on a single service thread
+	// The timers are stored on a hierarchical wheel, so scheduling and cancelling are O(1) and the thread only wakes up
+	// when the next non empty slot is due. All the timers that fall on the same tick are run on the same wakeup
+	// Callbacks run on the service thread, so they should be short. They can schedule or cancel timers
+	class TimerWheel
+	{
+	public:
+		typedef chrono::steady_clock clock;
+
+		explicit TimerWheel(chrono::nanoseconds TickDuration = 1ms);
+		~TimerWheel();
+
+		TimerWheel(const TimerWheel&) = delete;
+		TimerWheel& operator=(const TimerWheel&) = delete;
+
+		// Calls Callback after Delay, and then every Period if it's not zero
+		// Periodic timers follow absolute deadlines, if the callback takes longer than the period the missed calls are skipped
+		// Slack allows to delay the call up to that time so it can be coalesced with other timers, and save wakeups
+		// If Token is not null, cancelling it cancels the timer
+		TimerHandle Schedule(function<void()> Callback, chrono::nanoseconds Delay, chrono::nanoseconds Period = 0ns,
+							 chrono::nanoseconds Slack = 0ns, const CancellationToken* Token = nullptr);
+
+		// Returns false if the timer already finished or was cancelled
+		// If the callback is running it will finish, but won't be called again
+		bool Cancel(TimerHandle Handle);
+
+		// Number of times the service thread woke up to run timers
+		uint64_t GetWakeupCount() const { return WakeupCount.load(memory_order_relaxed); }
+		size_t GetTimerCount() const;
+	private:
+		static constexpr uint32_t LevelBits = 6;
+		static constexpr uint32_t SlotsPerLevel = 1 << LevelBits;
+		// Enough levels to cover the full 64 bits of ticks, so there's no overflow list
+		static constexpr uint32_t LevelCount = (64 + LevelBits - 1) / LevelBits;
+		static constexpr uint32_t InvalidNode = ~0u;
+		static constexpr uint64_t NoEvent = ~0ull;
+
+		enum class node_state_ : uint8_t { Free, Queued, Firing, Cancelled };
+
+		struct node_
+		{
+			function<void()> Callback;
+			shared_ptr<atomic<bool>> Token;
+			uint64_t Deadline; // Requested tick
+			uint64_t Expiry;   // Tick where it's stored, after applying the slack
+			uint64_t Period;   // In ticks, 0 for one shot timers
+			uint64_t SlackMask;
+			uint32_t Prev;
+			uint32_t Next;
+			uint32_t Generation = 0;
+			uint16_t Slot;
+			node_state_ State = node_state_::Free;
+		};
+
+		uint64_t current_tick_() const;
+		uint64_t to_ticks_(chrono::nanoseconds Duration) const;
+		uint32_t alloc_node_();
+		void free_node_(uint32_t Index);
+		void insert_(uint32_t Index);
+		void unlink_(uint32_t Index);
+		uint64_t next_event_() const;
+		void process_tick_(uint64_t Tick, unique_lock<mutex>& Lock);
+		void service_();
+
+		clock::time_point Start;
+		clock::duration Tick;
+		// Last processed tick
+		uint64_t Now = 0;
+		// Tick the service thread is sleeping until, so Schedule only wakes it when the new timer is earlier
+		uint64_t WaitTarget = NoEvent;
+
+		// Nodes are on a deque so the callbacks stay in place while they run without the lock
+		// Only the elements stay in place, as adding nodes can reallocate the index of the deque, so the nodes that fire
+		// are resolved to pointers while the lock is held
+		deque<node_> Nodes;
+		uint32_t FreeNodes = InvalidNode;
+		size_t ActiveTimers = 0;
+		uint32_t Slots[LevelCount][SlotsPerLevel];
+		uint64_t OccupiedSlots[LevelCount] = {};
+		vector<pair<uint32_t, node_*>> Firing;
+
+		mutable mutex Mutex;
+		condition_variable Wakeup;
+		bool Stopping = false;
+		atomic<uint64_t> WakeupCount = 0;
+		thread ServiceThread;
+	};
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include "stdafx.h"
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+
+namespace FrameDX
+{
+	// Waits on a fixed period, targeting absolute deadlines so errors don't accumulate
+	// Each wait sleeps for most of the remaining time and then yields for the last stretch
+	// The overshoot of sleep_for is learned while running (smoothed mean + deviation, as TCP does with round trip times)
+	// so the spin stretch is only as long as the current system needs
+	// The estimate starts from one 1 ms sleep measured on construction. Waits that had time to sleep but not enough margin
+	// shrink it, so an estimate that got too large can't keep the pacer spinning forever
+	// Not thread safe, the stats should be read from the thread that calls Wait
+	class FramePacer
+	{
+	public:
+		typedef chrono::steady_clock clock;
+		typedef chrono::duration<double> seconds;
+
+		struct Stats
+		{
+			uint64_t Frames = 0;
+			// Deadlines that were already gone when Wait was called. The pacer skips them instead of trying to catch up
+			uint64_t MissedDeadlines = 0;
+			// Time between the returns of Wait. The deviation is the jitter
+			seconds MeanPeriod = seconds(0);
+			seconds PeriodDeviation = seconds(0);
+			// How late Wait returned after the deadline
+			seconds MeanLateness = seconds(0);
+			seconds MaxLateness = seconds(0);
+
+			// Relative error of the mean period
+			double PeriodError(seconds Target) const { return abs(MeanPeriod.count() - Target.count()) / Target.count(); }
+		};
+
+		template<typename D>
+		explicit FramePacer(D TargetPeriod) : Period(chrono::duration_cast<clock::duration>(TargetPeriod))
+		{
+			// The default timer resolution on Windows is 15.6 ms, which would make most waits a spin
+			timeBeginPeriod(1);
+
+			auto start = clock::now();
+			this_thread::sleep_for(chrono::milliseconds(1));
+			SleepOverhead = max(seconds(clock::now() - start) - seconds(chrono::milliseconds(1)), seconds(0));
+			SleepOverheadDeviation = SleepOverhead / 2.0;
+
+			Reset();
+		}
+		~FramePacer() { timeEndPeriod(1); }
+
+		FramePacer(const FramePacer&) = delete;
+		FramePacer& operator=(const FramePacer&) = delete;
+
+		// Starts counting the period from now
+		void Reset()
+		{
+			NextDeadline = clock::now() + Period;
+			LastWake = clock::time_point();
+		}
+
+		template<typename D>
+		void SetPeriod(D NewPeriod)
+		{
+			Period = chrono::duration_cast<clock::duration>(NewPeriod);
+			Reset();
+		}
+		clock::duration GetPeriod() const { return Period; }
+
+		// Blocks until the next deadline, then moves it one period forward
+		void Wait()
+		{
+			auto deadline = NextDeadline;
+			auto now = clock::now();
+
+			if(now < deadline)
+			{
+				// Coarse sleep, leaving enough margin for the expected overshoot
+				auto margin = chrono::duration_cast<clock::duration>(SleepOverhead + 4 * SleepOverheadDeviation) + MinSpin;
+				auto request = deadline - now - margin;
+				if(request > clock::duration::zero())
+				{
+					this_thread::sleep_for(request);
+					auto after_sleep = clock::now();
+					learn_overhead_(seconds(after_sleep - now - request));
+					now = after_sleep;
+				}
+				else if(deadline - now > MinSpin)
+				{
+					// There was time to sleep but the margin didn't allow it, so the estimate is decayed
+					// If it was right it grows back on the next sleep
+					SleepOverhead -= SleepOverhead / 8.0;
+					SleepOverheadDeviation -= SleepOverheadDeviation / 4.0;
+				}
+
+				// Yield until the deadline
+				while(now < deadline)
+				{
+					this_thread::yield();
+					now = clock::now();
+				}
+			}
+
+			record_(deadline, now);
+
+			// If one or more deadlines were missed, skip them so the next frames are not rushed
+			NextDeadline = deadline + Period;
+			if(now >= NextDeadline)
+			{
+				auto missed = (now - deadline) / Period;
+				CurrentStats.MissedDeadlines += missed;
+				NextDeadline = deadline + (missed + 1) * Period;
+			}
+		}
+
+		const Stats& GetStats() const { return CurrentStats; }
+		void ResetStats() { CurrentStats = Stats(); PeriodSamples = 0; PeriodVariance = 0.0; LastWake = clock::time_point(); }
+
+		// Current estimate of how much sleep_for oversleeps
+		seconds GetSleepOverhead() const { return SleepOverhead; }
+
+		// Minimum time that is always spent yielding before a deadline
+		static constexpr clock::duration MinSpin = chrono::microseconds(200);
+	private:
+		void learn_overhead_(seconds Sample)
+		{
+			if(Sample < seconds(0))
+				Sample = seconds(0);
+
+			auto error = seconds(abs((Sample - SleepOverhead).count()));
+			SleepOverheadDeviation += (error - SleepOverheadDeviation) / 4.0;
+			SleepOverhead += (Sample - SleepOverhead) / 8.0;
+		}
+
+		void record_(clock::time_point Deadline, clock::time_point Now)
+		{
+			auto lateness = seconds(Now - Deadline);
+			CurrentStats.Frames++;
+			CurrentStats.MeanLateness += (lateness - CurrentStats.MeanLateness) / double(CurrentStats.Frames);
+			CurrentStats.MaxLateness = max(CurrentStats.MaxLateness, lateness);
+
+			// Running mean and variance of the period (Welford)
+			if(LastWake != clock::time_point())
+			{
+				auto period = seconds(Now - LastWake);
+				auto count = double(++PeriodSamples);
+				auto delta = period - CurrentStats.MeanPeriod;
+				CurrentStats.MeanPeriod += delta / count;
+				PeriodVariance += delta.count() * (period - CurrentStats.MeanPeriod).count();
+				CurrentStats.PeriodDeviation = seconds(count > 1 ? sqrt(PeriodVariance / (count - 1)) : 0.0);
+			}
+			LastWake = Now;
+		}
+
+		clock::duration Period;
+		clock::time_point NextDeadline;
+		clock::time_point LastWake;
+
+		// Measured on construction
+		seconds SleepOverhead = seconds(0);
+		seconds SleepOverheadDeviation = seconds(0);
+
+		Stats CurrentStats;
+		uint64_t PeriodSamples = 0;
+		double PeriodVariance = 0.0;
+	};
+}
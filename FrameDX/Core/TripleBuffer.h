@@ -0,0 +1,51 @@
+#pragma once
+#include "stdafx.h"
+
+namespace FrameDX
+{
+	// Passes values from one writer thread to one reader thread without locks
+	// The writer fills the write buffer and publishes it, the reader always gets the latest published one
+	// Neither side ever waits. Values published while the reader is busy are skipped
+	template<typename T>
+	class TripleBuffer
+	{
+	public:
+		TripleBuffer() = default;
+		explicit TripleBuffer(const T& Initial)
+		{
+			for(auto& slot : Slots)
+				slot.Value = Initial;
+		}
+
+		TripleBuffer(const TripleBuffer&) = delete;
+		TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+		// Writer side
+		T& GetWriteBuffer() { return Slots[Write].Value; }
+		// Swaps the write buffer with the shared one, and flags it as new
+		void Publish() { Write = Shared.exchange(Write | NewData, memory_order_acq_rel) & IndexMask; }
+
+		// Reader side
+		// Gets the last published buffer if there's a new one. Returns true if it changed
+		bool Update()
+		{
+			if(!(Shared.load(memory_order_relaxed) & NewData))
+				return false;
+
+			Read = Shared.exchange(Read, memory_order_acq_rel) & IndexMask;
+			return true;
+		}
+		const T& GetReadBuffer() const { return Slots[Read].Value; }
+	private:
+		static constexpr uint8_t IndexMask = 3;
+		static constexpr uint8_t NewData = 4;
+
+		// Each buffer on its own cache line, so the two threads don't share any
+		struct alignas(64) slot_ { T Value; };
+		slot_ Slots[3];
+
+		alignas(64) atomic<uint8_t> Shared = 1;
+		alignas(64) uint8_t Write = 0;
+		alignas(64) uint8_t Read = 2;
+	};
+}
@@ -1,16 +1,17 @@
 #pragma once
 #include "stdafx.h"
 #include "Core.h"
+#include "Timing.h"
 #include "../Device/Device.h"
 
 namespace FrameDX
 {
 	// Loops and calls f, while trying to keep all iterations of the same duration
-	// SHOULD NOT BE ASSUMED TO BE ACCURATE!!!
-	// It relays on this_thread::sleep_for, so it's only as accurate as sleep_for is
 	// Can be interrupted
-	// Allows the use of generic std::function functions, which is a big limitation of Win32 timers
-	// A quick test based on the log printer loop of the test app gives the following results
+	// Iterations are paced with a FramePacer, so the period doesn't drift and the sleep overshoot is compensated
+	// Any callable can be used, it doesn't need to be wrapped on a std::function
+	// The previous version relied only on this_thread::sleep_for, with an overhead measured once. A quick test based on
+	// the log printer loop of the test app gave the following results with it
 	// System : Windows 10 Pro x64 10.0.17134, Xeon E5-2683 V3, 32 GB RAM, 2x Samsung Evo 850 (250 GB, RAID0)
 	//		Period | Error (%)
 	//		------------------
@@ -20,27 +21,17 @@ namespace FrameDX
 	//		100 ms | 0.5 - 1
 	//		200 ms | 0.4 - 0.5
 	//		500 ms | 0.18 - 0.2
-	template<typename D>
-	void TimedLoop(function<void()> f,D d, bool* BreakCondition = nullptr)
+	// Running the test app with -timerbench measures this table again for the old loop and for this one, and checks that
+	// this one stays under 0.5% at 10 ms. FramePacer::Stats::PeriodError gives the same number for any pacer
+	template<typename F, typename D>
+	void TimedLoop(F&& f, D d, bool* BreakCondition = nullptr)
 	{
-		// Find the overhead of sleep
-		// Assuming a constant overhead, something that IS WRONG
-		auto t0 = chrono::high_resolution_clock::now();
-			this_thread::sleep_for(1ns);
-		auto t1 = chrono::high_resolution_clock::now();
-		auto overhead = t1 - t0;
+		FramePacer pacer(d);
 
 		while((BreakCondition && *BreakCondition) || !BreakCondition)
 		{
-			t0 = chrono::high_resolution_clock::now();
-				f();
-			t1 = chrono::high_resolution_clock::now();
-			
-			// Don't sleep if the time is under the overhead of sleep_for
-			// Also compensate for overhead here
-			auto r = d - (t1 - t0) - overhead;
-			if(r > overhead)
-				this_thread::sleep_for(r);
+			f();
+			pacer.Wait();
 		}
 	}
 	
@@ -53,6 +44,16 @@ namespace FrameDX
 	template<typename T>
 	T saturate(T x) { return clamp(x, T(0), T(1));  }
 
+	// FNV-1a of a range of bytes
+	inline uint64_t hash_bytes(const void* Data, size_t Size)
+	{
+		uint64_t hash = 0xCBF29CE484222325ull;
+		auto bytes = (const uint8_t*)Data;
+		for(size_t i = 0; i < Size; i++)
+			hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+		return hash;
+	}
+
 	#define __unique_string_inner2(str,c) str #c
 	#define __unique_string_inner(str,c) __unique_string_inner2(str,c)
 	#define UNIQUE_STRING(base) __unique_string_inner( base, __COUNTER__ )
@@ -76,7 +77,8 @@ namespace FrameDX
 			data_desc.pSysMem = &DataVector[0];
 		
 		*OutBuffer = nullptr;
-		auto s = LogCheckAndContinue(Dev.GetDevice()->CreateBuffer(&desc, &data_desc, OutBuffer), LogCategory::Error);
+		// D3D11 fails if the initial data points to nothing, so don't send it when there's no data
+		auto s = LogCheckAndContinue(Dev.GetDeviceBackend()->CreateBuffer(&desc, data_desc.pSysMem ? &data_desc : nullptr, OutBuffer), LogCategory::Error);
 		if (s == StatusCode::Ok)
 		{
 			static atomic<int> counter_(0);
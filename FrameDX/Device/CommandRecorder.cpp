@@ -0,0 +1,139 @@
+#include "stdafx.h"
+#include "CommandRecorder.h"
+#include "Device.h"
+#include "../Core/Log.h"
+#include "../Core/JobSystem.h"
+
+using namespace FrameDX;
+
+StatusCode CommandRecorder::Create(Device* OwnerDevice, size_t ContextCount, BackendType Backend)
+{
+	Owner = OwnerDevice;
+	Type = Backend;
+
+	if(ContextCount == 0)
+		ContextCount = GetJobSystem().GetWorkerCount() + 1;
+
+	for(size_t i = 0; i < ContextCount; i++)
+	{
+		unique_ptr<RecordingContext> context;
+		LogCheckWithReturn(create_context_(context), LogCategory::Error);
+
+		FreeContexts.push_back(context.get());
+		Contexts.push_back(move(context));
+	}
+
+	return StatusCode::Ok;
+}
+
+StatusCode CommandRecorder::create_context_(unique_ptr<RecordingContext>& Out)
+{
+	Out = make_unique<RecordingContext>();
+
+	// Headless devices can't create deferred contexts, so they always record on memory
+	if(Type == BackendType::Deferred && !Owner->IsHeadless())
+	{
+		// Creating deferred contexts is thread safe
+		LogCheckWithReturn(Owner->GetDevice()->CreateDeferredContext(0, &Out->DeferredContext), LogCategory::Error);
+		Out->Backend = make_unique<D3D11ContextBackend>(Out->DeferredContext);
+	}
+	else
+		Out->Backend = make_unique<RecordingContextBackend>();
+
+	Out->Binder.SetBackend(Out->Backend.get());
+	Out->ConstantSlots.SetDevice(Owner->GetDeviceBackend());
+	return StatusCode::Ok;
+}
+
+RecordingContext* CommandRecorder::acquire_context_()
+{
+	{
+		lock_guard<mutex> lock(PoolMutex);
+		if(!FreeContexts.empty())
+		{
+			RecordingContext* context = FreeContexts.back();
+			FreeContexts.pop_back();
+			return context;
+		}
+	}
+
+	// All of them are in use, so add a new one
+	unique_ptr<RecordingContext> context;
+	if(create_context_(context) != StatusCode::Ok)
+		return nullptr;
+
+	lock_guard<mutex> lock(PoolMutex);
+	Contexts.push_back(move(context));
+	return Contexts.back().get();
+}
+
+void CommandRecorder::return_context_(RecordingContext* Context)
+{
+	lock_guard<mutex> lock(PoolMutex);
+	FreeContexts.push_back(Context);
+}
+
+StatusCode CommandRecorder::Record(size_t PassCount, const function<void(RecordingContext&, size_t)>& Record, vector<unique_ptr<CommandList>>& Lists)
+{
+	Lists.clear();
+	Lists.resize(PassCount);
+
+	atomic<bool> failed = false;
+
+	// One job per pass, the passes are coarse enough
+	GetJobSystem().ParallelFor(0, PassCount, [&](size_t pass)
+	{
+		RecordingContext* context = acquire_context_();
+		if(!context)
+		{
+			failed = true;
+			return;
+		}
+
+		Record(*context, pass);
+		if(context->Backend->FinishCommandList(Lists[pass]) != StatusCode::Ok)
+			failed = true;
+
+		// Finishing the list resets the context state
+		context->Binder.Invalidate();
+		return_context_(context);
+	}, 1);
+
+	// All the passes are done, so the counters can be collected from here
+	LastStats = SubmissionStats();
+	{
+		lock_guard<mutex> lock(PoolMutex);
+		for(auto& context : Contexts)
+		{
+			LastStats += context->Binder.GetStats();
+			context->Binder.ResetStats();
+		}
+	}
+
+	return failed ? StatusCode::Failed : StatusCode::Ok;
+}
+
+StatusCode CommandRecorder::RecordAndExecute(size_t PassCount, const function<void(RecordingContext&, size_t)>& Record)
+{
+	vector<unique_ptr<CommandList>> lists;
+	LogCheckWithReturn(this->Record(PassCount, Record, lists), LogCategory::Error);
+
+	Owner->ExecuteCommandLists(lists);
+	Owner->AddSubmissionStats(LastStats);
+	return StatusCode::Ok;
+}
+
+void CommandRecorder::Release()
+{
+	lock_guard<mutex> lock(PoolMutex);
+	for(auto& context : Contexts)
+	{
+		context->Binder.Release();
+		context->ConstantSlots.Release();
+		if(context->DeferredContext)
+			context->DeferredContext->Release();
+	}
+
+	Contexts.clear();
+	FreeContexts.clear();
+}
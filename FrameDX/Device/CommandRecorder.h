@@ -0,0 +1,104 @@
+#pragma once
+#include "stdafx.h"
+#include "../Core/Core.h"
+#include "../Core/PipelineState.h"
+#include "ContextBackend.h"
+#include "PipelineBinder.h"
+#include "UploadRing.h"
+
+namespace FrameDX
+{
+	class Device;
+
+	// A context that one thread records on. It has its own binder, so redundant state is filtered per context
+	class RecordingContext
+	{
+	public:
+		ContextBackend* GetBackend() { return Backend.get(); }
+
+		// Same as Device::BindPipelineState, but on this context
+		void BindPipelineState(const PipelineState& NewState) { Binder.Bind(NewState); }
+		void BindPipelineState(const BakedPipelineState& NewState) { Binder.Bind(NewState); }
+
+		void Draw(UINT VertexCount, UINT StartVertex) { Backend->Draw(VertexCount, StartVertex); Binder.GetStats().Draws++; }
+		void DrawIndexed(UINT IndexCount, UINT StartIndex, INT BaseVertex) { Backend->DrawIndexed(IndexCount, StartIndex, BaseVertex); Binder.GetStats().Draws++; }
+		void Dispatch(UINT GroupsX, UINT GroupsY, UINT GroupsZ) { Backend->Dispatch(GroupsX, GroupsY, GroupsZ); Binder.GetStats().Dispatches++; }
+
+		void ClearRenderTargetView(ID3D11RenderTargetView* RTV, const FLOAT Color[4]) { Backend->ClearRenderTargetView(RTV, Color); }
+		void ClearDepthStencilView(ID3D11DepthStencilView* DSV, UINT Flags, FLOAT Depth, UINT8 Stencil) { Backend->ClearDepthStencilView(DSV, Flags, Depth, Stencil); }
+
+		// Maps the provided buffer and copies the value. Deferred contexts only allow WRITE_DISCARD maps on dynamic resources
+		template<typename T>
+		StatusCode UpdateBuffer(ID3D11Buffer* Buffer, const T& Value) { Binder.GetStats().Maps++; return Backend->UpdateBuffer(Buffer, &Value, sizeof(T)); }
+
+		// Same as Device::BindConstants, but the upload ring is only used on the immediate context,
+		// so here each slot has its own buffer that is mapped on every call
+		template<typename T>
+		StatusCode BindConstants(ShaderStage Stage, UINT Slot, const T& Value)
+		{
+			static_assert(sizeof(T) % 16 == 0, "T needs to be 16-bytes aligned");
+			return ConstantSlots.Bind(Binder, Stage, Slot, &Value, sizeof(T));
+		}
+
+		// Calls sent on this context since the counters were last collected
+		const SubmissionStats& GetStats() { return Binder.GetStats(); }
+	private:
+		friend class CommandRecorder;
+		friend class RenderQueue;
+
+		unique_ptr<ContextBackend> Backend;
+		// Only set for deferred backends
+		ID3D11DeviceContext* DeferredContext = nullptr;
+		PipelineBinder Binder;
+		ConstantSlotBuffers ConstantSlots;
+	};
+
+	// Records passes in parallel on the job system, one command list per pass, and executes them on the immediate context
+	// in submission order. The contexts are pooled, so a worker takes any free one when it starts a pass
+	class CommandRecorder
+	{
+	public:
+		enum class BackendType
+		{
+			// D3D11 deferred contexts
+			Deferred,
+			// RecordingContextBackend, doesn't need a GPU. Its lists can only be executed on the immediate context
+			// if the device was created, otherwise they can be executed on any other backend
+			Recording
+		};
+
+		CommandRecorder() : Owner(nullptr), Type(BackendType::Deferred) {}
+
+		// If ContextCount is 0 it creates one per job system worker plus one for the calling thread
+		// More contexts are created on demand if there are more concurrent passes than contexts
+		StatusCode Create(Device* OwnerDevice, size_t ContextCount = 0, BackendType Backend = BackendType::Deferred);
+
+		// Calls Record(Context, PassIndex) for each pass on the job system, and stores the command list of pass i on Lists[i]
+		// A pass always starts with the default state, so it must bind everything it uses
+		StatusCode Record(size_t PassCount, const function<void(RecordingContext&, size_t)>& Record, vector<unique_ptr<CommandList>>& Lists);
+
+		// Records the passes and executes them on the immediate context of the owner device, in order
+		// The calls recorded are added to the submission stats of the device
+		StatusCode RecordAndExecute(size_t PassCount, const function<void(RecordingContext&, size_t)>& Record);
+
+		size_t GetContextCount() { lock_guard<mutex> lock(PoolMutex); return Contexts.size(); }
+
+		// Calls sent by all the passes of the last Record
+		const SubmissionStats& GetLastStats() const { return LastStats; }
+
+		void Release();
+	private:
+		StatusCode create_context_(unique_ptr<RecordingContext>& Out);
+		RecordingContext* acquire_context_();
+		void return_context_(RecordingContext* Context);
+
+		Device* Owner;
+		BackendType Type;
+
+		mutex PoolMutex;
+		vector<unique_ptr<RecordingContext>> Contexts;
+		vector<RecordingContext*> FreeContexts;
+
+		SubmissionStats LastStats;
+	};
+}
@@ -0,0 +1,693 @@
+#include "stdafx.h"
+#include "CommandTrace.h"
+#include "../Core/Log.h"
+
+using namespace FrameDX;
+
+namespace
+{
+	// "FDXT", then the version
+	constexpr uint32_t TraceMagic = 0x54584446;
+	// Version 2 added SetConstantBuffers1 and UpdateBufferRange, version 3 added CopyResource and version 4 UncapturedCommandList
+	// The rest didn't change, so older traces still load
+	constexpr uint32_t TraceVersion = 4;
+
+	// The calls are packed without padding: the op, then its arguments
+	// New ops go at the end, to keep the values of the older ones
+	enum class trace_op_ : uint8_t
+	{
+		IASetIndexBuffer, IASetVertexBuffers, IASetInputLayout, IASetPrimitiveTopology,
+		RSSetViewports, RSSetState,
+		OMSetDepthStencilState, OMSetBlendState, OMSetRenderTargets, OMSetRenderTargetsAndUnorderedAccessViews, CSSetUnorderedAccessViews,
+		SetShader, SetShaderResources, SetConstantBuffers, SetSamplers,
+		ClearRenderTargetView, ClearDepthStencilView,
+		Draw, DrawIndexed, Dispatch,
+		UpdateBuffer,
+		Present,
+		SetConstantBuffers1, UpdateBufferRange,
+		CopyResource,
+		// A D3D11 command list was executed here, its calls are not on the trace
+		UncapturedCommandList
+	};
+
+	// Largest array of any call, the shader resource slots
+	constexpr UINT MaxArrayCount = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+}
+
+StatusCode CaptureContextBackend::Open(const string& Path, ContextBackend* InnerBackend)
+{
+	Close();
+
+	File.open(Path, ios::binary | ios::trunc);
+	LogAssertWithReturn(File.is_open(), LogCategory::Error, StatusCode::AccessDenied);
+
+	Inner = InnerBackend;
+	FrameCount = 0;
+	UncapturedLists = 0;
+	Ids.clear();
+	Stream.clear();
+
+	write_(TraceMagic);
+	write_(TraceVersion);
+	return StatusCode::Ok;
+}
+
+void CaptureContextBackend::EndFrame(UINT SyncInterval, UINT Flags)
+{
+	write_(trace_op_::Present);
+	write_(SyncInterval);
+	write_(Flags);
+	FrameCount++;
+
+	File.write((const char*)Stream.data(), Stream.size());
+	Stream.clear();
+}
+
+void CaptureContextBackend::Close()
+{
+	if(!File.is_open())
+		return;
+
+	// The calls after the last frame are kept, so the trace ends where the capture did
+	File.write((const char*)Stream.data(), Stream.size());
+	Stream.clear();
+	File.close();
+}
+
+void CaptureContextBackend::write_id_(const void* Object)
+{
+	if(!Object)
+	{
+		write_<uint32_t>(0);
+		return;
+	}
+
+	auto result = Ids.emplace(Object, (uint32_t)Ids.size() + 1);
+	write_(result.first->second);
+}
+
+void CaptureContextBackend::IASetIndexBuffer(ID3D11Buffer* Buffer, DXGI_FORMAT Format, UINT Offset)
+{
+	write_(trace_op_::IASetIndexBuffer);
+	write_id_(Buffer);
+	write_(Format);
+	write_(Offset);
+	Inner->IASetIndexBuffer(Buffer, Format, Offset);
+}
+
+void CaptureContextBackend::IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* Strides, const UINT* Offsets)
+{
+	write_(trace_op_::IASetVertexBuffers);
+	write_(StartSlot);
+	write_ids_(Buffers, Count);
+	write_array_(Strides, Count);
+	write_array_(Offsets, Count);
+	Inner->IASetVertexBuffers(StartSlot, Count, Buffers, Strides, Offsets);
+}
+
+void CaptureContextBackend::IASetInputLayout(ID3D11InputLayout* Layout)
+{
+	write_(trace_op_::IASetInputLayout);
+	write_id_(Layout);
+	Inner->IASetInputLayout(Layout);
+}
+
+void CaptureContextBackend::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology)
+{
+	write_(trace_op_::IASetPrimitiveTopology);
+	write_(Topology);
+	Inner->IASetPrimitiveTopology(Topology);
+}
+
+void CaptureContextBackend::RSSetViewports(UINT Count, const D3D11_VIEWPORT* Viewports)
+{
+	write_(trace_op_::RSSetViewports);
+	write_array_(Viewports, Count);
+	Inner->RSSetViewports(Count, Viewports);
+}
+
+void CaptureContextBackend::RSSetState(ID3D11RasterizerState* State)
+{
+	write_(trace_op_::RSSetState);
+	write_id_(State);
+	Inner->RSSetState(State);
+}
+
+void CaptureContextBackend::OMSetDepthStencilState(ID3D11DepthStencilState* State, UINT StencilRef)
+{
+	write_(trace_op_::OMSetDepthStencilState);
+	write_id_(State);
+	write_(StencilRef);
+	Inner->OMSetDepthStencilState(State, StencilRef);
+}
+
+void CaptureContextBackend::OMSetBlendState(ID3D11BlendState* State, const FLOAT BlendFactors[4], UINT SampleMask)
+{
+	write_(trace_op_::OMSetBlendState);
+	write_id_(State);
+	write_array_(BlendFactors, BlendFactors ? 4 : 0);
+	write_(SampleMask);
+	Inner->OMSetBlendState(State, BlendFactors, SampleMask);
+}
+
+void CaptureContextBackend::OMSetRenderTargets(UINT Count, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV)
+{
+	write_(trace_op_::OMSetRenderTargets);
+	write_ids_(RTVs, Count);
+	write_id_(DSV);
+	Inner->OMSetRenderTargets(Count, RTVs, DSV);
+}
+
+void CaptureContextBackend::OMSetRenderTargetsAndUnorderedAccessViews(UINT RTVCount, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV,
+																	  UINT UAVStart, UINT UAVCount, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts)
+{
+	write_(trace_op_::OMSetRenderTargetsAndUnorderedAccessViews);
+	// RTVCount can be D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL, and then there's no array
+	write_(RTVCount);
+	write_ids_(RTVs, RTVs ? RTVCount : 0);
+	write_id_(DSV);
+	write_(UAVStart);
+	write_ids_(UAVs, UAVCount);
+	write_array_(InitialCounts, InitialCounts ? UAVCount : 0);
+	Inner->OMSetRenderTargetsAndUnorderedAccessViews(RTVCount, RTVs, DSV, UAVStart, UAVCount, UAVs, InitialCounts);
+}
+
+void CaptureContextBackend::CSSetUnorderedAccessViews(UINT StartSlot, UINT Count, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts)
+{
+	write_(trace_op_::CSSetUnorderedAccessViews);
+	write_(StartSlot);
+	write_ids_(UAVs, Count);
+	write_array_(InitialCounts, InitialCounts ? Count : 0);
+	Inner->CSSetUnorderedAccessViews(StartSlot, Count, UAVs, InitialCounts);
+}
+
+void CaptureContextBackend::SetShader(ShaderStage Stage, void* ShaderPointer)
+{
+	write_(trace_op_::SetShader);
+	write_(Stage);
+	write_id_(ShaderPointer);
+	Inner->SetShader(Stage, ShaderPointer);
+}
+
+void CaptureContextBackend::SetShaderResources(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* SRVs)
+{
+	write_(trace_op_::SetShaderResources);
+	write_(Stage);
+	write_(StartSlot);
+	write_ids_(SRVs, Count);
+	Inner->SetShaderResources(Stage, StartSlot, Count, SRVs);
+}
+
+void CaptureContextBackend::SetConstantBuffers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers)
+{
+	write_(trace_op_::SetConstantBuffers);
+	write_(Stage);
+	write_(StartSlot);
+	write_ids_(Buffers, Count);
+	Inner->SetConstantBuffers(Stage, StartSlot, Count, Buffers);
+}
+
+void CaptureContextBackend::SetConstantBuffers1(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* FirstConstants, const UINT* NumConstants)
+{
+	write_(trace_op_::SetConstantBuffers1);
+	write_(Stage);
+	write_(StartSlot);
+	write_ids_(Buffers, Count);
+	write_array_(FirstConstants, Count);
+	write_array_(NumConstants, Count);
+	Inner->SetConstantBuffers1(Stage, StartSlot, Count, Buffers, FirstConstants, NumConstants);
+}
+
+void CaptureContextBackend::SetSamplers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11SamplerState* const* Samplers)
+{
+	write_(trace_op_::SetSamplers);
+	write_(Stage);
+	write_(StartSlot);
+	write_ids_(Samplers, Count);
+	Inner->SetSamplers(Stage, StartSlot, Count, Samplers);
+}
+
+void CaptureContextBackend::ClearRenderTargetView(ID3D11RenderTargetView* RTV, const FLOAT Color[4])
+{
+	write_(trace_op_::ClearRenderTargetView);
+	write_id_(RTV);
+	write_array_(Color, 4);
+	Inner->ClearRenderTargetView(RTV, Color);
+}
+
+void CaptureContextBackend::ClearDepthStencilView(ID3D11DepthStencilView* DSV, UINT Flags, FLOAT Depth, UINT8 Stencil)
+{
+	write_(trace_op_::ClearDepthStencilView);
+	write_id_(DSV);
+	write_(Flags);
+	write_(Depth);
+	write_(Stencil);
+	Inner->ClearDepthStencilView(DSV, Flags, Depth, Stencil);
+}
+
+void CaptureContextBackend::CopyResource(ID3D11Resource* Dest, ID3D11Resource* Source)
+{
+	write_(trace_op_::CopyResource);
+	write_id_(Dest);
+	write_id_(Source);
+	Inner->CopyResource(Dest, Source);
+}
+
+void CaptureContextBackend::Draw(UINT VertexCount, UINT StartVertex)
+{
+	write_(trace_op_::Draw);
+	write_(VertexCount);
+	write_(StartVertex);
+	Inner->Draw(VertexCount, StartVertex);
+}
+
+void CaptureContextBackend::DrawIndexed(UINT IndexCount, UINT StartIndex, INT BaseVertex)
+{
+	write_(trace_op_::DrawIndexed);
+	write_(IndexCount);
+	write_(StartIndex);
+	write_(BaseVertex);
+	Inner->DrawIndexed(IndexCount, StartIndex, BaseVertex);
+}
+
+void CaptureContextBackend::Dispatch(UINT GroupsX, UINT GroupsY, UINT GroupsZ)
+{
+	write_(trace_op_::Dispatch);
+	write_(GroupsX);
+	write_(GroupsY);
+	write_(GroupsZ);
+	Inner->Dispatch(GroupsX, GroupsY, GroupsZ);
+}
+
+void CaptureContextBackend::ExecuteCommandList(ID3D11CommandList* List)
+{
+	// Only warn once per capture, the same passes usually run every frame
+	if(UncapturedLists++ == 0)
+		LogMsg(L"A D3D11 command list was executed during a capture, its calls are missing from the trace. Record with BackendType::Recording to capture them", LogCategory::Warning);
+
+	write_(trace_op_::UncapturedCommandList);
+	Inner->ExecuteCommandList(List);
+}
+
+StatusCode CaptureContextBackend::UpdateBuffer(ID3D11Buffer* Buffer, const void* Data, size_t Size)
+{
+	write_(trace_op_::UpdateBuffer);
+	write_id_(Buffer);
+	write_array_((const uint8_t*)Data, (UINT)Size);
+	return Inner->UpdateBuffer(Buffer, Data, Size);
+}
+
+StatusCode CaptureContextBackend::UpdateBufferRange(ID3D11Buffer* Buffer, size_t Offset, const void* Data, size_t Size, bool Discard)
+{
+	write_(trace_op_::UpdateBufferRange);
+	write_id_(Buffer);
+	write_((uint64_t)Offset);
+	write_(Discard);
+	write_array_((const uint8_t*)Data, (UINT)Size);
+	return Inner->UpdateBufferRange(Buffer, Offset, Data, Size, Discard);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Reads the values of a trace. Reading past the end, or an array larger than any call takes, flags it as failed
+// and returns zeros from then on
+class TraceReplayer::reader_
+{
+public:
+	reader_(TraceReplayer& Owner) : Owner(Owner), Data(Owner.Trace.data()), Size(Owner.Trace.size()), Offset(0), Failed(false) {}
+
+	bool done() const { return Offset >= Size; }
+	bool failed() const { return Failed; }
+
+	template<typename T>
+	T read()
+	{
+		T value{};
+		if(Failed || Offset + sizeof(T) > Size)
+		{
+			Failed = true;
+			return value;
+		}
+
+		memcpy(&value, Data + Offset, sizeof(T));
+		Offset += sizeof(T);
+		return value;
+	}
+
+	// Copies the values to Out, as there's no padding to align them inside the trace. Returns null if the array was null
+	template<typename T, size_t N>
+	const T* read_array(UINT& Count, T (&Out)[N])
+	{
+		Count = read<UINT>();
+		bool valid = read<uint8_t>() != 0;
+		if(!valid || Failed)
+			return nullptr;
+		if(Count > N || Offset + sizeof(T) * Count > Size)
+		{
+			Failed = true;
+			Count = 0;
+			return nullptr;
+		}
+
+		memcpy(Out, Data + Offset, sizeof(T) * Count);
+		Offset += sizeof(T) * Count;
+		return Out;
+	}
+
+	// Bytes don't need alignment, so they are passed from the trace
+	const uint8_t* read_bytes(UINT& Count)
+	{
+		Count = read<UINT>();
+		bool valid = read<uint8_t>() != 0;
+		if(!valid || Failed)
+			return nullptr;
+		if(Offset + Count > Size)
+		{
+			Failed = true;
+			Count = 0;
+			return nullptr;
+		}
+
+		auto bytes = Data + Offset;
+		Offset += Count;
+		return bytes;
+	}
+
+	// Resolves an array of ids into Out. Returns null if the array was null
+	template<typename T>
+	T* const* read_objects(TraceObject Type, UINT& Count, T* (&Out)[MaxArrayCount])
+	{
+		Count = read<UINT>();
+		bool valid = read<uint8_t>() != 0;
+		if(!valid || Failed)
+			return nullptr;
+		if(Count > MaxArrayCount)
+		{
+			Failed = true;
+			Count = 0;
+			return nullptr;
+		}
+
+		for(UINT i = 0; i < Count; i++)
+			Out[i] = (T*)Owner.resolve_(Type, read<uint32_t>());
+		return Out;
+	}
+
+	template<typename T>
+	T* read_object(TraceObject Type) { return (T*)Owner.resolve_(Type, read<uint32_t>()); }
+
+	// The arrays of a call that go together are written with the same count, so a different one means the trace is corrupted
+	void check_count(const void* Array, UINT Count, UINT Expected)
+	{
+		if(Array && Count != Expected)
+			Failed = true;
+	}
+private:
+	TraceReplayer& Owner;
+	const uint8_t* Data;
+	size_t Size;
+	size_t Offset;
+	bool Failed;
+};
+
+StatusCode TraceReplayer::Load(const string& Path)
+{
+	ifstream file(Path, ios::binary | ios::ate);
+	LogAssertWithReturn(file.is_open(), LogCategory::Error, StatusCode::FileNotFound);
+
+	vector<uint8_t> data((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)data.data(), data.size());
+	LogAssertWithReturn(file.good(), LogCategory::Error, StatusCode::Failed);
+
+	return Load(move(data));
+}
+
+StatusCode TraceReplayer::Load(vector<uint8_t>&& Data)
+{
+	uint32_t header[2] = {};
+	LogAssertWithReturn(Data.size() >= sizeof(header), LogCategory::Error, StatusCode::InvalidArgument);
+	memcpy(header, Data.data(), sizeof(header));
+	LogAssertWithReturn(header[0] == TraceMagic && header[1] >= 1 && header[1] <= TraceVersion, LogCategory::Error, StatusCode::InvalidArgument);
+
+	Trace.assign(Data.begin() + sizeof(header), Data.end());
+	Objects.clear();
+	FrameCount = 0;
+	return StatusCode::Ok;
+}
+
+void* TraceReplayer::resolve_(TraceObject Type, uint32_t Id)
+{
+	if(Id == 0)
+		return nullptr;
+
+	if(Id >= Objects.size())
+		Objects.resize(Id + 1, nullptr);
+
+	void*& object = Objects[Id];
+	if(!object)
+		object = ObjectResolver ? ObjectResolver(Type, Id) : (void*)(uintptr_t)(Id * 16);
+	return object;
+}
+
+StatusCode TraceReplayer::Replay(ContextBackend& Target, const function<void(size_t)>& OnFrame)
+{
+	reader_ reader(*this);
+	FrameCount = 0;
+	UncapturedLists = 0;
+
+	ID3D11Buffer* buffers[MaxArrayCount];
+	ID3D11ShaderResourceView* srvs[MaxArrayCount];
+	ID3D11SamplerState* samplers[MaxArrayCount];
+	ID3D11RenderTargetView* rtvs[MaxArrayCount];
+	ID3D11UnorderedAccessView* uavs[MaxArrayCount];
+	UINT uints[MaxArrayCount], other_uints[MaxArrayCount];
+	D3D11_VIEWPORT viewports[MaxArrayCount];
+	FLOAT floats[4];
+
+	// Each case reads all the arguments, and only makes the call if they were all there
+	while(!reader.done() && !reader.failed())
+	{
+		UINT count, other_count;
+		switch(reader.read<trace_op_>())
+		{
+		case trace_op_::IASetIndexBuffer:
+		{
+			auto buffer = reader.read_object<ID3D11Buffer>(TraceObject::Buffer);
+			auto format = reader.read<DXGI_FORMAT>();
+			auto offset = reader.read<UINT>();
+			if(!reader.failed()) Target.IASetIndexBuffer(buffer, format, offset);
+			break;
+		}
+		case trace_op_::IASetVertexBuffers:
+		{
+			auto start = reader.read<UINT>();
+			auto vbs = reader.read_objects(TraceObject::Buffer, count, buffers);
+			auto strides = reader.read_array(other_count, uints);
+			reader.check_count(strides, other_count, count);
+			auto offsets = reader.read_array(other_count, other_uints);
+			reader.check_count(offsets, other_count, count);
+			if(!reader.failed()) Target.IASetVertexBuffers(start, count, vbs, strides, offsets);
+			break;
+		}
+		case trace_op_::IASetInputLayout:
+		{
+			auto layout = reader.read_object<ID3D11InputLayout>(TraceObject::InputLayout);
+			if(!reader.failed()) Target.IASetInputLayout(layout);
+			break;
+		}
+		case trace_op_::IASetPrimitiveTopology:
+		{
+			auto topology = reader.read<D3D11_PRIMITIVE_TOPOLOGY>();
+			if(!reader.failed()) Target.IASetPrimitiveTopology(topology);
+			break;
+		}
+		case trace_op_::RSSetViewports:
+		{
+			auto values = reader.read_array(count, viewports);
+			if(!reader.failed()) Target.RSSetViewports(count, values);
+			break;
+		}
+		case trace_op_::RSSetState:
+		{
+			auto state = reader.read_object<ID3D11RasterizerState>(TraceObject::RasterizerState);
+			if(!reader.failed()) Target.RSSetState(state);
+			break;
+		}
+		case trace_op_::OMSetDepthStencilState:
+		{
+			auto state = reader.read_object<ID3D11DepthStencilState>(TraceObject::DepthStencilState);
+			auto stencil_ref = reader.read<UINT>();
+			if(!reader.failed()) Target.OMSetDepthStencilState(state, stencil_ref);
+			break;
+		}
+		case trace_op_::OMSetBlendState:
+		{
+			auto state = reader.read_object<ID3D11BlendState>(TraceObject::BlendState);
+			auto factors = reader.read_array(count, floats);
+			reader.check_count(factors, count, 4);
+			auto sample_mask = reader.read<UINT>();
+			if(!reader.failed()) Target.OMSetBlendState(state, factors, sample_mask);
+			break;
+		}
+		case trace_op_::OMSetRenderTargets:
+		{
+			auto targets = reader.read_objects(TraceObject::RenderTargetView, count, rtvs);
+			auto dsv = reader.read_object<ID3D11DepthStencilView>(TraceObject::DepthStencilView);
+			if(!reader.failed()) Target.OMSetRenderTargets(count, targets, dsv);
+			break;
+		}
+		case trace_op_::OMSetRenderTargetsAndUnorderedAccessViews:
+		{
+			auto rtv_count = reader.read<UINT>();
+			auto targets = reader.read_objects(TraceObject::RenderTargetView, count, rtvs);
+			reader.check_count(targets, count, rtv_count);
+			auto dsv = reader.read_object<ID3D11DepthStencilView>(TraceObject::DepthStencilView);
+			auto uav_start = reader.read<UINT>();
+			auto views = reader.read_objects(TraceObject::UnorderedAccessView, count, uavs);
+			auto initial_counts = reader.read_array(other_count, uints);
+			reader.check_count(initial_counts, other_count, count);
+			if(!reader.failed()) Target.OMSetRenderTargetsAndUnorderedAccessViews(rtv_count, targets, dsv, uav_start, count, views, initial_counts);
+			break;
+		}
+		case trace_op_::CSSetUnorderedAccessViews:
+		{
+			auto start = reader.read<UINT>();
+			auto views = reader.read_objects(TraceObject::UnorderedAccessView, count, uavs);
+			auto initial_counts = reader.read_array(other_count, uints);
+			reader.check_count(initial_counts, other_count, count);
+			if(!reader.failed()) Target.CSSetUnorderedAccessViews(start, count, views, initial_counts);
+			break;
+		}
+		case trace_op_::SetShader:
+		{
+			auto stage = reader.read<ShaderStage>();
+			auto shader = reader.read_object<void>(TraceObject::Shader);
+			if(!reader.failed()) Target.SetShader(stage, shader);
+			break;
+		}
+		case trace_op_::SetShaderResources:
+		{
+			auto stage = reader.read<ShaderStage>();
+			auto start = reader.read<UINT>();
+			auto views = reader.read_objects(TraceObject::ShaderResourceView, count, srvs);
+			if(!reader.failed()) Target.SetShaderResources(stage, start, count, views);
+			break;
+		}
+		case trace_op_::SetConstantBuffers:
+		{
+			auto stage = reader.read<ShaderStage>();
+			auto start = reader.read<UINT>();
+			auto cbs = reader.read_objects(TraceObject::Buffer, count, buffers);
+			if(!reader.failed()) Target.SetConstantBuffers(stage, start, count, cbs);
+			break;
+		}
+		case trace_op_::SetConstantBuffers1:
+		{
+			auto stage = reader.read<ShaderStage>();
+			auto start = reader.read<UINT>();
+			auto cbs = reader.read_objects(TraceObject::Buffer, count, buffers);
+			auto first = reader.read_array(other_count, uints);
+			reader.check_count(first, other_count, count);
+			auto num = reader.read_array(other_count, other_uints);
+			reader.check_count(num, other_count, count);
+			if(!reader.failed()) Target.SetConstantBuffers1(stage, start, count, cbs, first, num);
+			break;
+		}
+		case trace_op_::SetSamplers:
+		{
+			auto stage = reader.read<ShaderStage>();
+			auto start = reader.read<UINT>();
+			auto states = reader.read_objects(TraceObject::SamplerState, count, samplers);
+			if(!reader.failed()) Target.SetSamplers(stage, start, count, states);
+			break;
+		}
+		case trace_op_::ClearRenderTargetView:
+		{
+			auto rtv = reader.read_object<ID3D11RenderTargetView>(TraceObject::RenderTargetView);
+			auto color = reader.read_array(count, floats);
+			reader.check_count(color, count, 4);
+			if(!reader.failed() && color) Target.ClearRenderTargetView(rtv, color);
+			break;
+		}
+		case trace_op_::ClearDepthStencilView:
+		{
+			auto dsv = reader.read_object<ID3D11DepthStencilView>(TraceObject::DepthStencilView);
+			auto flags = reader.read<UINT>();
+			auto depth = reader.read<FLOAT>();
+			auto stencil = reader.read<UINT8>();
+			if(!reader.failed()) Target.ClearDepthStencilView(dsv, flags, depth, stencil);
+			break;
+		}
+		case trace_op_::CopyResource:
+		{
+			auto dest = reader.read_object<ID3D11Resource>(TraceObject::Resource);
+			auto source = reader.read_object<ID3D11Resource>(TraceObject::Resource);
+			if(!reader.failed()) Target.CopyResource(dest, source);
+			break;
+		}
+		case trace_op_::Draw:
+		{
+			auto vertex_count = reader.read<UINT>();
+			auto start = reader.read<UINT>();
+			if(!reader.failed()) Target.Draw(vertex_count, start);
+			break;
+		}
+		case trace_op_::DrawIndexed:
+		{
+			auto index_count = reader.read<UINT>();
+			auto start = reader.read<UINT>();
+			auto base_vertex = reader.read<INT>();
+			if(!reader.failed()) Target.DrawIndexed(index_count, start, base_vertex);
+			break;
+		}
+		case trace_op_::Dispatch:
+		{
+			auto x = reader.read<UINT>();
+			auto y = reader.read<UINT>();
+			auto z = reader.read<UINT>();
+			if(!reader.failed()) Target.Dispatch(x, y, z);
+			break;
+		}
+		case trace_op_::UpdateBuffer:
+		{
+			auto buffer = reader.read_object<ID3D11Buffer>(TraceObject::Buffer);
+			auto data = reader.read_bytes(count);
+			if(!reader.failed()) Target.UpdateBuffer(buffer, data, count);
+			break;
+		}
+		case trace_op_::UpdateBufferRange:
+		{
+			auto buffer = reader.read_object<ID3D11Buffer>(TraceObject::Buffer);
+			auto offset = reader.read<uint64_t>();
+			auto discard = reader.read<bool>();
+			auto data = reader.read_bytes(count);
+			if(!reader.failed()) Target.UpdateBufferRange(buffer, (size_t)offset, data, count, discard);
+			break;
+		}
+		case trace_op_::Present:
+		{
+			reader.read<UINT>();
+			reader.read<UINT>();
+			if(!reader.failed())
+			{
+				if(OnFrame) OnFrame(FrameCount);
+				FrameCount++;
+			}
+			break;
+		}
+		case trace_op_::UncapturedCommandList:
+		{
+			if(UncapturedLists++ == 0)
+				LogMsg(L"The trace has D3D11 command lists that weren't captured, the replay is missing their calls", LogCategory::Warning);
+			break;
+		}
+		default:
+			LogMsg(L"Unknown op on trace", LogCategory::Error);
+			return StatusCode::InvalidArgument;
+		}
+	}
+
+	LogAssertWithReturn(!reader.failed(), LogCategory::Error, StatusCode::InvalidArgument);
+	return StatusCode::Ok;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include "stdafx.h"
+#include "../Core/Core.h"
+#include "ContextBackend.h"
+
+namespace FrameDX
+{
+	// Types of the objects referenced by a trace
+	enum class TraceObject : uint8_t
+	{
+		Buffer, InputLayout, RasterizerState, DepthStencilState, BlendState, SamplerState,
+		RenderTargetView, DepthStencilView, UnorderedAccessView, ShaderResourceView, Shader,
+		// Textures, or buffers used as a whole resource
+		Resource
+	};
+
+	// Forwards everything to another backend, and writes each call to a binary trace file
+	// Objects are written as ids instead of pointers, numbered in the order they are first used, so the trace doesn't depend on
+	// the process that captured it. Buffer updates are written with their contents
+	// The calls are kept on memory and written to the file at the end of each frame
+	class CaptureContextBackend : public ContextBackend
+	{
+	public:
+		CaptureContextBackend() : Inner(nullptr), FrameCount(0), UncapturedLists(0) {}
+		~CaptureContextBackend() { Close(); }
+
+		// Narrow path, so the traces can be used outside of Windows
+		StatusCode Open(const string& Path, ContextBackend* InnerBackend);
+		// Writes the frame marker and everything captured since the last one
+		void EndFrame(UINT SyncInterval, UINT Flags);
+		void Close();
+
+		bool IsOpen() const { return File.is_open(); }
+		ContextBackend* GetInner() { return Inner; }
+		size_t GetFrameCount() const { return FrameCount; }
+		// D3D11 command lists executed during the capture, whose calls are missing from the trace
+		size_t GetUncapturedListCount() const { return UncapturedLists; }
+
+		virtual void IASetIndexBuffer(ID3D11Buffer* Buffer, DXGI_FORMAT Format, UINT Offset) override;
+		virtual void IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* Strides, const UINT* Offsets) override;
+		virtual void IASetInputLayout(ID3D11InputLayout* Layout) override;
+		virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology) override;
+
+		virtual void RSSetViewports(UINT Count, const D3D11_VIEWPORT* Viewports) override;
+		virtual void RSSetState(ID3D11RasterizerState* State) override;
+
+		virtual void OMSetDepthStencilState(ID3D11DepthStencilState* State, UINT StencilRef) override;
+		virtual void OMSetBlendState(ID3D11BlendState* State, const FLOAT BlendFactors[4], UINT SampleMask) override;
+		virtual void OMSetRenderTargets(UINT Count, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV) override;
+		virtual void OMSetRenderTargetsAndUnorderedAccessViews(UINT RTVCount, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV,
+															   UINT UAVStart, UINT UAVCount, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts) override;
+		virtual void CSSetUnorderedAccessViews(UINT StartSlot, UINT Count, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts) override;
+
+		virtual void SetShader(ShaderStage Stage, void* ShaderPointer) override;
+		virtual void SetShaderResources(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* SRVs) override;
+		virtual void SetConstantBuffers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers) override;
+		virtual void SetConstantBuffers1(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* FirstConstants, const UINT* NumConstants) override;
+		virtual void SetSamplers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11SamplerState* const* Samplers) override;
+
+		virtual void ClearRenderTargetView(ID3D11RenderTargetView* RTV, const FLOAT Color[4]) override;
+		virtual void ClearDepthStencilView(ID3D11DepthStencilView* DSV, UINT Flags, FLOAT Depth, UINT8 Stencil) override;
+		virtual void CopyResource(ID3D11Resource* Dest, ID3D11Resource* Source) override;
+
+		virtual void Draw(UINT VertexCount, UINT StartVertex) override;
+		virtual void DrawIndexed(UINT IndexCount, UINT StartIndex, INT BaseVertex) override;
+		virtual void Dispatch(UINT GroupsX, UINT GroupsY, UINT GroupsZ) override;
+
+		virtual StatusCode UpdateBuffer(ID3D11Buffer* Buffer, const void* Data, size_t Size) override;
+		virtual StatusCode UpdateBufferRange(ID3D11Buffer* Buffer, size_t Offset, const void* Data, size_t Size, bool Discard) override;
+
+		// Not captured. Recorded command lists replay through this backend, so those are captured
+		virtual StatusCode FinishCommandList(unique_ptr<CommandList>& Out) override { return Inner->FinishCommandList(Out); }
+		// D3D11 command lists can't be captured, so they are forwarded and a marker is written in their place
+		// To capture the passes of a CommandRecorder create it with BackendType::Recording
+		virtual void ExecuteCommandList(ID3D11CommandList* List) override;
+	private:
+		template<typename T>
+		void write_(const T& Value)
+		{
+			auto bytes = (const uint8_t*)&Value;
+			Stream.insert(Stream.end(), bytes, bytes + sizeof(T));
+		}
+		void write_id_(const void* Object);
+		// Arrays are written with their count and whether they are null, as null arrays and arrays of nulls are not the same call
+		template<typename T>
+		void write_ids_(T* const* Objects, UINT Count)
+		{
+			write_(Count);
+			write_<uint8_t>(Objects != nullptr);
+			if(Objects)
+				for(UINT i = 0; i < Count; i++)
+					write_id_(Objects[i]);
+		}
+		template<typename T>
+		void write_array_(const T* Values, UINT Count)
+		{
+			write_(Count);
+			write_<uint8_t>(Values != nullptr);
+			if(Values)
+				Stream.insert(Stream.end(), (const uint8_t*)Values, (const uint8_t*)(Values + Count));
+		}
+
+		ContextBackend* Inner;
+		ofstream File;
+		vector<uint8_t> Stream;
+		unordered_map<const void*, uint32_t> Ids;
+		size_t FrameCount;
+		size_t UncapturedLists;
+	};
+
+	// Runs a trace written by CaptureContextBackend on any backend
+	// The objects are created by the resolver, from their type and id. By default each id gets a distinct fake pointer,
+	// which is only valid for backends that don't use the objects, like RecordingContextBackend
+	class TraceReplayer
+	{
+	public:
+		typedef function<void*(TraceObject Type, uint32_t Id)> Resolver;
+
+		StatusCode Load(const string& Path);
+		StatusCode Load(vector<uint8_t>&& Data);
+
+		void SetResolver(Resolver NewResolver) { ObjectResolver = move(NewResolver); Objects.clear(); }
+
+		// Sends all the calls to the target. OnFrame(FrameIndex) is called on each frame marker, where the capture presented
+		// Fails if the trace is truncated or corrupted, after replaying the calls before that point
+		StatusCode Replay(ContextBackend& Target, const function<void(size_t)>& OnFrame = {});
+
+		// Frames replayed by the last Replay
+		size_t GetFrameCount() const { return FrameCount; }
+		// Command lists the last Replay found that weren't captured. Their calls are missing, so the replay doesn't match the capture
+		size_t GetUncapturedListCount() const { return UncapturedLists; }
+	private:
+		class reader_;
+
+		void* resolve_(TraceObject Type, uint32_t Id);
+
+		vector<uint8_t> Trace;
+		size_t FrameCount = 0;
+		size_t UncapturedLists = 0;
+		Resolver ObjectResolver;
+		// Resolved objects, indexed by id
+		vector<void*> Objects;
+	};
+}
@@ -0,0 +1,525 @@
+#include "stdafx.h"
+#include "ContextBackend.h"
+#include "../Core/Log.h"
+
+using namespace FrameDX;
+
+namespace
+{
+	class d3d11_command_list_ : public CommandList
+	{
+	public:
+		explicit d3d11_command_list_(ID3D11CommandList* List) : List(List) {}
+		~d3d11_command_list_() { List->Release(); }
+
+		virtual void Execute(ContextBackend& Target) override { Target.ExecuteCommandList(List); }
+	private:
+		ID3D11CommandList* List;
+	};
+}
+
+void D3D11ContextBackend::SetContext(ID3D11DeviceContext* NewContext)
+{
+	Context = NewContext;
+	Context1 = nullptr;
+	if(Context && SUCCEEDED(Context->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&Context1)))
+		Context1->Release();
+	else
+		Context1 = nullptr;
+}
+
+void D3D11ContextBackend::SetShader(ShaderStage Stage, void* ShaderPointer)
+{
+	switch(Stage)
+	{
+	case ShaderStage::Vertex:   Context->VSSetShader((ID3D11VertexShader*)ShaderPointer, nullptr, 0);   break;
+	case ShaderStage::Hull:     Context->HSSetShader((ID3D11HullShader*)ShaderPointer, nullptr, 0);     break;
+	case ShaderStage::Domain:   Context->DSSetShader((ID3D11DomainShader*)ShaderPointer, nullptr, 0);   break;
+	case ShaderStage::Geometry: Context->GSSetShader((ID3D11GeometryShader*)ShaderPointer, nullptr, 0); break;
+	case ShaderStage::Pixel:    Context->PSSetShader((ID3D11PixelShader*)ShaderPointer, nullptr, 0);    break;
+	case ShaderStage::Compute:  Context->CSSetShader((ID3D11ComputeShader*)ShaderPointer, nullptr, 0);  break;
+	}
+}
+
+#define __STAGE_SWITCH(function, ...) switch(Stage) {\
+	case ShaderStage::Vertex:   Context->VS##function(__VA_ARGS__); break;\
+	case ShaderStage::Hull:     Context->HS##function(__VA_ARGS__); break;\
+	case ShaderStage::Domain:   Context->DS##function(__VA_ARGS__); break;\
+	case ShaderStage::Geometry: Context->GS##function(__VA_ARGS__); break;\
+	case ShaderStage::Pixel:    Context->PS##function(__VA_ARGS__); break;\
+	case ShaderStage::Compute:  Context->CS##function(__VA_ARGS__); break; }
+
+void D3D11ContextBackend::SetShaderResources(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* SRVs)
+{
+	__STAGE_SWITCH(SetShaderResources, StartSlot, Count, SRVs);
+}
+
+void D3D11ContextBackend::SetConstantBuffers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers)
+{
+	__STAGE_SWITCH(SetConstantBuffers, StartSlot, Count, Buffers);
+}
+
+void D3D11ContextBackend::SetConstantBuffers1(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* FirstConstants, const UINT* NumConstants)
+{
+	if(LogAssertAndContinue(Context1 != nullptr, LogCategory::Error))
+		return;
+
+	switch(Stage)
+	{
+	case ShaderStage::Vertex:   Context1->VSSetConstantBuffers1(StartSlot, Count, Buffers, FirstConstants, NumConstants); break;
+	case ShaderStage::Hull:     Context1->HSSetConstantBuffers1(StartSlot, Count, Buffers, FirstConstants, NumConstants); break;
+	case ShaderStage::Domain:   Context1->DSSetConstantBuffers1(StartSlot, Count, Buffers, FirstConstants, NumConstants); break;
+	case ShaderStage::Geometry: Context1->GSSetConstantBuffers1(StartSlot, Count, Buffers, FirstConstants, NumConstants); break;
+	case ShaderStage::Pixel:    Context1->PSSetConstantBuffers1(StartSlot, Count, Buffers, FirstConstants, NumConstants); break;
+	case ShaderStage::Compute:  Context1->CSSetConstantBuffers1(StartSlot, Count, Buffers, FirstConstants, NumConstants); break;
+	}
+}
+
+void D3D11ContextBackend::SetSamplers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11SamplerState* const* Samplers)
+{
+	__STAGE_SWITCH(SetSamplers, StartSlot, Count, Samplers);
+}
+
+#undef __STAGE_SWITCH
+
+StatusCode D3D11ContextBackend::UpdateBuffer(ID3D11Buffer* Buffer, const void* Data, size_t Size)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	ZeroMemory(&mapped, sizeof(D3D11_MAPPED_SUBRESOURCE));
+	LogCheckWithReturn(Context->Map(Buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped), LogCategory::Error);
+
+	memcpy(mapped.pData, Data, Size);
+	Context->Unmap(Buffer, 0);
+
+	return StatusCode::Ok;
+}
+
+StatusCode D3D11ContextBackend::UpdateBufferRange(ID3D11Buffer* Buffer, size_t Offset, const void* Data, size_t Size, bool Discard)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	ZeroMemory(&mapped, sizeof(D3D11_MAPPED_SUBRESOURCE));
+	LogCheckWithReturn(Context->Map(Buffer, 0, Discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped), LogCategory::Error);
+
+	memcpy((uint8_t*)mapped.pData + Offset, Data, Size);
+	Context->Unmap(Buffer, 0);
+
+	return StatusCode::Ok;
+}
+
+StatusCode D3D11ContextBackend::FinishCommandList(unique_ptr<CommandList>& Out)
+{
+	ID3D11CommandList* list = nullptr;
+	LogCheckWithReturn(Context->FinishCommandList(FALSE, &list), LogCategory::Error);
+
+	Out = make_unique<d3d11_command_list_>(list);
+	return StatusCode::Ok;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+class RecordingContextBackend::recorded_list_ : public CommandList
+{
+public:
+	explicit recorded_list_(vector<uint8_t>&& Stream) : Stream(move(Stream)) {}
+
+	virtual void Execute(ContextBackend& Target) override
+	{
+		Offset = 0;
+		while(Offset < Stream.size())
+			replay_(Target, read_<op_>());
+	}
+private:
+	template<typename T>
+	T read_()
+	{
+		T value;
+		Offset = align_(Offset);
+		memcpy(&value, Stream.data() + Offset, sizeof(T));
+		Offset += sizeof(T);
+		return value;
+	}
+
+	// Points to the array inside the stream
+	template<typename T>
+	const T* read_array_(UINT& Count)
+	{
+		Count = read_<UINT>();
+		if(!read_<bool>())
+			return nullptr;
+
+		Offset = align_(Offset);
+		auto values = (const T*)(Stream.data() + Offset);
+		Offset += sizeof(T) * Count;
+		return values;
+	}
+
+	void replay_(ContextBackend& Target, op_ Op)
+	{
+		UINT count, other_count;
+		switch(Op)
+		{
+		case op_::IASetIndexBuffer:
+		{
+			auto buffer = read_<ID3D11Buffer*>();
+			auto format = read_<DXGI_FORMAT>();
+			Target.IASetIndexBuffer(buffer, format, read_<UINT>());
+			break;
+		}
+		case op_::IASetVertexBuffers:
+		{
+			auto start = read_<UINT>();
+			auto buffers = read_array_<ID3D11Buffer*>(count);
+			auto strides = read_array_<UINT>(count);
+			auto offsets = read_array_<UINT>(count);
+			Target.IASetVertexBuffers(start, count, buffers, strides, offsets);
+			break;
+		}
+		case op_::IASetInputLayout:
+			Target.IASetInputLayout(read_<ID3D11InputLayout*>());
+			break;
+		case op_::IASetPrimitiveTopology:
+			Target.IASetPrimitiveTopology(read_<D3D11_PRIMITIVE_TOPOLOGY>());
+			break;
+		case op_::RSSetViewports:
+		{
+			auto viewports = read_array_<D3D11_VIEWPORT>(count);
+			Target.RSSetViewports(count, viewports);
+			break;
+		}
+		case op_::RSSetState:
+			Target.RSSetState(read_<ID3D11RasterizerState*>());
+			break;
+		case op_::OMSetDepthStencilState:
+		{
+			auto state = read_<ID3D11DepthStencilState*>();
+			Target.OMSetDepthStencilState(state, read_<UINT>());
+			break;
+		}
+		case op_::OMSetBlendState:
+		{
+			auto state = read_<ID3D11BlendState*>();
+			auto factors = read_array_<FLOAT>(count);
+			Target.OMSetBlendState(state, factors, read_<UINT>());
+			break;
+		}
+		case op_::OMSetRenderTargets:
+		{
+			auto rtvs = read_array_<ID3D11RenderTargetView*>(count);
+			Target.OMSetRenderTargets(count, rtvs, read_<ID3D11DepthStencilView*>());
+			break;
+		}
+		case op_::OMSetRenderTargetsAndUnorderedAccessViews:
+		{
+			auto rtvs = read_array_<ID3D11RenderTargetView*>(count);
+			auto dsv = read_<ID3D11DepthStencilView*>();
+			auto uav_start = read_<UINT>();
+			auto uavs = read_array_<ID3D11UnorderedAccessView*>(other_count);
+			auto initial_counts = read_array_<UINT>(other_count);
+			Target.OMSetRenderTargetsAndUnorderedAccessViews(count, rtvs, dsv, uav_start, other_count, uavs, initial_counts);
+			break;
+		}
+		case op_::CSSetUnorderedAccessViews:
+		{
+			auto start = read_<UINT>();
+			auto uavs = read_array_<ID3D11UnorderedAccessView*>(count);
+			auto initial_counts = read_array_<UINT>(count);
+			Target.CSSetUnorderedAccessViews(start, count, uavs, initial_counts);
+			break;
+		}
+		case op_::SetShader:
+		{
+			auto stage = read_<ShaderStage>();
+			Target.SetShader(stage, read_<void*>());
+			break;
+		}
+		case op_::SetShaderResources:
+		{
+			auto stage = read_<ShaderStage>();
+			auto start = read_<UINT>();
+			auto srvs = read_array_<ID3D11ShaderResourceView*>(count);
+			Target.SetShaderResources(stage, start, count, srvs);
+			break;
+		}
+		case op_::SetConstantBuffers:
+		{
+			auto stage = read_<ShaderStage>();
+			auto start = read_<UINT>();
+			auto buffers = read_array_<ID3D11Buffer*>(count);
+			Target.SetConstantBuffers(stage, start, count, buffers);
+			break;
+		}
+		case op_::SetConstantBuffers1:
+		{
+			auto stage = read_<ShaderStage>();
+			auto start = read_<UINT>();
+			auto buffers = read_array_<ID3D11Buffer*>(count);
+			auto first = read_array_<UINT>(count);
+			auto num = read_array_<UINT>(count);
+			Target.SetConstantBuffers1(stage, start, count, buffers, first, num);
+			break;
+		}
+		case op_::SetSamplers:
+		{
+			auto stage = read_<ShaderStage>();
+			auto start = read_<UINT>();
+			auto samplers = read_array_<ID3D11SamplerState*>(count);
+			Target.SetSamplers(stage, start, count, samplers);
+			break;
+		}
+		case op_::ClearRenderTargetView:
+		{
+			auto rtv = read_<ID3D11RenderTargetView*>();
+			Target.ClearRenderTargetView(rtv, read_array_<FLOAT>(count));
+			break;
+		}
+		case op_::ClearDepthStencilView:
+		{
+			auto dsv = read_<ID3D11DepthStencilView*>();
+			auto flags = read_<UINT>();
+			auto depth = read_<FLOAT>();
+			Target.ClearDepthStencilView(dsv, flags, depth, read_<UINT8>());
+			break;
+		}
+		case op_::CopyResource:
+		{
+			auto dest = read_<ID3D11Resource*>();
+			Target.CopyResource(dest, read_<ID3D11Resource*>());
+			break;
+		}
+		case op_::Draw:
+		{
+			auto vertex_count = read_<UINT>();
+			Target.Draw(vertex_count, read_<UINT>());
+			break;
+		}
+		case op_::DrawIndexed:
+		{
+			auto index_count = read_<UINT>();
+			auto start = read_<UINT>();
+			Target.DrawIndexed(index_count, start, read_<INT>());
+			break;
+		}
+		case op_::Dispatch:
+		{
+			auto x = read_<UINT>();
+			auto y = read_<UINT>();
+			Target.Dispatch(x, y, read_<UINT>());
+			break;
+		}
+		case op_::UpdateBuffer:
+		{
+			auto buffer = read_<ID3D11Buffer*>();
+			auto data = read_array_<uint8_t>(count);
+			Target.UpdateBuffer(buffer, data, count);
+			break;
+		}
+		case op_::UpdateBufferRange:
+		{
+			auto buffer = read_<ID3D11Buffer*>();
+			auto offset = read_<size_t>();
+			auto discard = read_<bool>();
+			auto data = read_array_<uint8_t>(count);
+			Target.UpdateBufferRange(buffer, offset, data, count, discard);
+			break;
+		}
+		}
+	}
+
+	vector<uint8_t> Stream;
+	size_t Offset = 0;
+};
+
+void RecordingContextBackend::IASetIndexBuffer(ID3D11Buffer* Buffer, DXGI_FORMAT Format, UINT Offset)
+{
+	begin_(op_::IASetIndexBuffer);
+	write_(Buffer);
+	write_(Format);
+	write_(Offset);
+}
+
+void RecordingContextBackend::IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* Strides, const UINT* Offsets)
+{
+	begin_(op_::IASetVertexBuffers);
+	write_(StartSlot);
+	write_array_(Buffers, Count);
+	write_array_(Strides, Count);
+	write_array_(Offsets, Count);
+}
+
+void RecordingContextBackend::IASetInputLayout(ID3D11InputLayout* Layout)
+{
+	begin_(op_::IASetInputLayout);
+	write_(Layout);
+}
+
+void RecordingContextBackend::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology)
+{
+	begin_(op_::IASetPrimitiveTopology);
+	write_(Topology);
+}
+
+void RecordingContextBackend::RSSetViewports(UINT Count, const D3D11_VIEWPORT* Viewports)
+{
+	begin_(op_::RSSetViewports);
+	write_array_(Viewports, Count);
+}
+
+void RecordingContextBackend::RSSetState(ID3D11RasterizerState* State)
+{
+	begin_(op_::RSSetState);
+	write_(State);
+}
+
+void RecordingContextBackend::OMSetDepthStencilState(ID3D11DepthStencilState* State, UINT StencilRef)
+{
+	begin_(op_::OMSetDepthStencilState);
+	write_(State);
+	write_(StencilRef);
+}
+
+void RecordingContextBackend::OMSetBlendState(ID3D11BlendState* State, const FLOAT BlendFactors[4], UINT SampleMask)
+{
+	begin_(op_::OMSetBlendState);
+	write_(State);
+	write_array_(BlendFactors, 4);
+	write_(SampleMask);
+}
+
+void RecordingContextBackend::OMSetRenderTargets(UINT Count, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV)
+{
+	begin_(op_::OMSetRenderTargets);
+	write_array_(RTVs, Count);
+	write_(DSV);
+}
+
+void RecordingContextBackend::OMSetRenderTargetsAndUnorderedAccessViews(UINT RTVCount, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV,
+																		UINT UAVStart, UINT UAVCount, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts)
+{
+	begin_(op_::OMSetRenderTargetsAndUnorderedAccessViews);
+	write_array_(RTVs, RTVCount);
+	write_(DSV);
+	write_(UAVStart);
+	write_array_(UAVs, UAVCount);
+	write_array_(InitialCounts, UAVCount);
+}
+
+void RecordingContextBackend::CSSetUnorderedAccessViews(UINT StartSlot, UINT Count, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts)
+{
+	begin_(op_::CSSetUnorderedAccessViews);
+	write_(StartSlot);
+	write_array_(UAVs, Count);
+	write_array_(InitialCounts, Count);
+}
+
+void RecordingContextBackend::SetShader(ShaderStage Stage, void* ShaderPointer)
+{
+	begin_(op_::SetShader);
+	write_(Stage);
+	write_(ShaderPointer);
+}
+
+void RecordingContextBackend::SetShaderResources(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* SRVs)
+{
+	begin_(op_::SetShaderResources);
+	write_(Stage);
+	write_(StartSlot);
+	write_array_(SRVs, Count);
+}
+
+void RecordingContextBackend::SetConstantBuffers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers)
+{
+	begin_(op_::SetConstantBuffers);
+	write_(Stage);
+	write_(StartSlot);
+	write_array_(Buffers, Count);
+}
+
+void RecordingContextBackend::SetConstantBuffers1(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* FirstConstants, const UINT* NumConstants)
+{
+	begin_(op_::SetConstantBuffers1);
+	write_(Stage);
+	write_(StartSlot);
+	write_array_(Buffers, Count);
+	write_array_(FirstConstants, Count);
+	write_array_(NumConstants, Count);
+}
+
+void RecordingContextBackend::SetSamplers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11SamplerState* const* Samplers)
+{
+	begin_(op_::SetSamplers);
+	write_(Stage);
+	write_(StartSlot);
+	write_array_(Samplers, Count);
+}
+
+void RecordingContextBackend::ClearRenderTargetView(ID3D11RenderTargetView* RTV, const FLOAT Color[4])
+{
+	begin_(op_::ClearRenderTargetView);
+	write_(RTV);
+	write_array_(Color, 4);
+}
+
+void RecordingContextBackend::ClearDepthStencilView(ID3D11DepthStencilView* DSV, UINT Flags, FLOAT Depth, UINT8 Stencil)
+{
+	begin_(op_::ClearDepthStencilView);
+	write_(DSV);
+	write_(Flags);
+	write_(Depth);
+	write_(Stencil);
+}
+
+void RecordingContextBackend::CopyResource(ID3D11Resource* Dest, ID3D11Resource* Source)
+{
+	begin_(op_::CopyResource);
+	write_(Dest);
+	write_(Source);
+}
+
+void RecordingContextBackend::Draw(UINT VertexCount, UINT StartVertex)
+{
+	begin_(op_::Draw);
+	write_(VertexCount);
+	write_(StartVertex);
+}
+
+void RecordingContextBackend::DrawIndexed(UINT IndexCount, UINT StartIndex, INT BaseVertex)
+{
+	begin_(op_::DrawIndexed);
+	write_(IndexCount);
+	write_(StartIndex);
+	write_(BaseVertex);
+}
+
+void RecordingContextBackend::Dispatch(UINT GroupsX, UINT GroupsY, UINT GroupsZ)
+{
+	begin_(op_::Dispatch);
+	write_(GroupsX);
+	write_(GroupsY);
+	write_(GroupsZ);
+}
+
+StatusCode RecordingContextBackend::UpdateBuffer(ID3D11Buffer* Buffer, const void* Data, size_t Size)
+{
+	begin_(op_::UpdateBuffer);
+	write_(Buffer);
+	write_array_((const uint8_t*)Data, (UINT)Size);
+	return StatusCode::Ok;
+}
+
+StatusCode RecordingContextBackend::UpdateBufferRange(ID3D11Buffer* Buffer, size_t Offset, const void* Data, size_t Size, bool Discard)
+{
+	begin_(op_::UpdateBufferRange);
+	write_(Buffer);
+	write_(Offset);
+	write_(Discard);
+	write_array_((const uint8_t*)Data, (UINT)Size);
+	return StatusCode::Ok;
+}
+
+StatusCode RecordingContextBackend::FinishCommandList(unique_ptr<CommandList>& Out)
+{
+	Out = make_unique<recorded_list_>(move(Stream));
+	Stream.clear();
+	CommandCount = 0;
+	return StatusCode::Ok;
+}
@@ -0,0 +1,212 @@
+#pragma once
+#include "stdafx.h"
+#include "../Core/Core.h"
+#include "../Core/PipelineState.h"
+
+namespace FrameDX
+{
+	class ContextBackend;
+
+	// Commands recorded by a backend, to be executed later on another one
+	class CommandList
+	{
+	public:
+		virtual ~CommandList() = default;
+		virtual void Execute(ContextBackend& Target) = 0;
+	};
+
+	// The subset of ID3D11DeviceContext that FrameDX uses to bind state and submit work
+	// Shader stage functions are indexed by stage, instead of having one function per stage
+	class ContextBackend
+	{
+	public:
+		virtual ~ContextBackend() = default;
+
+		virtual void IASetIndexBuffer(ID3D11Buffer* Buffer, DXGI_FORMAT Format, UINT Offset) = 0;
+		virtual void IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* Strides, const UINT* Offsets) = 0;
+		virtual void IASetInputLayout(ID3D11InputLayout* Layout) = 0;
+		virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology) = 0;
+
+		virtual void RSSetViewports(UINT Count, const D3D11_VIEWPORT* Viewports) = 0;
+		virtual void RSSetState(ID3D11RasterizerState* State) = 0;
+
+		virtual void OMSetDepthStencilState(ID3D11DepthStencilState* State, UINT StencilRef) = 0;
+		virtual void OMSetBlendState(ID3D11BlendState* State, const FLOAT BlendFactors[4], UINT SampleMask) = 0;
+		virtual void OMSetRenderTargets(UINT Count, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV) = 0;
+		virtual void OMSetRenderTargetsAndUnorderedAccessViews(UINT RTVCount, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV,
+															   UINT UAVStart, UINT UAVCount, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts) = 0;
+		virtual void CSSetUnorderedAccessViews(UINT StartSlot, UINT Count, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts) = 0;
+
+		// ShaderPointer is the one returned by Shader::GetShaderPointer
+		virtual void SetShader(ShaderStage Stage, void* ShaderPointer) = 0;
+		virtual void SetShaderResources(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* SRVs) = 0;
+		virtual void SetConstantBuffers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers) = 0;
+		// Binds a range of each buffer, in constants of 16 bytes. Both have to be multiples of 16 constants
+		// Needs a D3D11.1 context
+		virtual void SetConstantBuffers1(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* FirstConstants, const UINT* NumConstants) = 0;
+		virtual void SetSamplers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11SamplerState* const* Samplers) = 0;
+
+		virtual void ClearRenderTargetView(ID3D11RenderTargetView* RTV, const FLOAT Color[4]) = 0;
+		virtual void ClearDepthStencilView(ID3D11DepthStencilView* DSV, UINT Flags, FLOAT Depth, UINT8 Stencil) = 0;
+		// Copies the whole resource. Both need the same type, size and a compatible format
+		virtual void CopyResource(ID3D11Resource* Dest, ID3D11Resource* Source) = 0;
+
+		virtual void Draw(UINT VertexCount, UINT StartVertex) = 0;
+		virtual void DrawIndexed(UINT IndexCount, UINT StartIndex, INT BaseVertex) = 0;
+		virtual void Dispatch(UINT GroupsX, UINT GroupsY, UINT GroupsZ) = 0;
+
+		// Writes the data to the buffer, discarding the previous contents
+		virtual StatusCode UpdateBuffer(ID3D11Buffer* Buffer, const void* Data, size_t Size) = 0;
+		// Writes the data at Offset and keeps the rest of the buffer, so the range can't be in use by the GPU
+		// With Discard the previous contents are dropped instead, as UpdateBuffer does
+		virtual StatusCode UpdateBufferRange(ID3D11Buffer* Buffer, size_t Offset, const void* Data, size_t Size, bool Discard) = 0;
+
+		// Closes the commands recorded so far into a command list. Afterwards the state of the backend is reset to the defaults
+		// Not supported by immediate contexts
+		virtual StatusCode FinishCommandList(unique_ptr<CommandList>& Out) = 0;
+		// Only valid on D3D11 backends. After it, the state is reset to the defaults
+		virtual void ExecuteCommandList(ID3D11CommandList* List) = 0;
+	};
+
+	// Forwards everything to a D3D11 context, either the immediate one or a deferred one
+	class D3D11ContextBackend : public ContextBackend
+	{
+	public:
+		D3D11ContextBackend() : Context(nullptr), Context1(nullptr) {}
+		explicit D3D11ContextBackend(ID3D11DeviceContext* Context) : Context(nullptr), Context1(nullptr) { SetContext(Context); }
+
+		ID3D11DeviceContext* GetContext() { return Context; }
+		void SetContext(ID3D11DeviceContext* NewContext);
+		// True if the context is D3D11.1 or newer, and so supports SetConstantBuffers1
+		bool SupportsConstantBufferRanges() const { return Context1 != nullptr; }
+
+		virtual void IASetIndexBuffer(ID3D11Buffer* Buffer, DXGI_FORMAT Format, UINT Offset) override { Context->IASetIndexBuffer(Buffer, Format, Offset); }
+		virtual void IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* Strides, const UINT* Offsets) override { Context->IASetVertexBuffers(StartSlot, Count, Buffers, Strides, Offsets); }
+		virtual void IASetInputLayout(ID3D11InputLayout* Layout) override { Context->IASetInputLayout(Layout); }
+		virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology) override { Context->IASetPrimitiveTopology(Topology); }
+
+		virtual void RSSetViewports(UINT Count, const D3D11_VIEWPORT* Viewports) override { Context->RSSetViewports(Count, Viewports); }
+		virtual void RSSetState(ID3D11RasterizerState* State) override { Context->RSSetState(State); }
+
+		virtual void OMSetDepthStencilState(ID3D11DepthStencilState* State, UINT StencilRef) override { Context->OMSetDepthStencilState(State, StencilRef); }
+		virtual void OMSetBlendState(ID3D11BlendState* State, const FLOAT BlendFactors[4], UINT SampleMask) override { Context->OMSetBlendState(State, BlendFactors, SampleMask); }
+		virtual void OMSetRenderTargets(UINT Count, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV) override { Context->OMSetRenderTargets(Count, RTVs, DSV); }
+		virtual void OMSetRenderTargetsAndUnorderedAccessViews(UINT RTVCount, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV,
+															   UINT UAVStart, UINT UAVCount, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts) override
+		{
+			Context->OMSetRenderTargetsAndUnorderedAccessViews(RTVCount, RTVs, DSV, UAVStart, UAVCount, UAVs, InitialCounts);
+		}
+		virtual void CSSetUnorderedAccessViews(UINT StartSlot, UINT Count, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts) override { Context->CSSetUnorderedAccessViews(StartSlot, Count, UAVs, InitialCounts); }
+
+		virtual void SetShader(ShaderStage Stage, void* ShaderPointer) override;
+		virtual void SetShaderResources(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* SRVs) override;
+		virtual void SetConstantBuffers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers) override;
+		virtual void SetConstantBuffers1(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* FirstConstants, const UINT* NumConstants) override;
+		virtual void SetSamplers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11SamplerState* const* Samplers) override;
+
+		virtual void ClearRenderTargetView(ID3D11RenderTargetView* RTV, const FLOAT Color[4]) override { Context->ClearRenderTargetView(RTV, Color); }
+		virtual void ClearDepthStencilView(ID3D11DepthStencilView* DSV, UINT Flags, FLOAT Depth, UINT8 Stencil) override { Context->ClearDepthStencilView(DSV, Flags, Depth, Stencil); }
+		virtual void CopyResource(ID3D11Resource* Dest, ID3D11Resource* Source) override { Context->CopyResource(Dest, Source); }
+
+		virtual void Draw(UINT VertexCount, UINT StartVertex) override { Context->Draw(VertexCount, StartVertex); }
+		virtual void DrawIndexed(UINT IndexCount, UINT StartIndex, INT BaseVertex) override { Context->DrawIndexed(IndexCount, StartIndex, BaseVertex); }
+		virtual void Dispatch(UINT GroupsX, UINT GroupsY, UINT GroupsZ) override { Context->Dispatch(GroupsX, GroupsY, GroupsZ); }
+
+		virtual StatusCode UpdateBuffer(ID3D11Buffer* Buffer, const void* Data, size_t Size) override;
+		virtual StatusCode UpdateBufferRange(ID3D11Buffer* Buffer, size_t Offset, const void* Data, size_t Size, bool Discard) override;
+
+		virtual StatusCode FinishCommandList(unique_ptr<CommandList>& Out) override;
+		virtual void ExecuteCommandList(ID3D11CommandList* List) override { Context->ExecuteCommandList(List, FALSE); }
+	private:
+		ID3D11DeviceContext* Context;
+		// Same object as Context, so it isn't referenced. Null on D3D11.0
+		ID3D11DeviceContext1* Context1;
+	};
+
+	// Stand-in that records the calls on memory instead of sending them to a driver
+	// Used to test and measure the recording path without a GPU. The command lists it produces replay the calls on the target
+	// The calls store the object pointers without referencing them, so every object used must stay alive until the lists
+	// that use it are replayed or destroyed
+	class RecordingContextBackend : public ContextBackend
+	{
+	public:
+		virtual void IASetIndexBuffer(ID3D11Buffer* Buffer, DXGI_FORMAT Format, UINT Offset) override;
+		virtual void IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* Strides, const UINT* Offsets) override;
+		virtual void IASetInputLayout(ID3D11InputLayout* Layout) override;
+		virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology) override;
+
+		virtual void RSSetViewports(UINT Count, const D3D11_VIEWPORT* Viewports) override;
+		virtual void RSSetState(ID3D11RasterizerState* State) override;
+
+		virtual void OMSetDepthStencilState(ID3D11DepthStencilState* State, UINT StencilRef) override;
+		virtual void OMSetBlendState(ID3D11BlendState* State, const FLOAT BlendFactors[4], UINT SampleMask) override;
+		virtual void OMSetRenderTargets(UINT Count, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV) override;
+		virtual void OMSetRenderTargetsAndUnorderedAccessViews(UINT RTVCount, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV,
+															   UINT UAVStart, UINT UAVCount, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts) override;
+		virtual void CSSetUnorderedAccessViews(UINT StartSlot, UINT Count, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts) override;
+
+		virtual void SetShader(ShaderStage Stage, void* ShaderPointer) override;
+		virtual void SetShaderResources(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* SRVs) override;
+		virtual void SetConstantBuffers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers) override;
+		virtual void SetConstantBuffers1(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* FirstConstants, const UINT* NumConstants) override;
+		virtual void SetSamplers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11SamplerState* const* Samplers) override;
+
+		virtual void ClearRenderTargetView(ID3D11RenderTargetView* RTV, const FLOAT Color[4]) override;
+		virtual void ClearDepthStencilView(ID3D11DepthStencilView* DSV, UINT Flags, FLOAT Depth, UINT8 Stencil) override;
+		virtual void CopyResource(ID3D11Resource* Dest, ID3D11Resource* Source) override;
+
+		virtual void Draw(UINT VertexCount, UINT StartVertex) override;
+		virtual void DrawIndexed(UINT IndexCount, UINT StartIndex, INT BaseVertex) override;
+		virtual void Dispatch(UINT GroupsX, UINT GroupsY, UINT GroupsZ) override;
+
+		virtual StatusCode UpdateBuffer(ID3D11Buffer* Buffer, const void* Data, size_t Size) override;
+		virtual StatusCode UpdateBufferRange(ID3D11Buffer* Buffer, size_t Offset, const void* Data, size_t Size, bool Discard) override;
+
+		virtual StatusCode FinishCommandList(unique_ptr<CommandList>& Out) override;
+		// Command lists of real contexts can't be recorded
+		virtual void ExecuteCommandList(ID3D11CommandList* List) override {}
+
+		// Number of calls recorded since the last FinishCommandList
+		size_t GetCommandCount() const { return CommandCount; }
+	private:
+		enum class op_ : uint8_t
+		{
+			IASetIndexBuffer, IASetVertexBuffers, IASetInputLayout, IASetPrimitiveTopology,
+			RSSetViewports, RSSetState,
+			OMSetDepthStencilState, OMSetBlendState, OMSetRenderTargets, OMSetRenderTargetsAndUnorderedAccessViews, CSSetUnorderedAccessViews,
+			SetShader, SetShaderResources, SetConstantBuffers, SetConstantBuffers1, SetSamplers,
+			ClearRenderTargetView, ClearDepthStencilView,
+			Draw, DrawIndexed, Dispatch,
+			UpdateBuffer, UpdateBufferRange,
+			CopyResource
+		};
+
+		// The calls are packed on a byte stream: the op, then its arguments
+		// Every value starts on a multiple of 8 bytes, so the arrays can be passed directly from the stream when replaying
+		static constexpr size_t StreamAlignment = 8;
+		static size_t align_(size_t Offset) { return (Offset + StreamAlignment - 1) & ~(StreamAlignment - 1); }
+
+		void write_bytes_(const void* Data, size_t Size)
+		{
+			size_t offset = align_(Stream.size());
+			Stream.resize(offset + Size);
+			memcpy(Stream.data() + offset, Data, Size);
+		}
+		template<typename T>
+		void write_(const T& Value) { write_bytes_(&Value, sizeof(T)); }
+		template<typename T>
+		void write_array_(const T* Values, UINT Count)
+		{
+			write_(Count);
+			write_(Values != nullptr);
+			if(Values)
+				write_bytes_(Values, sizeof(T) * Count);
+		}
+		void begin_(op_ Op) { write_(Op); CommandCount++; }
+
+		class recorded_list_;
+
+		vector<uint8_t> Stream;
+		size_t CommandCount = 0;
+	};
+}
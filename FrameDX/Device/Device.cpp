@@ -2,6 +2,7 @@
 #include "../Core/Core.h"
 #include "../Core/Log.h"
 #include "Device.h"
+#include "../Core/Buffer.h"
 #include "../Shader/Shaders.h"
 
 using namespace FrameDX;
@@ -9,6 +10,12 @@ using namespace FrameDX;
 function<void(WPARAM, KeyAction)> Device::KeyboardCallback = [](WPARAM, KeyAction) {};
 function<void(WPARAM,int,int)> Device::MouseCallback = [](WPARAM, int, int) {};
 
+namespace
+{
+	// DXGI queues up to 3 frames by default, so the GPU is done with the constants of a frame 4 frames later
+	constexpr uint32_t UploadFramesInFlight = 4;
+}
+
 void FrameDX::Device::EnterMainLoop(function<bool(double)> LoopBody)
 {
 	MSG msg;
@@ -30,8 +37,10 @@ void FrameDX::Device::EnterMainLoop(function<bool(double)> LoopBody)
 		else
 		{
 			// Measure time between now and the last call
-			auto time = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - last_call_time);
-			last_call_time = chrono::high_resolution_clock::now();
+			auto now = chrono::high_resolution_clock::now();
+			auto time = chrono::duration_cast<chrono::nanoseconds>(now - last_call_time);
+			last_call_time = now;
+			Stats.RecordFrame(time);
 			if (!LoopBody(time.count()))
 				return;
 		}
@@ -218,6 +227,21 @@ StatusCode Device::Start(const Device::Description& params)
 	else
 		ContextVersion = 0;
 
+	ImmediateBackend.SetContext(ImmediateContext);
+	ImmediateBinder.SetBackend(&ImmediateBackend);
+	D3D11Objects.SetDevice(D3DDevice);
+	States.SetDevice(ObjectBackend);
+	ConstantSlots.SetDevice(ObjectBackend);
+
+	// The upload ring binds ranges of a constant buffer and maps it with no overwrite, which needs D3D11.1 and driver support
+	// It also relies on Present to reuse its space, as the swap chain is what keeps the CPU at most a few frames ahead,
+	// so compute only devices use the per slot buffers
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if(!Desc.ComputeOnly && Desc.UploadRingSize && ImmediateBackend.SupportsConstantBufferRanges() &&
+	   SUCCEEDED(D3DDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+	   options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer)
+		LogCheckWithReturn(Uploads.Create(ObjectBackend, Desc.UploadRingSize, UploadFramesInFlight), LogCategory::Error);
+
 	// While it's supposed that sending a size of 0 makes DXGI get the size directly from the window, it ends up a little bit smaller than expected
 	// Also, i need to make sure the same size as the backbuffer is sent to the DSV, so if no size is provided manually, it's set to the window size
 	if(Desc.SwapChainDescription.BackbufferDescription.SizeX == 0 || Desc.SwapChainDescription.BackbufferDescription.SizeY == 0)
@@ -356,675 +380,170 @@ StatusCode Device::Start(const Device::Description& params)
 	return StatusCode::Ok;
 }
 
-void Device::BindPipelineState(const PipelineState& NewState)
+StatusCode Device::StartHeadless()
 {
-#define changed(v) (!IsPipelineStateValid || (CurrentPipelineState.v != NewState.v))
-#define update(v) CurrentPipelineState.v = NewState.v
-	// If any step needs unbinds, just set the resources count for that type to 0 and be done with it in one call
-	// The old "sparse unbind" is useless 
-	bool needs_srv_unbind[(size_t)ShaderStage::_count]{}; // one per stage
-	bool needs_uav_unbind = false;
-	bool needs_cs_uav_unbind = false;
-	bool needs_rtv_unbind = false;
-
-	bool needs_srv_bind[(size_t)ShaderStage::_count]{}; // one per stage
-	bool needs_uav_bind = false;
-	bool needs_cs_uav_bind = false;
-	bool needs_rtv_bind = false;
-
-	// Mesh
-	if (NewState.Mesh.IndexBuffer && (changed(Mesh.IndexBuffer) || changed(Mesh.IndexFormat)))
-	{
-		ImmediateContext->IASetIndexBuffer(NewState.Mesh.IndexBuffer, NewState.Mesh.IndexFormat, 0);
-
-		update(Mesh.IndexBuffer);
-		update(Mesh.IndexFormat);
-	}
-
-	if (NewState.Mesh.VertexBuffer && (changed(Mesh.VertexBuffer) || changed(Mesh.VertexStride)))
-	{
-		UINT offset = 0;
-		ImmediateContext->IASetVertexBuffers(0, 1, &NewState.Mesh.VertexBuffer, &NewState.Mesh.VertexStride, &offset);
-		update(Mesh.VertexBuffer);
-		update(Mesh.VertexStride);
-	}
-
-	if (NewState.InputLayout && changed(InputLayout))
-	{
-		ImmediateContext->IASetInputLayout(NewState.InputLayout);
-		update(InputLayout);
-	}
+	Desc.ComputeOnly = true;
+	DeviceVersion = 0;
+	ContextVersion = 0;
+	SwapChainVersion = 0;
+
+	ObjectBackend = &NullObjects;
+	NullContext.SetObjectBackend(&NullObjects);
+	ActiveBackend = &NullContext;
+	ImmediateBinder.SetBackend(ActiveBackend);
+	States.SetDevice(ObjectBackend);
+	ConstantSlots.SetDevice(ObjectBackend);
 
+	return StatusCode::Ok;
+}
 
-	if (changed(Mesh.PrimitiveType))
-	{
-		ImmediateContext->IASetPrimitiveTopology(NewState.Mesh.PrimitiveType);
-		update(Mesh.PrimitiveType);
-	}
-
-	// Output Context
-	if (changed(Output.Viewports))
-	{
-		ImmediateContext->RSSetViewports(NewState.Output.Viewports.size(), NewState.Output.Viewports.data());
-		update(Output.Viewports);
-	}
-
-	if (NewState.Output.DepthStencilState && (changed(Output.DepthStencilState) || changed(Output.StencilRef)))
-	{
-		ImmediateContext->OMSetDepthStencilState(NewState.Output.DepthStencilState, NewState.Output.StencilRef);
-		update(Output.DepthStencilState);
-		update(Output.StencilRef);
-	}
+void Device::BindPipelineState(const PipelineState& NewState)
+{
+	ImmediateBinder.Bind(NewState);
+}
 
-	if (NewState.Output.BlendState &&
-	   ( changed(Output.BlendState) || 
-		 changed(Output.BlendFactors[0]) || 
-		 changed(Output.BlendFactors[1]) ||
-		 changed(Output.BlendFactors[2]) ||
-		 changed(Output.BlendFactors[3]) 
-	   ))
-	{
-		ImmediateContext->OMSetBlendState(NewState.Output.BlendState, NewState.Output.BlendFactors, -1);
-		update(Output.BlendState);
-		update(Output.BlendFactors[0]);
-		update(Output.BlendFactors[1]);
-		update(Output.BlendFactors[2]);
-		update(Output.BlendFactors[3]);
-	}
+void Device::BindPipelineState(const BakedPipelineState& NewState)
+{
+	ImmediateBinder.Bind(NewState);
+}
 
-	if (NewState.Output.RasterState && changed(Output.RasterState))
-	{
-		ImmediateContext->RSSetState(NewState.Output.RasterState);
-		update(Output.RasterState);
-	}
+StatusCode Device::bind_constants_(ShaderStage Stage, UINT Slot, const void* Data, size_t Size)
+{
+	LogAssertWithReturn(Slot < D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT, LogCategory::Error, StatusCode::InvalidArgument);
 
-	if (NewState.Output.DSV && changed(Output.DSV))
+	if(Uploads.IsValid())
 	{
-		ID3D11Resource * resource;
-		NewState.Output.DSV->GetResource(&resource);
-
-		{
-			auto entry = SRVBoundResources.equal_range(resource);
-			for (auto iter = entry.first; iter != entry.second;)
-			{
-				// Flag that an unbind is needed, and remove it from the bound resources
-				needs_srv_unbind[(size_t)iter->second] = true;
-
-				iter->first->Release();
-				SRVBoundResources.erase(iter++);
-			}
-		}
-		{
-			auto entry = UAVBoundResources.equal_range(resource);
-			for (auto iter = entry.first; iter != entry.second;)
-			{
-				// Flag that an unbind is needed, and remove it from the bound resources
-				if (iter->second == UAVStage::Compute)
-					needs_cs_uav_unbind = true;
-				else
-					needs_uav_unbind = true;
-
-				iter->first->Release();
-				UAVBoundResources.erase(iter++);
-			}
-		}
-
-		// DSVs are unbinded at the same time as RTVs
-		//RTVBoundResources.insert({resource});
-		resource->Release();
-
-		needs_rtv_bind = true;
-		update(Output.DSV);
+		UploadRing::Allocation allocation;
+		LogCheckWithReturn(Uploads.Allocate(ActiveBackend, Data, Size, allocation), LogCategory::Error);
+		ImmediateBinder.BindConstantBuffer(Stage, Slot, allocation.Buffer, allocation.FirstConstant, allocation.NumConstants);
+		return StatusCode::Ok;
 	}
 
-#define check_slot_base(idx, type, resources_vector, stage, pipeline_segment, access_code) if (idx < CurrentPipelineState.pipeline_segment.type.size() && CurrentPipelineState.pipeline_segment.type[idx]){\
-		ID3D11Resource * prev_resource;\
-		CurrentPipelineState.pipeline_segment.type[idx]->GetResource(&prev_resource);\
-		auto entry = resources_vector.find(prev_resource);\
-		if (entry != resources_vector.end())\
-		{\
-			access_code\
-		}\
-		prev_resource->Release();}\
-
-#define check_slot_binding(idx, type, resources_vector) check_slot_base(idx,type, resources_vector, , Output, (*entry)->Release(); resources_vector.erase(entry);)
-
-#define check_slot_binding_staged(idx, type, resources_vector, stage) check_slot_base(idx,type, resources_vector, stage, Output, if(entry->second == stage){ entry->first->Release();resources_vector.erase(entry);})
-		
-#define check_slot_binding_srv(idx, type, resources_vector, stage) check_slot_base(idx,type, resources_vector, stage, Shaders[stage], if(entry->second == (ShaderStage)stage){ entry->first->Release();resources_vector.erase(entry);})
+	return ConstantSlots.Bind(ImmediateBinder, Stage, Slot, Data, Size);
+}
 
-	if (changed(Output.RTVs))
+void Device::FlushConstantBuffers()
+{
+	// A failed upload is logged and dropped, so it's not tried again on every draw
+	for(auto buffer : DirtyConstantBuffers)
 	{
-		bool any_valid = false;
-		//for (auto & rtv : NewState.Output.RTVs)
-		for(int i = 0;i < NewState.Output.RTVs.size();i++)
-		{
-			auto & rtv = NewState.Output.RTVs[i];
-			if (!rtv)
-			{
-				check_slot_binding(i, RTVs, RTVBoundResources);
-				continue;
-			}
-
-			any_valid = true;
-
-			ID3D11Resource * resource;
-			rtv->GetResource(&resource);
-
-			{
-				auto entry = SRVBoundResources.equal_range(resource);
-				for (auto iter = entry.first; iter != entry.second;)
-				{
-					// Flag that an unbind is needed, and remove it from the bound resources
-					needs_srv_unbind[(size_t)iter->second] = true;
-
-					iter->first->Release();
-					SRVBoundResources.erase(iter++);
-				}
-			}
-			{
-				auto entry = UAVBoundResources.equal_range(resource);
-				for (auto iter = entry.first; iter != entry.second;)
-				{
-					// Flag that an unbind is needed, and remove it from the bound resources
-					if (iter->second == UAVStage::Compute)
-						needs_cs_uav_unbind = true;
-					else
-						needs_uav_unbind = true;
-
-					iter->first->Release();
-					UAVBoundResources.erase(iter++);
-				}
-			}
-
-			//RTVBoundResources.insert({ resource });
-			resource->Release();
-
-			// Check if there was a bound resource on this slot
-			// If there was, need to remove it from the bound resources list
-			check_slot_binding(i, RTVs, RTVBoundResources);
-		}
-		
-		if(any_valid)
-		{
-			needs_rtv_bind = true;
-			update(Output.RTVs);
-		}
+		buffer->Dirty = false;
+		LogCheckAndContinue(upload_constant_buffer_(*buffer), LogCategory::Error);
 	}
+	DirtyConstantBuffers.clear();
+}
 
-	if (changed(Output.UAVs))
+void Device::forget_constant_buffer_(TrackedConstantBuffer* Buffer)
+{
+	auto it = find(DirtyConstantBuffers.begin(), DirtyConstantBuffers.end(), Buffer);
+	if(it != DirtyConstantBuffers.end())
 	{
-		bool any_valid = false;
-		//for (auto & uav : NewState.Output.UAVs)
-		for(int i = 0;i < NewState.Output.UAVs.size();i++)
-		{
-			auto & uav = NewState.Output.UAVs[i];
-			if (!uav) 
-			{
-				check_slot_binding_staged(i, UAVs, UAVBoundResources, UAVStage::OutputMerger);
-				continue;
-			}
-			any_valid = true;
-
-			ID3D11Resource * resource;
-			uav->GetResource(&resource);
-
-			{
-				auto entry = SRVBoundResources.equal_range(resource);
-				for (auto iter = entry.first; iter != entry.second;)
-				{
-					// Flag that an unbind is needed, and remove it from the bound resources
-					needs_srv_unbind[(size_t)iter->second] = true;
-
-					iter->first->Release();
-					SRVBoundResources.erase(iter++);
-				}
-			}
-			{
-				auto entry = RTVBoundResources.find(resource);
-				if (entry != RTVBoundResources.end())
-				{
-					// Flag that an unbind is needed, and remove it from the bound resources
-					needs_rtv_unbind = true;
-
-					(*entry)->Release();
-					RTVBoundResources.erase(entry);
-				}
-			}
-
-			//UAVBoundResources.insert({ resource, UAVStage::OutputMerger });
-			resource->Release();
-
-			// Check if there was a bound resource on this slot
-			// If there was, need to remove it from the bound resources list
-			check_slot_binding_staged(i, UAVs, UAVBoundResources, UAVStage::OutputMerger);
-		}
-
-		if(any_valid)
-		{
-			needs_uav_bind = true;
-			update(Output.UAVs);
-		}
+		*it = DirtyConstantBuffers.back();
+		DirtyConstantBuffers.pop_back();
 	}
+}
 
-	if (changed(Output.ComputeShaderUAVs))
-	{
-		bool any_valid = false;
-		//for (auto & uav : NewState.Output.ComputeShaderUAVs)
-		for(int i = 0;i < NewState.Output.ComputeShaderUAVs.size();i++)
-		{
-			auto & uav = NewState.Output.ComputeShaderUAVs[i];
-			if (!uav)
-			{
-				check_slot_binding_staged(i, UAVs, UAVBoundResources, UAVStage::Compute);
-				continue;
-			}
-			any_valid = true;
-
-			ID3D11Resource * resource;
-			uav->GetResource(&resource);
-
-			{
-				auto entry = SRVBoundResources.equal_range(resource);
-				for (auto iter = entry.first; iter != entry.second;)
-				{
-					// Flag that an unbind is needed, and remove it from the bound resources
-					needs_srv_unbind[(size_t)iter->second] = true;
-
-					iter->first->Release();
-					SRVBoundResources.erase(iter++);
-				}
-			}
-			{
-				auto entry = RTVBoundResources.find(resource);
-				if (entry != RTVBoundResources.end())
-				{
-					// Flag that an unbind is needed, and remove it from the bound resources
-					needs_rtv_unbind = true;
-
-					(*entry)->Release();
-					RTVBoundResources.erase(entry);
-				}
-			}
-
-			//UAVBoundResources.insert({ resource, UAVStage::Compute });
-			resource->Release();
-
-			// Check if there was a bound resource on this slot
-			// If there was, need to remove it from the bound resources list
-			check_slot_binding_staged(i, UAVs, UAVBoundResources, UAVStage::Compute);
-		}
-
-		if (any_valid)
-		{
-			needs_cs_uav_bind = true;
-			update(Output.ComputeShaderUAVs);
-		}
-	}
+StatusCode Device::upload_constant_buffer_(TrackedConstantBuffer& Buffer)
+{
+	LogAssertWithReturn(Buffer.Buffer, LogCategory::Error, StatusCode::InvalidCall);
 
-	// Shaders
-#define update_shader(t,tf) if (NewState.Shaders[(size_t)ShaderStage::t].ShaderPtr && changed(Shaders[(size_t)ShaderStage::t].ShaderPtr)) {\
-		ImmediateContext->tf##SetShader((ID3D11##t##Shader*)NewState.Shaders[(size_t)ShaderStage::t].ShaderPtr->GetShaderPointer(), nullptr, 0);\
-		update(Shaders[(size_t)ShaderStage::t].ShaderPtr); }
-#define update_shader_cb(t,tf) if (NewState.Shaders[(size_t)ShaderStage::t].ShaderPtr && changed(Shaders[(size_t)ShaderStage::t].ConstantBuffersTable)) {\
-		ImmediateContext->tf##SetConstantBuffers(0,NewState.Shaders[(size_t)ShaderStage::t].ConstantBuffersTable.size(), NewState.Shaders[(size_t)ShaderStage::t].ConstantBuffersTable.data());\
-		update(Shaders[(size_t)ShaderStage::t].ConstantBuffersTable); }
-#define update_shader_samplers(t,tf) if (NewState.Shaders[(size_t)ShaderStage::t].ShaderPtr && changed(Shaders[(size_t)ShaderStage::t].SamplersTable)) {\
-		ImmediateContext->tf##SetSamplers(0,NewState.Shaders[(size_t)ShaderStage::t].SamplersTable.size(), NewState.Shaders[(size_t)ShaderStage::t].SamplersTable.data());\
-		update(Shaders[(size_t)ShaderStage::t].SamplersTable); }
-
-	update_shader(Vertex  , VS);
-	update_shader(Hull    , HS);
-	update_shader(Domain  , DS);
-	update_shader(Geometry, GS);
-	update_shader(Pixel   , PS);
-	update_shader(Compute , CS);
-
-	update_shader_cb(Vertex  , VS);
-	update_shader_cb(Hull    , HS);
-	update_shader_cb(Domain  , DS);
-	update_shader_cb(Geometry, GS);
-	update_shader_cb(Pixel   , PS);
-	update_shader_cb(Compute , CS);
-
-	update_shader_samplers(Vertex  , VS);
-	update_shader_samplers(Hull    , HS);
-	update_shader_samplers(Domain  , DS);
-	update_shader_samplers(Geometry, GS);
-	update_shader_samplers(Pixel   , PS);
-	update_shader_samplers(Compute , CS);
-
-	for (size_t stage = 0; stage < (size_t)ShaderStage::_count; stage++)
+	// The GPU buffer already has the same contents
+	auto& uploaded = Buffer.UploadedData;
+	if(uploaded.size() == Buffer.TrackedSize && memcmp(uploaded.data(), Buffer.TrackedData, Buffer.TrackedSize) == 0)
 	{
-		if (changed(Shaders[stage].ResourcesTable))
-		{
-			bool any_valid = false;
-			//for (auto & srv : NewState.Shaders[stage].ResourcesTable)
-			for (int i = 0; i < NewState.Shaders[stage].ResourcesTable.size(); i++)
-			{
-				auto srv = NewState.Shaders[stage].ResourcesTable[i];
-				if (!srv)
-				{
-					check_slot_binding_srv(i, ResourcesTable, SRVBoundResources, stage);
-					continue;
-				}
-
-				any_valid = true;
-
-				ID3D11Resource * resource;
-				srv->GetResource(&resource);
-
-				{
-					auto entry = UAVBoundResources.equal_range(resource);
-					for (auto iter = entry.first; iter != entry.second;)
-					{
-						// Flag that an unbind is needed, and remove it from the bound resources
-						if (iter->second == UAVStage::Compute)
-							needs_cs_uav_unbind = true;
-						else
-							needs_uav_unbind = true;
-
-						iter->first->Release();
-						UAVBoundResources.erase(iter++);
-					}
-				}
-				{
-					auto entry = RTVBoundResources.find(resource);
-					if (entry != RTVBoundResources.end())
-					{
-						// Flag that an unbind is needed, and remove it from the bound resources
-						needs_rtv_unbind = true;
-
-						(*entry)->Release();
-						RTVBoundResources.erase(entry);
-					}
-				}
-
-				//SRVBoundResources.insert({ resource, (ShaderStage)stage });
-				resource->Release();
-
-				// Check if there was a bound resource on this slot
-				// If there was, need to remove it from the bound resources list
-				check_slot_binding_srv(i, ResourcesTable, SRVBoundResources, stage);
-			}
-
-			if (any_valid)
-			{
-				needs_srv_bind[stage] = true;
-				update(Shaders[stage].ResourcesTable);
-			}
-		}
+		ImmediateBinder.GetStats().SkippedMaps++;
+		return StatusCode::Ok;
 	}
 
-	// Finished with the setup
-	// At this point CurrentPipelineState is fully updated
-	// -----------------------------------------
-	
-	// Unbind if needed
-	if (needs_cs_uav_unbind)
-	{
-		ID3D11UnorderedAccessView * clear_buffers[D3D11_1_UAV_SLOT_COUNT] = {};
-		ImmediateContext->CSSetUnorderedAccessViews(0, D3D11_1_UAV_SLOT_COUNT, clear_buffers, nullptr);
-
-		// If doing an unbind, need to update the current state even if it's null
-		// Otherwise it won't be bound again
-		update(Output.ComputeShaderUAVs);
+	LogCheckWithReturn(ActiveBackend->UpdateBuffer(Buffer.Buffer, Buffer.TrackedData, Buffer.TrackedSize), LogCategory::Error);
+	ImmediateBinder.GetStats().Maps++;
+	uploaded.resize(Buffer.TrackedSize);
+	memcpy(uploaded.data(), Buffer.TrackedData, Buffer.TrackedSize);
 
-		// Remove from the resources map all the UAVs bounded on the CS stage
-		for (auto iter = UAVBoundResources.begin(); iter != UAVBoundResources.end();)
-			if (iter->second == UAVStage::Compute)
-			{
-				iter->first->Release();
-				UAVBoundResources.erase(iter++);// Removing from a map doesn't invalidate other iterators
-			}
-			else iter++;
-	}
-		
-	if (needs_rtv_unbind)
-	{
-		if (needs_uav_unbind)
-		{
-			ImmediateContext->OMSetRenderTargetsAndUnorderedAccessViews(0, nullptr, nullptr, 0, 0, nullptr, nullptr);
-			// If doing an unbind, need to update the current state even if it's null
-			// Otherwise it won't be bound again
-			update(Output.UAVs);
-
-			// Remove from the resources map all the UAVs bounded on the OM stage
-			for (auto iter = UAVBoundResources.begin(); iter != UAVBoundResources.end();)
-				if (iter->second == UAVStage::OutputMerger)
-				{
-					iter->first->Release();
-					UAVBoundResources.erase(iter++);// Removing from a map doesn't invalidate other iterators
-				}
-				else iter++;
-					
-		}
-		else
-			ImmediateContext->OMSetRenderTargets(0, nullptr, nullptr);
+	return StatusCode::Ok;
+}
 
-		// If doing an unbind, need to update the current state even if it's null
-		// Otherwise it won't be bound again
-		update(Output.RTVs);
-		update(Output.DSV);
+void Device::ExecuteCommandLists(vector<unique_ptr<CommandList>>& Lists)
+{
+	// The lists may read the edited buffers
+	flush_uploads_();
 
-		// Clear the RTV resources map
-		RTVBoundResources = {};
-	}
+	for (auto& list : Lists)
+		if (list) list->Execute(*ActiveBackend);
 
-	if (needs_srv_unbind[(size_t)ShaderStage::Vertex])
-	{
-		ID3D11ShaderResourceView * clear_buffers[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
-		ImmediateContext->VSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, clear_buffers);
-		update(Shaders[(size_t)ShaderStage::Vertex].ResourcesTable);
+	// Executing a command list resets the state of the immediate context
+	if (!Lists.empty())
+		ImmediateBinder.Invalidate();
+}
 
-		// Remove from the resources map all the SRVs bounded on this stage
-		for (auto iter = SRVBoundResources.begin(); iter != SRVBoundResources.end();)
-			if (iter->second == ShaderStage::Vertex)
-			{
-				iter->first->Release();
-				SRVBoundResources.erase(iter++);// Removing from a map doesn't invalidate other iterators
-			}
-			else iter++;
-	}
-	if (needs_srv_unbind[(size_t)ShaderStage::Hull])
-	{
-		ID3D11ShaderResourceView * clear_buffers[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
-		ImmediateContext->HSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, clear_buffers);
-		update(Shaders[(size_t)ShaderStage::Hull].ResourcesTable);
+StatusCode Device::Present(UINT SyncInterval, UINT Flags)
+{
+	// Compute only and headless devices don't have a swap chain
+	HRESULT result = SwapChain ? SwapChain->Present(SyncInterval, Flags) : S_OK;
+	if(IsCapturing())
+		Capture.EndFrame(SyncInterval, Flags);
+	if(Uploads.IsValid())
+		Uploads.EndFrame();
 
-		// Remove from the resources map all the SRVs bounded on this stage
-		for (auto iter = SRVBoundResources.begin(); iter != SRVBoundResources.end();)
-			if (iter->second == ShaderStage::Hull)
-			{
-				iter->first->Release();
-				SRVBoundResources.erase(iter++);// Removing from a map doesn't invalidate other iterators
-			}
-			else iter++;
-	}
-	if (needs_srv_unbind[(size_t)ShaderStage::Domain])
 	{
-		ID3D11ShaderResourceView * clear_buffers[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
-		ImmediateContext->DSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, clear_buffers);
-		update(Shaders[(size_t)ShaderStage::Domain].ResourcesTable);
-
-		// Remove from the resources map all the SRVs bounded on this stage
-		for (auto iter = SRVBoundResources.begin(); iter != SRVBoundResources.end();)
-			if (iter->second == ShaderStage::Domain)
-			{
-				iter->first->Release();
-				SRVBoundResources.erase(iter++);// Removing from a map doesn't invalidate other iterators
-			}
-			else iter++;
+		lock_guard<mutex> lock(SubmissionMutex);
+		LastSubmission = ImmediateBinder.GetStats();
 	}
-	if (needs_srv_unbind[(size_t)ShaderStage::Geometry])
-	{
-		ID3D11ShaderResourceView * clear_buffers[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
-		ImmediateContext->GSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, clear_buffers);
-		update(Shaders[(size_t)ShaderStage::Geometry].ResourcesTable);
+	ImmediateBinder.ResetStats();
 
-		// Remove from the resources map all the SRVs bounded on this stage
-		for (auto iter = SRVBoundResources.begin(); iter != SRVBoundResources.end();)
-			if (iter->second == ShaderStage::Geometry)
-			{
-				iter->first->Release();
-				SRVBoundResources.erase(iter++);// Removing from a map doesn't invalidate other iterators
-			}
-			else iter++;
-	}
-	if (needs_srv_unbind[(size_t)ShaderStage::Pixel])
-	{
-		ID3D11ShaderResourceView * clear_buffers[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
-		ImmediateContext->PSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, clear_buffers);
-		update(Shaders[(size_t)ShaderStage::Pixel].ResourcesTable);
+	return (StatusCode)result;
+}
 
-		// Remove from the resources map all the SRVs bounded on this stage
-		for (auto iter = SRVBoundResources.begin(); iter != SRVBoundResources.end();)
-			if (iter->second == ShaderStage::Pixel)
-			{
-				iter->first->Release();
-				SRVBoundResources.erase(iter++);// Removing from a map doesn't invalidate other iterators
-			}
-			else iter++;
-	}
-	if (needs_srv_unbind[(size_t)ShaderStage::Compute])
-	{
-		ID3D11ShaderResourceView * clear_buffers[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
-		ImmediateContext->CSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, clear_buffers);
-		update(Shaders[(size_t)ShaderStage::Compute].ResourcesTable);
+StatusCode Device::BeginCapture(const string& Path)
+{
+	EndCapture();
+	LogCheckWithReturn(Capture.Open(Path, immediate_backend_()), LogCategory::Error);
 
-		// Remove from the resources map all the SRVs bounded on this stage
-		for (auto iter = SRVBoundResources.begin(); iter != SRVBoundResources.end();)
-			if (iter->second == ShaderStage::Compute)
-			{
-				iter->first->Release();
-				SRVBoundResources.erase(iter++);// Removing from a map doesn't invalidate other iterators
-			}
-			else iter++;
-	}
+	// The binder assumes the default state after changing the backend, so the context must have it
+	if(ImmediateContext)
+		ImmediateContext->ClearState();
+	ActiveBackend = &Capture;
+	ImmediateBinder.SetBackend(ActiveBackend);
 
-	// Now bind if needed
-	UINT dummy = -1;
+	return StatusCode::Ok;
+}
 
-	if (needs_rtv_bind)
-	{
-		if (needs_uav_bind)
-			ImmediateContext->OMSetRenderTargetsAndUnorderedAccessViews
-				(
-					CurrentPipelineState.Output.RTVs.size(), 
-					CurrentPipelineState.Output.RTVs.data(), 
-					CurrentPipelineState.Output.DSV, 
-					CurrentPipelineState.Output.RTVs.size(), 
-					CurrentPipelineState.Output.UAVs.size(), 
-					CurrentPipelineState.Output.UAVs.data(),
-					&dummy
-				);
-		else
-			ImmediateContext->OMSetRenderTargets
-				(
-					CurrentPipelineState.Output.RTVs.size(), 
-					CurrentPipelineState.Output.RTVs.data(), 
-					CurrentPipelineState.Output.DSV
-				);
-	}
+void Device::EndCapture()
+{
+	if(!IsCapturing())
+		return;
 
-	if (needs_cs_uav_bind)
-		ImmediateContext->CSSetUnorderedAccessViews(0, CurrentPipelineState.Output.ComputeShaderUAVs.size(), CurrentPipelineState.Output.ComputeShaderUAVs.data(), &dummy);
-
-	if (needs_srv_bind[(size_t)ShaderStage::Vertex])
-		ImmediateContext->VSSetShaderResources(0, CurrentPipelineState.Shaders[(size_t)ShaderStage::Vertex].ResourcesTable.size(), CurrentPipelineState.Shaders[(size_t)ShaderStage::Vertex].ResourcesTable.data());
-	if (needs_srv_bind[(size_t)ShaderStage::Hull])
-		ImmediateContext->HSSetShaderResources(0, CurrentPipelineState.Shaders[(size_t)ShaderStage::Hull].ResourcesTable.size(), CurrentPipelineState.Shaders[(size_t)ShaderStage::Hull].ResourcesTable.data());
-	if (needs_srv_bind[(size_t)ShaderStage::Domain])
-		ImmediateContext->DSSetShaderResources(0, CurrentPipelineState.Shaders[(size_t)ShaderStage::Domain].ResourcesTable.size(), CurrentPipelineState.Shaders[(size_t)ShaderStage::Domain].ResourcesTable.data());
-	if (needs_srv_bind[(size_t)ShaderStage::Geometry])
-		ImmediateContext->GSSetShaderResources(0, CurrentPipelineState.Shaders[(size_t)ShaderStage::Geometry].ResourcesTable.size(), CurrentPipelineState.Shaders[(size_t)ShaderStage::Geometry].ResourcesTable.data());
-	if (needs_srv_bind[(size_t)ShaderStage::Pixel])
-		ImmediateContext->PSSetShaderResources(0, CurrentPipelineState.Shaders[(size_t)ShaderStage::Pixel].ResourcesTable.size(), CurrentPipelineState.Shaders[(size_t)ShaderStage::Pixel].ResourcesTable.data());
-	if (needs_srv_bind[(size_t)ShaderStage::Compute])
-		ImmediateContext->CSSetShaderResources(0, CurrentPipelineState.Shaders[(size_t)ShaderStage::Compute].ResourcesTable.size(), CurrentPipelineState.Shaders[(size_t)ShaderStage::Compute].ResourcesTable.data());
-
-	// Register the bound resources
-	// Assume all the resources were bound correctly. This should always be the case, unless the pipeline state itself has dependency cycles
-	if (NewState.Output.DSV)
-	{
-		ID3D11Resource * resource;
-		NewState.Output.DSV->GetResource(&resource);
-		RTVBoundResources.insert(resource);
-	}
+	Capture.Close();
 
-	for (auto ptr : NewState.Output.RTVs)
-	{
-		if (!ptr) continue;
-		ID3D11Resource * resource;
-		ptr->GetResource(&resource);
-		RTVBoundResources.insert(resource);
-	}
+	if(ImmediateContext)
+		ImmediateContext->ClearState();
+	ActiveBackend = immediate_backend_();
+	ImmediateBinder.SetBackend(ActiveBackend);
+}
 
-	for (auto ptr : NewState.Output.UAVs)
-	{
-		if (!ptr) continue;
-		ID3D11Resource * resource;
-		ptr->GetResource(&resource);
-		UAVBoundResources.insert({ resource, UAVStage::OutputMerger });
-	}
+void Device::Release()
+{
+	EndCapture();
+	ImmediateBinder.Release();
+	States.Release();
 
-	for (auto ptr : NewState.Output.ComputeShaderUAVs)
-	{
-		if (!ptr) continue;
-		ID3D11Resource * resource;
-		ptr->GetResource(&resource);
-		UAVBoundResources.insert({ resource, UAVStage::Compute });
-	}
+	// The buffers still registered are released by their owners, which would try to unregister them
+	for(auto buffer : DirtyConstantBuffers)
+		buffer->Dirty = false;
+	DirtyConstantBuffers.clear();
 
-	auto update_shader_registry = [&](ShaderStage stage)
-	{
-		for (auto ptr : NewState.Shaders[(size_t)stage].ResourcesTable)
-		{
-			if (!ptr) continue;
-			ID3D11Resource * resource;
-			ptr->GetResource(&resource);
-			SRVBoundResources.insert({ resource, stage });
-		}
-	};
-
-	update_shader_registry(ShaderStage::Vertex);
-	update_shader_registry(ShaderStage::Hull);
-	update_shader_registry(ShaderStage::Domain);
-	update_shader_registry(ShaderStage::Geometry);
-	update_shader_registry(ShaderStage::Pixel);
-	update_shader_registry(ShaderStage::Compute);
-	
+	Uploads.Release();
+	ConstantSlots.Release();
 
-	// Now if it was invalid make a copy of the state, even copying nulls
-	// This way we make sure the state is valid, even if it has nulls
-	if (!IsPipelineStateValid)
+	if(IsHeadless())
 	{
-		CurrentPipelineState = NewState;
-		IsPipelineStateValid = true;
+		// The objects still alive at this point are leaks, unless they are released later by their destructors
+		NullObjects.ReportLiveObjects();
+		return;
 	}
-	
-#undef update_shader_cb
-#undef update_shader_samplers
-#undef update_shader
-#undef changed
-#undef update
-#undef check_slot_base
-#undef check_slot_binding
-#undef check_slot_binding_staged
-#undef check_slot_binding_srv
-
-}
-
-void Device::Release()
-{
-	for (auto& r : SRVBoundResources)
-		if(r.first) r.first->Release();
-	for (auto& r : UAVBoundResources)
-		if(r.first) r.first->Release();
-	for (auto& r : RTVBoundResources)
-		if (r) r->Release();
 
 	D3DDevice->Release();
 	ImmediateContext->Release();
-	SwapChain->Release();
+	if(SwapChain)
+		SwapChain->Release();
 }
\ No newline at end of file
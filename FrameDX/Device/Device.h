@@ -3,9 +3,20 @@
 #include "../Texture/Texture.h"
 #include "../Core/Log.h"
 #include "../Core/PipelineState.h"
+#include "../Core/FrameStats.h"
+#include "../Core/Timing.h"
+#include "../Core/TripleBuffer.h"
+#include "ContextBackend.h"
+#include "DeviceBackend.h"
+#include "PipelineBinder.h"
+#include "StateCache.h"
+#include "CommandTrace.h"
+#include "UploadRing.h"
 
 namespace FrameDX
 {
+	class TrackedConstantBuffer;
+
 	class Device
 	{
 	public:
@@ -14,7 +25,9 @@ namespace FrameDX
 			D3DDevice = nullptr;
 			ImmediateContext = nullptr;
 			SwapChain = nullptr;
-			IsPipelineStateValid = false;
+			WindowHandle = nullptr;
+			ActiveBackend = &ImmediateBackend;
+			ObjectBackend = &D3D11Objects;
 		}
 
 		// There can only be ONE keyboard callback function on the entire program, that's why it's static
@@ -27,6 +40,7 @@ namespace FrameDX
 			{
 				AdapterIndex = 0;
 				ComputeOnly = false;
+				UploadRingSize = 1 << 20;
 
 				WindowDescription.Name = L"FrameDX";
 				WindowDescription.SizeX = 0;
@@ -53,6 +67,10 @@ namespace FrameDX
 			// Compute only devices only create the D3D device and immediate context.
 			bool ComputeOnly; 
 
+			// Size of the ring used by BindConstants. It grows if a frame needs more
+			// 0 doesn't create it, and then BindConstants maps a buffer per slot on each call. Compute only devices never create it
+			uint32_t UploadRingSize;
+
 			// ------------------------
 			// The following variables are only valid if ComputeOnly == false
 			struct 
@@ -84,8 +102,21 @@ namespace FrameDX
 		} Desc;
 
 		StatusCode Start(const Description& CreationParameters);
+		// Starts without window, swap chain nor D3D11 device, to measure the CPU cost of FrameDX alone
+		// Objects are created on a NullDeviceBackend and the immediate context calls go to a NullContextBackend, which validate them
+		// Only what goes through the backends works, that is, the binder, states, buffers, textures created from a description,
+		// Texture::CopyFrom, shaders, input layouts, command recording and captures. Command recorders always use the recording backend
+		// Shaders are still compiled from their files, so they need the D3D compiler. GetDevice and GetImmediateContext return null,
+		// and Texture2D::CreateFromFile fails, as the loader needs a D3D11 device
+		StatusCode StartHeadless();
+		bool IsHeadless() { return ObjectBackend == &NullObjects; }
 
 		ID3D11Device * GetDevice() { return D3DDevice; }
+		// Creates the objects. Use it instead of GetDevice, so it works on headless devices
+		DeviceBackend * GetDeviceBackend() { return ObjectBackend; }
+		// Only valid on headless devices
+		NullDeviceBackend& GetNullDevice() { return NullObjects; }
+		NullContextBackend& GetNullContext() { return NullContext; }
 
 #define __GET_DEVICE_DECL(v) ID3D11Device ## v * GetDevice##v(bool LogWrongVersion = true) {\
 		if(LogWrongVersion && LogAssertAndContinue(DeviceVersion >= v,LogCategory::Error)) return nullptr;\
@@ -98,6 +129,10 @@ namespace FrameDX
 		__GET_DEVICE_DECL(5);
 
 		ID3D11DeviceContext * GetImmediateContext(){ return ImmediateContext; };
+		// The capture backend while capturing, so the calls made through it are captured
+		ContextBackend * GetImmediateBackend(){ return ActiveBackend; };
+		// Shared rasterizer, depth stencil, blend and sampler states
+		StateCache& GetStateCache(){ return States; };
 
 #define __GET_CONTEXT_DECL(v) ID3D11DeviceContext ## v * GetImmediateContext##v(bool LogWrongVersion = true) {\
 		if(LogWrongVersion && LogAssertAndContinue(ContextVersion >= v,LogCategory::Error)) return nullptr;\
@@ -122,8 +157,65 @@ namespace FrameDX
 
 		// Wraps a PeekMessage loop, and calls f on idle time
 		// The function returns true if it should continue
+		// The time of each frame is recorded on the frame stats
 		void EnterMainLoop(function<bool(double)> LoopBody);
 
+		// Same as above, but the simulation runs on its own thread at a fixed tick, decoupled from rendering
+		// Update(State, TickNanoseconds) advances the state one tick, and returns true if it should continue
+		// Render(Previous, Current, Alpha, FrameNanoseconds) gets the last two ticks, and how far the frame is between them ([0,1])
+		// so it can interpolate. Returns true if it should continue
+		// The state is passed to the render thread with a triple buffer, so neither side waits for the other
+		// and the frame rate is limited by the slower of the two instead of their sum
+		// Update runs outside of the render thread, so it must not use the immediate context
+		template<typename S, typename U, typename R>
+		void EnterMainLoop(U&& Update, R&& Render, chrono::nanoseconds TickPeriod, const S& InitialState = S())
+		{
+			struct tick_
+			{
+				S Previous;
+				S Current;
+				chrono::high_resolution_clock::time_point Time;
+			};
+			TripleBuffer<tick_> ticks({ InitialState, InitialState, chrono::high_resolution_clock::now() });
+			atomic<bool> running = true;
+
+			thread update_thread([&]()
+			{
+				S state = InitialState;
+				FramePacer pacer(TickPeriod);
+
+				while(running.load(memory_order_relaxed))
+				{
+					auto& tick = ticks.GetWriteBuffer();
+					tick.Previous = state;
+					if(!Update(state, (double)TickPeriod.count()))
+						running = false;
+					tick.Current = state;
+					tick.Time = chrono::high_resolution_clock::now();
+					ticks.Publish();
+
+					pacer.Wait();
+				}
+			});
+
+			EnterMainLoop([&](double FrameNanoseconds)
+			{
+				if(!running.load(memory_order_relaxed))
+					return false;
+
+				ticks.Update();
+				auto& tick = ticks.GetReadBuffer();
+				double alpha = chrono::duration<double>(chrono::high_resolution_clock::now() - tick.Time) / TickPeriod;
+				return (bool)Render(tick.Previous, tick.Current, min(max(alpha, 0.0), 1.0), FrameNanoseconds);
+			});
+
+			running = false;
+			update_thread.join();
+		}
+
+		// Frame times and timing scopes of the main loop. Can be read from any thread
+		FrameStats& GetFrameStats() { return Stats; }
+
 		Texture2D * GetBackbuffer(){ return &Backbuffer; }
 		Texture2D * GetZBuffer(){ return &ZBuffer; }
 
@@ -133,8 +225,56 @@ namespace FrameDX
 		// This DOES NOT prevent in/out conflicts in the provided pipeline state, it ONLY prevents it compared to the old state
 		// Null pointers are ignored. If you want to set something to null, you have to do it manually
 		void BindPipelineState(const PipelineState& NewState);
-
-		PipelineState GetCurrentPipelineStateCopy() { return CurrentPipelineState;  }
+		// Only checks the segments whose hash changed since the last baked state bound
+		void BindPipelineState(const BakedPipelineState& NewState);
+
+		PipelineState GetCurrentPipelineStateCopy() { return ImmediateBinder.GetCurrentPipelineStateCopy();  }
+
+		// Executes the lists on the immediate context, in order
+		// The immediate context state is reset afterwards, so the next BindPipelineState binds everything again
+		void ExecuteCommandLists(vector<unique_ptr<CommandList>>& Lists);
+
+		// Draws and dispatches on the immediate context, counted on the submission stats
+		// The constants bound and the constant buffers edited since the last one are sent first
+		void Draw(UINT VertexCount, UINT StartVertex) { flush_uploads_(); ActiveBackend->Draw(VertexCount, StartVertex); ImmediateBinder.GetStats().Draws++; }
+		void DrawIndexed(UINT IndexCount, UINT StartIndex, INT BaseVertex) { flush_uploads_(); ActiveBackend->DrawIndexed(IndexCount, StartIndex, BaseVertex); ImmediateBinder.GetStats().Draws++; }
+		void Dispatch(UINT GroupsX, UINT GroupsY, UINT GroupsZ) { flush_uploads_(); ActiveBackend->Dispatch(GroupsX, GroupsY, GroupsZ); ImmediateBinder.GetStats().Dispatches++; }
+		// Copies a whole resource on the immediate context, so it also works on headless devices and shows up on captures
+		void CopyResource(ID3D11Resource* Dest, ID3D11Resource* Source) { ActiveBackend->CopyResource(Dest, Source); }
+
+		// Copies the value to the upload ring and binds it to a constant buffer slot of the stage, until a state binds that slot again
+		// The ring is sent before the next draw or dispatch, with one map for everything bound since the previous one,
+		// so binding all the constants of a frame before its draws takes a single map
+		// Without a D3D11.1 context, or without a swap chain, each slot has its own dynamic buffer, mapped on every call
+		template<typename T>
+		StatusCode BindConstants(ShaderStage Stage, UINT Slot, const T& Value)
+		{
+			static_assert(sizeof(T) % 16 == 0, "T needs to be 16-bytes aligned");
+			return bind_constants_(Stage, Slot, &Value, sizeof(T));
+		}
+		// Not valid if the device can't use it, see BindConstants
+		UploadRing& GetUploadRing() { return Uploads; }
+
+		// Uploads the constant buffers edited since the last draw or dispatch, skipping the ones whose contents didn't change
+		// Draws and dispatches already do it, so it's only needed to use the buffers in other ways
+		void FlushConstantBuffers();
+
+		// Presents the backbuffer and ends the frame of the submission stats
+		StatusCode Present(UINT SyncInterval = 0, UINT Flags = 0);
+
+		// Calls sent to the immediate context during the last presented frame, including the command lists recorded with
+		// CommandRecorder::RecordAndExecute. Can be read from any thread
+		SubmissionStats GetSubmissionStats() { lock_guard<mutex> lock(SubmissionMutex); return LastSubmission; }
+		// Adds calls sent on other contexts to the current frame. Only from the thread that uses the immediate context
+		void AddSubmissionStats(const SubmissionStats& Stats) { ImmediateBinder.GetStats() += Stats; }
+
+		// Writes every call sent to the immediate context through the device to a trace, until EndCapture
+		// That is, the state changes sent by BindPipelineState, the buffer updates, draws, dispatches and presents
+		// The context state is cleared when the capture starts, so the trace doesn't depend on what was bound before
+		// Calls made directly on the ID3D11DeviceContext are not captured. Use TraceReplayer to run the trace
+		StatusCode BeginCapture(const string& Path);
+		void EndCapture();
+		bool IsCapturing() { return ActiveBackend == &Capture; }
 	
 		// Should be the last release called
 		// Not using a destructor because I can't know the order they'll be destructed
@@ -146,12 +286,8 @@ namespace FrameDX
 		template<typename T>
 		StatusCode UpdateBuffer(ID3D11Buffer* Buffer, const T& Value)
 		{
-			D3D11_MAPPED_SUBRESOURCE mapped;
-			ZeroMemory(&mapped, sizeof(D3D11_MAPPED_SUBRESOURCE));
-			LogCheckWithReturn(ImmediateContext->Map(Buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped), LogCategory::Error);
-
-			memcpy(mapped.pData, &Value, sizeof(T));
-			ImmediateContext->Unmap(Buffer, 0);
+			LogCheckWithReturn(ActiveBackend->UpdateBuffer(Buffer, &Value, sizeof(T)), LogCategory::Error);
+			ImmediateBinder.GetStats().Maps++;
 
 			return StatusCode::Ok;
 		}
@@ -159,30 +295,58 @@ namespace FrameDX
 		template<typename T>
 		StatusCode UpdateBufferFromVector(ID3D11Buffer* Buffer, const std::vector<T>& Data)
 		{
-			D3D11_MAPPED_SUBRESOURCE mapped;
-			ZeroMemory(&mapped, sizeof(D3D11_MAPPED_SUBRESOURCE));
-			LogCheckWithReturn(ImmediateContext->Map(Buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped), LogCategory::Error);
-
-			memcpy(mapped.pData, Data.data(), sizeof(T)*Data.size());
-			ImmediateContext->Unmap(Buffer, 0);
+			LogCheckWithReturn(ActiveBackend->UpdateBuffer(Buffer, Data.data(), sizeof(T)*Data.size()), LogCategory::Error);
+			ImmediateBinder.GetStats().Maps++;
 
 			return StatusCode::Ok;
 		}
 	private:
-		// Used to keep track of the bound state
-		enum class UAVStage { Compute, OutputMerger };
+		friend class TrackedConstantBuffer;
+		friend class RenderQueue;
 
-		unordered_multimap<ID3D11Resource*, ShaderStage> SRVBoundResources;
-		unordered_multimap<ID3D11Resource*, UAVStage> UAVBoundResources;
-		unordered_set<ID3D11Resource*> RTVBoundResources;
-		
-		PipelineState CurrentPipelineState;
-		bool IsPipelineStateValid;
+		StatusCode bind_constants_(ShaderStage Stage, UINT Slot, const void* Data, size_t Size);
+		void flush_uploads_()
+		{
+			if(!DirtyConstantBuffers.empty())
+				FlushConstantBuffers();
+			if(!Uploads.HasPending())
+				return;
+
+			size_t maps = Uploads.GetCounters().Maps;
+			LogCheckAndContinue(Uploads.Flush(ActiveBackend), LogCategory::Error);
+			ImmediateBinder.GetStats().Maps += (uint32_t)(Uploads.GetCounters().Maps - maps);
+		}
+
+		void track_constant_buffer_(TrackedConstantBuffer* Buffer) { DirtyConstantBuffers.push_back(Buffer); }
+		void forget_constant_buffer_(TrackedConstantBuffer* Buffer);
+		StatusCode upload_constant_buffer_(TrackedConstantBuffer& Buffer);
 
 		static LRESULT WINAPI InternalMessageProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 		ID3D11Device * D3DDevice;
 		ID3D11DeviceContext * ImmediateContext;
+		D3D11ContextBackend ImmediateBackend;
+		// Either the immediate backend or the capture, which forwards to it. The null context on headless devices
+		ContextBackend* ActiveBackend;
+		ContextBackend* immediate_backend_() { return IsHeadless() ? (ContextBackend*)&NullContext : &ImmediateBackend; }
+		// The D3D11 device, or the null one on headless devices
+		DeviceBackend* ObjectBackend;
+		D3D11DeviceBackend D3D11Objects;
+		NullDeviceBackend NullObjects;
+		NullContextBackend NullContext;
+		CaptureContextBackend Capture;
+		PipelineBinder ImmediateBinder;
+		StateCache States;
+
+		UploadRing Uploads;
+		// Used by BindConstants when there's no ring
+		ConstantSlotBuffers ConstantSlots;
+		// Constant buffers edited since the last flush, each one once
+		vector<TrackedConstantBuffer*> DirtyConstantBuffers;
+
+		// Counters of the last presented frame. The ones of the current frame are on the binder
+		mutex SubmissionMutex;
+		SubmissionStats LastSubmission;
 
 		int DeviceVersion;
 		int ContextVersion;
@@ -195,6 +359,7 @@ namespace FrameDX
 		HWND WindowHandle;
 		
 		std::chrono::time_point<std::chrono::high_resolution_clock> last_call_time;
+		FrameStats Stats;
 	};
 }
 
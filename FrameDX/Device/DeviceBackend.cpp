@@ -0,0 +1,681 @@
+#include "stdafx.h"
+#include "DeviceBackend.h"
+#include "../Core/Log.h"
+
+using namespace FrameDX;
+
+StatusCode D3D11DeviceBackend::CreateShader(ShaderStage Stage, const void* Bytecode, SIZE_T BytecodeSize, void** Out)
+{
+	switch(Stage)
+	{
+	case ShaderStage::Vertex:   return (StatusCode)D3DDevice->CreateVertexShader(Bytecode, BytecodeSize, nullptr, (ID3D11VertexShader**)Out);
+	case ShaderStage::Hull:     return (StatusCode)D3DDevice->CreateHullShader(Bytecode, BytecodeSize, nullptr, (ID3D11HullShader**)Out);
+	case ShaderStage::Domain:   return (StatusCode)D3DDevice->CreateDomainShader(Bytecode, BytecodeSize, nullptr, (ID3D11DomainShader**)Out);
+	case ShaderStage::Geometry: return (StatusCode)D3DDevice->CreateGeometryShader(Bytecode, BytecodeSize, nullptr, (ID3D11GeometryShader**)Out);
+	case ShaderStage::Pixel:    return (StatusCode)D3DDevice->CreatePixelShader(Bytecode, BytecodeSize, nullptr, (ID3D11PixelShader**)Out);
+	case ShaderStage::Compute:  return (StatusCode)D3DDevice->CreateComputeShader(Bytecode, BytecodeSize, nullptr, (ID3D11ComputeShader**)Out);
+	}
+	return StatusCode::InvalidArgument;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+namespace FrameDX
+{
+	// Live objects of a null device, with the type and debug name of each one
+	class null_registry_
+	{
+	public:
+		void track(const void* Object, const wchar_t* Type)
+		{
+			lock_guard<mutex> lock(Mutex);
+			Objects[Object] = { Type, "" };
+			Created++;
+		}
+		void untrack(const void* Object)
+		{
+			lock_guard<mutex> lock(Mutex);
+			Objects.erase(Object);
+		}
+		bool contains(const void* Object)
+		{
+			lock_guard<mutex> lock(Mutex);
+			return Objects.count(Object) != 0;
+		}
+		void set_name(const void* Object, const void* Data, UINT Size)
+		{
+			lock_guard<mutex> lock(Mutex);
+			// The names set by FrameDX are sent with and without the terminator
+			string name((const char*)Data, Size);
+			if(!name.empty() && name.back() == '\0')
+				name.pop_back();
+			Objects[Object].Name = move(name);
+		}
+		string get_name(const void* Object)
+		{
+			lock_guard<mutex> lock(Mutex);
+			return Objects[Object].Name;
+		}
+
+		struct entry_
+		{
+			const wchar_t* Type;
+			string Name;
+		};
+
+		mutex Mutex;
+		unordered_map<const void*, entry_> Objects;
+		size_t Created = 0;
+	};
+}
+
+namespace
+{
+	// Reference counted stand-in of a D3D11 object, registered while it's alive
+	// P is the interface between ID3D11DeviceChild and I, if any
+	template<typename I, typename P = I>
+	class null_child_ : public I
+	{
+	public:
+		null_child_(const shared_ptr<null_registry_>& Registry, const wchar_t* Type) : Registry(Registry), References(1) { Registry->track(this, Type); }
+		virtual ~null_child_() { Registry->untrack(this); }
+
+		ULONG STDMETHODCALLTYPE AddRef() override { return ++References; }
+		ULONG STDMETHODCALLTYPE Release() override
+		{
+			ULONG count = --References;
+			if(count == 0)
+				delete this;
+			return count;
+		}
+		HRESULT STDMETHODCALLTYPE QueryInterface(REFIID Id, void** Out) override
+		{
+			if(!Out)
+				return E_POINTER;
+			if(Id == __uuidof(IUnknown) || Id == __uuidof(ID3D11DeviceChild) || Id == __uuidof(P) || Id == __uuidof(I))
+			{
+				AddRef();
+				*Out = this;
+				return S_OK;
+			}
+			*Out = nullptr;
+			return E_NOINTERFACE;
+		}
+
+		// There is no device behind the objects
+		void STDMETHODCALLTYPE GetDevice(ID3D11Device** Out) override { *Out = nullptr; }
+		// Only the debug name is stored, as FrameDX doesn't use any other data
+		HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID Id, UINT* Size, void* Data) override
+		{
+			if(Id != WKPDID_D3DDebugObjectName || !Size)
+				return E_INVALIDARG;
+
+			string name = Registry->get_name(this);
+			if(Data)
+			{
+				if(*Size < name.size())
+					return E_INVALIDARG;
+				memcpy(Data, name.data(), name.size());
+			}
+			*Size = (UINT)name.size();
+			return S_OK;
+		}
+		HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID Id, UINT Size, const void* Data) override
+		{
+			if(Id != WKPDID_D3DDebugObjectName || (Size > 0 && !Data))
+				return E_INVALIDARG;
+
+			Registry->set_name(this, Data, Size);
+			return S_OK;
+		}
+		HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID Id, const IUnknown* Data) override { return E_NOTIMPL; }
+	private:
+		shared_ptr<null_registry_> Registry;
+		atomic<ULONG> References;
+	};
+
+	template<typename I, typename D, D3D11_RESOURCE_DIMENSION Dimension>
+	class null_resource_ : public null_child_<I, ID3D11Resource>
+	{
+	public:
+		null_resource_(const shared_ptr<null_registry_>& Registry, const wchar_t* Type, const D& Desc) :
+			null_child_<I, ID3D11Resource>(Registry, Type), Desc(Desc), EvictionPriority(0) {}
+
+		void STDMETHODCALLTYPE GetType(D3D11_RESOURCE_DIMENSION* Out) override { *Out = Dimension; }
+		void STDMETHODCALLTYPE SetEvictionPriority(UINT Priority) override { EvictionPriority = Priority; }
+		UINT STDMETHODCALLTYPE GetEvictionPriority() override { return EvictionPriority; }
+		void STDMETHODCALLTYPE GetDesc(D* Out) override { *Out = Desc; }
+	private:
+		D Desc;
+		UINT EvictionPriority;
+	};
+
+	// Holds a reference to the resource, as D3D11 does
+	template<typename I, typename D>
+	class null_view_ : public null_child_<I, ID3D11View>
+	{
+	public:
+		null_view_(const shared_ptr<null_registry_>& Registry, const wchar_t* Type, ID3D11Resource* Resource, const D& Desc) :
+			null_child_<I, ID3D11View>(Registry, Type), Resource(Resource), Desc(Desc) { Resource->AddRef(); }
+		~null_view_() { Resource->Release(); }
+
+		void STDMETHODCALLTYPE GetResource(ID3D11Resource** Out) override { Resource->AddRef(); *Out = Resource; }
+		void STDMETHODCALLTYPE GetDesc(D* Out) override { *Out = Desc; }
+	private:
+		ID3D11Resource* Resource;
+		D Desc;
+	};
+
+	template<typename I, typename D>
+	class null_state_ : public null_child_<I>
+	{
+	public:
+		null_state_(const shared_ptr<null_registry_>& Registry, const wchar_t* Type, const D& Desc) : null_child_<I>(Registry, Type), Desc(Desc) {}
+
+		void STDMETHODCALLTYPE GetDesc(D* Out) override { *Out = Desc; }
+	private:
+		D Desc;
+	};
+
+	// Bind flags of a buffer or 2D texture, 0 for the rest
+	UINT get_bind_flags_(ID3D11Resource* Resource)
+	{
+		D3D11_RESOURCE_DIMENSION type;
+		Resource->GetType(&type);
+
+		if(type == D3D11_RESOURCE_DIMENSION_BUFFER)
+		{
+			D3D11_BUFFER_DESC desc;
+			((ID3D11Buffer*)Resource)->GetDesc(&desc);
+			return desc.BindFlags;
+		}
+		if(type == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+		{
+			D3D11_TEXTURE2D_DESC desc;
+			((ID3D11Texture2D*)Resource)->GetDesc(&desc);
+			return desc.BindFlags;
+		}
+		return 0;
+	}
+
+	template<typename D>
+	D desc_or_zero_(const D* Desc)
+	{
+		D desc;
+		if(Desc)
+			desc = *Desc;
+		else
+			memset(&desc, 0, sizeof(D));
+		return desc;
+	}
+}
+
+NullDeviceBackend::NullDeviceBackend() :
+	Registry(make_shared<null_registry_>())
+{
+}
+
+StatusCode NullDeviceBackend::CreateBuffer(const D3D11_BUFFER_DESC* Desc, const D3D11_SUBRESOURCE_DATA* Data, ID3D11Buffer** Out)
+{
+	if(LogAssertAndContinue(Desc && Out, LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(Desc->ByteWidth > 0, LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(!Data || Data->pSysMem, LogCategory::Error))
+		return fail_();
+
+	if(Desc->BindFlags & D3D11_BIND_CONSTANT_BUFFER)
+	{
+		// Feature level 11.0 can't bind constant buffers as anything else
+		if(LogAssertAndContinue(Desc->BindFlags == D3D11_BIND_CONSTANT_BUFFER, LogCategory::Error))
+			return fail_();
+		if(LogAssertAndContinue(Desc->ByteWidth % 16 == 0 && Desc->ByteWidth <= D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT * 16, LogCategory::Error))
+			return fail_();
+	}
+	if(Desc->MiscFlags & D3D11_RESOURCE_MISC_BUFFER_STRUCTURED)
+	{
+		if(LogAssertAndContinue(Desc->StructureByteStride > 0 && Desc->ByteWidth % Desc->StructureByteStride == 0, LogCategory::Error))
+			return fail_();
+	}
+
+	switch(Desc->Usage)
+	{
+	case D3D11_USAGE_IMMUTABLE:
+		if(LogAssertAndContinue(Data && Desc->CPUAccessFlags == 0 && !(Desc->BindFlags & D3D11_BIND_UNORDERED_ACCESS), LogCategory::Error))
+			return fail_();
+		break;
+	case D3D11_USAGE_DYNAMIC:
+		if(LogAssertAndContinue(Desc->CPUAccessFlags == D3D11_CPU_ACCESS_WRITE && !(Desc->BindFlags & D3D11_BIND_UNORDERED_ACCESS), LogCategory::Error))
+			return fail_();
+		break;
+	case D3D11_USAGE_STAGING:
+		if(LogAssertAndContinue(Desc->BindFlags == 0 && Desc->CPUAccessFlags != 0, LogCategory::Error))
+			return fail_();
+		break;
+	default:
+		if(LogAssertAndContinue(!(Desc->CPUAccessFlags & D3D11_CPU_ACCESS_WRITE), LogCategory::Error))
+			return fail_();
+		break;
+	}
+
+	*Out = new null_resource_<ID3D11Buffer, D3D11_BUFFER_DESC, D3D11_RESOURCE_DIMENSION_BUFFER>(Registry, L"Buffer", *Desc);
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateTexture2D(const D3D11_TEXTURE2D_DESC* Desc, const D3D11_SUBRESOURCE_DATA* Data, ID3D11Texture2D** Out)
+{
+	if(LogAssertAndContinue(Desc && Out, LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(Desc->Width > 0 && Desc->Width <= D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION &&
+							Desc->Height > 0 && Desc->Height <= D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION, LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(Desc->ArraySize > 0 && Desc->SampleDesc.Count > 0, LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(!Data || Data->pSysMem, LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(Desc->Usage != D3D11_USAGE_IMMUTABLE || Data, LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(!(Desc->BindFlags & (D3D11_BIND_CONSTANT_BUFFER | D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_INDEX_BUFFER)), LogCategory::Error))
+		return fail_();
+
+	*Out = new null_resource_<ID3D11Texture2D, D3D11_TEXTURE2D_DESC, D3D11_RESOURCE_DIMENSION_TEXTURE2D>(Registry, L"Texture2D", *Desc);
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateShaderResourceView(ID3D11Resource* Resource, const D3D11_SHADER_RESOURCE_VIEW_DESC* Desc, ID3D11ShaderResourceView** Out)
+{
+	if(LogAssertAndContinue(Resource && Out && IsLive(Resource), LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(get_bind_flags_(Resource) & D3D11_BIND_SHADER_RESOURCE, LogCategory::Error))
+		return fail_();
+
+	*Out = new null_view_<ID3D11ShaderResourceView, D3D11_SHADER_RESOURCE_VIEW_DESC>(Registry, L"ShaderResourceView", Resource, desc_or_zero_(Desc));
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateUnorderedAccessView(ID3D11Resource* Resource, const D3D11_UNORDERED_ACCESS_VIEW_DESC* Desc, ID3D11UnorderedAccessView** Out)
+{
+	if(LogAssertAndContinue(Resource && Out && IsLive(Resource), LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(get_bind_flags_(Resource) & D3D11_BIND_UNORDERED_ACCESS, LogCategory::Error))
+		return fail_();
+
+	*Out = new null_view_<ID3D11UnorderedAccessView, D3D11_UNORDERED_ACCESS_VIEW_DESC>(Registry, L"UnorderedAccessView", Resource, desc_or_zero_(Desc));
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateRenderTargetView(ID3D11Resource* Resource, const D3D11_RENDER_TARGET_VIEW_DESC* Desc, ID3D11RenderTargetView** Out)
+{
+	if(LogAssertAndContinue(Resource && Out && IsLive(Resource), LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(get_bind_flags_(Resource) & D3D11_BIND_RENDER_TARGET, LogCategory::Error))
+		return fail_();
+
+	*Out = new null_view_<ID3D11RenderTargetView, D3D11_RENDER_TARGET_VIEW_DESC>(Registry, L"RenderTargetView", Resource, desc_or_zero_(Desc));
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateDepthStencilView(ID3D11Resource* Resource, const D3D11_DEPTH_STENCIL_VIEW_DESC* Desc, ID3D11DepthStencilView** Out)
+{
+	if(LogAssertAndContinue(Resource && Out && IsLive(Resource), LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(get_bind_flags_(Resource) & D3D11_BIND_DEPTH_STENCIL, LogCategory::Error))
+		return fail_();
+
+	*Out = new null_view_<ID3D11DepthStencilView, D3D11_DEPTH_STENCIL_VIEW_DESC>(Registry, L"DepthStencilView", Resource, desc_or_zero_(Desc));
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC* Elements, UINT Count, const void* Bytecode, SIZE_T BytecodeSize, ID3D11InputLayout** Out)
+{
+	if(LogAssertAndContinue(Out && Bytecode && BytecodeSize > 0, LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(Count == 0 || Elements, LogCategory::Error))
+		return fail_();
+	for(UINT i = 0; i < Count; i++)
+	{
+		if(LogAssertAndContinue(Elements[i].SemanticName != nullptr, LogCategory::Error))
+			return fail_();
+	}
+
+	*Out = new null_child_<ID3D11InputLayout>(Registry, L"InputLayout");
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateShader(ShaderStage Stage, const void* Bytecode, SIZE_T BytecodeSize, void** Out)
+{
+	if(LogAssertAndContinue(Out && Bytecode && BytecodeSize > 0, LogCategory::Error))
+		return fail_();
+
+	switch(Stage)
+	{
+	case ShaderStage::Vertex:   *Out = static_cast<ID3D11VertexShader*>(new null_child_<ID3D11VertexShader>(Registry, L"VertexShader"));       break;
+	case ShaderStage::Hull:     *Out = static_cast<ID3D11HullShader*>(new null_child_<ID3D11HullShader>(Registry, L"HullShader"));             break;
+	case ShaderStage::Domain:   *Out = static_cast<ID3D11DomainShader*>(new null_child_<ID3D11DomainShader>(Registry, L"DomainShader"));       break;
+	case ShaderStage::Geometry: *Out = static_cast<ID3D11GeometryShader*>(new null_child_<ID3D11GeometryShader>(Registry, L"GeometryShader")); break;
+	case ShaderStage::Pixel:    *Out = static_cast<ID3D11PixelShader*>(new null_child_<ID3D11PixelShader>(Registry, L"PixelShader"));          break;
+	case ShaderStage::Compute:  *Out = static_cast<ID3D11ComputeShader*>(new null_child_<ID3D11ComputeShader>(Registry, L"ComputeShader"));    break;
+	default:
+		return fail_();
+	}
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateRasterizerState(const D3D11_RASTERIZER_DESC* Desc, ID3D11RasterizerState** Out)
+{
+	if(LogAssertAndContinue(Desc && Out, LogCategory::Error))
+		return fail_();
+
+	*Out = new null_state_<ID3D11RasterizerState, D3D11_RASTERIZER_DESC>(Registry, L"RasterizerState", *Desc);
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC* Desc, ID3D11DepthStencilState** Out)
+{
+	if(LogAssertAndContinue(Desc && Out, LogCategory::Error))
+		return fail_();
+
+	*Out = new null_state_<ID3D11DepthStencilState, D3D11_DEPTH_STENCIL_DESC>(Registry, L"DepthStencilState", *Desc);
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateBlendState(const D3D11_BLEND_DESC* Desc, ID3D11BlendState** Out)
+{
+	if(LogAssertAndContinue(Desc && Out, LogCategory::Error))
+		return fail_();
+
+	*Out = new null_state_<ID3D11BlendState, D3D11_BLEND_DESC>(Registry, L"BlendState", *Desc);
+	return StatusCode::Ok;
+}
+
+StatusCode NullDeviceBackend::CreateSamplerState(const D3D11_SAMPLER_DESC* Desc, ID3D11SamplerState** Out)
+{
+	if(LogAssertAndContinue(Desc && Out, LogCategory::Error))
+		return fail_();
+	if(LogAssertAndContinue(Desc->MinLOD <= Desc->MaxLOD, LogCategory::Error))
+		return fail_();
+
+	*Out = new null_state_<ID3D11SamplerState, D3D11_SAMPLER_DESC>(Registry, L"SamplerState", *Desc);
+	return StatusCode::Ok;
+}
+
+bool NullDeviceBackend::IsLive(const void* Object)
+{
+	return Registry->contains(Object);
+}
+
+size_t NullDeviceBackend::GetLiveObjectCount()
+{
+	lock_guard<mutex> lock(Registry->Mutex);
+	return Registry->Objects.size();
+}
+
+size_t NullDeviceBackend::GetCreatedObjectCount()
+{
+	lock_guard<mutex> lock(Registry->Mutex);
+	return Registry->Created;
+}
+
+size_t NullDeviceBackend::ReportLiveObjects()
+{
+	lock_guard<mutex> lock(Registry->Mutex);
+	for(auto& [object, entry] : Registry->Objects)
+	{
+		wstring message = L"Live object : ";
+		message += entry.Type;
+		if(!entry.Name.empty())
+			message += L" " + wstring(entry.Name.begin(), entry.Name.end());
+		LogMsg(message, LogCategory::Warning);
+	}
+	return Registry->Objects.size();
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Logs and counts the failed checks
+#define __NULL_CHECK(cond) if(LogAssertAndContinue(cond, LogCategory::Error)) Counts.Errors++;
+
+void NullContextBackend::check_object_(const void* Object)
+{
+	if(Object && Objects)
+		__NULL_CHECK(Objects->IsLive(Object));
+}
+
+template<typename T>
+void NullContextBackend::check_range_(UINT StartSlot, UINT Count, T* const* Values, UINT SlotCount)
+{
+	Counts.Slots += Count;
+
+	__NULL_CHECK(StartSlot <= SlotCount && Count <= SlotCount - StartSlot);
+	__NULL_CHECK(Count == 0 || Values);
+	if(Values)
+		for(UINT i = 0; i < Count; i++)
+			check_object_(Values[i]);
+}
+
+void NullContextBackend::IASetIndexBuffer(ID3D11Buffer* Buffer, DXGI_FORMAT Format, UINT Offset)
+{
+	Counts.Calls++;
+	__NULL_CHECK(!Buffer || Format == DXGI_FORMAT_R16_UINT || Format == DXGI_FORMAT_R32_UINT);
+	check_object_(Buffer);
+}
+
+void NullContextBackend::IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* Strides, const UINT* Offsets)
+{
+	Counts.Calls++;
+	check_range_(StartSlot, Count, Buffers, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT);
+	__NULL_CHECK(Count == 0 || (Strides && Offsets));
+}
+
+void NullContextBackend::IASetInputLayout(ID3D11InputLayout* Layout)
+{
+	Counts.Calls++;
+	check_object_(Layout);
+}
+
+void NullContextBackend::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology)
+{
+	Counts.Calls++;
+}
+
+void NullContextBackend::RSSetViewports(UINT Count, const D3D11_VIEWPORT* Viewports)
+{
+	Counts.Calls++;
+	Counts.Slots += Count;
+	__NULL_CHECK(Count <= D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE && (Count == 0 || Viewports));
+}
+
+void NullContextBackend::RSSetState(ID3D11RasterizerState* State)
+{
+	Counts.Calls++;
+	check_object_(State);
+}
+
+void NullContextBackend::OMSetDepthStencilState(ID3D11DepthStencilState* State, UINT StencilRef)
+{
+	Counts.Calls++;
+	check_object_(State);
+}
+
+void NullContextBackend::OMSetBlendState(ID3D11BlendState* State, const FLOAT BlendFactors[4], UINT SampleMask)
+{
+	Counts.Calls++;
+	check_object_(State);
+}
+
+void NullContextBackend::OMSetRenderTargets(UINT Count, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV)
+{
+	Counts.Calls++;
+	check_range_(0, Count, RTVs, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT);
+	check_object_(DSV);
+}
+
+void NullContextBackend::OMSetRenderTargetsAndUnorderedAccessViews(UINT RTVCount, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV,
+																	 UINT UAVStart, UINT UAVCount, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts)
+{
+	Counts.Calls++;
+
+	bool keep_rtvs = RTVCount == D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL;
+	if(!keep_rtvs)
+	{
+		check_range_(0, RTVCount, RTVs, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT);
+		check_object_(DSV);
+	}
+
+	if(UAVCount != D3D11_KEEP_UNORDERED_ACCESS_VIEWS)
+	{
+		// The UAVs go after the render targets
+		__NULL_CHECK(keep_rtvs || UAVCount == 0 || UAVStart >= RTVCount);
+		check_range_(UAVStart, UAVCount, UAVs, D3D11_1_UAV_SLOT_COUNT);
+	}
+}
+
+void NullContextBackend::CSSetUnorderedAccessViews(UINT StartSlot, UINT Count, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts)
+{
+	Counts.Calls++;
+	check_range_(StartSlot, Count, UAVs, D3D11_1_UAV_SLOT_COUNT);
+}
+
+void NullContextBackend::SetShader(ShaderStage Stage, void* ShaderPointer)
+{
+	Counts.Calls++;
+	check_object_(ShaderPointer);
+}
+
+void NullContextBackend::SetShaderResources(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* SRVs)
+{
+	Counts.Calls++;
+	check_range_(StartSlot, Count, SRVs, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT);
+}
+
+void NullContextBackend::SetConstantBuffers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers)
+{
+	Counts.Calls++;
+	check_range_(StartSlot, Count, Buffers, D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT);
+}
+
+void NullContextBackend::SetConstantBuffers1(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* FirstConstants, const UINT* NumConstants)
+{
+	Counts.Calls++;
+	check_range_(StartSlot, Count, Buffers, D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT);
+	if(!Buffers || Count == 0)
+		return;
+
+	__NULL_CHECK(FirstConstants && NumConstants);
+	if(!FirstConstants || !NumConstants)
+		return;
+
+	// The ranges are in multiples of 16 constants, up to the size of a constant buffer, and inside the buffer
+	for(UINT i = 0; i < Count; i++)
+	{
+		if(!Buffers[i])
+			continue;
+
+		D3D11_BUFFER_DESC desc;
+		Buffers[i]->GetDesc(&desc);
+		__NULL_CHECK(FirstConstants[i] % 16 == 0 && NumConstants[i] % 16 == 0 && NumConstants[i] > 0 &&
+					 NumConstants[i] <= D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT &&
+					 ((size_t)FirstConstants[i] + NumConstants[i]) * 16 <= desc.ByteWidth);
+	}
+}
+
+void NullContextBackend::SetSamplers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11SamplerState* const* Samplers)
+{
+	Counts.Calls++;
+	check_range_(StartSlot, Count, Samplers, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT);
+}
+
+void NullContextBackend::ClearRenderTargetView(ID3D11RenderTargetView* RTV, const FLOAT Color[4])
+{
+	Counts.Calls++;
+	__NULL_CHECK(RTV && Color);
+	check_object_(RTV);
+}
+
+void NullContextBackend::ClearDepthStencilView(ID3D11DepthStencilView* DSV, UINT Flags, FLOAT Depth, UINT8 Stencil)
+{
+	Counts.Calls++;
+	__NULL_CHECK(DSV && Depth >= 0.0f && Depth <= 1.0f);
+	check_object_(DSV);
+}
+
+void NullContextBackend::CopyResource(ID3D11Resource* Dest, ID3D11Resource* Source)
+{
+	Counts.Calls++;
+	__NULL_CHECK(Dest && Source && Dest != Source);
+	check_object_(Dest);
+	check_object_(Source);
+}
+
+void NullContextBackend::Draw(UINT VertexCount, UINT StartVertex)
+{
+	Counts.Calls++;
+	Counts.Draws++;
+}
+
+void NullContextBackend::DrawIndexed(UINT IndexCount, UINT StartIndex, INT BaseVertex)
+{
+	Counts.Calls++;
+	Counts.Draws++;
+}
+
+void NullContextBackend::Dispatch(UINT GroupsX, UINT GroupsY, UINT GroupsZ)
+{
+	Counts.Calls++;
+	Counts.Dispatches++;
+	__NULL_CHECK(GroupsX <= D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION &&
+				 GroupsY <= D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION &&
+				 GroupsZ <= D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION);
+}
+
+StatusCode NullContextBackend::UpdateBuffer(ID3D11Buffer* Buffer, const void* Data, size_t Size)
+{
+	Counts.Calls++;
+	Counts.Updates++;
+	Counts.UpdatedBytes += Size;
+
+	if(LogAssertAndContinue(Buffer && (Data || Size == 0), LogCategory::Error) ||
+	   LogAssertAndContinue(!Objects || Objects->IsLive(Buffer), LogCategory::Error))
+	{
+		Counts.Errors++;
+		return StatusCode::InvalidArgument;
+	}
+
+	// Mapped with discard, so it has to be dynamic and the data has to fit
+	D3D11_BUFFER_DESC desc;
+	Buffer->GetDesc(&desc);
+	if(LogAssertAndContinue(desc.Usage == D3D11_USAGE_DYNAMIC && (desc.CPUAccessFlags & D3D11_CPU_ACCESS_WRITE) && Size <= desc.ByteWidth, LogCategory::Error))
+	{
+		Counts.Errors++;
+		return StatusCode::InvalidArgument;
+	}
+
+	return StatusCode::Ok;
+}
+
+StatusCode NullContextBackend::UpdateBufferRange(ID3D11Buffer* Buffer, size_t Offset, const void* Data, size_t Size, bool Discard)
+{
+	Counts.Calls++;
+	Counts.Updates++;
+	Counts.UpdatedBytes += Size;
+
+	if(LogAssertAndContinue(Buffer && (Data || Size == 0), LogCategory::Error) ||
+	   LogAssertAndContinue(!Objects || Objects->IsLive(Buffer), LogCategory::Error))
+	{
+		Counts.Errors++;
+		return StatusCode::InvalidArgument;
+	}
+
+	// Mapped with discard or no overwrite, so it has to be dynamic and the range has to be inside
+	D3D11_BUFFER_DESC desc;
+	Buffer->GetDesc(&desc);
+	if(LogAssertAndContinue(desc.Usage == D3D11_USAGE_DYNAMIC && (desc.CPUAccessFlags & D3D11_CPU_ACCESS_WRITE) && Offset <= desc.ByteWidth && Size <= desc.ByteWidth - Offset, LogCategory::Error))
+	{
+		Counts.Errors++;
+		return StatusCode::InvalidArgument;
+	}
+
+	return StatusCode::Ok;
+}
+
+#undef __NULL_CHECK
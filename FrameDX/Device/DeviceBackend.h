@@ -0,0 +1,184 @@
+#pragma once
+#include "stdafx.h"
+#include "../Core/Core.h"
+#include "ContextBackend.h"
+
+namespace FrameDX
+{
+	class null_registry_;
+
+	// The subset of ID3D11Device that FrameDX uses to create objects
+	// The objects returned are owned by the caller, like the ones returned by the device
+	class DeviceBackend
+	{
+	public:
+		virtual ~DeviceBackend() = default;
+
+		virtual StatusCode CreateBuffer(const D3D11_BUFFER_DESC* Desc, const D3D11_SUBRESOURCE_DATA* Data, ID3D11Buffer** Out) = 0;
+		virtual StatusCode CreateTexture2D(const D3D11_TEXTURE2D_DESC* Desc, const D3D11_SUBRESOURCE_DATA* Data, ID3D11Texture2D** Out) = 0;
+
+		virtual StatusCode CreateShaderResourceView(ID3D11Resource* Resource, const D3D11_SHADER_RESOURCE_VIEW_DESC* Desc, ID3D11ShaderResourceView** Out) = 0;
+		virtual StatusCode CreateUnorderedAccessView(ID3D11Resource* Resource, const D3D11_UNORDERED_ACCESS_VIEW_DESC* Desc, ID3D11UnorderedAccessView** Out) = 0;
+		virtual StatusCode CreateRenderTargetView(ID3D11Resource* Resource, const D3D11_RENDER_TARGET_VIEW_DESC* Desc, ID3D11RenderTargetView** Out) = 0;
+		virtual StatusCode CreateDepthStencilView(ID3D11Resource* Resource, const D3D11_DEPTH_STENCIL_VIEW_DESC* Desc, ID3D11DepthStencilView** Out) = 0;
+
+		virtual StatusCode CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC* Elements, UINT Count, const void* Bytecode, SIZE_T BytecodeSize, ID3D11InputLayout** Out) = 0;
+		// Out gets the shader interface of the stage, the same way as the pointer returned by Shader::GetShaderPointer
+		virtual StatusCode CreateShader(ShaderStage Stage, const void* Bytecode, SIZE_T BytecodeSize, void** Out) = 0;
+
+		virtual StatusCode CreateRasterizerState(const D3D11_RASTERIZER_DESC* Desc, ID3D11RasterizerState** Out) = 0;
+		virtual StatusCode CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC* Desc, ID3D11DepthStencilState** Out) = 0;
+		virtual StatusCode CreateBlendState(const D3D11_BLEND_DESC* Desc, ID3D11BlendState** Out) = 0;
+		virtual StatusCode CreateSamplerState(const D3D11_SAMPLER_DESC* Desc, ID3D11SamplerState** Out) = 0;
+	};
+
+	// Forwards everything to a D3D11 device
+	class D3D11DeviceBackend : public DeviceBackend
+	{
+	public:
+		D3D11DeviceBackend() : D3DDevice(nullptr) {}
+		explicit D3D11DeviceBackend(ID3D11Device* D3DDevice) : D3DDevice(D3DDevice) {}
+
+		ID3D11Device* GetDevice() { return D3DDevice; }
+		void SetDevice(ID3D11Device* NewDevice) { D3DDevice = NewDevice; }
+
+		virtual StatusCode CreateBuffer(const D3D11_BUFFER_DESC* Desc, const D3D11_SUBRESOURCE_DATA* Data, ID3D11Buffer** Out) override { return (StatusCode)D3DDevice->CreateBuffer(Desc, Data, Out); }
+		virtual StatusCode CreateTexture2D(const D3D11_TEXTURE2D_DESC* Desc, const D3D11_SUBRESOURCE_DATA* Data, ID3D11Texture2D** Out) override { return (StatusCode)D3DDevice->CreateTexture2D(Desc, Data, Out); }
+
+		virtual StatusCode CreateShaderResourceView(ID3D11Resource* Resource, const D3D11_SHADER_RESOURCE_VIEW_DESC* Desc, ID3D11ShaderResourceView** Out) override { return (StatusCode)D3DDevice->CreateShaderResourceView(Resource, Desc, Out); }
+		virtual StatusCode CreateUnorderedAccessView(ID3D11Resource* Resource, const D3D11_UNORDERED_ACCESS_VIEW_DESC* Desc, ID3D11UnorderedAccessView** Out) override { return (StatusCode)D3DDevice->CreateUnorderedAccessView(Resource, Desc, Out); }
+		virtual StatusCode CreateRenderTargetView(ID3D11Resource* Resource, const D3D11_RENDER_TARGET_VIEW_DESC* Desc, ID3D11RenderTargetView** Out) override { return (StatusCode)D3DDevice->CreateRenderTargetView(Resource, Desc, Out); }
+		virtual StatusCode CreateDepthStencilView(ID3D11Resource* Resource, const D3D11_DEPTH_STENCIL_VIEW_DESC* Desc, ID3D11DepthStencilView** Out) override { return (StatusCode)D3DDevice->CreateDepthStencilView(Resource, Desc, Out); }
+
+		virtual StatusCode CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC* Elements, UINT Count, const void* Bytecode, SIZE_T BytecodeSize, ID3D11InputLayout** Out) override
+		{
+			return (StatusCode)D3DDevice->CreateInputLayout(Elements, Count, Bytecode, BytecodeSize, Out);
+		}
+		virtual StatusCode CreateShader(ShaderStage Stage, const void* Bytecode, SIZE_T BytecodeSize, void** Out) override;
+
+		virtual StatusCode CreateRasterizerState(const D3D11_RASTERIZER_DESC* Desc, ID3D11RasterizerState** Out) override { return (StatusCode)D3DDevice->CreateRasterizerState(Desc, Out); }
+		virtual StatusCode CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC* Desc, ID3D11DepthStencilState** Out) override { return (StatusCode)D3DDevice->CreateDepthStencilState(Desc, Out); }
+		virtual StatusCode CreateBlendState(const D3D11_BLEND_DESC* Desc, ID3D11BlendState** Out) override { return (StatusCode)D3DDevice->CreateBlendState(Desc, Out); }
+		virtual StatusCode CreateSamplerState(const D3D11_SAMPLER_DESC* Desc, ID3D11SamplerState** Out) override { return (StatusCode)D3DDevice->CreateSamplerState(Desc, Out); }
+	private:
+		ID3D11Device* D3DDevice;
+	};
+
+	// Headless device. The objects are reference counted stand-ins that only keep their description, so nothing touches a GPU
+	// The arguments are validated with roughly the same rules as the debug layer, and the live objects are tracked to report leaks
+	// Used to measure the CPU cost of FrameDX alone, without the driver
+	// Thread safe
+	class NullDeviceBackend : public DeviceBackend
+	{
+	public:
+		NullDeviceBackend();
+
+		NullDeviceBackend(const NullDeviceBackend&) = delete;
+		NullDeviceBackend& operator=(const NullDeviceBackend&) = delete;
+
+		virtual StatusCode CreateBuffer(const D3D11_BUFFER_DESC* Desc, const D3D11_SUBRESOURCE_DATA* Data, ID3D11Buffer** Out) override;
+		virtual StatusCode CreateTexture2D(const D3D11_TEXTURE2D_DESC* Desc, const D3D11_SUBRESOURCE_DATA* Data, ID3D11Texture2D** Out) override;
+
+		virtual StatusCode CreateShaderResourceView(ID3D11Resource* Resource, const D3D11_SHADER_RESOURCE_VIEW_DESC* Desc, ID3D11ShaderResourceView** Out) override;
+		virtual StatusCode CreateUnorderedAccessView(ID3D11Resource* Resource, const D3D11_UNORDERED_ACCESS_VIEW_DESC* Desc, ID3D11UnorderedAccessView** Out) override;
+		virtual StatusCode CreateRenderTargetView(ID3D11Resource* Resource, const D3D11_RENDER_TARGET_VIEW_DESC* Desc, ID3D11RenderTargetView** Out) override;
+		virtual StatusCode CreateDepthStencilView(ID3D11Resource* Resource, const D3D11_DEPTH_STENCIL_VIEW_DESC* Desc, ID3D11DepthStencilView** Out) override;
+
+		virtual StatusCode CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC* Elements, UINT Count, const void* Bytecode, SIZE_T BytecodeSize, ID3D11InputLayout** Out) override;
+		virtual StatusCode CreateShader(ShaderStage Stage, const void* Bytecode, SIZE_T BytecodeSize, void** Out) override;
+
+		virtual StatusCode CreateRasterizerState(const D3D11_RASTERIZER_DESC* Desc, ID3D11RasterizerState** Out) override;
+		virtual StatusCode CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC* Desc, ID3D11DepthStencilState** Out) override;
+		virtual StatusCode CreateBlendState(const D3D11_BLEND_DESC* Desc, ID3D11BlendState** Out) override;
+		virtual StatusCode CreateSamplerState(const D3D11_SAMPLER_DESC* Desc, ID3D11SamplerState** Out) override;
+
+		// True if Object was created here and wasn't destroyed yet
+		bool IsLive(const void* Object);
+		size_t GetLiveObjectCount();
+		// Objects created since the backend was constructed
+		size_t GetCreatedObjectCount();
+		// Creations that failed the validation
+		size_t GetErrorCount() { return Errors.load(memory_order_relaxed); }
+
+		// Logs a warning with the type and debug name of each live object. Returns the number of them
+		size_t ReportLiveObjects();
+	private:
+		StatusCode fail_() { Errors++; return StatusCode::InvalidArgument; }
+
+		// Shared with the objects, so they can be released after the backend
+		shared_ptr<null_registry_> Registry;
+		atomic<size_t> Errors = 0;
+	};
+
+	// Headless context. Validates the calls and counts them, without executing anything
+	// If Objects is set, binding an object that is not live on it is an error, which catches the use of released objects
+	// Not thread safe, as the immediate context
+	class NullContextBackend : public ContextBackend
+	{
+	public:
+		struct Counters
+		{
+			size_t Calls = 0;
+			// Slots sent by the calls that take arrays
+			size_t Slots = 0;
+			size_t Draws = 0;
+			size_t Dispatches = 0;
+			size_t Updates = 0;
+			size_t UpdatedBytes = 0;
+			// Calls that failed the validation
+			size_t Errors = 0;
+		};
+
+		explicit NullContextBackend(NullDeviceBackend* Objects = nullptr) : Objects(Objects) {}
+
+		void SetObjectBackend(NullDeviceBackend* NewObjects) { Objects = NewObjects; }
+
+		const Counters& GetCounters() const { return Counts; }
+		void ResetCounters() { Counts = Counters(); }
+
+		virtual void IASetIndexBuffer(ID3D11Buffer* Buffer, DXGI_FORMAT Format, UINT Offset) override;
+		virtual void IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* Strides, const UINT* Offsets) override;
+		virtual void IASetInputLayout(ID3D11InputLayout* Layout) override;
+		virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology) override;
+
+		virtual void RSSetViewports(UINT Count, const D3D11_VIEWPORT* Viewports) override;
+		virtual void RSSetState(ID3D11RasterizerState* State) override;
+
+		virtual void OMSetDepthStencilState(ID3D11DepthStencilState* State, UINT StencilRef) override;
+		virtual void OMSetBlendState(ID3D11BlendState* State, const FLOAT BlendFactors[4], UINT SampleMask) override;
+		virtual void OMSetRenderTargets(UINT Count, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV) override;
+		virtual void OMSetRenderTargetsAndUnorderedAccessViews(UINT RTVCount, ID3D11RenderTargetView* const* RTVs, ID3D11DepthStencilView* DSV,
+															   UINT UAVStart, UINT UAVCount, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts) override;
+		virtual void CSSetUnorderedAccessViews(UINT StartSlot, UINT Count, ID3D11UnorderedAccessView* const* UAVs, const UINT* InitialCounts) override;
+
+		virtual void SetShader(ShaderStage Stage, void* ShaderPointer) override;
+		virtual void SetShaderResources(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* SRVs) override;
+		virtual void SetConstantBuffers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers) override;
+		virtual void SetConstantBuffers1(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* Buffers, const UINT* FirstConstants, const UINT* NumConstants) override;
+		virtual void SetSamplers(ShaderStage Stage, UINT StartSlot, UINT Count, ID3D11SamplerState* const* Samplers) override;
+
+		virtual void ClearRenderTargetView(ID3D11RenderTargetView* RTV, const FLOAT Color[4]) override;
+		virtual void ClearDepthStencilView(ID3D11DepthStencilView* DSV, UINT Flags, FLOAT Depth, UINT8 Stencil) override;
+		virtual void CopyResource(ID3D11Resource* Dest, ID3D11Resource* Source) override;
+
+		virtual void Draw(UINT VertexCount, UINT StartVertex) override;
+		virtual void DrawIndexed(UINT IndexCount, UINT StartIndex, INT BaseVertex) override;
+		virtual void Dispatch(UINT GroupsX, UINT GroupsY, UINT GroupsZ) override;
+
+		virtual StatusCode UpdateBuffer(ID3D11Buffer* Buffer, const void* Data, size_t Size) override;
+		virtual StatusCode UpdateBufferRange(ID3D11Buffer* Buffer, size_t Offset, const void* Data, size_t Size, bool Discard) override;
+
+		// Not supported, as on immediate contexts
+		virtual StatusCode FinishCommandList(unique_ptr<CommandList>& Out) override { return StatusCode::NotImplemented; }
+		// Command lists of real contexts can't be executed
+		virtual void ExecuteCommandList(ID3D11CommandList* List) override { Counts.Calls++; }
+	private:
+		// Log and count an error if the check fails
+		void check_object_(const void* Object);
+		template<typename T>
+		void check_range_(UINT StartSlot, UINT Count, T* const* Values, UINT SlotCount);
+
+		NullDeviceBackend* Objects;
+		Counters Counts;
+	};
+}
@@ -0,0 +1,517 @@
+#include "stdafx.h"
+#include "PipelineBinder.h"
+#include "../Shader/Shaders.h"
+
+using namespace FrameDX;
+
+void PipelineBinder::Bind(const PipelineState& NewState)
+{
+	Stats.Binds++;
+	bind_(NewState, BakedPipelineState::AllSegments);
+
+	// There are no hashes to compare against, so the next baked bind must check everything
+	ValidHashes = 0;
+}
+
+void PipelineBinder::Bind(const BakedPipelineState& NewState)
+{
+	// Only the segments that changed since the last baked state are checked
+	uint32_t mask = 0;
+	for (uint32_t segment = 0; segment < (uint32_t)BakedPipelineState::Segment::_count; segment++)
+	{
+		uint64_t hash = NewState.GetHash((BakedPipelineState::Segment)segment);
+		if (!(ValidHashes & (1u << segment)) || BoundHashes[segment] != hash)
+			mask |= 1u << segment;
+		BoundHashes[segment] = hash;
+	}
+
+	Stats.Binds++;
+	Stats.SkippedSegments += (uint32_t)bitset<32>(BakedPipelineState::AllSegments & ~mask).count();
+	if (!mask)
+		return;
+
+	uint32_t disturbed = bind_(NewState.GetState(), mask);
+	ValidHashes = BakedPipelineState::AllSegments & ~disturbed;
+}
+
+void PipelineBinder::BindConstantBuffer(ShaderStage Stage, UINT Slot, ID3D11Buffer* Buffer, UINT FirstConstant, UINT NumConstants)
+{
+	if (Slot >= D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT)
+		return;
+
+	// Ranges are always sent, as they usually point to a new allocation
+	auto& stage_stats = Stats.Stages[(size_t)Stage];
+	if (NumConstants)
+		Backend->SetConstantBuffers1(Stage, Slot, 1, &Buffer, &FirstConstant, &NumConstants);
+	else if (BoundConstantBuffers[(size_t)Stage][Slot] != Buffer)
+		Backend->SetConstantBuffers(Stage, Slot, 1, &Buffer);
+	else
+	{
+		stage_stats.Skipped++;
+		return;
+	}
+	stage_stats.Calls++;
+	stage_stats.Slots++;
+	BoundConstantBuffers[(size_t)Stage][Slot] = Buffer;
+
+	// The tracked table has to differ from any state that binds another buffer there, so it's checked again
+	auto& table = CurrentPipelineState.Shaders[(size_t)Stage].ConstantBuffersTable;
+	if (Slot < table.size())
+		table[Slot] = Buffer;
+	ValidHashes &= ~(1u << (uint32_t)Stage);
+}
+
+uint32_t PipelineBinder::bind_(const PipelineState& NewState, uint32_t SegmentMask)
+{
+#define changed(v) (!IsPipelineStateValid || (CurrentPipelineState.v != NewState.v))
+#define update(v) CurrentPipelineState.v = NewState.v
+#define segment(s) (SegmentMask & (1u << (uint32_t)BakedPipelineState::Segment::s))
+	// Shader resources and compute UAVs are unbound only on the slots that have a conflict
+	// The output merger can't unbind single slots, so its render targets or UAVs are unbound all at once
+	bitset<D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT> srv_conflicts[(size_t)ShaderStage::_count]; // one per stage
+	bitset<D3D11_1_UAV_SLOT_COUNT> cs_uav_conflicts;
+	bool needs_uav_unbind = false;
+	bool needs_rtv_unbind = false;
+
+	bool needs_srv_bind[(size_t)ShaderStage::_count]{}; // one per stage
+	bool needs_uav_bind = false;
+	bool needs_cs_uav_bind = false;
+	bool needs_rtv_bind = false;
+
+	// Flag the unbinds needed to use a resource on a new binding
+	auto check_srvs = [&](ID3D11Resource* Resource)
+	{
+		for (size_t stage = 0; stage < (size_t)ShaderStage::_count; stage++)
+			SRVSlots[stage].find(Resource, srv_conflicts[stage]);
+	};
+	auto check_uavs = [&](ID3D11Resource* Resource)
+	{
+		CSUAVSlots.find(Resource, cs_uav_conflicts);
+		if (OMUAVSlots.contains(Resource))
+			needs_uav_unbind = true;
+	};
+	auto check_rtvs = [&](ID3D11Resource* Resource)
+	{
+		if (RTVSlots.contains(Resource) || DSVResource == Resource)
+			needs_rtv_unbind = true;
+	};
+	auto any_valid = [](const auto& Views)
+	{
+		for (auto& view : Views)
+			if (view) return true;
+		return false;
+	};
+
+	// Mesh
+	if (segment(InputAssembler) && NewState.Mesh.IndexBuffer && (changed(Mesh.IndexBuffer) || changed(Mesh.IndexFormat)))
+	{
+		Backend->IASetIndexBuffer(NewState.Mesh.IndexBuffer, NewState.Mesh.IndexFormat, 0);
+		Stats.FixedFunctionCalls++;
+
+		update(Mesh.IndexBuffer);
+		update(Mesh.IndexFormat);
+	}
+	else if (segment(InputAssembler) && NewState.Mesh.IndexBuffer)
+		Stats.FixedFunctionSkipped++;
+
+	if (segment(InputAssembler) && NewState.Mesh.VertexBuffer && (changed(Mesh.VertexBuffer) || changed(Mesh.VertexStride)))
+	{
+		UINT offset = 0;
+		Backend->IASetVertexBuffers(0, 1, &NewState.Mesh.VertexBuffer, &NewState.Mesh.VertexStride, &offset);
+		Stats.FixedFunctionCalls++;
+		update(Mesh.VertexBuffer);
+		update(Mesh.VertexStride);
+	}
+	else if (segment(InputAssembler) && NewState.Mesh.VertexBuffer)
+		Stats.FixedFunctionSkipped++;
+
+	if (segment(InputAssembler) && NewState.InputLayout && changed(InputLayout))
+	{
+		Backend->IASetInputLayout(NewState.InputLayout);
+		Stats.FixedFunctionCalls++;
+		update(InputLayout);
+	}
+	else if (segment(InputAssembler) && NewState.InputLayout)
+		Stats.FixedFunctionSkipped++;
+
+
+	if (segment(InputAssembler) && changed(Mesh.PrimitiveType))
+	{
+		Backend->IASetPrimitiveTopology(NewState.Mesh.PrimitiveType);
+		Stats.FixedFunctionCalls++;
+		update(Mesh.PrimitiveType);
+	}
+	else if (segment(InputAssembler))
+		Stats.FixedFunctionSkipped++;
+
+	// Output Context
+	if (segment(Rasterizer) && changed(Output.Viewports))
+	{
+		Backend->RSSetViewports(NewState.Output.Viewports.size(), NewState.Output.Viewports.data());
+		Stats.FixedFunctionCalls++;
+		update(Output.Viewports);
+	}
+	else if (segment(Rasterizer))
+		Stats.FixedFunctionSkipped++;
+
+	if (segment(OutputMerger) && NewState.Output.DepthStencilState && (changed(Output.DepthStencilState) || changed(Output.StencilRef)))
+	{
+		Backend->OMSetDepthStencilState(NewState.Output.DepthStencilState, NewState.Output.StencilRef);
+		Stats.FixedFunctionCalls++;
+		update(Output.DepthStencilState);
+		update(Output.StencilRef);
+	}
+	else if (segment(OutputMerger) && NewState.Output.DepthStencilState)
+		Stats.FixedFunctionSkipped++;
+
+	if (segment(OutputMerger) && NewState.Output.BlendState &&
+	   ( changed(Output.BlendState) || 
+		 changed(Output.BlendFactors[0]) || 
+		 changed(Output.BlendFactors[1]) ||
+		 changed(Output.BlendFactors[2]) ||
+		 changed(Output.BlendFactors[3]) 
+	   ))
+	{
+		Backend->OMSetBlendState(NewState.Output.BlendState, NewState.Output.BlendFactors, -1);
+		Stats.FixedFunctionCalls++;
+		update(Output.BlendState);
+		update(Output.BlendFactors[0]);
+		update(Output.BlendFactors[1]);
+		update(Output.BlendFactors[2]);
+		update(Output.BlendFactors[3]);
+	}
+	else if (segment(OutputMerger) && NewState.Output.BlendState)
+		Stats.FixedFunctionSkipped++;
+
+	if (segment(Rasterizer) && NewState.Output.RasterState && changed(Output.RasterState))
+	{
+		Backend->RSSetState(NewState.Output.RasterState);
+		Stats.FixedFunctionCalls++;
+		update(Output.RasterState);
+	}
+	else if (segment(Rasterizer) && NewState.Output.RasterState)
+		Stats.FixedFunctionSkipped++;
+
+	// For each output table that is going to be bound, check its resources against the inputs, and forget the slots it overwrites
+	// Those are not a conflict, as they are replaced before the inputs are bound
+	// The new resources are registered after binding, so conflicts inside the new state itself are not detected
+	if (segment(OutputMerger) && NewState.Output.DSV && changed(Output.DSV))
+	{
+		check_srvs(NewState.Output.DSV.Resource);
+		check_uavs(NewState.Output.DSV.Resource);
+		DSVResource = nullptr;
+
+		needs_rtv_bind = true;
+		update(Output.DSV);
+	}
+	else if (segment(OutputMerger) && NewState.Output.DSV)
+		Stats.FixedFunctionSkipped++;
+
+	if (segment(OutputMerger) && changed(Output.RTVs) && any_valid(NewState.Output.RTVs))
+	{
+		for (auto& rtv : NewState.Output.RTVs)
+		{
+			if (!rtv) continue;
+			check_srvs(rtv.Resource);
+			check_uavs(rtv.Resource);
+		}
+		RTVSlots.clear();
+
+		needs_rtv_bind = true;
+		update(Output.RTVs);
+	}
+	else if (segment(OutputMerger) && any_valid(NewState.Output.RTVs))
+		Stats.FixedFunctionSkipped++;
+
+	if (segment(OutputMerger) && changed(Output.UAVs) && any_valid(NewState.Output.UAVs))
+	{
+		for (auto& uav : NewState.Output.UAVs)
+		{
+			if (!uav) continue;
+			check_srvs(uav.Resource);
+			check_rtvs(uav.Resource);
+		}
+		OMUAVSlots.clear();
+
+		needs_uav_bind = true;
+		update(Output.UAVs);
+	}
+	else if (segment(OutputMerger) && any_valid(NewState.Output.UAVs))
+		Stats.FixedFunctionSkipped++;
+
+	if (segment(Compute) && changed(Output.ComputeShaderUAVs) && any_valid(NewState.Output.ComputeShaderUAVs))
+	{
+		for (auto& uav : NewState.Output.ComputeShaderUAVs)
+		{
+			if (!uav) continue;
+			check_srvs(uav.Resource);
+			check_rtvs(uav.Resource);
+		}
+		CSUAVSlots.forget(NewState.Output.ComputeShaderUAVs.size());
+
+		needs_cs_uav_bind = true;
+		update(Output.ComputeShaderUAVs);
+	}
+	else if (segment(Compute) && any_valid(NewState.Output.ComputeShaderUAVs))
+		Stats.Stages[(size_t)ShaderStage::Compute].Skipped += (uint32_t)NewState.Output.ComputeShaderUAVs.size();
+
+	// Shaders
+	for (size_t stage = 0; stage < (size_t)ShaderStage::_count; stage++)
+	{
+		if (!(SegmentMask & (1u << stage)) || !NewState.Shaders[stage].ShaderPtr)
+			continue;
+
+		auto& stage_stats = Stats.Stages[stage];
+		if (changed(Shaders[stage].ShaderPtr))
+		{
+			Backend->SetShader((ShaderStage)stage, NewState.Shaders[stage].ShaderPtr->GetShaderPointer());
+			stage_stats.Calls++;
+			update(Shaders[stage].ShaderPtr);
+		}
+		else
+			stage_stats.Skipped++;
+
+		// Only the slots that differ from what's bound are sent, in as few calls as possible
+		if (changed(Shaders[stage].ConstantBuffersTable))
+		{
+			auto& table = NewState.Shaders[stage].ConstantBuffersTable;
+			UINT count = (UINT)min<size_t>(table.size(), D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT);
+			UINT sent = set_dirty_ranges_(table.data(), BoundConstantBuffers[stage], count, [&](UINT Start, UINT Count, ID3D11Buffer* const* Buffers)
+			{
+				Backend->SetConstantBuffers((ShaderStage)stage, Start, Count, Buffers);
+				stage_stats.Calls++;
+				stage_stats.Slots += Count;
+			});
+			stage_stats.Skipped += count - sent;
+			update(Shaders[stage].ConstantBuffersTable);
+		}
+		else
+			stage_stats.Skipped += (uint32_t)NewState.Shaders[stage].ConstantBuffersTable.size();
+
+		if (changed(Shaders[stage].SamplersTable))
+		{
+			auto& table = NewState.Shaders[stage].SamplersTable;
+			UINT count = (UINT)min<size_t>(table.size(), D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT);
+			UINT sent = set_dirty_ranges_(table.data(), BoundSamplers[stage], count, [&](UINT Start, UINT Count, ID3D11SamplerState* const* Samplers)
+			{
+				Backend->SetSamplers((ShaderStage)stage, Start, Count, Samplers);
+				stage_stats.Calls++;
+				stage_stats.Slots += Count;
+			});
+			stage_stats.Skipped += count - sent;
+			update(Shaders[stage].SamplersTable);
+		}
+		else
+			stage_stats.Skipped += (uint32_t)NewState.Shaders[stage].SamplersTable.size();
+	}
+
+	for (size_t stage = 0; stage < (size_t)ShaderStage::_count; stage++)
+	{
+		auto& table = NewState.Shaders[stage].ResourcesTable;
+		if ((SegmentMask & (1u << stage)) && changed(Shaders[stage].ResourcesTable) && any_valid(table))
+		{
+			for (auto& srv : table)
+			{
+				if (!srv) continue;
+				check_uavs(srv.Resource);
+				check_rtvs(srv.Resource);
+			}
+			SRVSlots[stage].forget(table.size());
+
+			needs_srv_bind[stage] = true;
+			update(Shaders[stage].ResourcesTable);
+		}
+		else if ((SegmentMask & (1u << stage)) && any_valid(table))
+			Stats.Stages[stage].Skipped += (uint32_t)table.size();
+	}
+
+	// Finished with the setup
+	// At this point CurrentPipelineState is fully updated
+	// -----------------------------------------
+	
+	// Unbind if needed
+	// The tracked state gets a null on each unbound slot, so the next state that uses it binds it again
+	// Tables that are bound below don't need it, as their slots are compared against what's actually bound
+	auto null_slots = [](auto& Views, const auto& Slots)
+	{
+		for (size_t slot = 0; slot < Views.size() && slot < Slots.size(); slot++)
+			if (Slots[slot])
+				Views[slot] = nullptr;
+	};
+
+	bool needs_cs_uav_unbind = cs_uav_conflicts.any();
+	if (needs_cs_uav_unbind)
+	{
+		static ID3D11UnorderedAccessView* const null_uavs[D3D11_1_UAV_SLOT_COUNT] = {};
+		for_each_range_(cs_uav_conflicts, [&](UINT Start, UINT Count)
+		{
+			Backend->CSSetUnorderedAccessViews(Start, Count, null_uavs, nullptr);
+			Stats.Stages[(size_t)ShaderStage::Compute].Calls++;
+			Stats.ComputeUAVHazardUnbinds++;
+		});
+
+		CSUAVSlots.unset(cs_uav_conflicts);
+		if (!needs_cs_uav_bind)
+			null_slots(CurrentPipelineState.Output.ComputeShaderUAVs, cs_uav_conflicts);
+	}
+		
+	if (needs_rtv_unbind || needs_uav_unbind)
+	{
+		Stats.FixedFunctionCalls++;
+		if (needs_rtv_unbind)
+			Stats.RenderTargetHazardUnbinds++;
+		if (needs_uav_unbind)
+			Stats.OutputUAVHazardUnbinds++;
+
+		if (needs_uav_unbind)
+		{
+			// Keep the render targets if they don't conflict and are not going to be replaced anyway
+			if (needs_rtv_unbind || needs_rtv_bind)
+				Backend->OMSetRenderTargetsAndUnorderedAccessViews(0, nullptr, nullptr, 0, 0, nullptr, nullptr);
+			else
+				Backend->OMSetRenderTargetsAndUnorderedAccessViews(D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL, nullptr, nullptr, RTVSlots.Count, 0, nullptr, nullptr);
+			// If doing an unbind, need to update the current state even if it's null
+			// Otherwise it won't be bound again
+			update(Output.UAVs);
+			OMUAVSlots.clear();
+		}
+		else
+			Backend->OMSetRenderTargets(0, nullptr, nullptr);
+
+		if (needs_rtv_unbind)
+		{
+			// If doing an unbind, need to update the current state even if it's null
+			// Otherwise it won't be bound again
+			update(Output.RTVs);
+			update(Output.DSV);
+			RTVSlots.clear();
+			DSVResource = nullptr;
+		}
+	}
+
+	for (size_t stage = 0; stage < (size_t)ShaderStage::_count; stage++)
+	{
+		if (srv_conflicts[stage].none())
+			continue;
+
+		static ID3D11ShaderResourceView* const null_srvs[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
+		for_each_range_(srv_conflicts[stage], [&](UINT Start, UINT Count)
+		{
+			Backend->SetShaderResources((ShaderStage)stage, Start, Count, null_srvs);
+			Stats.Stages[stage].Calls++;
+			Stats.Stages[stage].HazardUnbinds++;
+		});
+
+		SRVSlots[stage].unset(srv_conflicts[stage]);
+		if (!needs_srv_bind[stage])
+			null_slots(CurrentPipelineState.Shaders[stage].ResourcesTable, srv_conflicts[stage]);
+	}
+
+	// Now bind if needed, and register what was bound
+	// The views are copied to fixed arrays, so nothing is allocated
+	// -1 keeps the current counter of append and consume buffers
+	static const auto keep_counters = []()
+	{
+		array<UINT, D3D11_1_UAV_SLOT_COUNT> counters;
+		counters.fill((UINT)-1);
+		return counters;
+	}();
+
+	if (needs_rtv_bind || needs_uav_bind)
+	{
+		Stats.FixedFunctionCalls++;
+		auto& output = CurrentPipelineState.Output;
+
+		ID3D11RenderTargetView* rtvs[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+		UINT rtv_count = copy_views_(output.RTVs, rtvs);
+		RTVSlots.assign(output.RTVs);
+		DSVResource = output.DSV.Resource;
+
+		if (needs_uav_bind)
+		{
+			ID3D11UnorderedAccessView* uavs[D3D11_1_UAV_SLOT_COUNT];
+			UINT uav_count = copy_views_(output.UAVs, uavs);
+			OMUAVSlots.assign(output.UAVs);
+
+			Backend->OMSetRenderTargetsAndUnorderedAccessViews(rtv_count, rtvs, output.DSV, rtv_count, uav_count, uavs, keep_counters.data());
+		}
+		else
+			Backend->OMSetRenderTargets(rtv_count, rtvs, output.DSV);
+	}
+
+	if (needs_cs_uav_bind)
+	{
+		auto& table = CurrentPipelineState.Output.ComputeShaderUAVs;
+		ID3D11UnorderedAccessView* uavs[D3D11_1_UAV_SLOT_COUNT];
+		UINT uav_count = copy_views_(table, uavs);
+		UINT sent = set_dirty_ranges_(uavs, CSUAVSlots.Views, uav_count, [&](UINT Start, UINT Count, ID3D11UnorderedAccessView* const* UAVs)
+		{
+			Backend->CSSetUnorderedAccessViews(Start, Count, UAVs, keep_counters.data());
+			Stats.Stages[(size_t)ShaderStage::Compute].Calls++;
+			Stats.Stages[(size_t)ShaderStage::Compute].Slots += Count;
+		});
+		Stats.Stages[(size_t)ShaderStage::Compute].Skipped += uav_count - sent;
+		CSUAVSlots.assign_range(table);
+	}
+
+	for (size_t stage = 0; stage < (size_t)ShaderStage::_count; stage++)
+	{
+		if (!needs_srv_bind[stage])
+			continue;
+
+		auto& table = CurrentPipelineState.Shaders[stage].ResourcesTable;
+		ID3D11ShaderResourceView* srvs[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+		UINT srv_count = copy_views_(table, srvs);
+		UINT sent = set_dirty_ranges_(srvs, SRVSlots[stage].Views, srv_count, [&](UINT Start, UINT Count, ID3D11ShaderResourceView* const* SRVs)
+		{
+			Backend->SetShaderResources((ShaderStage)stage, Start, Count, SRVs);
+			Stats.Stages[stage].Calls++;
+			Stats.Stages[stage].Slots += Count;
+		});
+		Stats.Stages[stage].Skipped += srv_count - sent;
+		SRVSlots[stage].assign_range(table);
+	}
+
+	// Now if it was invalid make a copy of the state, even copying nulls
+	// This way we make sure the state is valid, even if it has nulls
+	if (!IsPipelineStateValid)
+	{
+		CurrentPipelineState = NewState;
+		IsPipelineStateValid = true;
+	}
+
+	// Segments that had resources unbound because of a conflict. Their hashes no longer match what's bound
+	uint32_t disturbed = 0;
+	if (needs_cs_uav_unbind)
+		disturbed |= 1u << (uint32_t)BakedPipelineState::Segment::Compute;
+	if (needs_rtv_unbind || needs_uav_unbind)
+		disturbed |= 1u << (uint32_t)BakedPipelineState::Segment::OutputMerger;
+	for (size_t stage = 0; stage < (size_t)ShaderStage::_count; stage++)
+		if (srv_conflicts[stage].any())
+			disturbed |= 1u << stage;
+
+	return disturbed;
+	
+#undef changed
+#undef update
+#undef segment
+}
+
+void PipelineBinder::Invalidate()
+{
+	for (auto& table : SRVSlots)
+		table.clear();
+	CSUAVSlots.clear();
+	OMUAVSlots.clear();
+	RTVSlots.clear();
+	DSVResource = nullptr;
+	for (size_t stage = 0; stage < (size_t)ShaderStage::_count; stage++)
+	{
+		fill(begin(BoundConstantBuffers[stage]), end(BoundConstantBuffers[stage]), nullptr);
+		fill(begin(BoundSamplers[stage]), end(BoundSamplers[stage]), nullptr);
+	}
+
+	CurrentPipelineState = PipelineState();
+	IsPipelineStateValid = false;
+	ValidHashes = 0;
+}
@@ -0,0 +1,194 @@
+#pragma once
+#include "stdafx.h"
+#include "../Core/Core.h"
+#include "../Core/PipelineState.h"
+#include "ContextBackend.h"
+#include "SubmissionStats.h"
+
+namespace FrameDX
+{
+	// Tracks the pipeline state bound on one context, and only sends the changes
+	// Each context needs its own binder, as the bound state is per context
+	class PipelineBinder
+	{
+	public:
+		PipelineBinder() : Backend(nullptr), IsPipelineStateValid(false), ValidHashes(0) {}
+		explicit PipelineBinder(ContextBackend* Backend) : Backend(Backend), IsPipelineStateValid(false), ValidHashes(0) {}
+
+		void SetBackend(ContextBackend* NewBackend) { Backend = NewBackend; Invalidate(); }
+		ContextBackend* GetBackend() { return Backend; }
+
+		// Binds a new state
+		// Automatically unbinds resources that have an in/out conflict (bound before as uav and then as srv or vice versa)
+		// It stores the state to check if it changed, so it won't detect changes done directly.
+		// This DOES NOT prevent in/out conflicts in the provided pipeline state, it ONLY prevents it compared to the old state
+		// Null pointers are ignored. If you want to set something to null, you have to do it manually
+		void Bind(const PipelineState& NewState);
+		// Same as above, but segments with the same hash as the last baked state bound are skipped without looking at them
+		// Binding a PipelineState in between makes the next baked bind check all the segments
+		void Bind(const BakedPipelineState& NewState);
+
+		// Binds one constant buffer slot outside of a pipeline state, i.e. for the allocations of an UploadRing
+		// NumConstants 0 binds the whole buffer, and otherwise the range as SetConstantBuffers1
+		// The next state bound sends its own buffer on that slot again
+		void BindConstantBuffer(ShaderStage Stage, UINT Slot, ID3D11Buffer* Buffer, UINT FirstConstant = 0, UINT NumConstants = 0);
+
+		// Forgets the tracked state, and assumes the context is back to its default state, with every slot empty
+		// Must be called after the context state is reset, i.e. after finishing or executing a command list
+		void Invalidate();
+
+		PipelineState GetCurrentPipelineStateCopy() { return CurrentPipelineState; }
+
+		// Counters of the calls sent since the last reset. The owner of the context also counts its draws and maps here
+		SubmissionStats& GetStats() { return Stats; }
+		void ResetStats() { Stats = SubmissionStats(); }
+
+		// Forgets the tracked state. The binder doesn't hold references, so there's nothing else to release
+		void Release() { Invalidate(); }
+	private:
+		// Binds the segments on the mask, and returns the ones that had to be unbound because of a conflict
+		uint32_t bind_(const PipelineState& NewState, uint32_t SegmentMask);
+
+		// Views bound on each slot of a table, and their resources, used to find in/out conflicts
+		// Only the first Count slots can be in use. Empty slots are null, and so are all the slots after Count
+		// The views are not referenced, they are only compared. The D3D11 context holds its own references to what is bound,
+		// but the recording and null backends don't, so with them the views must outlive the commands that use them
+		template<typename T, size_t N>
+		struct slot_table_
+		{
+			T* Views[N] = {};
+			ID3D11Resource* Resources[N] = {};
+			uint32_t Count = 0;
+
+			bool contains(ID3D11Resource* Resource) const
+			{
+				for (uint32_t i = 0; i < Count; i++)
+					if (Resources[i] == Resource)
+						return true;
+				return false;
+			}
+			// Flags the slots that hold the resource
+			void find(ID3D11Resource* Resource, bitset<N>& Slots) const
+			{
+				for (uint32_t i = 0; i < Count; i++)
+					if (Resources[i] == Resource)
+						Slots.set(i);
+			}
+
+			// For bindings that replace the whole table
+			void assign(const vector<View<T>>& Views)
+			{
+				clear();
+				assign_range(Views);
+			}
+			// For bindings that only replace the first Views.size() slots
+			void assign_range(const vector<View<T>>& NewViews)
+			{
+				uint32_t count = (uint32_t)min(NewViews.size(), N);
+				for (uint32_t i = 0; i < count; i++)
+				{
+					Views[i] = NewViews[i].Ptr;
+					Resources[i] = NewViews[i].Resource;
+				}
+				Count = max(Count, count);
+			}
+			// Stops checking the first slots for conflicts, as they are going to be replaced
+			// The views are kept, so the slots that don't change are not bound again
+			void forget(size_t SlotCount)
+			{
+				uint32_t count = (uint32_t)min<size_t>(min<size_t>(SlotCount, N), Count);
+				for (uint32_t i = 0; i < count; i++)
+					Resources[i] = nullptr;
+			}
+			// Empties the flagged slots, after they were unbound
+			void unset(const bitset<N>& Slots)
+			{
+				for (uint32_t i = 0; i < Count; i++)
+				{
+					if (!Slots[i]) continue;
+					Views[i] = nullptr;
+					Resources[i] = nullptr;
+				}
+			}
+			void clear()
+			{
+				for (uint32_t i = 0; i < Count; i++)
+				{
+					Views[i] = nullptr;
+					Resources[i] = nullptr;
+				}
+				Count = 0;
+			}
+		};
+
+		// Copies the view pointers to a fixed array and returns how many were copied
+		template<typename T, size_t N>
+		static UINT copy_views_(const vector<View<T>>& Views, T* (&Out)[N])
+		{
+			UINT count = (UINT)min(Views.size(), N);
+			for (UINT i = 0; i < count; i++)
+				Out[i] = Views[i].Ptr;
+			return count;
+		}
+
+		// Calls Set(StartSlot, Count, Values) once for each run of consecutive slots where Values differs from Bound, and updates Bound
+		// Returns how many slots were sent
+		template<typename T, typename F>
+		static UINT set_dirty_ranges_(T* const* Values, T** Bound, UINT Count, F&& Set)
+		{
+			UINT sent = 0;
+			UINT slot = 0;
+			while (slot < Count)
+			{
+				if (Values[slot] == Bound[slot])
+				{
+					slot++;
+					continue;
+				}
+
+				UINT start = slot;
+				for (; slot < Count && Values[slot] != Bound[slot]; slot++)
+					Bound[slot] = Values[slot];
+				Set(start, slot - start, Values + start);
+				sent += slot - start;
+			}
+			return sent;
+		}
+
+		// Calls Unset(StartSlot, Count) once for each run of consecutive flagged slots
+		template<size_t N, typename F>
+		static void for_each_range_(const bitset<N>& Slots, F&& Unset)
+		{
+			for (UINT slot = 0; slot < N; slot++)
+			{
+				if (!Slots[slot])
+					continue;
+
+				UINT start = slot;
+				while (slot < N && Slots[slot])
+					slot++;
+				Unset(start, slot - start);
+			}
+		}
+
+		slot_table_<ID3D11ShaderResourceView, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT> SRVSlots[(size_t)ShaderStage::_count];
+		slot_table_<ID3D11UnorderedAccessView, D3D11_1_UAV_SLOT_COUNT> CSUAVSlots;
+		slot_table_<ID3D11UnorderedAccessView, D3D11_1_UAV_SLOT_COUNT> OMUAVSlots;
+		slot_table_<ID3D11RenderTargetView, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT> RTVSlots;
+		ID3D11Resource* DSVResource = nullptr;
+
+		// Constant buffers and samplers bound on each slot. They can't be in a conflict, so they only need the pointers
+		ID3D11Buffer* BoundConstantBuffers[(size_t)ShaderStage::_count][D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT] = {};
+		ID3D11SamplerState* BoundSamplers[(size_t)ShaderStage::_count][D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT] = {};
+
+		ContextBackend* Backend;
+		PipelineState CurrentPipelineState;
+		bool IsPipelineStateValid;
+
+		// Hashes of the last baked state bound, and which of them still match the bound state
+		uint64_t BoundHashes[(size_t)BakedPipelineState::Segment::_count];
+		uint32_t ValidHashes;
+
+		SubmissionStats Stats;
+	};
+}
@@ -0,0 +1,245 @@
+#include "stdafx.h"
+#include "RenderQueue.h"
+#include "Device.h"
+#include "CommandRecorder.h"
+#include "../Core/JobSystem.h"
+
+using namespace FrameDX;
+
+namespace
+{
+	// Folds a 64 bit hash to its top Bits bits
+	uint64_t fold(uint64_t Hash, uint32_t Bits)
+	{
+		Hash ^= Hash >> 32;
+		return (Hash * 0x9E3779B97F4A7C15ull) >> (64 - Bits);
+	}
+
+	uint64_t mix(uint64_t Hash, uint64_t Value)
+	{
+		return (Hash ^ Value) * 0x100000001B3ull;
+	}
+
+	// Below this many draws the sort runs on the calling thread
+	constexpr size_t ParallelSortThreshold = 4096;
+}
+
+uint64_t RenderQueue::make_key_(const BakedPipelineState& State, float Depth)
+{
+	uint64_t shaders = 0xCBF29CE484222325ull;
+	for(auto& shader : State.GetState().Shaders)
+		shaders = mix(shaders, (uint64_t)shader.ShaderPtr);
+
+	uint64_t resources = 0xCBF29CE484222325ull;
+	for(uint32_t segment = 0; segment < (uint32_t)BakedPipelineState::Segment::_count; segment++)
+		if(segment != (uint32_t)BakedPipelineState::Segment::InputAssembler)
+			resources = mix(resources, State.GetHash((BakedPipelineState::Segment)segment));
+
+	// The bits of a positive float sort the same way as the float, so the top ones are a coarse depth
+	uint32_t depth_bits;
+	float depth = max(Depth, 0.0f);
+	memcpy(&depth_bits, &depth, sizeof(float));
+
+	return (fold(shaders, 24) << 40) |
+		   (fold(State.GetHash(BakedPipelineState::Segment::InputAssembler), 12) << 28) |
+		   (fold(resources, 12) << 16) |
+		   (depth_bits >> 16);
+}
+
+size_t RenderQueue::count_changes_(const BakedPipelineState& Previous, const BakedPipelineState& Next)
+{
+	size_t changes = 0;
+	for(uint32_t segment = 0; segment < (uint32_t)BakedPipelineState::Segment::_count; segment++)
+		if(Previous.GetHash((BakedPipelineState::Segment)segment) != Next.GetHash((BakedPipelineState::Segment)segment))
+			changes++;
+	return changes;
+}
+
+void RenderQueue::Add(const BakedPipelineState& State, const DrawArguments& Arguments, float Depth)
+{
+	add_(State, Arguments, Depth, 0, 0, nullptr, 0);
+}
+
+void RenderQueue::add_(const BakedPipelineState& State, const DrawArguments& Arguments, float Depth, UINT ConstantsSlot, uint32_t StageMask, const void* Constants, size_t Size)
+{
+	if(Items.empty())
+		UnsortedStateChanges = (size_t)BakedPipelineState::Segment::_count;
+	else
+		UnsortedStateChanges += count_changes_(*Items.back().State, State);
+
+	size_t offset = ConstantData.size();
+	if(Size)
+		ConstantData.insert(ConstantData.end(), (const uint8_t*)Constants, (const uint8_t*)Constants + Size);
+
+	Entries.push_back({ make_key_(State, Depth), (uint32_t)Items.size() });
+	Items.push_back({ &State, Arguments, offset, Size, ConstantsSlot, StageMask });
+}
+
+void RenderQueue::Clear()
+{
+	Items.clear();
+	Entries.clear();
+	ConstantData.clear();
+	StagedConstants.clear();
+	UnsortedStateChanges = 0;
+}
+
+void RenderQueue::stage_constants_(Device& Target)
+{
+	StagedConstants.clear();
+	if(ConstantData.empty() || !Target.Uploads.IsValid())
+		return;
+
+	// In submission order, so consecutive draws read consecutive ranges
+	// A failed allocation is left empty, and that draw binds its constants on its own
+	StagedConstants.resize(Items.size());
+	for(auto& entry : Entries)
+	{
+		auto& item = Items[entry.Index];
+		if(item.ConstantsSize)
+			LogCheckAndContinue(Target.Uploads.Allocate(Target.ActiveBackend, &ConstantData[item.ConstantsOffset], item.ConstantsSize, StagedConstants[entry.Index]), LogCategory::Error);
+	}
+}
+
+void RenderQueue::bind_constants_(Device& Target, uint32_t Index)
+{
+	auto& item = Items[Index];
+	for(uint32_t stage = 0; stage < (uint32_t)ShaderStage::_count; stage++)
+	{
+		if(!(item.ConstantsStages & (1u << stage)))
+			continue;
+
+		if(Index < StagedConstants.size() && StagedConstants[Index].Buffer)
+		{
+			auto& allocation = StagedConstants[Index];
+			Target.ImmediateBinder.BindConstantBuffer((ShaderStage)stage, item.ConstantsSlot, allocation.Buffer, allocation.FirstConstant, allocation.NumConstants);
+		}
+		else
+			LogCheckAndContinue(Target.bind_constants_((ShaderStage)stage, item.ConstantsSlot, &ConstantData[item.ConstantsOffset], item.ConstantsSize), LogCategory::Error);
+	}
+}
+
+void RenderQueue::bind_constants_(RecordingContext& Target, uint32_t Index)
+{
+	auto& item = Items[Index];
+	for(uint32_t stage = 0; stage < (uint32_t)ShaderStage::_count; stage++)
+		if(item.ConstantsStages & (1u << stage))
+			LogCheckAndContinue(Target.ConstantSlots.Bind(Target.Binder, (ShaderStage)stage, item.ConstantsSlot, &ConstantData[item.ConstantsOffset], item.ConstantsSize), LogCategory::Error);
+}
+
+void RenderQueue::sort_()
+{
+	size_t count = Entries.size();
+	if(count < 2)
+		return;
+
+	Scratch.resize(count);
+
+	auto& jobs = GetJobSystem();
+	size_t chunk_count = count < ParallelSortThreshold ? 1 : min<size_t>(count / (ParallelSortThreshold / 4), 4 * (jobs.GetWorkerCount() + 1));
+	size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+	Histograms.resize(chunk_count);
+
+	auto for_each_chunk = [&](auto&& f)
+	{
+		if(chunk_count == 1)
+			f(0);
+		else
+			jobs.ParallelFor(0, chunk_count, f, 1);
+	};
+
+	sort_entry_* source = Entries.data();
+	sort_entry_* destination = Scratch.data();
+
+	for(uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		// Count the digits of each chunk
+		for_each_chunk([&](size_t chunk)
+		{
+			auto& histogram = Histograms[chunk];
+			histogram.fill(0);
+
+			size_t end = min(count, (chunk + 1) * chunk_size);
+			for(size_t i = chunk * chunk_size; i < end; i++)
+				histogram[(source[i].Key >> shift) & 0xFF]++;
+		});
+
+		// Turn the counts into the position of each chunk on each bucket. Going bucket by bucket, then chunk by chunk, keeps it stable
+		uint32_t offset = 0;
+		bool single_bucket = false;
+		for(size_t digit = 0; digit < 256; digit++)
+		{
+			uint32_t bucket_start = offset;
+			for(auto& histogram : Histograms)
+			{
+				uint32_t digit_count = histogram[digit];
+				histogram[digit] = offset;
+				offset += digit_count;
+			}
+
+			if(offset - bucket_start == count)
+				single_bucket = true;
+		}
+
+		// All the keys have the same digit, so this pass wouldn't change anything
+		if(single_bucket)
+			continue;
+
+		for_each_chunk([&](size_t chunk)
+		{
+			auto& positions = Histograms[chunk];
+
+			size_t end = min(count, (chunk + 1) * chunk_size);
+			for(size_t i = chunk * chunk_size; i < end; i++)
+				destination[positions[(source[i].Key >> shift) & 0xFF]++] = source[i];
+		});
+
+		swap(source, destination);
+	}
+
+	if(source != Entries.data())
+		Entries.swap(Scratch);
+}
+
+template<typename T>
+void RenderQueue::submit_(T& Target)
+{
+	sort_();
+	stage_constants_(Target);
+
+	LastStats.Draws = Items.size();
+	LastStats.UnsortedStateChanges = UnsortedStateChanges;
+	LastStats.StateChanges = 0;
+
+	const BakedPipelineState* previous = nullptr;
+	for(auto& entry : Entries)
+	{
+		auto& item = Items[entry.Index];
+
+		if(item.State != previous)
+		{
+			LastStats.StateChanges += previous ? count_changes_(*previous, *item.State) : (size_t)BakedPipelineState::Segment::_count;
+			Target.BindPipelineState(*item.State);
+			previous = item.State;
+		}
+		if(item.ConstantsSize)
+			bind_constants_(Target, entry.Index);
+
+		if(item.Arguments.IsIndexed)
+			Target.DrawIndexed(item.Arguments.Count, item.Arguments.Start, item.Arguments.BaseVertex);
+		else
+			Target.Draw(item.Arguments.Count, item.Arguments.Start);
+	}
+
+	Clear();
+}
+
+void RenderQueue::Submit(Device& Target)
+{
+	submit_(Target);
+}
+
+void RenderQueue::Submit(RecordingContext& Target)
+{
+	submit_(Target);
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "stdafx.h"
+#include "../Core/Core.h"
+#include "../Core/PipelineState.h"
+#include "UploadRing.h"
+
+namespace FrameDX
+{
+	class Device;
+	class RecordingContext;
+	class ContextBackend;
+
+	// Collects draws during a frame, sorts them by state and submits them in that order, so consecutive draws share as much state as possible
+	// The sort key has, from the most significant bits:
+	//		24 bits from the shaders
+	//		12 bits from the input assembler (input layout, buffers and topology)
+	//		12 bits from the rest of the state (resources, outputs and raster state)
+	//		16 bits of depth, so draws with the same state go front to back
+	// The fields are hashes folded to their size, so a collision only makes the order a bit worse
+	class RenderQueue
+	{
+	public:
+		struct DrawArguments
+		{
+			static DrawArguments Indexed(UINT IndexCount, UINT StartIndex = 0, INT BaseVertex = 0) { return { true, IndexCount, StartIndex, BaseVertex }; }
+			static DrawArguments NonIndexed(UINT VertexCount, UINT StartVertex = 0) { return { false, VertexCount, StartVertex, 0 }; }
+
+			bool IsIndexed;
+			// Index count for indexed draws, vertex count otherwise
+			UINT Count;
+			UINT Start;
+			INT BaseVertex;
+		};
+
+		// State changes of the last submit, counted as segments that differ between consecutive draws
+		// That's the number of segments the binder has to check, see BakedPipelineState
+		struct Stats
+		{
+			size_t Draws;
+			size_t StateChanges;
+			// The state changes there would have been submitting the draws in the order they were added
+			size_t UnsortedStateChanges;
+
+			size_t GetSavedStateChanges() const { return UnsortedStateChanges - min(StateChanges, UnsortedStateChanges); }
+		};
+
+		RenderQueue() : LastStats{}, UnsortedStateChanges(0) {}
+
+		// The state is referenced, not copied, so it must be valid until the queue is submitted
+		// Depth should be positive, and is only used to sort draws with the same state
+		void Add(const BakedPipelineState& State, const DrawArguments& Arguments, float Depth);
+		// Same as above, with constants of its own bound on a slot of the stages on StageMask (bit i = ShaderStage i) after the state
+		// They are copied. On a device with an upload ring, Submit copies the constants of all the draws to the ring before
+		// the first one, so the whole queue is sent with a single map
+		template<typename T>
+		void Add(const BakedPipelineState& State, const DrawArguments& Arguments, float Depth, UINT ConstantsSlot, uint32_t StageMask, const T& Constants)
+		{
+			static_assert(sizeof(T) % 16 == 0, "T needs to be 16-bytes aligned");
+			add_(State, Arguments, Depth, ConstantsSlot, StageMask, &Constants, sizeof(T));
+		}
+
+		// Sorts the draws, binds and draws them, and empties the queue
+		void Submit(Device& Target);
+		void Submit(RecordingContext& Target);
+
+		// Empties the queue without submitting
+		void Clear();
+
+		size_t GetDrawCount() const { return Items.size(); }
+		Stats GetLastStats() const { return LastStats; }
+	private:
+		struct item_
+		{
+			const BakedPipelineState* State;
+			DrawArguments Arguments;
+			// Range of ConstantData, empty if the draw has no constants
+			size_t ConstantsOffset;
+			size_t ConstantsSize;
+			UINT ConstantsSlot;
+			uint32_t ConstantsStages;
+		};
+		struct sort_entry_
+		{
+			uint64_t Key;
+			uint32_t Index;
+		};
+
+		void add_(const BakedPipelineState& State, const DrawArguments& Arguments, float Depth, UINT ConstantsSlot, uint32_t StageMask, const void* Constants, size_t Size);
+		static uint64_t make_key_(const BakedPipelineState& State, float Depth);
+		static size_t count_changes_(const BakedPipelineState& Previous, const BakedPipelineState& Next);
+
+		// Parallel LSD radix sort of the entries, 8 bits per pass. Passes where all the keys have the same digit are skipped
+		void sort_();
+
+		// Target is a Device or a RecordingContext
+		template<typename T>
+		void submit_(T& Target);
+		// Copies the constants of all the draws to the upload ring of the device, if it has one. Nothing to do on a recording context
+		void stage_constants_(Device& Target);
+		void stage_constants_(RecordingContext& Target) {}
+		void bind_constants_(Device& Target, uint32_t Index);
+		void bind_constants_(RecordingContext& Target, uint32_t Index);
+
+		vector<item_> Items;
+		vector<uint8_t> ConstantData;
+		// Allocations of the constants of each item, when they were staged
+		vector<UploadRing::Allocation> StagedConstants;
+		vector<sort_entry_> Entries;
+		vector<sort_entry_> Scratch;
+		vector<array<uint32_t, 256>> Histograms;
+
+		Stats LastStats;
+		size_t UnsortedStateChanges;
+	};
+}
@@ -0,0 +1,196 @@
+#include "stdafx.h"
+#include "StateCache.h"
+#include "../Core/Log.h"
+#include "../Core/Utils.h"
+
+using namespace FrameDX;
+
+namespace
+{
+	// Copies the description field by field over zeroed memory, so the padding is always zero and it can be hashed and compared as bytes
+	D3D11_RASTERIZER_DESC normalize(const D3D11_RASTERIZER_DESC& Desc) { return Desc; }
+	D3D11_SAMPLER_DESC normalize(const D3D11_SAMPLER_DESC& Desc) { return Desc; }
+
+	D3D11_DEPTH_STENCIL_DESC normalize(const D3D11_DEPTH_STENCIL_DESC& Desc)
+	{
+		D3D11_DEPTH_STENCIL_DESC out;
+		memset(&out, 0, sizeof(out));
+		out.DepthEnable = Desc.DepthEnable;
+		out.DepthWriteMask = Desc.DepthWriteMask;
+		out.DepthFunc = Desc.DepthFunc;
+		out.StencilEnable = Desc.StencilEnable;
+		out.StencilReadMask = Desc.StencilReadMask;
+		out.StencilWriteMask = Desc.StencilWriteMask;
+		out.FrontFace = Desc.FrontFace;
+		out.BackFace = Desc.BackFace;
+		return out;
+	}
+
+	D3D11_BLEND_DESC normalize(const D3D11_BLEND_DESC& Desc)
+	{
+		D3D11_BLEND_DESC out;
+		memset(&out, 0, sizeof(out));
+		out.AlphaToCoverageEnable = Desc.AlphaToCoverageEnable;
+		out.IndependentBlendEnable = Desc.IndependentBlendEnable;
+		for(size_t i = 0; i < 8; i++)
+		{
+			auto& in_rt = Desc.RenderTarget[i];
+			auto& out_rt = out.RenderTarget[i];
+			out_rt.BlendEnable = in_rt.BlendEnable;
+			out_rt.SrcBlend = in_rt.SrcBlend;
+			out_rt.DestBlend = in_rt.DestBlend;
+			out_rt.BlendOp = in_rt.BlendOp;
+			out_rt.SrcBlendAlpha = in_rt.SrcBlendAlpha;
+			out_rt.DestBlendAlpha = in_rt.DestBlendAlpha;
+			out_rt.BlendOpAlpha = in_rt.BlendOpAlpha;
+			out_rt.RenderTargetWriteMask = in_rt.RenderTargetWriteMask;
+		}
+		return out;
+	}
+}
+
+namespace FrameDX
+{
+	// Open addressing table that never grows, so readers can probe it without locks
+	// Entries are published with a release store after they are fully built, and never change afterwards
+	template<typename D, typename S>
+	class state_table_
+	{
+	public:
+		state_table_() : Slots(new atomic<entry_*>[Capacity]) 
+		{
+			for(size_t i = 0; i < Capacity; i++)
+				Slots[i].store(nullptr, memory_order_relaxed);
+		}
+
+		template<typename F>
+		StatusCode get(const D& Desc, S** Out, F&& Create)
+		{
+			D key = normalize(Desc);
+			uint64_t hash = hash_bytes(&key, sizeof(D));
+
+			size_t free_slot;
+			if(entry_* entry = find_(key, hash, free_slot))
+			{
+				*Out = entry->State;
+				return StatusCode::Ok;
+			}
+
+			lock_guard<mutex> lock(InsertMutex);
+
+			// Another thread could have added it while waiting for the lock
+			if(entry_* entry = find_(key, hash, free_slot))
+			{
+				*Out = entry->State;
+				return StatusCode::Ok;
+			}
+			if(free_slot == Capacity)
+				return StatusCode::TooManyUniqueStateObjects;
+
+			S* state = nullptr;
+			LogCheckWithReturn(Create(&key, &state), LogCategory::Error);
+
+			Entries.push_back({ hash, key, state });
+			Slots[free_slot].store(&Entries.back(), memory_order_release);
+			Count.store(Entries.size(), memory_order_relaxed);
+
+			*Out = state;
+			return StatusCode::Ok;
+		}
+
+		size_t size() const { return Count.load(memory_order_relaxed); }
+
+		void release()
+		{
+			lock_guard<mutex> lock(InsertMutex);
+			for(size_t i = 0; i < Capacity; i++)
+				Slots[i].store(nullptr, memory_order_relaxed);
+			for(auto& entry : Entries)
+				entry.State->Release();
+			Entries.clear();
+			Count.store(0, memory_order_relaxed);
+		}
+	private:
+		struct entry_
+		{
+			uint64_t Hash;
+			D Desc;
+			S* State;
+		};
+
+		// Twice the D3D11 limit of 4096 unique objects per type, so the probes stay short
+		static constexpr size_t Capacity = 8192;
+
+		// Returns the entry if found. Otherwise, FreeSlot is where it would go, or Capacity if the table is full
+		entry_* find_(const D& Key, uint64_t Hash, size_t& FreeSlot)
+		{
+			size_t index = Hash & (Capacity - 1);
+			for(size_t probe = 0; probe < Capacity; probe++)
+			{
+				entry_* entry = Slots[index].load(memory_order_acquire);
+				if(!entry)
+				{
+					FreeSlot = index;
+					return nullptr;
+				}
+				if(entry->Hash == Hash && !memcmp(&entry->Desc, &Key, sizeof(D)))
+					return entry;
+
+				index = (index + 1) & (Capacity - 1);
+			}
+
+			FreeSlot = Capacity;
+			return nullptr;
+		}
+
+		unique_ptr<atomic<entry_*>[]> Slots;
+
+		// Deque so the entries don't move when it grows
+		mutex InsertMutex;
+		deque<entry_> Entries;
+		atomic<size_t> Count = 0;
+	};
+}
+
+StateCache::StateCache() :
+	Objects(nullptr),
+	RasterizerStates(make_unique<state_table_<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>>()),
+	DepthStencilStates(make_unique<state_table_<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>>()),
+	BlendStates(make_unique<state_table_<D3D11_BLEND_DESC, ID3D11BlendState>>()),
+	SamplerStates(make_unique<state_table_<D3D11_SAMPLER_DESC, ID3D11SamplerState>>())
+{}
+
+StateCache::~StateCache() = default;
+
+StatusCode StateCache::GetRasterizerState(const D3D11_RASTERIZER_DESC& Desc, ID3D11RasterizerState** Out)
+{
+	return RasterizerStates->get(Desc, Out, [this](const D3D11_RASTERIZER_DESC* Key, ID3D11RasterizerState** State) { return Objects->CreateRasterizerState(Key, State); });
+}
+
+StatusCode StateCache::GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& Desc, ID3D11DepthStencilState** Out)
+{
+	return DepthStencilStates->get(Desc, Out, [this](const D3D11_DEPTH_STENCIL_DESC* Key, ID3D11DepthStencilState** State) { return Objects->CreateDepthStencilState(Key, State); });
+}
+
+StatusCode StateCache::GetBlendState(const D3D11_BLEND_DESC& Desc, ID3D11BlendState** Out)
+{
+	return BlendStates->get(Desc, Out, [this](const D3D11_BLEND_DESC* Key, ID3D11BlendState** State) { return Objects->CreateBlendState(Key, State); });
+}
+
+StatusCode StateCache::GetSamplerState(const D3D11_SAMPLER_DESC& Desc, ID3D11SamplerState** Out)
+{
+	return SamplerStates->get(Desc, Out, [this](const D3D11_SAMPLER_DESC* Key, ID3D11SamplerState** State) { return Objects->CreateSamplerState(Key, State); });
+}
+
+size_t StateCache::GetRasterizerStateCount() const { return RasterizerStates->size(); }
+size_t StateCache::GetDepthStencilStateCount() const { return DepthStencilStates->size(); }
+size_t StateCache::GetBlendStateCount() const { return BlendStates->size(); }
+size_t StateCache::GetSamplerStateCount() const { return SamplerStates->size(); }
+
+void StateCache::Release()
+{
+	RasterizerStates->release();
+	DepthStencilStates->release();
+	BlendStates->release();
+	SamplerStates->release();
+}
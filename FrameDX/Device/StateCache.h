@@ -0,0 +1,45 @@
+#pragma once
+#include "stdafx.h"
+#include "../Core/Core.h"
+#include "DeviceBackend.h"
+
+namespace FrameDX
+{
+	template<typename D, typename S> class state_table_;
+
+	// Creates the rasterizer, depth stencil, blend and sampler states, and returns the same object for equal descriptions
+	// D3D11 limits the number of unique state objects, and sharing them makes the binder see the same pointer for the same state
+	// Lookups are lock free and can be done from any thread. Only creating a new object takes a lock
+	// The cache owns the objects, so they must not be released, and they are valid until the cache is released
+	class StateCache
+	{
+	public:
+		StateCache();
+		~StateCache();
+
+		StateCache(const StateCache&) = delete;
+		StateCache& operator=(const StateCache&) = delete;
+
+		void SetDevice(DeviceBackend* NewDevice) { Objects = NewDevice; }
+
+		StatusCode GetRasterizerState(const D3D11_RASTERIZER_DESC& Desc, ID3D11RasterizerState** Out);
+		StatusCode GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& Desc, ID3D11DepthStencilState** Out);
+		StatusCode GetBlendState(const D3D11_BLEND_DESC& Desc, ID3D11BlendState** Out);
+		StatusCode GetSamplerState(const D3D11_SAMPLER_DESC& Desc, ID3D11SamplerState** Out);
+
+		// Number of unique objects of each type
+		size_t GetRasterizerStateCount() const;
+		size_t GetDepthStencilStateCount() const;
+		size_t GetBlendStateCount() const;
+		size_t GetSamplerStateCount() const;
+
+		void Release();
+	private:
+		DeviceBackend* Objects;
+
+		unique_ptr<state_table_<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>> RasterizerStates;
+		unique_ptr<state_table_<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>> DepthStencilStates;
+		unique_ptr<state_table_<D3D11_BLEND_DESC, ID3D11BlendState>> BlendStates;
+		unique_ptr<state_table_<D3D11_SAMPLER_DESC, ID3D11SamplerState>> SamplerStates;
+	};
+}
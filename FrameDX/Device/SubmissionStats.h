@@ -0,0 +1,91 @@
+#pragma once
+#include "stdafx.h"
+#include "../Core/PipelineState.h"
+
+namespace FrameDX
+{
+	// Counters of the work sent to one context
+	// They are plain integers, as each context is only used by one thread at a time
+	// The hazard unbinds are also counted on the calls
+	struct SubmissionStats
+	{
+		struct StageCounters
+		{
+			// Shader, shader resource, constant buffer and sampler calls. For compute, also the UAV calls
+			uint32_t Calls = 0;
+			// Slots sent on those calls
+			uint32_t Slots = 0;
+			// Shaders and slots that were already bound, so they weren't sent
+			uint32_t Skipped = 0;
+			// Calls that unbound shader resources because they were going to be used as outputs
+			uint32_t HazardUnbinds = 0;
+		};
+		StageCounters Stages[(size_t)ShaderStage::_count];
+
+		// Input assembler, rasterizer and output merger calls, and states that were already bound
+		uint32_t FixedFunctionCalls = 0;
+		uint32_t FixedFunctionSkipped = 0;
+
+		// Calls that unbound outputs because they were going to be used as inputs
+		uint32_t RenderTargetHazardUnbinds = 0;
+		uint32_t OutputUAVHazardUnbinds = 0;
+		uint32_t ComputeUAVHazardUnbinds = 0;
+
+		// Pipeline states bound, and baked segments skipped because their hash didn't change
+		uint32_t Binds = 0;
+		uint32_t SkippedSegments = 0;
+
+		uint32_t Draws = 0;
+		uint32_t Dispatches = 0;
+		uint32_t Maps = 0;
+		// Constant buffer uploads skipped because their contents didn't change
+		uint32_t SkippedMaps = 0;
+
+		SubmissionStats& operator+=(const SubmissionStats& Other)
+		{
+			for (size_t stage = 0; stage < (size_t)ShaderStage::_count; stage++)
+			{
+				Stages[stage].Calls += Other.Stages[stage].Calls;
+				Stages[stage].Slots += Other.Stages[stage].Slots;
+				Stages[stage].Skipped += Other.Stages[stage].Skipped;
+				Stages[stage].HazardUnbinds += Other.Stages[stage].HazardUnbinds;
+			}
+			FixedFunctionCalls += Other.FixedFunctionCalls;
+			FixedFunctionSkipped += Other.FixedFunctionSkipped;
+			RenderTargetHazardUnbinds += Other.RenderTargetHazardUnbinds;
+			OutputUAVHazardUnbinds += Other.OutputUAVHazardUnbinds;
+			ComputeUAVHazardUnbinds += Other.ComputeUAVHazardUnbinds;
+			Binds += Other.Binds;
+			SkippedSegments += Other.SkippedSegments;
+			Draws += Other.Draws;
+			Dispatches += Other.Dispatches;
+			Maps += Other.Maps;
+			SkippedMaps += Other.SkippedMaps;
+			return *this;
+		}
+
+		// All the calls sent to the context
+		uint32_t GetContextCalls() const
+		{
+			uint32_t calls = FixedFunctionCalls + Draws + Dispatches + Maps;
+			for (auto& stage : Stages)
+				calls += stage.Calls;
+			return calls;
+		}
+		// All the bindings that were already bound, not counting the skipped segments
+		uint32_t GetSkipped() const
+		{
+			uint32_t skipped = FixedFunctionSkipped;
+			for (auto& stage : Stages)
+				skipped += stage.Skipped;
+			return skipped;
+		}
+		uint32_t GetHazardUnbinds() const
+		{
+			uint32_t unbinds = RenderTargetHazardUnbinds + OutputUAVHazardUnbinds + ComputeUAVHazardUnbinds;
+			for (auto& stage : Stages)
+				unbinds += stage.HazardUnbinds;
+			return unbinds;
+		}
+	};
+}
@@ -0,0 +1,200 @@
+#include "stdafx.h"
+#include "UploadRing.h"
+#include "../Core/Log.h"
+
+using namespace FrameDX;
+
+namespace
+{
+	size_t align_up(size_t Value, size_t Alignment) { return (Value + Alignment - 1) / Alignment * Alignment; }
+}
+
+StatusCode UploadRing::Create(DeviceBackend* Objects, size_t Size, uint32_t FramesInFlight)
+{
+	LogAssertWithReturn(Objects && Size > 0 && FramesInFlight > 0, LogCategory::Error, StatusCode::InvalidArgument);
+
+	Release();
+	this->Objects = Objects;
+	this->FramesInFlight = FramesInFlight;
+	return create_buffer_(align_up(Size, Alignment));
+}
+
+void UploadRing::Release()
+{
+	if(Buffer)
+		Buffer->Release();
+	Buffer = nullptr;
+
+	for(auto& retired : Retired)
+		retired.first->Release();
+	Retired.clear();
+
+	Shadow.clear();
+	Shadow.shrink_to_fit();
+	FramesBytes.clear();
+	Head = Flushed = WrapEnd = Used = FrameBytes = 0;
+}
+
+StatusCode UploadRing::create_buffer_(size_t Size)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = (UINT)Size;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	ID3D11Buffer* buffer = nullptr;
+	LogCheckWithReturn(Objects->CreateBuffer(&desc, nullptr, &buffer), LogCategory::Error);
+
+	Buffer = buffer;
+	Shadow.assign(Size, 0);
+	FramesBytes.clear();
+	Head = Flushed = WrapEnd = Used = FrameBytes = 0;
+	NeedsDiscard = true;
+
+	return StatusCode::Ok;
+}
+
+StatusCode UploadRing::Allocate(ContextBackend* Context, const void* Data, size_t Size, Allocation& Out)
+{
+	LogAssertWithReturn(Buffer, LogCategory::Error, StatusCode::InvalidCall);
+	LogAssertWithReturn(Data && Size > 0 && Size <= D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT * 16, LogCategory::Error, StatusCode::InvalidArgument);
+
+	// If it doesn't fit before the end of the buffer it goes to the start, and the end is wasted until this frame is done
+	size_t size = align_up(Size, Alignment);
+	bool wraps = Head + size > Shadow.size();
+	size_t needed = wraps ? Shadow.size() - Head + size : size;
+
+	if(Used + needed > Shadow.size())
+	{
+		// The frames in flight still use the old buffer, so it's released after them
+		// What was allocated on it and not flushed yet is sent now, as the draws that use it come later
+		LogCheckWithReturn(Flush(Context), LogCategory::Error);
+		Retired.emplace_back(Buffer, FramesInFlight);
+		Buffer = nullptr;
+
+		LogMsg(L"The upload ring is full, creating a larger one", LogCategory::Warning);
+		size_t new_size = Shadow.size() * 2;
+		while(new_size < size)
+			new_size *= 2;
+		LogCheckWithReturn(create_buffer_(new_size), LogCategory::Error);
+		Counts.Grows++;
+
+		wraps = false;
+		needed = size;
+	}
+
+	if(wraps)
+	{
+		// A pending range is flushed in two parts, the one before wrapping and the one from the start
+		if(Head != Flushed)
+			WrapEnd = Head;
+		else
+			Flushed = 0;
+		Head = 0;
+	}
+
+	memcpy(Shadow.data() + Head, Data, Size);
+	Out.Buffer = Buffer;
+	Out.FirstConstant = (UINT)(Head / 16);
+	Out.NumConstants = (UINT)(size / 16);
+
+	Head += size;
+	Used += needed;
+	FrameBytes += needed;
+	Counts.Allocations++;
+	Counts.AllocatedBytes += Size;
+
+	return StatusCode::Ok;
+}
+
+StatusCode UploadRing::write_(ContextBackend* Context, size_t Offset, size_t Size)
+{
+	// Only the first map of a buffer has to discard, after it the ranges written are never in use
+	LogCheckWithReturn(Context->UpdateBufferRange(Buffer, Offset, Shadow.data() + Offset, Size, NeedsDiscard), LogCategory::Error);
+	NeedsDiscard = false;
+	Counts.Maps++;
+	return StatusCode::Ok;
+}
+
+StatusCode UploadRing::Flush(ContextBackend* Context)
+{
+	if(!HasPending())
+		return StatusCode::Ok;
+	LogAssertWithReturn(Context, LogCategory::Error, StatusCode::InvalidArgument);
+
+	if(WrapEnd)
+	{
+		LogCheckWithReturn(write_(Context, Flushed, WrapEnd - Flushed), LogCategory::Error);
+		Flushed = 0;
+		WrapEnd = 0;
+	}
+	if(Head != Flushed)
+		LogCheckWithReturn(write_(Context, Flushed, Head - Flushed), LogCategory::Error);
+	Flushed = Head;
+	Counts.Flushes++;
+
+	return StatusCode::Ok;
+}
+
+void UploadRing::EndFrame()
+{
+	FramesBytes.push_back(FrameBytes);
+	FrameBytes = 0;
+	while(FramesBytes.size() > FramesInFlight)
+	{
+		Used -= FramesBytes.front();
+		FramesBytes.pop_front();
+	}
+
+	for(auto& retired : Retired)
+	{
+		if(--retired.second == 0)
+			retired.first->Release();
+	}
+	Retired.erase(remove_if(Retired.begin(), Retired.end(), [](const pair<ID3D11Buffer*, uint32_t>& Entry) { return Entry.second == 0; }), Retired.end());
+}
+
+void ConstantSlotBuffers::Release()
+{
+	for(auto& stage : Buffers)
+	{
+		for(auto& buffer : stage)
+		{
+			if(buffer)
+				buffer->Release();
+			buffer = nullptr;
+		}
+	}
+	for(auto& stage : Sizes)
+		fill(begin(stage), end(stage), 0);
+}
+
+StatusCode ConstantSlotBuffers::Bind(PipelineBinder& Binder, ShaderStage Stage, UINT Slot, const void* Data, size_t Size)
+{
+	LogAssertWithReturn(Objects && Binder.GetBackend(), LogCategory::Error, StatusCode::InvalidCall);
+	LogAssertWithReturn(Slot < D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT && Data && Size > 0, LogCategory::Error, StatusCode::InvalidArgument);
+
+	ID3D11Buffer*& buffer = Buffers[(size_t)Stage][Slot];
+	size_t& buffer_size = Sizes[(size_t)Stage][Slot];
+	if(!buffer || buffer_size < Size)
+	{
+		if(buffer)
+			buffer->Release();
+		buffer = nullptr;
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = (UINT)align_up(Size, 16);
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		LogCheckWithReturn(Objects->CreateBuffer(&desc, nullptr, &buffer), LogCategory::Error);
+		buffer_size = desc.ByteWidth;
+	}
+
+	LogCheckWithReturn(Binder.GetBackend()->UpdateBuffer(buffer, Data, Size), LogCategory::Error);
+	Binder.GetStats().Maps++;
+	Binder.BindConstantBuffer(Stage, Slot, buffer);
+
+	return StatusCode::Ok;
+}
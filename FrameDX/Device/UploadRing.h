@@ -0,0 +1,119 @@
+#pragma once
+#include "stdafx.h"
+#include "../Core/Core.h"
+#include "ContextBackend.h"
+#include "DeviceBackend.h"
+#include "PipelineBinder.h"
+
+namespace FrameDX
+{
+	// Linear allocator for per-frame constants, on one large dynamic constant buffer
+	// Allocate copies the data to a CPU side copy of the buffer, and Flush sends everything allocated since the last flush
+	// with a single map. That map uses NO_OVERWRITE, as the ranges it writes are not in use by the GPU, so the maps per frame
+	// depend on the flushes (one before each draw that has new allocations) instead of on the number of buffers updated
+	// Allocations are aligned to 256 bytes, as SetConstantBuffers1 takes the ranges in multiples of 16 constants
+	//
+	// The space used on a frame is reused FramesInFlight frames later, by then the GPU is done with it as the swap chain
+	// doesn't let the CPU get further ahead, so EndFrame has to be called once per Present. If a frame needs more space than what's free, a larger buffer is created,
+	// and the old one is kept until the frames that used it are done
+	// Needs a D3D11.1 context that can map constant buffers with NO_OVERWRITE. Not thread safe, as the immediate context
+	class UploadRing
+	{
+	public:
+		static constexpr UINT Alignment = 256;
+
+		// A range of the buffer, ready to bind with SetConstantBuffers1
+		struct Allocation
+		{
+			ID3D11Buffer* Buffer = nullptr;
+			UINT FirstConstant = 0;
+			UINT NumConstants = 0;
+		};
+
+		struct Counters
+		{
+			size_t Allocations = 0;
+			size_t AllocatedBytes = 0;
+			size_t Flushes = 0;
+			// Maps done by the flushes, two when the range wrapped around the end of the buffer
+			size_t Maps = 0;
+			// Times the buffer was too small and had to grow
+			size_t Grows = 0;
+		};
+
+		UploadRing() = default;
+		~UploadRing() { Release(); }
+		UploadRing(const UploadRing&) = delete;
+		UploadRing& operator=(const UploadRing&) = delete;
+
+		// Size is rounded up to the alignment
+		StatusCode Create(DeviceBackend* Objects, size_t Size, uint32_t FramesInFlight);
+		void Release();
+		bool IsValid() const { return Buffer != nullptr; }
+
+		// Copies the data to the ring. It's sent to the GPU on the next Flush, which has to happen before the allocation is used
+		// The context is needed to flush what was pending if the ring has to grow
+		StatusCode Allocate(ContextBackend* Context, const void* Data, size_t Size, Allocation& Out);
+		// Sends the allocations done since the last flush
+		StatusCode Flush(ContextBackend* Context);
+		bool HasPending() const { return Head != Flushed || WrapEnd != 0; }
+
+		// Marks the end of a frame, and frees the space used FramesInFlight frames ago
+		void EndFrame();
+
+		size_t GetSize() const { return Shadow.size(); }
+		// Bytes used by the frames in flight, including the current one
+		size_t GetUsed() const { return Used; }
+		const Counters& GetCounters() const { return Counts; }
+		void ResetCounters() { Counts = Counters(); }
+	private:
+		StatusCode create_buffer_(size_t Size);
+		StatusCode write_(ContextBackend* Context, size_t Offset, size_t Size);
+
+		DeviceBackend* Objects = nullptr;
+		ID3D11Buffer* Buffer = nullptr;
+		// What was written to the buffer, so a flush can send a whole range at once
+		vector<uint8_t> Shadow;
+
+		// Where the next allocation goes, and the start of the range that wasn't flushed yet
+		size_t Head = 0;
+		size_t Flushed = 0;
+		// If the pending range wrapped, where it ended before going back to the start. 0 otherwise
+		size_t WrapEnd = 0;
+		// Bytes from the oldest frame in flight to Head. Allocations can't get past that frame
+		size_t Used = 0;
+		// Bytes used by the current frame, and by each of the frames in flight before it
+		size_t FrameBytes = 0;
+		deque<size_t> FramesBytes;
+		uint32_t FramesInFlight = 0;
+		// A new buffer is mapped with discard the first time, as the driver can't know it's not in use
+		bool NeedsDiscard = true;
+
+		// Buffers that were replaced by a larger one, with the frames left until the GPU is done with them
+		vector<pair<ID3D11Buffer*, uint32_t>> Retired;
+
+		Counters Counts;
+	};
+
+	// Used instead of the ring when it can't be, i.e. on deferred contexts or without D3D11.1
+	// Each stage and slot has its own dynamic buffer, created on first use (and again if it's too small) and mapped with
+	// discard on every bind, which gives each bind its own copy of the data even on a command list
+	class ConstantSlotBuffers
+	{
+	public:
+		ConstantSlotBuffers() = default;
+		~ConstantSlotBuffers() { Release(); }
+		ConstantSlotBuffers(const ConstantSlotBuffers&) = delete;
+		ConstantSlotBuffers& operator=(const ConstantSlotBuffers&) = delete;
+
+		void SetDevice(DeviceBackend* NewObjects) { Objects = NewObjects; }
+		void Release();
+
+		// Copies the data to the buffer of the slot, on the context of the binder, and binds it there
+		StatusCode Bind(PipelineBinder& Binder, ShaderStage Stage, UINT Slot, const void* Data, size_t Size);
+	private:
+		DeviceBackend* Objects = nullptr;
+		ID3D11Buffer* Buffers[(size_t)ShaderStage::_count][D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT] = {};
+		size_t Sizes[(size_t)ShaderStage::_count][D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT] = {};
+	};
+}
@@ -0,0 +1,464 @@
+#pragma once
+// Only uses the standard library and the SSE2/AVX2 intrinsics, so it can be built and used outside of Windows
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "../Core/JobSystem.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FRAMEDX_CPU_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRAMEDX_CPU_SSE2
+#endif
+
+namespace FrameDX
+{
+	// Runs compute kernels written in C++ on the CPU, with the same thread group semantics as a Dispatch
+	// A kernel runs CpuLaneCount threads of a group at once, one per SIMD lane, so it's written with the lane types below
+	// instead of float and uint. The functions on them are named after the HLSL intrinsics and behave the same way
+	// The lanes are 8 wide with AVX2, 4 wide with SSE2, and scalar loops of 4 on anything else
+#if defined(FRAMEDX_CPU_AVX2)
+	constexpr uint32_t CpuLaneCount = 8;
+	typedef __m256 cpu_float_reg_;
+	typedef __m256i cpu_int_reg_;
+#elif defined(FRAMEDX_CPU_SSE2)
+	constexpr uint32_t CpuLaneCount = 4;
+	typedef __m128 cpu_float_reg_;
+	typedef __m128i cpu_int_reg_;
+#else
+	constexpr uint32_t CpuLaneCount = 4;
+	struct cpu_float_reg_ { float v[4]; };
+	struct cpu_int_reg_ { int32_t v[4]; };
+#endif
+
+	// Per lane condition, all bits set where true
+	struct CpuMask
+	{
+		cpu_int_reg_ V;
+	};
+
+	struct CpuFloat
+	{
+		cpu_float_reg_ V;
+
+		CpuFloat() = default;
+		CpuFloat(cpu_float_reg_ Value) : V(Value) {}
+		CpuFloat(float Value);
+
+		static CpuFloat Load(const float* Values);
+		void Store(float* Values) const;
+	};
+
+	// Wraps on overflow as uint does. Comparisons and conversions treat the values as signed, so they must be below 2^31
+	struct CpuUInt
+	{
+		cpu_int_reg_ V;
+
+		CpuUInt() = default;
+		CpuUInt(cpu_int_reg_ Value) : V(Value) {}
+		CpuUInt(uint32_t Value);
+
+		static CpuUInt Load(const uint32_t* Values);
+		void Store(uint32_t* Values) const;
+	};
+
+#if defined(FRAMEDX_CPU_AVX2)
+	inline CpuFloat::CpuFloat(float Value) : V(_mm256_set1_ps(Value)) {}
+	inline CpuFloat CpuFloat::Load(const float* Values) { return _mm256_loadu_ps(Values); }
+	inline void CpuFloat::Store(float* Values) const { _mm256_storeu_ps(Values, V); }
+	inline CpuUInt::CpuUInt(uint32_t Value) : V(_mm256_set1_epi32((int)Value)) {}
+	inline CpuUInt CpuUInt::Load(const uint32_t* Values) { return _mm256_loadu_si256((const __m256i*)Values); }
+	inline void CpuUInt::Store(uint32_t* Values) const { _mm256_storeu_si256((__m256i*)Values, V); }
+
+	inline CpuFloat operator+(const CpuFloat& a, const CpuFloat& b) { return _mm256_add_ps(a.V, b.V); }
+	inline CpuFloat operator-(const CpuFloat& a, const CpuFloat& b) { return _mm256_sub_ps(a.V, b.V); }
+	inline CpuFloat operator*(const CpuFloat& a, const CpuFloat& b) { return _mm256_mul_ps(a.V, b.V); }
+	inline CpuFloat operator/(const CpuFloat& a, const CpuFloat& b) { return _mm256_div_ps(a.V, b.V); }
+	inline CpuMask operator<(const CpuFloat& a, const CpuFloat& b) { return { _mm256_castps_si256(_mm256_cmp_ps(a.V, b.V, _CMP_LT_OQ)) }; }
+	inline CpuMask operator<=(const CpuFloat& a, const CpuFloat& b) { return { _mm256_castps_si256(_mm256_cmp_ps(a.V, b.V, _CMP_LE_OQ)) }; }
+	inline CpuMask operator==(const CpuFloat& a, const CpuFloat& b) { return { _mm256_castps_si256(_mm256_cmp_ps(a.V, b.V, _CMP_EQ_OQ)) }; }
+	inline CpuFloat Min(const CpuFloat& a, const CpuFloat& b) { return _mm256_min_ps(a.V, b.V); }
+	inline CpuFloat Max(const CpuFloat& a, const CpuFloat& b) { return _mm256_max_ps(a.V, b.V); }
+	inline CpuFloat Sqrt(const CpuFloat& a) { return _mm256_sqrt_ps(a.V); }
+	inline CpuFloat Floor(const CpuFloat& a) { return _mm256_floor_ps(a.V); }
+	inline CpuFloat Trunc(const CpuFloat& a) { return _mm256_round_ps(a.V, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+	inline CpuFloat Abs(const CpuFloat& a) { return _mm256_and_ps(a.V, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff))); }
+	inline CpuFloat Select(const CpuMask& m, const CpuFloat& a, const CpuFloat& b) { return _mm256_blendv_ps(b.V, a.V, _mm256_castsi256_ps(m.V)); }
+
+	inline CpuUInt operator+(const CpuUInt& a, const CpuUInt& b) { return _mm256_add_epi32(a.V, b.V); }
+	inline CpuUInt operator-(const CpuUInt& a, const CpuUInt& b) { return _mm256_sub_epi32(a.V, b.V); }
+	inline CpuUInt operator*(const CpuUInt& a, const CpuUInt& b) { return _mm256_mullo_epi32(a.V, b.V); }
+	inline CpuUInt operator&(const CpuUInt& a, const CpuUInt& b) { return _mm256_and_si256(a.V, b.V); }
+	inline CpuUInt operator|(const CpuUInt& a, const CpuUInt& b) { return _mm256_or_si256(a.V, b.V); }
+	inline CpuUInt operator^(const CpuUInt& a, const CpuUInt& b) { return _mm256_xor_si256(a.V, b.V); }
+	inline CpuUInt operator<<(const CpuUInt& a, int n) { return _mm256_sll_epi32(a.V, _mm_cvtsi32_si128(n)); }
+	inline CpuUInt operator>>(const CpuUInt& a, int n) { return _mm256_srl_epi32(a.V, _mm_cvtsi32_si128(n)); }
+	inline CpuMask operator<(const CpuUInt& a, const CpuUInt& b) { return { _mm256_cmpgt_epi32(b.V, a.V) }; }
+	inline CpuMask operator==(const CpuUInt& a, const CpuUInt& b) { return { _mm256_cmpeq_epi32(a.V, b.V) }; }
+	inline CpuUInt Select(const CpuMask& m, const CpuUInt& a, const CpuUInt& b) { return _mm256_blendv_epi8(b.V, a.V, m.V); }
+	inline CpuFloat ToFloat(const CpuUInt& a) { return _mm256_cvtepi32_ps(a.V); }
+	// Truncates, as the float to uint conversion of HLSL
+	inline CpuUInt ToUInt(const CpuFloat& a) { return _mm256_cvttps_epi32(a.V); }
+
+	inline CpuMask operator&(const CpuMask& a, const CpuMask& b) { return { _mm256_and_si256(a.V, b.V) }; }
+	inline CpuMask operator|(const CpuMask& a, const CpuMask& b) { return { _mm256_or_si256(a.V, b.V) }; }
+	inline CpuMask operator~(const CpuMask& a) { return { _mm256_xor_si256(a.V, _mm256_set1_epi32(-1)) }; }
+	inline uint32_t GetLaneBits(const CpuMask& m) { return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(m.V)); }
+#elif defined(FRAMEDX_CPU_SSE2)
+	inline CpuFloat::CpuFloat(float Value) : V(_mm_set1_ps(Value)) {}
+	inline CpuFloat CpuFloat::Load(const float* Values) { return _mm_loadu_ps(Values); }
+	inline void CpuFloat::Store(float* Values) const { _mm_storeu_ps(Values, V); }
+	inline CpuUInt::CpuUInt(uint32_t Value) : V(_mm_set1_epi32((int)Value)) {}
+	inline CpuUInt CpuUInt::Load(const uint32_t* Values) { return _mm_loadu_si128((const __m128i*)Values); }
+	inline void CpuUInt::Store(uint32_t* Values) const { _mm_storeu_si128((__m128i*)Values, V); }
+
+	inline CpuFloat operator+(const CpuFloat& a, const CpuFloat& b) { return _mm_add_ps(a.V, b.V); }
+	inline CpuFloat operator-(const CpuFloat& a, const CpuFloat& b) { return _mm_sub_ps(a.V, b.V); }
+	inline CpuFloat operator*(const CpuFloat& a, const CpuFloat& b) { return _mm_mul_ps(a.V, b.V); }
+	inline CpuFloat operator/(const CpuFloat& a, const CpuFloat& b) { return _mm_div_ps(a.V, b.V); }
+	inline CpuMask operator<(const CpuFloat& a, const CpuFloat& b) { return { _mm_castps_si128(_mm_cmplt_ps(a.V, b.V)) }; }
+	inline CpuMask operator<=(const CpuFloat& a, const CpuFloat& b) { return { _mm_castps_si128(_mm_cmple_ps(a.V, b.V)) }; }
+	inline CpuMask operator==(const CpuFloat& a, const CpuFloat& b) { return { _mm_castps_si128(_mm_cmpeq_ps(a.V, b.V)) }; }
+	inline CpuFloat Min(const CpuFloat& a, const CpuFloat& b) { return _mm_min_ps(a.V, b.V); }
+	inline CpuFloat Max(const CpuFloat& a, const CpuFloat& b) { return _mm_max_ps(a.V, b.V); }
+	inline CpuFloat Sqrt(const CpuFloat& a) { return _mm_sqrt_ps(a.V); }
+	inline CpuFloat Abs(const CpuFloat& a) { return _mm_and_ps(a.V, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff))); }
+	inline CpuFloat Select(const CpuMask& m, const CpuFloat& a, const CpuFloat& b)
+	{
+		__m128 mask = _mm_castsi128_ps(m.V);
+		return _mm_or_ps(_mm_and_ps(mask, a.V), _mm_andnot_ps(mask, b.V));
+	}
+	// SSE2 has no rounding, so it goes through an integer. Only valid below 2^31
+	inline CpuFloat Trunc(const CpuFloat& a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a.V)); }
+	inline CpuFloat Floor(const CpuFloat& a)
+	{
+		__m128 t = Trunc(a).V;
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.V), _mm_set1_ps(1.0f)));
+	}
+
+	inline CpuUInt operator+(const CpuUInt& a, const CpuUInt& b) { return _mm_add_epi32(a.V, b.V); }
+	inline CpuUInt operator-(const CpuUInt& a, const CpuUInt& b) { return _mm_sub_epi32(a.V, b.V); }
+	inline CpuUInt operator*(const CpuUInt& a, const CpuUInt& b)
+	{
+		// SSE2 only multiplies the even lanes, so the odd ones are shifted down and multiplied apart
+		__m128i even = _mm_mul_epu32(a.V, b.V);
+		__m128i odd = _mm_mul_epu32(_mm_srli_si128(a.V, 4), _mm_srli_si128(b.V, 4));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+	inline CpuUInt operator&(const CpuUInt& a, const CpuUInt& b) { return _mm_and_si128(a.V, b.V); }
+	inline CpuUInt operator|(const CpuUInt& a, const CpuUInt& b) { return _mm_or_si128(a.V, b.V); }
+	inline CpuUInt operator^(const CpuUInt& a, const CpuUInt& b) { return _mm_xor_si128(a.V, b.V); }
+	inline CpuUInt operator<<(const CpuUInt& a, int n) { return _mm_sll_epi32(a.V, _mm_cvtsi32_si128(n)); }
+	inline CpuUInt operator>>(const CpuUInt& a, int n) { return _mm_srl_epi32(a.V, _mm_cvtsi32_si128(n)); }
+	inline CpuMask operator<(const CpuUInt& a, const CpuUInt& b) { return { _mm_cmplt_epi32(a.V, b.V) }; }
+	inline CpuMask operator==(const CpuUInt& a, const CpuUInt& b) { return { _mm_cmpeq_epi32(a.V, b.V) }; }
+	inline CpuUInt Select(const CpuMask& m, const CpuUInt& a, const CpuUInt& b) { return _mm_or_si128(_mm_and_si128(m.V, a.V), _mm_andnot_si128(m.V, b.V)); }
+	inline CpuFloat ToFloat(const CpuUInt& a) { return _mm_cvtepi32_ps(a.V); }
+	// Truncates, as the float to uint conversion of HLSL
+	inline CpuUInt ToUInt(const CpuFloat& a) { return _mm_cvttps_epi32(a.V); }
+
+	inline CpuMask operator&(const CpuMask& a, const CpuMask& b) { return { _mm_and_si128(a.V, b.V) }; }
+	inline CpuMask operator|(const CpuMask& a, const CpuMask& b) { return { _mm_or_si128(a.V, b.V) }; }
+	inline CpuMask operator~(const CpuMask& a) { return { _mm_xor_si128(a.V, _mm_set1_epi32(-1)) }; }
+	inline uint32_t GetLaneBits(const CpuMask& m) { return (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(m.V)); }
+#else
+	// Applies the expression to each lane. The compiler can still vectorize the loops
+#define __LANES(type, expr) type r; for(uint32_t i = 0; i < CpuLaneCount; i++) r.V.v[i] = (expr); return r;
+
+	inline CpuFloat::CpuFloat(float Value) { for(uint32_t i = 0; i < CpuLaneCount; i++) V.v[i] = Value; }
+	inline CpuFloat CpuFloat::Load(const float* Values) { CpuFloat r; memcpy(r.V.v, Values, sizeof(r.V.v)); return r; }
+	inline void CpuFloat::Store(float* Values) const { memcpy(Values, V.v, sizeof(V.v)); }
+	inline CpuUInt::CpuUInt(uint32_t Value) { for(uint32_t i = 0; i < CpuLaneCount; i++) V.v[i] = (int32_t)Value; }
+	inline CpuUInt CpuUInt::Load(const uint32_t* Values) { CpuUInt r; memcpy(r.V.v, Values, sizeof(r.V.v)); return r; }
+	inline void CpuUInt::Store(uint32_t* Values) const { memcpy(Values, V.v, sizeof(V.v)); }
+
+	inline CpuFloat operator+(const CpuFloat& a, const CpuFloat& b) { __LANES(CpuFloat, a.V.v[i] + b.V.v[i]) }
+	inline CpuFloat operator-(const CpuFloat& a, const CpuFloat& b) { __LANES(CpuFloat, a.V.v[i] - b.V.v[i]) }
+	inline CpuFloat operator*(const CpuFloat& a, const CpuFloat& b) { __LANES(CpuFloat, a.V.v[i] * b.V.v[i]) }
+	inline CpuFloat operator/(const CpuFloat& a, const CpuFloat& b) { __LANES(CpuFloat, a.V.v[i] / b.V.v[i]) }
+	inline CpuMask operator<(const CpuFloat& a, const CpuFloat& b) { __LANES(CpuMask, a.V.v[i] < b.V.v[i] ? -1 : 0) }
+	inline CpuMask operator<=(const CpuFloat& a, const CpuFloat& b) { __LANES(CpuMask, a.V.v[i] <= b.V.v[i] ? -1 : 0) }
+	inline CpuMask operator==(const CpuFloat& a, const CpuFloat& b) { __LANES(CpuMask, a.V.v[i] == b.V.v[i] ? -1 : 0) }
+	inline CpuFloat Min(const CpuFloat& a, const CpuFloat& b) { __LANES(CpuFloat, b.V.v[i] < a.V.v[i] ? b.V.v[i] : a.V.v[i]) }
+	inline CpuFloat Max(const CpuFloat& a, const CpuFloat& b) { __LANES(CpuFloat, a.V.v[i] < b.V.v[i] ? b.V.v[i] : a.V.v[i]) }
+	inline CpuFloat Sqrt(const CpuFloat& a) { __LANES(CpuFloat, std::sqrt(a.V.v[i])) }
+	inline CpuFloat Floor(const CpuFloat& a) { __LANES(CpuFloat, std::floor(a.V.v[i])) }
+	inline CpuFloat Trunc(const CpuFloat& a) { __LANES(CpuFloat, std::trunc(a.V.v[i])) }
+	inline CpuFloat Abs(const CpuFloat& a) { __LANES(CpuFloat, std::fabs(a.V.v[i])) }
+	inline CpuFloat Select(const CpuMask& m, const CpuFloat& a, const CpuFloat& b) { __LANES(CpuFloat, m.V.v[i] ? a.V.v[i] : b.V.v[i]) }
+
+	inline CpuUInt operator+(const CpuUInt& a, const CpuUInt& b) { __LANES(CpuUInt, (int32_t)((uint32_t)a.V.v[i] + (uint32_t)b.V.v[i])) }
+	inline CpuUInt operator-(const CpuUInt& a, const CpuUInt& b) { __LANES(CpuUInt, (int32_t)((uint32_t)a.V.v[i] - (uint32_t)b.V.v[i])) }
+	inline CpuUInt operator*(const CpuUInt& a, const CpuUInt& b) { __LANES(CpuUInt, (int32_t)((uint32_t)a.V.v[i] * (uint32_t)b.V.v[i])) }
+	inline CpuUInt operator&(const CpuUInt& a, const CpuUInt& b) { __LANES(CpuUInt, a.V.v[i] & b.V.v[i]) }
+	inline CpuUInt operator|(const CpuUInt& a, const CpuUInt& b) { __LANES(CpuUInt, a.V.v[i] | b.V.v[i]) }
+	inline CpuUInt operator^(const CpuUInt& a, const CpuUInt& b) { __LANES(CpuUInt, a.V.v[i] ^ b.V.v[i]) }
+	inline CpuUInt operator<<(const CpuUInt& a, int n) { __LANES(CpuUInt, (int32_t)((uint32_t)a.V.v[i] << n)) }
+	inline CpuUInt operator>>(const CpuUInt& a, int n) { __LANES(CpuUInt, (int32_t)((uint32_t)a.V.v[i] >> n)) }
+	inline CpuMask operator<(const CpuUInt& a, const CpuUInt& b) { __LANES(CpuMask, a.V.v[i] < b.V.v[i] ? -1 : 0) }
+	inline CpuMask operator==(const CpuUInt& a, const CpuUInt& b) { __LANES(CpuMask, a.V.v[i] == b.V.v[i] ? -1 : 0) }
+	inline CpuUInt Select(const CpuMask& m, const CpuUInt& a, const CpuUInt& b) { __LANES(CpuUInt, m.V.v[i] ? a.V.v[i] : b.V.v[i]) }
+	inline CpuFloat ToFloat(const CpuUInt& a) { __LANES(CpuFloat, (float)a.V.v[i]) }
+	// Truncates, as the float to uint conversion of HLSL
+	inline CpuUInt ToUInt(const CpuFloat& a) { __LANES(CpuUInt, (int32_t)a.V.v[i]) }
+
+	inline CpuMask operator&(const CpuMask& a, const CpuMask& b) { __LANES(CpuMask, a.V.v[i] & b.V.v[i]) }
+	inline CpuMask operator|(const CpuMask& a, const CpuMask& b) { __LANES(CpuMask, a.V.v[i] | b.V.v[i]) }
+	inline CpuMask operator~(const CpuMask& a) { __LANES(CpuMask, ~a.V.v[i]) }
+	inline uint32_t GetLaneBits(const CpuMask& m)
+	{
+		uint32_t bits = 0;
+		for(uint32_t i = 0; i < CpuLaneCount; i++)
+			bits |= (m.V.v[i] ? 1u : 0u) << i;
+		return bits;
+	}
+
+#undef __LANES
+#endif
+
+	// Derived from the ones above, so they are the same on every instruction set
+	inline CpuFloat operator-(const CpuFloat& a) { return CpuFloat(0.0f) - a; }
+	inline CpuFloat& operator+=(CpuFloat& a, const CpuFloat& b) { return a = a + b; }
+	inline CpuFloat& operator-=(CpuFloat& a, const CpuFloat& b) { return a = a - b; }
+	inline CpuFloat& operator*=(CpuFloat& a, const CpuFloat& b) { return a = a * b; }
+	inline CpuFloat& operator/=(CpuFloat& a, const CpuFloat& b) { return a = a / b; }
+	inline CpuMask operator>(const CpuFloat& a, const CpuFloat& b) { return b < a; }
+	inline CpuMask operator>=(const CpuFloat& a, const CpuFloat& b) { return b <= a; }
+	inline CpuMask operator!=(const CpuFloat& a, const CpuFloat& b) { return ~(a == b); }
+	inline CpuUInt& operator+=(CpuUInt& a, const CpuUInt& b) { return a = a + b; }
+	inline CpuMask operator>(const CpuUInt& a, const CpuUInt& b) { return b < a; }
+	inline CpuMask operator!=(const CpuUInt& a, const CpuUInt& b) { return ~(a == b); }
+	inline CpuMask& operator&=(CpuMask& a, const CpuMask& b) { return a = a & b; }
+	inline CpuMask& operator|=(CpuMask& a, const CpuMask& b) { return a = a | b; }
+
+	inline bool Any(const CpuMask& m) { return GetLaneBits(m) != 0; }
+	inline bool All(const CpuMask& m) { return GetLaneBits(m) == (1u << CpuLaneCount) - 1; }
+	inline CpuFloat Saturate(const CpuFloat& a) { return Min(Max(a, 0.0f), 1.0f); }
+	inline CpuFloat Lerp(const CpuFloat& a, const CpuFloat& b, const CpuFloat& t) { return a + (b - a) * t; }
+	// Same sign as a, as the HLSL one
+	inline CpuFloat Fmod(const CpuFloat& a, const CpuFloat& b) { return a - b * Trunc(a / b); }
+	inline CpuFloat Frac(const CpuFloat& a) { return a - Floor(a); }
+
+	// Vectors of lanes, one lane per thread
+	struct CpuFloat2 { CpuFloat x, y; };
+	struct CpuFloat3 { CpuFloat x, y, z; };
+	struct CpuFloat4 { CpuFloat x, y, z, w; };
+	struct CpuUInt3 { CpuUInt x, y, z; };
+
+	// Component wise, and with a scalar broadcast to every component
+#define __CPU_VECTOR_2(op) __CPU_VECTOR_OPS_N(CpuFloat2, op, a.x op b.x, a.y op b.y)
+#define __CPU_VECTOR_3(op) __CPU_VECTOR_OPS_N(CpuFloat3, op, a.x op b.x, a.y op b.y, a.z op b.z)
+#define __CPU_VECTOR_4(op) __CPU_VECTOR_OPS_N(CpuFloat4, op, a.x op b.x, a.y op b.y, a.z op b.z, a.w op b.w)
+#define __CPU_VECTOR_OPS_N(type, op, ...) \
+	inline type operator op(const type& a, const type& b) { return { __VA_ARGS__ }; } \
+	inline type operator op(const type& a, const CpuFloat& s) { type b; cpu_broadcast_(b, s); return a op b; } \
+	inline type operator op(const CpuFloat& s, const type& b) { type a; cpu_broadcast_(a, s); return a op b; }
+
+	inline void cpu_broadcast_(CpuFloat2& v, const CpuFloat& s) { v = { s, s }; }
+	inline void cpu_broadcast_(CpuFloat3& v, const CpuFloat& s) { v = { s, s, s }; }
+	inline void cpu_broadcast_(CpuFloat4& v, const CpuFloat& s) { v = { s, s, s, s }; }
+
+	__CPU_VECTOR_2(+) __CPU_VECTOR_2(-) __CPU_VECTOR_2(*) __CPU_VECTOR_2(/)
+	__CPU_VECTOR_3(+) __CPU_VECTOR_3(-) __CPU_VECTOR_3(*) __CPU_VECTOR_3(/)
+	__CPU_VECTOR_4(+) __CPU_VECTOR_4(-) __CPU_VECTOR_4(*) __CPU_VECTOR_4(/)
+
+#undef __CPU_VECTOR_2
+#undef __CPU_VECTOR_3
+#undef __CPU_VECTOR_4
+#undef __CPU_VECTOR_OPS_N
+
+	inline CpuFloat Dot(const CpuFloat2& a, const CpuFloat2& b) { return a.x * b.x + a.y * b.y; }
+	inline CpuFloat Dot(const CpuFloat3& a, const CpuFloat3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline CpuFloat Dot(const CpuFloat4& a, const CpuFloat4& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+	// Packs [0,1] values to R8G8B8A8_UNORM, as a store to a unorm float4 texture would
+	inline CpuUInt PackUNorm4(const CpuFloat4& v)
+	{
+		auto to_byte = [](const CpuFloat& c) { return ToUInt(Saturate(c) * 255.0f + 0.5f); };
+		return to_byte(v.x) | (to_byte(v.y) << 8) | (to_byte(v.z) << 16) | (to_byte(v.w) << 24);
+	}
+
+	// Lane type of the elements of the views that can be read and written a lane at a time
+	template<typename T> struct cpu_lanes_ {};
+	template<> struct cpu_lanes_<float> { typedef CpuFloat type; };
+	template<> struct cpu_lanes_<uint32_t> { typedef CpuUInt type; };
+
+	// Reads the element of each active lane. Out of bounds and inactive lanes read 0, as out of bounds reads do on the GPU
+	template<typename T, typename F>
+	typename cpu_lanes_<T>::type cpu_gather_(const CpuMask& Active, F&& Element)
+	{
+		T values[CpuLaneCount] = {};
+		uint32_t bits = GetLaneBits(Active);
+		for(uint32_t i = 0; i < CpuLaneCount; i++)
+			if(bits & (1u << i))
+				if(const T* element = Element(i))
+					values[i] = *element;
+		return cpu_lanes_<T>::type::Load(values);
+	}
+
+	// Writes the value of each active lane. Out of bounds writes are discarded
+	template<typename T, typename F>
+	void cpu_scatter_(const CpuMask& Active, const typename cpu_lanes_<T>::type& Value, F&& Element)
+	{
+		T values[CpuLaneCount];
+		Value.Store(values);
+		uint32_t bits = GetLaneBits(Active);
+		for(uint32_t i = 0; i < CpuLaneCount; i++)
+			if(bits & (1u << i))
+				if(T* element = Element(i))
+					*element = values[i];
+	}
+
+	// CPU side of a (RW)StructuredBuffer. Doesn't own the memory, so it's valid while the data it points to is
+	// Kernels that write to it must not write the same element from two threads, as the groups run in parallel
+	template<typename T>
+	struct CpuBufferView
+	{
+		T* Data = nullptr;
+		size_t Count = 0;
+
+		CpuBufferView() = default;
+		CpuBufferView(T* Data, size_t Count) : Data(Data), Count(Count) {}
+		CpuBufferView(std::vector<T>& Values) : Data(Values.data()), Count(Values.size()) {}
+
+		// Per lane access, only for float and uint32_t elements. Other types use Data directly
+		template<typename U = T>
+		typename cpu_lanes_<U>::type Load(const CpuUInt& Index, const CpuMask& Active) const
+		{
+			uint32_t index[CpuLaneCount];
+			Index.Store(index);
+			return cpu_gather_<T>(Active, [&](uint32_t Lane) { return index[Lane] < Count ? &Data[index[Lane]] : nullptr; });
+		}
+		template<typename U = T>
+		void Store(const CpuUInt& Index, const typename cpu_lanes_<U>::type& Value, const CpuMask& Active) const
+		{
+			uint32_t index[CpuLaneCount];
+			Index.Store(index);
+			cpu_scatter_<T>(Active, Value, [&](uint32_t Lane) { return index[Lane] < Count ? &Data[index[Lane]] : nullptr; });
+		}
+	};
+
+	// CPU side of a (RW)Texture2D, with a single mip. Texels are T, for example uint32_t for R8G8B8A8_UNORM
+	// Doesn't own the memory. RowPitch is in elements, and 0 means Width
+	template<typename T>
+	struct CpuTexture2DView
+	{
+		T* Data = nullptr;
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		uint32_t RowPitch = 0;
+
+		CpuTexture2DView() = default;
+		CpuTexture2DView(T* Data, uint32_t Width, uint32_t Height, uint32_t RowPitch = 0) : Data(Data), Width(Width), Height(Height), RowPitch(RowPitch ? RowPitch : Width) {}
+
+		T* GetTexel(uint32_t X, uint32_t Y) const { return X < Width && Y < Height ? &Data[(size_t)Y * RowPitch + X] : nullptr; }
+
+		template<typename U = T>
+		typename cpu_lanes_<U>::type Load(const CpuUInt& X, const CpuUInt& Y, const CpuMask& Active) const
+		{
+			uint32_t x[CpuLaneCount], y[CpuLaneCount];
+			X.Store(x);
+			Y.Store(y);
+			return cpu_gather_<T>(Active, [&](uint32_t Lane) { return (const T*)GetTexel(x[Lane], y[Lane]); });
+		}
+		template<typename U = T>
+		void Store(const CpuUInt& X, const CpuUInt& Y, const typename cpu_lanes_<U>::type& Value, const CpuMask& Active) const
+		{
+			uint32_t x[CpuLaneCount], y[CpuLaneCount];
+			X.Store(x);
+			Y.Store(y);
+			cpu_scatter_<T>(Active, Value, [&](uint32_t Lane) { return GetTexel(x[Lane], y[Lane]); });
+		}
+	};
+
+	// System values of the threads that a kernel call runs, one per lane
+	struct CpuThreadIds
+	{
+		CpuUInt3 DispatchThreadID;
+		CpuUInt3 GroupThreadID;
+		CpuUInt3 GroupID;
+		CpuUInt GroupIndex;
+
+		// Lanes that are threads of the group. Only the last call of each group can have inactive lanes,
+		// when the group size is not a multiple of CpuLaneCount
+		CpuMask Active;
+	};
+
+	// Runs Kernel over GroupsX * GroupsY * GroupsZ groups, as a Dispatch would
+	// The group size is taken from the static members GroupSizeX/Y/Z of the kernel, the same as [numthreads] on HLSL
+	// Kernel(const CpuThreadIds&) is called for CpuLaneCount threads of a group at a time, in SV_GroupIndex order
+	// Each group is a job, so groups are tiles of work spread over all the cores, and a group always runs on one thread
+	// Group shared memory and barriers are not supported, as the calls of a group run one after another
+	// Kernel is shared by all the workers, so it must be safe to call concurrently
+	template<typename K>
+	void CpuDispatch(const K& Kernel, uint32_t GroupsX, uint32_t GroupsY, uint32_t GroupsZ, JobSystem& Jobs = GetJobSystem())
+	{
+		constexpr uint32_t group_size = K::GroupSizeX * K::GroupSizeY * K::GroupSizeZ;
+		constexpr uint32_t batch_count = (group_size + CpuLaneCount - 1) / CpuLaneCount;
+		static_assert(group_size > 0, "The group size can't be 0");
+
+		// The ids inside the group are the same for every group, so they are computed once
+		struct batch_
+		{
+			CpuUInt3 GroupThreadID;
+			CpuUInt GroupIndex;
+			CpuMask Active;
+		};
+		std::vector<batch_> batches(batch_count);
+		for(uint32_t b = 0; b < batch_count; b++)
+		{
+			uint32_t x[CpuLaneCount], y[CpuLaneCount], z[CpuLaneCount], index[CpuLaneCount], active[CpuLaneCount];
+			for(uint32_t lane = 0; lane < CpuLaneCount; lane++)
+			{
+				uint32_t i = b * CpuLaneCount + lane;
+				bool is_active = i < group_size;
+				if(!is_active)
+					i = group_size - 1;
+
+				index[lane] = i;
+				x[lane] = i % K::GroupSizeX;
+				y[lane] = (i / K::GroupSizeX) % K::GroupSizeY;
+				z[lane] = i / (K::GroupSizeX * K::GroupSizeY);
+				active[lane] = is_active ? ~0u : 0u;
+			}
+
+			batches[b].GroupThreadID = { CpuUInt::Load(x), CpuUInt::Load(y), CpuUInt::Load(z) };
+			batches[b].GroupIndex = CpuUInt::Load(index);
+			batches[b].Active = { CpuUInt::Load(active).V };
+		}
+
+		size_t group_count = (size_t)GroupsX * GroupsY * GroupsZ;
+		Jobs.ParallelFor(0, group_count, [&](size_t Group)
+		{
+			uint32_t gx = (uint32_t)(Group % GroupsX);
+			uint32_t gy = (uint32_t)((Group / GroupsX) % GroupsY);
+			uint32_t gz = (uint32_t)(Group / ((size_t)GroupsX * GroupsY));
+
+			CpuThreadIds ids;
+			ids.GroupID = { CpuUInt(gx), CpuUInt(gy), CpuUInt(gz) };
+			CpuUInt3 base = { CpuUInt(gx * K::GroupSizeX), CpuUInt(gy * K::GroupSizeY), CpuUInt(gz * K::GroupSizeZ) };
+
+			for(const batch_& batch : batches)
+			{
+				ids.GroupThreadID = batch.GroupThreadID;
+				ids.GroupIndex = batch.GroupIndex;
+				ids.Active = batch.Active;
+				ids.DispatchThreadID = { base.x + batch.GroupThreadID.x, base.y + batch.GroupThreadID.y, base.z + batch.GroupThreadID.z };
+				Kernel(ids);
+			}
+		});
+	}
+
+	// Dispatches enough groups to cover ThreadsX * ThreadsY * ThreadsZ threads
+	// The threads past the end still run, so the kernel has to check the bounds or use the views, which ignore them
+	template<typename K>
+	void CpuDispatchThreads(const K& Kernel, uint32_t ThreadsX, uint32_t ThreadsY, uint32_t ThreadsZ, JobSystem& Jobs = GetJobSystem())
+	{
+		CpuDispatch(Kernel, (ThreadsX + K::GroupSizeX - 1) / K::GroupSizeX, (ThreadsY + K::GroupSizeY - 1) / K::GroupSizeY,
+					(ThreadsZ + K::GroupSizeZ - 1) / K::GroupSizeZ, Jobs);
+	}
+}
@@ -0,0 +1,97 @@
+#include "stdafx.h"
+#include "IncrementalCompute.h"
+#include "../Core/Utils.h"
+#include "../Device/Device.h"
+
+using namespace FrameDX;
+
+StatusCode FrameDX::IncrementalComputePass::Create(Device* OwnerDevice, ComputeShader* Shader, const Description& Params)
+{
+	LogAssertWithReturn(OwnerDevice && Shader, LogCategory::Error, StatusCode::InvalidArgument);
+	LogAssertWithReturn(Params.SizeX && Params.SizeY && Params.MaxIterations && Params.IterationBudget, LogCategory::Error, StatusCode::InvalidArgument);
+	LogAssertWithReturn(Shader->GroupSizeX && Shader->GroupSizeY, LogCategory::Error, StatusCode::InvalidArgument);
+
+	this->OwnerDevice = OwnerDevice;
+	Desc = Params;
+	TilesX = (Desc.SizeX + Shader->GroupSizeX - 1) / Shader->GroupSizeX;
+	TilesY = (Desc.SizeY + Shader->GroupSizeY - 1) / Shader->GroupSizeY;
+	IterationBegin = 0;
+
+	auto tex_desc = Texture2D::Description();
+	tex_desc.SizeX = Desc.SizeX;
+	tex_desc.SizeY = Desc.SizeY;
+	tex_desc.Format = Desc.Format;
+	tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	LogCheckWithReturn(Result.CreateFromDescription(OwnerDevice, tex_desc, {}, Texture2D::CreateSRVFlag | Texture2D::CreateUAVFlag), LogCategory::Error);
+
+	// The views take the element count from the data, so it's created zeroed
+	size_t pixel_count = (size_t)Desc.SizeX * Desc.SizeY;
+	LogCheckWithReturn(PixelStates.Build(pixel_count, *OwnerDevice, vector<pixel_state_>(pixel_count), D3D11_USAGE_DEFAULT, true), LogCategory::Error);
+	LogCheckWithReturn(TileStates.Build((size_t)TilesX * TilesY, *OwnerDevice, vector<tile_state_>((size_t)TilesX * TilesY), D3D11_USAGE_DEFAULT, true), LogCategory::Error);
+	LogCheckWithReturn(PassConstants.Build(*OwnerDevice), LogCategory::Error);
+
+	State = PipelineState();
+	State.Shaders[(size_t)ShaderStage::Compute].ShaderPtr = Shader;
+	State.Shaders[(size_t)ShaderStage::Compute].ConstantBuffersTable = { PassConstants.Buffer, ParamsBuffer };
+	State.Output.ComputeShaderUAVs = { Result.GetUAVView(), View<ID3D11UnorderedAccessView>(PixelStates.GetUAV()), View<ID3D11UnorderedAccessView>(TileStates.GetUAV()) };
+
+	return StatusCode::Ok;
+}
+
+StatusCode FrameDX::IncrementalComputePass::set_params_(const void* Params, size_t Size)
+{
+	LogAssertWithReturn(OwnerDevice, LogCategory::Error, StatusCode::InvalidCall);
+
+	uint64_t hash = hash_bytes(Params, Size);
+	if(ParamsBuffer && Size == ParamsSize && hash == ParamsHash)
+		return StatusCode::Ok;
+
+	if(Size != ParamsSize)
+	{
+		if(ParamsBuffer)
+			ParamsBuffer->Release();
+		ParamsBuffer = nullptr;
+
+		D3D11_BUFFER_DESC cb_desc = {};
+		cb_desc.ByteWidth = (UINT)Size;
+		cb_desc.Usage = D3D11_USAGE_DYNAMIC;
+		cb_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		cb_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateBuffer(&cb_desc, nullptr, &ParamsBuffer), LogCategory::Error);
+
+		ParamsSize = Size;
+		State.Shaders[(size_t)ShaderStage::Compute].ConstantBuffersTable = { PassConstants.Buffer, ParamsBuffer };
+	}
+
+	vector<uint8_t> data((const uint8_t*)Params, (const uint8_t*)Params + Size);
+	LogCheckWithReturn(OwnerDevice->UpdateBufferFromVector(ParamsBuffer, data), LogCategory::Error);
+
+	ParamsHash = hash;
+	IterationBegin = 0;
+
+	return StatusCode::Ok;
+}
+
+bool FrameDX::IncrementalComputePass::Run()
+{
+	if(!OwnerDevice || IsComplete())
+		return false;
+	// The shader reads the parameters from b1
+	LogAssertWithReturn(ParamsBuffer, LogCategory::Error, false);
+
+	// Uploaded by the dispatch
+	pass_constants_ constants = {};
+	constants.IterationBegin = IterationBegin;
+	constants.IterationEnd = min(Desc.MaxIterations, IterationBegin + Desc.IterationBudget);
+	constants.MaxIterations = Desc.MaxIterations;
+	constants.TilesX = TilesX;
+	constants.SizeX = Desc.SizeX;
+	constants.SizeY = Desc.SizeY;
+	PassConstants.Set(constants);
+
+	OwnerDevice->BindPipelineState(State);
+	OwnerDevice->Dispatch(TilesX, TilesY, 1);
+
+	IterationBegin = constants.IterationEnd;
+	return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "stdafx.h"
+#include "../Core/Core.h"
+#include "../Core/Buffer.h"
+#include "../Core/PipelineState.h"
+#include "../Texture/Texture.h"
+#include "Shaders.h"
+
+namespace FrameDX
+{
+	// Runs an iterative compute shader over a few frames, and only again when its parameters change
+	// The result stays on a persistent texture. After a change the shader runs up to IterationBudget iterations per frame,
+	// continuing from where the last frame left, until it reaches MaxIterations. Then it's not dispatched anymore
+	// Each thread group is a tile, and the shader marks the tiles where all the threads finished, so the next frames skip them
+	//
+	// The shader has to follow this layout
+	//		cbuffer PassConstants : register(b0) { uint IterationBegin; uint IterationEnd; uint MaxIterations; uint TilesX; uint SizeX; uint SizeY; }
+	//		cbuffer Params : register(b1), with the parameters given to SetParams
+	//		RWTexture2D<unorm float4> Result : register(u0)
+	//		RWStructuredBuffer<float4> State : register(u1), one element per pixel, to save what it needs to continue
+	//		RWStructuredBuffer<uint4> Tiles : register(u2), one per group. x is 1 when all the threads of the group finished
+	// IterationBegin is 0 on the first frame after a change, and then the state and the tiles have to be reset
+	class IncrementalComputePass
+	{
+	public:
+		struct Description
+		{
+			Description()
+			{
+				SizeX = 0;
+				SizeY = 0;
+				MaxIterations = 0;
+				IterationBudget = 256;
+				Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			}
+
+			uint32_t SizeX;
+			uint32_t SizeY;
+			uint32_t MaxIterations;
+			// Iterations run per frame, so the first frame after a change costs at most this
+			uint32_t IterationBudget;
+			DXGI_FORMAT Format;
+		} Desc;
+
+		IncrementalComputePass() = default;
+		~IncrementalComputePass()
+		{
+			if(ParamsBuffer)
+				ParamsBuffer->Release();
+		}
+		IncrementalComputePass(const IncrementalComputePass&) = delete;
+		IncrementalComputePass& operator=(const IncrementalComputePass&) = delete;
+
+		// The group size of the shader is the tile size
+		StatusCode Create(Device* OwnerDevice, ComputeShader* Shader, const Description& Params);
+
+		// Uploads the parameters if their hash changed since the last call, and then starts again
+		template<typename T>
+		StatusCode SetParams(const T& Params)
+		{
+			static_assert(sizeof(T) % 16 == 0, "T needs to be 16-bytes aligned");
+			return set_params_(&Params, sizeof(T));
+		}
+
+		// Starts again without a parameter change, i.e. when the result texture was overwritten
+		void Invalidate() { IterationBegin = 0; }
+
+		// Runs the iterations of this frame. Returns true if it dispatched, false once the result is complete
+		// SetParams has to be called before the first run
+		bool Run();
+
+		bool IsComplete() const { return IterationBegin >= Desc.MaxIterations; }
+		// How many of the iterations are done, from 0 to 1
+		float GetProgress() const { return Desc.MaxIterations ? min(1.0f, IterationBegin / float(Desc.MaxIterations)) : 1.0f; }
+
+		Texture2D* GetResult() { return &Result; }
+	private:
+		struct pass_constants_
+		{
+			uint32_t IterationBegin;
+			uint32_t IterationEnd;
+			uint32_t MaxIterations;
+			uint32_t TilesX;
+			uint32_t SizeX;
+			uint32_t SizeY;
+
+			uint32_t padding_[2];
+		};
+		struct pixel_state_ { float Values[4]; };
+		struct tile_state_ { uint32_t Values[4]; };
+
+		StatusCode set_params_(const void* Params, size_t Size);
+
+		Device* OwnerDevice = nullptr;
+		PipelineState State;
+		ConstantBuffer<pass_constants_> PassConstants;
+		ID3D11Buffer* ParamsBuffer = nullptr;
+		size_t ParamsSize = 0;
+		uint64_t ParamsHash = 0;
+
+		Texture2D Result;
+		StructuredBuffer<pixel_state_> PixelStates;
+		StructuredBuffer<tile_state_> TileStates;
+
+		uint32_t TilesX = 0;
+		uint32_t TilesY = 0;
+		uint32_t IterationBegin = 0;
+	};
+}
@@ -5,8 +5,8 @@
 
 using namespace FrameDX;
 
-ID3DBlob * ReadFile(ID3D11Device* device,
-					vector<pair<string,string>>& Defines,
+// Only compiles, so it doesn't need a device and works the same on headless ones
+ID3DBlob * ReadFile(vector<pair<string,string>>& Defines,
 					bool FullDebug, 
 					wstring& FilePath,
 					string& EntryPoint,
@@ -96,12 +96,12 @@ ID3DBlob * ReadFile(ID3D11Device* device,
 StatusCode FrameDX::ComputeShader::CreateFromFile(Device * device, wstring FilePath, string EntryPoint, bool FullDebug,vector<pair<string,string>> Defines)
 {
 	StatusCode status;
-	ID3DBlob * shader_blob = ReadFile(device->GetDevice(),Defines,FullDebug,FilePath,EntryPoint,"cs_5_0",status);
+	ID3DBlob * shader_blob = ReadFile(Defines,FullDebug,FilePath,EntryPoint,"cs_5_0",status);
 	
 	if(status != StatusCode::Ok) return status;
 
 	OwnerDevice = device;
-	LogCheckWithReturn(OwnerDevice->GetDevice()->CreateComputeShader(shader_blob->GetBufferPointer(),shader_blob->GetBufferSize(),nullptr,&Shader),LogCategory::Error);
+	LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateShader(ShaderStage::Compute,shader_blob->GetBufferPointer(),shader_blob->GetBufferSize(),(void**)&Shader),LogCategory::Error);
 
 	ID3D11ShaderReflection* reflector = NULL; 
 	LogCheckWithReturn(D3DReflect( shader_blob->GetBufferPointer(), shader_blob->GetBufferSize(), IID_ID3D11ShaderReflection, (void**) &reflector),LogCategory::Error);
@@ -113,12 +113,12 @@ StatusCode FrameDX::ComputeShader::CreateFromFile(Device * device, wstring FileP
 StatusCode FrameDX::PixelShader::CreateFromFile(Device * device, wstring FilePath, string EntryPoint, bool FullDebug,vector<pair<string,string>> Defines)
 {
 	StatusCode status;
-	ID3DBlob * shader_blob = ReadFile(device->GetDevice(),Defines,FullDebug,FilePath,EntryPoint,"ps_5_0",status);
+	ID3DBlob * shader_blob = ReadFile(Defines,FullDebug,FilePath,EntryPoint,"ps_5_0",status);
 	
 	if(status != StatusCode::Ok) return status;
 
 	OwnerDevice = device;
-	LogCheckWithReturn(OwnerDevice->GetDevice()->CreatePixelShader(shader_blob->GetBufferPointer(),shader_blob->GetBufferSize(),nullptr,&Shader),LogCategory::Error);
+	LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateShader(ShaderStage::Pixel,shader_blob->GetBufferPointer(),shader_blob->GetBufferSize(),(void**)&Shader),LogCategory::Error);
 
 	return StatusCode::Ok;
 }
@@ -127,12 +127,12 @@ StatusCode FrameDX::PixelShader::CreateFromFile(Device * device, wstring FilePat
 StatusCode FrameDX::VertexShader::CreateFromFile(Device * device, wstring FilePath, string EntryPoint, bool FullDebug,vector<pair<string,string>> Defines)
 {
 	StatusCode status;
-	Blob = ReadFile(device->GetDevice(),Defines,FullDebug,FilePath,EntryPoint,"vs_5_0",status);
+	Blob = ReadFile(Defines,FullDebug,FilePath,EntryPoint,"vs_5_0",status);
 	
 	if(status != StatusCode::Ok) return status;
 
 	OwnerDevice = device;
-	LogCheckWithReturn(OwnerDevice->GetDevice()->CreateVertexShader(Blob->GetBufferPointer(),Blob->GetBufferSize(),nullptr,&Shader),LogCategory::Error);
+	LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateShader(ShaderStage::Vertex,Blob->GetBufferPointer(),Blob->GetBufferSize(),(void**)&Shader),LogCategory::Error);
 
 	return StatusCode::Ok;
 }
@@ -141,12 +141,12 @@ StatusCode FrameDX::VertexShader::CreateFromFile(Device * device, wstring FilePa
 StatusCode FrameDX::GeometryShader::CreateFromFile(Device * device, wstring FilePath, string EntryPoint, bool FullDebug,vector<pair<string,string>> Defines)
 {
 	StatusCode status;
-	ID3DBlob * shader_blob = ReadFile(device->GetDevice(),Defines,FullDebug,FilePath,EntryPoint,"gs_5_0",status);
+	ID3DBlob * shader_blob = ReadFile(Defines,FullDebug,FilePath,EntryPoint,"gs_5_0",status);
 	
 	if(status != StatusCode::Ok) return status;
 
 	OwnerDevice = device;
-	LogCheckWithReturn(OwnerDevice->GetDevice()->CreateGeometryShader(shader_blob->GetBufferPointer(),shader_blob->GetBufferSize(),nullptr,&Shader),LogCategory::Error);
+	LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateShader(ShaderStage::Geometry,shader_blob->GetBufferPointer(),shader_blob->GetBufferSize(),(void**)&Shader),LogCategory::Error);
 
 	return StatusCode::Ok;
 }
@@ -154,12 +154,12 @@ StatusCode FrameDX::GeometryShader::CreateFromFile(Device * device, wstring File
 StatusCode FrameDX::HullShader::CreateFromFile(Device * device, wstring FilePath, string EntryPoint, bool FullDebug,vector<pair<string,string>> Defines)
 {
 	StatusCode status;
-	ID3DBlob * shader_blob = ReadFile(device->GetDevice(),Defines,FullDebug,FilePath,EntryPoint,"hs_5_0",status);
+	ID3DBlob * shader_blob = ReadFile(Defines,FullDebug,FilePath,EntryPoint,"hs_5_0",status);
 	
 	if(status != StatusCode::Ok) return status;
 
 	OwnerDevice = device;
-	LogCheckWithReturn(OwnerDevice->GetDevice()->CreateHullShader(shader_blob->GetBufferPointer(),shader_blob->GetBufferSize(),nullptr,&Shader),LogCategory::Error);
+	LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateShader(ShaderStage::Hull,shader_blob->GetBufferPointer(),shader_blob->GetBufferSize(),(void**)&Shader),LogCategory::Error);
 
 	return StatusCode::Ok;
 }
@@ -167,12 +167,12 @@ StatusCode FrameDX::HullShader::CreateFromFile(Device * device, wstring FilePath
 StatusCode FrameDX::DomainShader::CreateFromFile(Device * device, wstring FilePath, string EntryPoint, bool FullDebug,vector<pair<string,string>> Defines)
 {
 	StatusCode status;
-	ID3DBlob * shader_blob = ReadFile(device->GetDevice(),Defines,FullDebug,FilePath,EntryPoint,"ds_5_0",status);
+	ID3DBlob * shader_blob = ReadFile(Defines,FullDebug,FilePath,EntryPoint,"ds_5_0",status);
 	
 	if(status != StatusCode::Ok) return status;
 
 	OwnerDevice = device;
-	LogCheckWithReturn(OwnerDevice->GetDevice()->CreateDomainShader(shader_blob->GetBufferPointer(),shader_blob->GetBufferSize(),nullptr,&Shader),LogCategory::Error);
+	LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateShader(ShaderStage::Domain,shader_blob->GetBufferPointer(),shader_blob->GetBufferSize(),(void**)&Shader),LogCategory::Error);
 
 	return StatusCode::Ok;
 }
\ No newline at end of file
@@ -24,7 +24,7 @@ StatusCode FrameDX::Texture::CreateSRV(void* DescPtr,int InVersion)
 		else
 			FillSRVDescription(&srv_desc);
 
-		LogCheckWithReturn(OwnerDevice->GetDevice()->CreateShaderResourceView(TextureResource,&srv_desc,&SRV),LogCategory::Error);
+		LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateShaderResourceView(TextureResource,&srv_desc,&SRV),LogCategory::Error);
 	}
 	else if(TargetVersion == 1)
 	{
@@ -58,7 +58,7 @@ StatusCode FrameDX::Texture::CreateUAV(void* DescPtr,int InVersion)
 		else
 			FillUAVDescription(&uav_desc);
 
-		LogCheckWithReturn(OwnerDevice->GetDevice()->CreateUnorderedAccessView(TextureResource,&uav_desc,&UAV),LogCategory::Error);
+		LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateUnorderedAccessView(TextureResource,&uav_desc,&UAV),LogCategory::Error);
 	}
 	else if(TargetVersion == 1)
 	{
@@ -91,7 +91,7 @@ StatusCode FrameDX::Texture::CreateRTV(void* DescPtr,int InVersion)
 		else
 			FillRTVDescription(&rtv_desc);
 
-		LogCheckWithReturn(OwnerDevice->GetDevice()->CreateRenderTargetView(TextureResource,&rtv_desc,&RTV),LogCategory::Error);
+		LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateRenderTargetView(TextureResource,&rtv_desc,&RTV),LogCategory::Error);
 	}
 	else if(TargetVersion == 1)
 	{
@@ -124,7 +124,7 @@ StatusCode FrameDX::Texture::CreateDSV(void* DescPtr,int InVersion)
 		else
 			FillDSVDescription(&dsv_desc);
 
-		LogCheckWithReturn(OwnerDevice->GetDevice()->CreateDepthStencilView(TextureResource,&dsv_desc,&DSV),LogCategory::Error);
+		LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateDepthStencilView(TextureResource,&dsv_desc,&DSV),LogCategory::Error);
 	}
 	else
 		return StatusCode::InvalidArgument;
@@ -175,6 +175,9 @@ StatusCode FrameDX::Texture2D::CreateFromBackbuffer(Device * device)
 
 StatusCode FrameDX::Texture2D::CreateFromFile(Device * device, const std::wstring FilePath)
 {
+	// The loader needs a D3D11 device
+	LogAssertWithReturn(!device->IsHeadless(),LogCategory::Error,StatusCode::NotImplemented);
+
 	return (StatusCode)DirectX::CreateWICTextureFromFile(device->GetDevice(), FilePath.c_str(), &TextureResource, &SRV);
 }
 
@@ -183,9 +186,17 @@ StatusCode FrameDX::Texture2D::CreateFromDescription(Device * device, const Text
 	OwnerDevice = device;
 	Desc = params;
 
+	CpuData.clear();
+	CpuTexelSize = 0;
+
+	// The CPU copy starts zeroed if there's no data
+	if(Desc.KeepCpuData && Data.empty())
+		Data.resize((size_t)Desc.SizeX * Desc.SizeY * (DirectX::LoaderHelpers::BitsPerPixel(Desc.Format) / 8));
+
 	// Only transfer data
 	D3D11_SUBRESOURCE_DATA sdata;
 	sdata.pSysMem = nullptr;
+	uint32_t bpp = 0;
 	if(Data.size() > 0)
 	{
 		// Check that the size is valid
@@ -196,7 +207,7 @@ StatusCode FrameDX::Texture2D::CreateFromDescription(Device * device, const Text
 		if(LogAssertAndContinue(bits % 8 == 0,LogCategory::Error))
 			return StatusCode::NotImplemented;
 
-		auto bpp = bits / 8;
+		bpp = bits / 8;
 		// Only use the simple memory layout for now
 		if(LogAssertAndContinue(Desc.MemoryLayout != D3D11_TEXTURE_LAYOUT_64K_STANDARD_SWIZZLE,LogCategory::Error))
 			return StatusCode::NotImplemented;
@@ -248,7 +259,14 @@ StatusCode FrameDX::Texture2D::CreateFromDescription(Device * device, const Text
 		desc.MiscFlags = Desc.MiscFlags;
 		desc.Usage = Desc.Usage;
 
-		LogCheckWithReturn(OwnerDevice->GetDevice()->CreateTexture2D(&desc,sdata.pSysMem ? &sdata : nullptr,(ID3D11Texture2D**)&TextureResource),LogCategory::Error);
+		LogCheckWithReturn(OwnerDevice->GetDeviceBackend()->CreateTexture2D(&desc,sdata.pSysMem ? &sdata : nullptr,(ID3D11Texture2D**)&TextureResource),LogCategory::Error);
+	}
+
+	// Moving the vector keeps its storage, which is what was uploaded
+	if(Desc.KeepCpuData)
+	{
+		CpuData = move(Data);
+		CpuTexelSize = bpp;
 	}
 	
 	// Set debug name
@@ -273,7 +291,7 @@ StatusCode FrameDX::Texture::CopyFrom(Texture* Source)
 	SetLastError(S_OK);
 
 	// This returns void, using GetLastError to know if it worked or not
-	OwnerDevice->GetImmediateContext()->CopyResource(TextureResource,Source->TextureResource);
+	OwnerDevice->CopyResource(TextureResource,Source->TextureResource);
 
 	return LAST_ERROR;
 }
@@ -1,6 +1,9 @@
 #pragma once
 #include "stdafx.h"
 #include "../Core/Core.h"
+#include "../Core/Log.h"
+#include "../Core/PipelineState.h"
+#include "../Shader/CpuCompute.h"
 
 namespace FrameDX
 {
@@ -51,7 +54,7 @@ namespace FrameDX
 			wstring DebugName;
 		};
 		
-		// Makes a full copy from a source texture
+		// Makes a full copy from a source texture, on the immediate context of the owner device
 		StatusCode CopyFrom(Texture* Source);
 
 		// Returns the best version for a specified view type
@@ -83,6 +86,12 @@ namespace FrameDX
 		ID3D11UnorderedAccessView* UAV;
 		ID3D11DepthStencilView* DSV;
 
+		// The views paired with the texture resource, so storing them on a pipeline state doesn't have to resolve it
+		View<ID3D11RenderTargetView> GetRTVView() { return View<ID3D11RenderTargetView>(RTV, TextureResource); }
+		View<ID3D11ShaderResourceView> GetSRVView() { return View<ID3D11ShaderResourceView>(SRV, TextureResource); }
+		View<ID3D11UnorderedAccessView> GetUAVView() { return View<ID3D11UnorderedAccessView>(UAV, TextureResource); }
+		View<ID3D11DepthStencilView> GetDSVView() { return View<ID3D11DepthStencilView>(DSV, TextureResource); }
+
 		virtual void FillSRVDescription(D3D11_SHADER_RESOURCE_VIEW_DESC* DescPtr) = 0;
 		virtual void FillUAVDescription(D3D11_UNORDERED_ACCESS_VIEW_DESC* DescPtr) = 0;
 		virtual void FillRTVDescription(D3D11_RENDER_TARGET_VIEW_DESC* DescPtr) = 0;
@@ -111,10 +120,13 @@ namespace FrameDX
 			{
 				SizeX = 0;
 				SizeY = 0;
+				KeepCpuData = false;
 			}
 
 			uint32_t SizeX;
 			uint32_t SizeY;
+			// Keeps the data passed on creation (zeroed if there was none), so it can be bound to a CpuDispatch with GetCpuView
+			bool KeepCpuData;
 		} Desc;
 
 		// Creates a texture, optionally filling it with the provided vector
@@ -135,6 +147,17 @@ namespace FrameDX
 		// It only creates an SRV
 		StatusCode CreateFromFile(Device * device, const std::wstring FilePath);
 
+		// View of the CPU copy of the data to bind it to a CpuDispatch. Writes to it are not uploaded to the GPU texture
+		// Needs KeepCpuData, and T must be the size of a texel (i.e. uint32_t for R8G8B8A8_UNORM)
+		template<typename T>
+		CpuTexture2DView<T> GetCpuView()
+		{
+			if(LogAssertAndContinue(CpuTexelSize == sizeof(T),LogCategory::Error))
+				return {};
+			return CpuTexture2DView<T>((T*)CpuData.data(), Desc.SizeX, Desc.SizeY);
+		}
+		const vector<uint8_t>& GetRawData() const { return CpuData; }
+
 		virtual void FillSRVDescription(D3D11_SHADER_RESOURCE_VIEW_DESC* DescPtr) final override
 		{
 			DescPtr->Format = Desc.Format;
@@ -192,6 +215,9 @@ namespace FrameDX
 			else
 				DescPtr->ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
 		}
+	private:
+		vector<uint8_t> CpuData;
+		uint32_t CpuTexelSize = 0;
 	};
 }
 
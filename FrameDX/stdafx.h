@@ -17,6 +17,7 @@
 #include <d3d11_4.h>
 #include <dxgi1_2.h>
 #include <cinttypes>
+#include <cmath>
 #include <string>
 #include <functional>
 #include <ppl.h>
@@ -25,10 +26,19 @@
 #include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <locale>
 #include <codecvt>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 #include <vector>
+#include <array>
+#include <bitset>
+#include <deque>
+#include <algorithm>
 #include <wrl.h> // For the internal DirectXTK stuff
 #include <wincodec.h> // For the internal DirectXTK stuff
 #include "WICTextureLoader.h"
@@ -1,56 +1,105 @@
-Texture2D<unorm float4> InTex : register(t0);
+// Runs as an IncrementalComputePass, so each frame only does the iterations from IterationBegin to IterationEnd
+// and continues from the z saved on State
+cbuffer PassConstants : register(b0)
+{
+    uint IterationBegin;
+    uint IterationEnd;
+    uint MaxIterations;
+    uint TilesX;
+    uint SizeX;
+    uint SizeY;
+};
+
+cbuffer Params : register(b1)
+{
+    // c = DTid.xy * Scale + Offset
+    float2 Scale;
+    float2 Offset;
+};
+
 RWTexture2D<unorm float4> OutTex : register(u0);
+// xy is z, and z the iteration where it escaped, or -1
+RWStructuredBuffer<float4> State : register(u1);
+RWStructuredBuffer<uint4> Tiles : register(u2);
 
-[numthreads(16, 16, 1)]
-void main( uint3 DTid : SV_DispatchThreadID )
+void WriteColor(uint2 Pixel, float iters)
 {
-    float2 c = DTid.xy / float2(1024, 1024);
-    c = 2.0f*(c * 2 - 1);
+    static float NC = 32.0f;
 
-    //c *= 0.005;
-   // c += float2(-0.6, -0.44 ); // panning    
+    float ia = fmod(iters, NC) / NC;
 
-    float iters = -1;
-    static const float N = 10000;
-    float2 z = 0;
-    for (float i = 0; i < N; i++)
-    {
-        // iterate
-        z = float2(z.x * z.x - z.y * z.y, 2 * z.x * z.y) + c;
+    OutTex[Pixel] = float4(saturate(abs(ia * 6 - 3) - 1),saturate(2 - abs(ia * 6 - 2)), saturate(2 - abs(ia * 6 - 4)), 1);
 
-        if (dot(z, z) > 4)
-        {
-            iters = i;
-            break;
-        }
-           
-    }
-    
-    if(iters == -1)
-        OutTex[DTid.xy] = float4(0, 0, 0, 1);
-    else
-    {
-        static float NC = 32.0f;
+    /*
+    // Smooth coloring
 
-        float ia = fmod(iters, NC) / NC;
+    float ia = fmod(floor(iters / NC), NC) / NC;
+    float ib = fmod(floor(iters / NC) + 1, NC) / NC;
 
-        OutTex[DTid.xy] = float4(saturate(abs(ia * 6 - 3) - 1),saturate(2 - abs(ia * 6 - 2)), saturate(2 - abs(ia * 6 - 4)), 1);
+    float3 a = { saturate(abs(ia * 6 - 3) - 1),
+                 saturate(2 - abs(ia * 6 - 2)),
+                 saturate(2 - abs(ia * 6 - 4))
+               };
+    float3 b = { saturate(abs(ib * 6 - 3) - 1),
+                 saturate(2 - abs(ib * 6 - 2)),
+                 saturate(2 - abs(ib * 6 - 4))
+               };
 
-        /*
-        // Smooth coloring
+    OutTex[Pixel] = float4(lerp(fmod(iters, NC)/NC, a, b), 1);*/
+}
 
-        float ia = fmod(floor(iters / NC), NC) / NC;
-        float ib = fmod(floor(iters / NC) + 1, NC) / NC;
+groupshared uint running_threads;
 
-        float3 a = { saturate(abs(ia * 6 - 3) - 1),
-                     saturate(2 - abs(ia * 6 - 2)),
-                     saturate(2 - abs(ia * 6 - 4))
-                   };
-        float3 b = { saturate(abs(ib * 6 - 3) - 1),
-                     saturate(2 - abs(ib * 6 - 2)),
-                     saturate(2 - abs(ib * 6 - 4))
-                   };
+[numthreads(16, 16, 1)]
+void main( uint3 DTid : SV_DispatchThreadID, uint3 Gid : SV_GroupID, uint GI : SV_GroupIndex )
+{
+    uint tile = Gid.y * TilesX + Gid.x;
+    // The tiles where every pixel escaped on a previous frame have nothing left to do
+    // The barriers stay outside the branch, as the whole group takes it anyway
+    bool tile_done = IterationBegin > 0 && Tiles[tile].x;
+    if (GI == 0)
+        running_threads = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    if (!tile_done && DTid.x < SizeX && DTid.y < SizeY)
+    {
+        uint index = DTid.y * SizeX + DTid.x;
+        float4 state = IterationBegin == 0 ? float4(0, 0, -1, 0) : State[index];
+
+        if (state.z == -1)
+        {
+            float2 c = DTid.xy * Scale + Offset;
 
-        OutTex[DTid.xy] = float4(lerp(fmod(iters, NC)/NC, a, b), 1);*/
+            float iters = -1;
+            float2 z = state.xy;
+            for (float i = IterationBegin; i < IterationEnd; i++)
+            {
+                // iterate
+                z = float2(z.x * z.x - z.y * z.y, 2 * z.x * z.y) + c;
+
+                if (dot(z, z) > 4)
+                {
+                    iters = i;
+                    break;
+                }
+            }
+            State[index] = float4(z, iters, 0);
+
+            if (iters == -1 && IterationEnd < MaxIterations)
+                InterlockedAdd(running_threads, 1);
+
+            // The pixels that didn't escape yet show as if they never will
+            if (iters == -1)
+            {
+                if (IterationBegin == 0)
+                    OutTex[DTid.xy] = float4(0, 0, 0, 1);
+            }
+            else
+                WriteColor(DTid.xy, iters);
+        }
     }
+
+    GroupMemoryBarrierWithGroupSync();
+    if (GI == 0 && !tile_done)
+        Tiles[tile] = uint4(running_threads == 0, 0, 0, 0);
 }
\ No newline at end of file
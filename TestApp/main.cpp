@@ -5,35 +5,201 @@
 #include <corecrt_io.h>
 #include <thread>
 #include <chrono>
+#include <iomanip>
 #include <conio.h>
 #include "Shader/Shaders.h"
 #include "Core/Utils.h"
+#include "Core/Buffer.h"
 #include "Mesh/Mesh.h"
+#include "Core/TimerWheel.h"
+#include "Core/JobSystem.h"
+#include "Device/RenderQueue.h"
+#include "Shader/CpuCompute.h"
+#include "Shader/IncrementalCompute.h"
 
 using namespace std;
 
-int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
+// CPU port of TestCS.hlsl, used as the reference kernel of the CPU dispatch. Runs all the iterations at once
+struct MandelbrotKernel
+{
+	static constexpr uint32_t GroupSizeX = 16;
+	static constexpr uint32_t GroupSizeY = 16;
+	static constexpr uint32_t GroupSizeZ = 1;
+
+	FrameDX::CpuTexture2DView<uint32_t> OutTex;
+
+	void operator()(const FrameDX::CpuThreadIds& Ids) const
+	{
+		using namespace FrameDX;
+
+		CpuFloat2 c = { ToFloat(Ids.DispatchThreadID.x), ToFloat(Ids.DispatchThreadID.y) };
+		c = c / 1024.0f;
+		c = 2.0f*(c * 2.0f - 1.0f);
+
+		CpuFloat iters = -1.0f;
+		const float N = 10000;
+		CpuFloat2 z = { 0.0f, 0.0f };
+		// The lanes leave the loop on their own, and it stops when all of them did
+		CpuMask running = Ids.Active;
+		for(float i = 0; i < N && Any(running); i++)
+		{
+			z = CpuFloat2{ z.x * z.x - z.y * z.y, 2.0f * z.x * z.y } + c;
+
+			CpuMask escaped = running & (Dot(z, z) > 4.0f);
+			iters = Select(escaped, i, iters);
+			running = running & ~escaped;
+		}
+
+		const float NC = 32.0f;
+		CpuFloat ia = Fmod(iters, NC) / NC;
+		CpuFloat4 color = { Saturate(Abs(ia * 6.0f - 3.0f) - 1.0f), Saturate(2.0f - Abs(ia * 6.0f - 2.0f)), Saturate(2.0f - Abs(ia * 6.0f - 4.0f)), 1.0f };
+
+		CpuMask inside = iters == -1.0f;
+		color.x = Select(inside, 0.0f, color.x);
+		color.y = Select(inside, 0.0f, color.y);
+		color.z = Select(inside, 0.0f, color.z);
+
+		OutTex.Store(Ids.DispatchThreadID.x, Ids.DispatchThreadID.y, PackUNorm4(color), Ids.Active);
+	}
+};
+
+// Measures the period error of the old sleep_for loop and of TimedLoop, on the periods of the table on Utils.h
+// Runs with -timerbench on the command line, and prints the table instead of starting the device
+// Returns false if TimedLoop is off by 0.5% or more at 10 ms
+bool run_timer_benchmark()
+{
+	// Each period runs for about 5 seconds, with at least 20 iterations
+	auto run = [](chrono::milliseconds Period, auto&& Loop)
+	{
+		const int iterations = max(20, int(5000 / Period.count()));
+		vector<chrono::steady_clock::time_point> wakes;
+		wakes.reserve(iterations + 1);
+
+		bool running = true;
+		Loop([&]()
+		{
+			wakes.push_back(chrono::steady_clock::now());
+			if(wakes.size() > (size_t)iterations)
+				running = false;
+		}, Period, &running);
+
+		chrono::duration<double> mean = (wakes.back() - wakes.front()) / double(wakes.size() - 1);
+		return abs(mean.count() - chrono::duration<double>(Period).count()) / chrono::duration<double>(Period).count() * 100.0;
+	};
+
+	// The loop TimedLoop used before FramePacer, with the overhead of sleep_for measured once
+	auto old_loop = [](auto&& f, chrono::milliseconds d, bool* BreakCondition)
+	{
+		auto t0 = chrono::high_resolution_clock::now();
+		this_thread::sleep_for(1ns);
+		auto t1 = chrono::high_resolution_clock::now();
+		auto overhead = t1 - t0;
+
+		while(*BreakCondition)
+		{
+			t0 = chrono::high_resolution_clock::now();
+			f();
+			t1 = chrono::high_resolution_clock::now();
+
+			auto r = d - (t1 - t0) - overhead;
+			if(r > overhead)
+				this_thread::sleep_for(r);
+		}
+	};
+	auto paced_loop = [](auto&& f, chrono::milliseconds d, bool* BreakCondition) { FrameDX::TimedLoop(f, d, BreakCondition); };
+
+	// The old loop raised the timer resolution the same way the pacer does, as the test app linked winmm
+	timeBeginPeriod(1);
+	wcout << L"Period | sleep_for error (%) | TimedLoop error (%)" << endl;
+	wcout << L"-------------------------------------------------" << endl;
+	double error_10ms = 0.0;
+	for(int period : { 10, 25, 50, 100, 200, 500 })
+	{
+		double old_error = run(chrono::milliseconds(period), old_loop);
+		double paced_error = run(chrono::milliseconds(period), paced_loop);
+		if(period == 10)
+			error_10ms = paced_error;
+		wcout << setw(3) << period << L" ms | " << setw(19) << old_error << L" | " << setw(19) << paced_error << endl;
+	}
+	timeEndPeriod(1);
+
+	bool passed = error_10ms < 0.5;
+	wcout << (passed ? L"PASS" : L"FAIL") << L": TimedLoop error at 10 ms is " << error_10ms << L"%, the limit is 0.5%" << endl;
+	return passed;
+}
+
+int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR CommandLine, int)
 {
     AllocConsole();
 	freopen("CONIN$", "r", stdin);
 	freopen("CONOUT$", "w", stdout);
 	freopen("CONOUT$", "w", stderr);
 
+	if(CommandLine && strstr(CommandLine, "-timerbench"))
+	{
+		bool passed = run_timer_benchmark();
+		wcout << L"Press any key to exit" << endl;
+		_getch();
+		return passed ? 0 : 1;
+	}
+
 	thread log_printer([]()
 	{
-		size_t index = 0;
-		auto period = 250ms;
-		FrameDX::TimedLoop([&]()
+		// Sleeps until something is logged, then waits up to 1 ms to print in batches
+		FrameDX::log_::Cursor cursor;
+		while(true)
 		{
-			index += FrameDX::Log.PrintRange(wcout,index);
-		}, period);
+			FrameDX::Log.WaitForRecords(cursor, 256, 1ms);
+			FrameDX::Log.Print(wcout,cursor);
+		}
 	});
 	log_printer.detach();
 
-	FrameDX::Device::KeyboardCallback = [](WPARAM key, FrameDX::KeyAction action)
+	// Same mapping as the original shader, c = 2*(DTid.xy/1024*2 - 1)
+	struct MandelbrotParams
+	{
+		float Scale[2] = { 4.0f / 1024.0f, 4.0f / 1024.0f };
+		float Offset[2] = { -2.0f, -2.0f };
+	} mandelbrot_params;
+	// Filled once the device is created, the zoom uses its size
+	auto pass_desc = FrameDX::IncrementalComputePass::Description();
+
+	FrameDX::Device::KeyboardCallback = [&mandelbrot_params, &pass_desc](WPARAM key, FrameDX::KeyAction action)
 	{
 		if(key == 'W' && action == FrameDX::KeyAction::Up)
 			LogAssert(false,FrameDX::LogCategory::Error);
+
+		// Zooms the compute shader in and out around the center of the window, which restarts it
+		if((key == 'Z' || key == 'X') && action == FrameDX::KeyAction::Up)
+		{
+			float zoom = key == 'Z' ? 0.5f : 2.0f;
+			float half_x = pass_desc.SizeX / 2.0f;
+			float half_y = pass_desc.SizeY / 2.0f;
+			float center_x = mandelbrot_params.Offset[0] + mandelbrot_params.Scale[0] * half_x;
+			float center_y = mandelbrot_params.Offset[1] + mandelbrot_params.Scale[1] * half_y;
+			mandelbrot_params.Scale[0] *= zoom;
+			mandelbrot_params.Scale[1] *= zoom;
+			mandelbrot_params.Offset[0] = center_x - mandelbrot_params.Scale[0] * half_x;
+			mandelbrot_params.Offset[1] = center_y - mandelbrot_params.Scale[1] * half_y;
+		}
+
+		// Runs the compute shader on the CPU at 1080p and reports the throughput. Blocks the window until it's done
+		if(key == 'C' && action == FrameDX::KeyAction::Up)
+		{
+			const uint32_t size_x = 1920;
+			const uint32_t size_y = 1080;
+			vector<uint32_t> pixels(size_x*size_y);
+
+			MandelbrotKernel kernel;
+			kernel.OutTex = FrameDX::CpuTexture2DView<uint32_t>(pixels.data(), size_x, size_y);
+
+			auto start = chrono::high_resolution_clock::now();
+			FrameDX::CpuDispatchThreads(kernel, size_x, size_y, 1);
+			chrono::duration<double> seconds = chrono::high_resolution_clock::now() - start;
+
+			LogMsg(L"CPU compute " + to_wstring(seconds.count() * 1000.0) + L" ms, " + to_wstring(size_x*size_y / seconds.count() / 1e6) +
+				   L" Mpixels/s on " + to_wstring(FrameDX::GetJobSystem().GetWorkerCount()) + L" workers, " + to_wstring(FrameDX::CpuLaneCount) + L" lanes", FrameDX::LogCategory::Info);
+		}
 	};
 
 	FrameDX::Device dev;
@@ -46,6 +212,24 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 		LogCheck(dev.Start(desc), FrameDX::LogCategory::CriticalError);
 	}
 
+	// Reports the tail of the frame times every 5 seconds, the state changes the render queue saved on the last frame,
+	// and the calls sent to the context on the last frame
+	FrameDX::TimerWheel timers;
+	atomic<size_t> saved_state_changes = 0;
+	timers.Schedule([&dev, &saved_state_changes]()
+	{
+		auto frames = dev.GetFrameStats().GetFrameSummary();
+		LogMsg(L"Frame time p50 " + to_wstring(frames.P50.count()) + L" ms, p99 " + to_wstring(frames.P99.count()) +
+			   L" ms, max " + to_wstring(frames.Max.count()) + L" ms, " + to_wstring(frames.Hitches) + L" hitches, " +
+			   to_wstring(saved_state_changes.load()) + L" state changes saved", FrameDX::LogCategory::Info);
+
+		auto submission = dev.GetSubmissionStats();
+		LogMsg(L"Context calls " + to_wstring(submission.GetContextCalls()) + L", " + to_wstring(submission.GetSkipped()) + L" binds skipped, " +
+			   to_wstring(submission.GetHazardUnbinds()) + L" hazard unbinds, " + to_wstring(submission.Draws) + L" draws, " +
+			   to_wstring(submission.Dispatches) + L" dispatches, " + to_wstring(submission.Maps) + L" maps, " +
+			   to_wstring(submission.SkippedMaps) + L" unchanged buffers skipped", FrameDX::LogCategory::Info);
+	}, 5s, 5s);
+
 	FrameDX::Texture2D tmp;
 	{
 		auto tex_desc = FrameDX::Texture2D::Description();
@@ -55,9 +239,9 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 		tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
 
 		vector<uint8_t> img_data(tex_desc.SizeX*tex_desc.SizeY * 4);
-		for (int y = 0; y < tex_desc.SizeY; y++)
+		FrameDX::GetJobSystem().ParallelFor(0, tex_desc.SizeY, [&](size_t y)
 		{
-			static int i = 0;
+			size_t i = y * tex_desc.SizeX * 4;
 			for (int x = 0; x < tex_desc.SizeX; x++)
 			{
 				img_data[i++] = (x / float(tex_desc.SizeX)) * 255;
@@ -65,13 +249,24 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 				img_data[i++] = 0;
 				img_data[i++] = 255;
 			}
-		}
+		});
 		tmp.CreateFromDescription(&dev, tex_desc, img_data);
 	}
 	
 	FrameDX::ComputeShader test_cs;
 	test_cs.CreateFromFile(&dev,L"TestCS.hlsl","main");
 
+	// Only recomputes when the parameters change, over a few frames of 256 iterations
+	FrameDX::IncrementalComputePass mandelbrot_pass;
+	{
+		pass_desc.SizeX = dev.GetBackbuffer()->Desc.SizeX;
+		pass_desc.SizeY = dev.GetBackbuffer()->Desc.SizeY;
+		pass_desc.Format = dev.GetBackbuffer()->Desc.Format;
+		pass_desc.MaxIterations = 10000;
+		pass_desc.IterationBudget = 256;
+		LogCheck(mandelbrot_pass.Create(&dev, &test_cs, pass_desc), FrameDX::LogCategory::CriticalError);
+	}
+
 	D3D11_VIEWPORT viewport = {};
 	viewport.Height = 1080;
 	viewport.Width = 1920;
@@ -84,12 +279,16 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 	test_ps.CreateFromFile(&dev,L"TestPS.hlsl","main");
 
 	ID3D11RasterizerState* raster_state;
+	ID3D11RasterizerState* wireframe_raster_state;
 	{
 		D3D11_RASTERIZER_DESC rs_desc = {};
 		rs_desc.FillMode = D3D11_FILL_SOLID;
 		rs_desc.CullMode = D3D11_CULL_NONE;
 
-		dev.GetDevice()->CreateRasterizerState(&rs_desc, &raster_state);
+		LogCheck(dev.GetStateCache().GetRasterizerState(rs_desc, &raster_state), FrameDX::LogCategory::Error);
+
+		rs_desc.FillMode = D3D11_FILL_WIREFRAME;
+		LogCheck(dev.GetStateCache().GetRasterizerState(rs_desc, &wireframe_raster_state), FrameDX::LogCategory::Error);
 	}
 	
 	ID3D11DepthStencilState* depth_state;
@@ -99,7 +298,7 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 		ds_desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
 		ds_desc.DepthFunc = D3D11_COMPARISON_LESS;
 
-		dev.GetDevice()->CreateDepthStencilState(&ds_desc, &depth_state);
+		LogCheck(dev.GetStateCache().GetDepthStencilState(ds_desc, &depth_state), FrameDX::LogCategory::Error);
 	}
 
 	FrameDX::Mesh<FrameDX::StandardVertex> dbg_obj;
@@ -124,52 +323,29 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 		uint32_t padding_;
 	};
 
-	ID3D11Buffer* cb_buffer_mesh;
-	ID3D11Buffer* cb_buffer_global;
-	{
-		// Ensure 16 byte alignement 
-		static_assert(sizeof(MeshCB) % 16 == 0);
-		static_assert(sizeof(GlobalCB) % 16 == 0);
-
-		D3D11_BUFFER_DESC cb_desc;
-		
-		cb_desc.ByteWidth = sizeof(MeshCB);
-		cb_desc.Usage = D3D11_USAGE_DYNAMIC;
-		cb_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		cb_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-		cb_desc.MiscFlags = 0;
-		cb_desc.StructureByteStride = 0;
-
-		LogCheck(dev.GetDevice()->CreateBuffer(&cb_desc, nullptr, &cb_buffer_mesh), FrameDX::LogCategory::CriticalError);
-
-		cb_desc.ByteWidth = sizeof(GlobalCB);
-		cb_desc.Usage = D3D11_USAGE_DYNAMIC;
-		cb_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		cb_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-		cb_desc.MiscFlags = 0;
-		cb_desc.StructureByteStride = 0;
-
-		LogCheck(dev.GetDevice()->CreateBuffer(&cb_desc, nullptr, &cb_buffer_global), FrameDX::LogCategory::CriticalError);
-	}
+	// The per-mesh constants are passed with each draw to the render queue, which puts them on the upload ring
+	// The global ones are only uploaded when the camera moves
+	static_assert(sizeof(MeshCB) % 16 == 0);
+	FrameDX::ConstantBuffer<GlobalCB> global_cb;
+	LogCheck(global_cb.Build(dev), FrameDX::LogCategory::CriticalError);
 
 	// Create pipeline states
 	FrameDX::PipelineState mesh_state;
 	mesh_state.Output.Viewports = { viewport };
-	mesh_state.Output.RTVs = { dev.GetBackbuffer()->RTV };
-	mesh_state.Output.DSV = dev.GetZBuffer()->DSV;
+	mesh_state.Output.RTVs = { dev.GetBackbuffer()->GetRTVView() };
+	mesh_state.Output.DSV = dev.GetZBuffer()->GetDSVView();
 	mesh_state.Mesh = dbg_obj.GetContext();
 	mesh_state.Output.DepthStencilState = depth_state;
 	mesh_state.Output.RasterState = raster_state;
-	mesh_state.Shaders[(size_t)FrameDX::ShaderStage::Vertex].ConstantBuffersTable = { cb_buffer_mesh, cb_buffer_global};
+	mesh_state.Shaders[(size_t)FrameDX::ShaderStage::Vertex].ConstantBuffersTable = { nullptr, global_cb.Buffer };
 	mesh_state.Shaders[(size_t)FrameDX::ShaderStage::Vertex].ShaderPtr = &test_vs;
 	mesh_state.Shaders[(size_t)FrameDX::ShaderStage::Pixel].ShaderPtr = &test_ps;
-	mesh_state.Shaders[(size_t)FrameDX::ShaderStage::Pixel].ConstantBuffersTable = { cb_buffer_mesh, cb_buffer_global };
+	mesh_state.Shaders[(size_t)FrameDX::ShaderStage::Pixel].ConstantBuffersTable = { nullptr, global_cb.Buffer };
 	mesh_state.BuildInputLayout(&dev);
-
-	FrameDX::PipelineState cs_state;
-	cs_state.Shaders[(size_t)FrameDX::ShaderStage::Compute].ShaderPtr = &test_cs;
-	cs_state.Shaders[(size_t)FrameDX::ShaderStage::Compute].ResourcesTable = { tmp.SRV };
-	cs_state.Output.ComputeShaderUAVs = { dev.GetBackbuffer()->UAV };
+	FrameDX::BakedPipelineState mesh_baked(mesh_state);
+	mesh_state.Output.RasterState = wireframe_raster_state;
+	FrameDX::BakedPipelineState wireframe_mesh_baked(mesh_state);
+	FrameDX::RenderQueue render_queue;
 
 	// Update global cbuffer
 	DirectX::XMMATRIX view_mat, proj_mat;
@@ -177,7 +353,7 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 	FrameDX::Device::MouseCallback = [&](WPARAM wParam,int MouseX,int MouseY)
 	{
 		using namespace FrameDX;
-		GlobalCB cb_data;
+		GlobalCB cb_data = {};
 
 		static float angle_v = 0;
 		static float angle_h = 0;
@@ -210,7 +386,7 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 		DirectX::XMStoreFloat4x4(&cb_data.View,view_mat);
 		DirectX::XMStoreFloat4x4(&cb_data.Proj,proj_mat);
 
-		dev.UpdateBuffer(cb_buffer_global, cb_data);
+		global_cb.Set(cb_data);
 	};
 	// Ensure it's called at least once. Kinda hacky though...
 	FrameDX::Device::MouseCallback(0, 0, 0);
@@ -218,32 +394,51 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR, int)
 	// Main loop starts here
 	dev.EnterMainLoop([&](double GlobalTimeNanoseconds)
 	{
-		float clear_color[4] = { 0,0,0,1 };
-		dev.GetImmediateContext()->ClearRenderTargetView(dev.GetBackbuffer()->RTV, clear_color);
-
-		// Run compute shader
-		dev.BindPipelineState(cs_state);
-		dev.GetImmediateContext()->Dispatch(ceilf(dev.GetBackbuffer()->Desc.SizeX / test_cs.GroupSizeX), ceilf(dev.GetBackbuffer()->Desc.SizeY / test_cs.GroupSizeY), 1);
+		// Run compute shader. Once it's complete it's not dispatched anymore, and the result is just copied
+		{
+			TimingScope(dev.GetFrameStats(), L"Compute");
+			mandelbrot_pass.SetParams(mandelbrot_params);
+			mandelbrot_pass.Run();
+			dev.GetBackbuffer()->CopyFrom(mandelbrot_pass.GetResult());
+		}
 	
-		// Render mesh on top of the compute shader result
-		//		Update per-mesh cb
+		// Render meshes on top of the compute shader result
+		dev.GetImmediateContext()->ClearDepthStencilView(dev.GetZBuffer()->DSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
+		//		A grid of copies, alternating solid and wireframe, added in that order so the queue has state changes to save
 		{
-			MeshCB cb_data;
+			const int grid_size = 4;
+			const float spacing = 1.5f;
+			const uint32_t stages = (1u << (uint32_t)FrameDX::ShaderStage::Vertex) | (1u << (uint32_t)FrameDX::ShaderStage::Pixel);
 
-			cb_data.Color = { 1,1,1 };
-			auto world_mat = DirectX::XMMatrixIdentity();
-			DirectX::XMStoreFloat4x4(&cb_data.World, world_mat);
-			DirectX::XMStoreFloat4x4(&cb_data.WVP,
-				DirectX::XMMatrixTranspose(
-				DirectX::XMMatrixMultiply(DirectX::XMMatrixMultiply(world_mat, view_mat), proj_mat)));
-
-			dev.UpdateBuffer(cb_buffer_mesh, cb_data);
+			for(int x = 0; x < grid_size; x++)
+			{
+				for(int z = 0; z < grid_size; z++)
+				{
+					MeshCB cb_data;
+
+					bool wireframe = (x + z) % 2;
+					cb_data.Color = wireframe ? DirectX::XMFLOAT3(0.5f, 1, 0.5f) : DirectX::XMFLOAT3(1, 1, 1);
+					auto world_mat = DirectX::XMMatrixTranslation((x - (grid_size - 1) * 0.5f) * spacing, 0, (z - (grid_size - 1) * 0.5f) * spacing);
+					DirectX::XMStoreFloat4x4(&cb_data.World, world_mat);
+					DirectX::XMStoreFloat4x4(&cb_data.WVP,
+						DirectX::XMMatrixTranspose(
+						DirectX::XMMatrixMultiply(DirectX::XMMatrixMultiply(world_mat, view_mat), proj_mat)));
+
+					// View space depth of the center of the copy
+					float depth = DirectX::XMVectorGetZ(DirectX::XMVector3Transform(world_mat.r[3], view_mat));
+					render_queue.Add(wireframe ? wireframe_mesh_baked : mesh_baked,
+									 FrameDX::RenderQueue::DrawArguments::Indexed(dbg_obj.Desc.IndexCount),
+									 max(depth, 0.0f), 0, stages, cb_data);
+				}
+			}
 		}
-		dev.BindPipelineState(mesh_state);
-		dev.GetImmediateContext()->ClearDepthStencilView(dev.GetZBuffer()->DSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
-		dev.GetImmediateContext()->DrawIndexed(dbg_obj.Desc.IndexCount, 0, 0);
+		render_queue.Submit(dev);
+		saved_state_changes = render_queue.GetLastStats().GetSavedStateChanges();
 
-		dev.GetSwapChain()->Present(0,0);
+		{
+			TimingScope(dev.GetFrameStats(), L"Present");
+			dev.Present(0,0);
+		}
 		return true;
 	});
 